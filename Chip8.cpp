@@ -15,7 +15,11 @@
 
 #include "Chip8.h"
 
-#define TWO_DIM_TO_ONE(x,y,RowLength) ((x) + (y) * (RowLength))
+//
+// True when Category is both compiled in and switched on for this machine.
+//
+
+#define TRACING(Cpu, Category) (TRACE_COMPILED(Category) && (Cpu).Trace != NULL && (Cpu).Trace->Enabled(Category))
 
 unsigned char chip8_fontset[80] =
 {
@@ -37,599 +41,1715 @@ unsigned char chip8_fontset[80] =
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+Chip8::Chip8()
+{
+    State.ProgramEnd = NO_PROGRAM_END;
+    State.Fault = FAULT_NONE;
+    Jit = NULL;
+    Static = NULL;
+    Profiler = NULL;
+    Trace = NULL;
+    IdleSkip = true;
+    IdleLoopLength = 0;
+    IdleCyclesSkipped = 0;
+    KeyWaitCyclesPassed = 0;
+    Quirks = QUIRKS_DEFAULT;
+    Decoder = &Chip8::DecodeFor<DefaultQuirks>;
+}
+
+Chip8::~Chip8()
+{
+    delete Jit;
+    delete Static;
+    delete Profiler;
+    delete Trace;
+}
+
+//
+// Chip8State wants cache line alignment and plain new only promises 16 bytes before C++17.
+//
+void *Chip8::operator new(size_t Size)
+{
+    void *Block = NULL;
+    
+#if defined(_WIN32)
+    Block = _aligned_malloc(Size, alignof(Chip8State));
+#else
+    if (posix_memalign(&Block, alignof(Chip8State), Size) != 0) {
+        Block = NULL;
+    }
+#endif
+    
+    if (Block == NULL) {
+        throw std::bad_alloc();
+    }
+    
+    return Block;
+}
+
+void Chip8::operator delete(void *Block)
+{
+#if defined(_WIN32)
+    _aligned_free(Block);
+#else
+    free(Block);
+#endif
+}
+
 void Chip8::Initialize()
 {
     //
     // Set starting values. All zero except for PC.
     //
     
-    ProgramCounter = PROGRAM_START_LOCATION;
+    memset(&State, 0, sizeof(State));
+    
+    State.ProgramCounter = PROGRAM_START_LOCATION;
+    State.ProgramEnd = NO_PROGRAM_END;
+    State.Fault = FAULT_NONE;
+    State.DirtyRows = ALL_ROWS_DIRTY;
+    State.DrawFlag = true;
     Opcode = 0;
-    IndexRegister = 0;
-    StackPointer = 0;
-    SoundTimer = 0;
-    DelayTimer = 0;
     
-    //Stack.push_back(ProgramCounter);
+    memset(DecodeCache, 0, sizeof(DecodeCache));
     
-    memset(VRegisters, 0, 16 * sizeof(char));
-    memset(Graphics, 0, 64 * 32 * sizeof(char));
-    memset(Key, 0, 16 * sizeof(char));
-    memset(Memory, 0, 4096 * sizeof(unsigned char));
+    if (Jit != NULL) {
+        Jit->Flush();
+    }
     
     //
     // Load fonts into memory.
     //
     
-    memcpy(Memory, chip8_fontset, 80 * sizeof(char));
-    FontsetLocation = Memory;
+    memcpy(State.Memory, chip8_fontset, 80 * sizeof(char));
+    
+    if (Static != NULL) {
+        Static->Revalidate(*this, 0, sizeof(State.Memory));
+    }
     
     //
     // Seed random number generator
     //
     
-    std::srand((unsigned int)std::time(0));
+    SeedRandom((uint32_t)std::time(0));
     
 }
 
 bool Chip8::EmulateCycle(unsigned char* KeyboardState)
 {
-    unsigned short RegisterNum;
-    unsigned short RegisterNum1;
-    unsigned short RegisterNum2;
+    bool Ran;
     
-    unsigned char RandomNumber;
+    memcpy(State.Key, KeyboardState, sizeof(State.Key));
+    
+    if (StillWaitingForKey()) {
+        PassKeyWaitCycles(1);
+        return true;
+    }
     
-    unsigned short UShortValue;
-    unsigned char UCharValue;
+    Ran = Step();
+    IdleLoopLength = 0;
     
-    bool ValidKeyPressed;
+    return Ran;
+}
+
+//
+// Run one instruction with whatever keys are in the state. False if the machine is halted,
+// or the instruction faulted and didn't run.
+//
+bool Chip8::Step()
+{
+    DecodedInstruction *Instruction;
     
-    SDL_Event Event;
+    if (Halted()) {
+        return false;
+    }
     
     //
-    // Decrement Timers
+    // Opcodes are 2 bytes long. Rather than combining the bytes and walking the opcode switch
+    // every cycle, look up the decoded form of the instruction at this address and decode it
+    // the first time we land here.
     //
     
-    if (SoundTimer > 0) {
-        --SoundTimer;
+    State.ProgramCounter &= ADDRESS_BITMASK;
+    Instruction = &DecodeCache[State.ProgramCounter];
+    
+    if (Instruction->Handler == NULL) {
+        Decode(State.ProgramCounter, Instruction);
     }
     
-    if (DelayTimer > 0) {
-        --DelayTimer;
+    Opcode = Instruction->Opcode;
+    
+#if CHIP8_PROFILER
+    if (Profiler != NULL) {
+        Profiler->CountInstruction(State.ProgramCounter, Opcode);
     }
+#endif
     
-    //
-    // Opcodes are 2 bytes long, combine the next two entries of the ProgramCounter
-    //
+    State.ProgramCounter += 2;
     
-    if (Memory + ProgramCounter == ProgramEnd) {
+    Instruction->Handler(*this, *Instruction);
+    
+    if (State.Fault != FAULT_NONE) {
         return false;
     }
     
-    DbgPrint("Program Counter: 0x%4X\n", ProgramCounter);
+    if (TRACING(*this, TRACE_INSTRUCTIONS)) {
+        TraceInstruction((unsigned short) (Instruction - DecodeCache), *Instruction);
+    }
+    
+    return true;
+}
+
+//
+// Run up to Cycles instructions and return how many actually ran. With a recompiled program
+// attached or the JIT on, compiled blocks are used wherever there is one, recompiled ones
+// first, and the interpreter picks up everything else. The profiler and the instruction trace
+// only see interpreted instructions, so either of them bypasses both.
+//
+unsigned long Chip8::Run(unsigned char *KeyboardState, unsigned long Cycles)
+{
+    unsigned long CyclesRun = 0;
+    unsigned int BlockCycles;
+    unsigned int CycleBudget;
     
-    Opcode = Memory[ProgramCounter++] << 8 | Memory[ProgramCounter++];
+    memcpy(State.Key, KeyboardState, sizeof(State.Key));
+    IdleLoopLength = 0;
     
-    DbgPrint("Opcode: 0x%4X\n", Opcode);
+    if (StillWaitingForKey()) {
+        PassKeyWaitCycles(Cycles);
+        return Cycles;
+    }
     
-    switch (Opcode & FIRST_FOUR_BITMASK) {
+    while (CyclesRun < Cycles) {
+        
+        if ((Jit != NULL || Static != NULL) && Profiler == NULL && !TRACING(*this, TRACE_INSTRUCTIONS)) {
             
-        case 0x0000:
-            switch (Opcode & LAST_EIGHT_BITMASK) {
-                case 0xE0:
-                    
-                    //
-                    // Clear the screen
-                    //
-                    DbgPrint("0x%4X: Clear the screen\n", Opcode);
-                    
-                    memset(Graphics, 0, 64 * 32 * sizeof(char));
-                    
-                    DrawFlag = true;
-                    
-                    break;
-                    
-                case 0xEE:
-                    
-                    //
-                    // Return from subroutine
-                    //
-                    DbgPrint("0x%4x: Return from subroutine\n", Opcode);
-                    
-                    assert(!Stack.empty());
-                    
-                    ProgramCounter = Stack.back();
-                    Stack.pop_back();
-                    
-                default:
-                    break;
+            if (Halted()) {
+                break;
             }
-            break;
-            
-        case 0x1000:
-            
-            //
-            // Jump to address
-            //
-            DbgPrint("0x%4X: Jump to address\n", Opcode);
-            
-            UShortValue = Opcode & LAST_TWELVE_BITMASK;
-            ProgramCounter = UShortValue;
-            
-            
-            break;
-            
-        case 0x2000:
-            
-            //
-            // Call Subroutine
-            //
-            DbgPrint("0x%4X: Call subroutine\n", Opcode);
-            
-            Stack.push_back(ProgramCounter);
-            UShortValue = Opcode & LAST_TWELVE_BITMASK;
-            ProgramCounter = UShortValue;
-            break;
-            
-        case 0x3000:
-            
-            //
-            // Skip next instruction if register equals value
-            //
-            DbgPrint("0x%4X: Skip next instruction if register equals value\n", Opcode);
             
-            RegisterNum = GetRegister(First);
+            CycleBudget = (unsigned int) std::min(Cycles - CyclesRun, (unsigned long) std::max(JIT_MAX_BLOCK_INSTRUCTIONS, STATIC_MAX_BLOCK_INSTRUCTIONS));
+            BlockCycles = 0;
             
-            if (VRegisters[RegisterNum] == (Opcode & LAST_EIGHT_BITMASK)) {
-                SkipNextInstruction();
+            if (Static != NULL) {
+                BlockCycles = Static->RunBlock(State, State.ProgramCounter, State.ProgramEnd, CycleBudget);
             }
-            break;
-            
-        case 0x4000:
-            
-            //
-            // Skip next instruction if register doesn't equal value
-            //
-            DbgPrint("0x%4X: Skip next instruction if register doesn't equal value\n", Opcode);
             
-            RegisterNum = GetRegister(First);
-            
-            if (VRegisters[RegisterNum] != (Opcode & LAST_EIGHT_BITMASK)) {
-                SkipNextInstruction();
+            if (BlockCycles == 0 && Jit != NULL) {
+                BlockCycles = Jit->RunBlock(*this, State.ProgramCounter, State.VRegisters, CycleBudget);
             }
-            break;
             
-        case 0x5000:
-            
-            //
-            // Skip next instruction if registers are equal
-            //
-            DbgPrint("0x%4X: Skip next instruction if registers are equal\n", Opcode);
-            
-            RegisterNum1 = GetRegister(First);
-            RegisterNum2 = GetRegister(Second);
-            
-            if (VRegisters[RegisterNum1] == VRegisters[RegisterNum2]) {
-                SkipNextInstruction();
+            if (BlockCycles != 0) {
+                CyclesRun += BlockCycles;
+                continue;
             }
+        }
+        
+        if (!Step()) {
             break;
-            
-        case 0x6000:
-            
-            //
-            // Set register to value
-            //
-            DbgPrint("0x%4X: Set register to value\n", Opcode);
-            
-            RegisterNum = GetRegister(First);
-            VRegisters[RegisterNum] = Opcode & LAST_EIGHT_BITMASK;
-            break;
-            
-        case 0x7000:
-            
-            //
-            // Add value to register
-            //
-            DbgPrint("0x%4X: Add value to register\n", Opcode);
-            
-            RegisterNum = GetRegister(First);
-            UCharValue = Opcode & LAST_EIGHT_BITMASK;
-            
-            VRegisters[RegisterNum] += UCharValue;
+        }
+        
+        ++CyclesRun;
+        
+        //
+        // The keys won't change before the next call, so the rest of the frame is spent
+        // waiting.
+        //
+        
+        if (State.WaitingForKey) {
+            PassKeyWaitCycles(Cycles - CyclesRun);
+            CyclesRun = Cycles;
             break;
+        }
+        
+        if (IdleLoopLength != 0) {
             
-        case 0x8000:
-            
-            //
-            // Perform register operations
-            //
-            DbgPrint("0x%4X: Perform register operation\n", Opcode);
-            
-            RegisterNum1 = GetRegister(First);
-            RegisterNum2 = GetRegister(Second);
-            
-            switch (Opcode & LAST_FOUR_BITMASK) {
-                    
-                case 0x0:
-                    VRegisters[RegisterNum1] = VRegisters[RegisterNum2];
-                    break;
-                    
-                case 0x1:
-                    VRegisters[RegisterNum1] = VRegisters[RegisterNum1] | VRegisters[RegisterNum2];
-                    break;
-                    
-                case 0x2:
-                    VRegisters[RegisterNum1] = VRegisters[RegisterNum1] & VRegisters[RegisterNum2];
-                    break;
-                    
-                case 0x3:
-                    VRegisters[RegisterNum1] = VRegisters[RegisterNum1] ^ VRegisters[RegisterNum2];
-                    break;
-                    
-                case 0x4:
-                    CheckAndSetCarry(VRegisters[RegisterNum1],
-                                     VRegisters[RegisterNum2],
-                                     Add);
-                    
-                    VRegisters[RegisterNum1] = VRegisters[RegisterNum1] + VRegisters[RegisterNum2];
-                    break;
-                    
-                case 0x5:
-                    CheckAndSetCarry(VRegisters[RegisterNum1],
-                                     VRegisters[RegisterNum2],
-                                     Subtract);
-                    
-                    VRegisters[RegisterNum1] = VRegisters[RegisterNum1] - VRegisters[RegisterNum2];
-                    break;
-                    
-                default:
-                    break;
-            }
-            
-            
+            unsigned long Skipped = (Cycles - CyclesRun) / IdleLoopLength * IdleLoopLength;
             
+            CyclesRun += Skipped;
+            IdleCyclesSkipped += Skipped;
+            IdleLoopLength = 0;
+        }
+    }
+    
+    return CyclesRun;
+}
+
+//
+// The delay and sound timers count down at 60 Hz no matter how many instructions a frame
+// runs, so the frontend calls this once per frame.
+//
+void Chip8::TickTimers()
+{
+    if (State.SoundTimer > 0) {
+        --State.SoundTimer;
+    }
+    
+    if (State.DelayTimer > 0) {
+        --State.DelayTimer;
+    }
+    
+    if (Trace != NULL) {
+        
+        if (TRACING(*this, TRACE_TIMERS)) {
+            Trace->Record(TRACE_TIMERS, State.ProgramCounter, 0, State.IndexRegister, TRACE_NO_REGISTER, State.DelayTimer, State.SoundTimer);
+        }
+        
+        Trace->NextFrame();
+    }
+}
+
+void Chip8::SeedRandom(uint32_t Seed)
+{
+    //
+    // Xorshift gets stuck at zero, so zero picks some other seed.
+    //
+    
+    State.RandomState = Seed != 0 ? Seed : 0x2545F491;
+}
+
+//
+// Xorshift32, cheap and plenty random for games.
+//
+uint32_t Chip8::NextRandom()
+{
+    State.RandomState ^= State.RandomState << 13;
+    State.RandomState ^= State.RandomState >> 17;
+    State.RandomState ^= State.RandomState << 5;
+    
+    return State.RandomState;
+}
+
+void Chip8::SetJitEnabled(bool Enabled)
+{
+    if (Enabled && Jit == NULL) {
+        Jit = new Chip8Jit();
+        
+        if (!Jit->Available()) {
+            delete Jit;
+            Jit = NULL;
+        }
+        
+    } else if (!Enabled && Jit != NULL) {
+        delete Jit;
+        Jit = NULL;
+    }
+}
+
+void Chip8::SetStaticProgram(const StaticProgram *Program)
+{
+    delete Static;
+    Static = NULL;
+    
+    if (Program != NULL) {
+        Static = new Chip8Static(*Program);
+        Static->Revalidate(*this, 0, sizeof(State.Memory));
+    }
+}
+
+void Chip8::SetQuirkProfile(Chip8QuirkProfile Profile)
+{
+    switch (Profile) {
+        
+        case QUIRKS_DEFAULT:
+            Decoder = &Chip8::DecodeFor<DefaultQuirks>;
             break;
-            
-        case 0x9000:
-            
-            //
-            // Skip next instruction if registers are not equal
-            //
-            DbgPrint("0x%4X: Skip next instruction if registers are not equal\n", Opcode);
-            
-            RegisterNum1 = GetRegister(First);
-            RegisterNum2 = GetRegister(Second);
-            
-            if (VRegisters[RegisterNum1] != VRegisters[RegisterNum2]) {
-                SkipNextInstruction();
-            }
+        
+        case QUIRKS_COSMAC_VIP:
+            Decoder = &Chip8::DecodeFor<CosmacVipQuirks>;
             break;
-            
-        case 0xA000:
-            
-            //
-            // Set index register to the given address
-            //
-            DbgPrint("0x%4X: Set index register to the given address\n", Opcode);
-            
-            IndexRegister = Opcode & LAST_TWELVE_BITMASK;
+        
+        case QUIRKS_SUPER_CHIP:
+            Decoder = &Chip8::DecodeFor<SuperChipQuirks>;
             break;
-            
-        case 0xB000:
-            
-            //
-            // Jump to address given plus value in register 0
-            //
-            DbgPrint("0x%4X: Jump to address given plus value in register 0\n", Opcode);
-            
-            UShortValue = Opcode & LAST_TWELVE_BITMASK;
-            ProgramCounter -= 2;
-            ProgramCounter = UShortValue + VRegisters[0];
+        
+        case QUIRKS_XO_CHIP:
+            Decoder = &Chip8::DecodeFor<XoChipQuirks>;
             break;
+    }
+    
+    Quirks = Profile;
+    
+    memset(DecodeCache, 0, sizeof(DecodeCache));
+    
+    if (Jit != NULL) {
+        Jit->Flush();
+    }
+    
+    if (Static != NULL) {
+        Static->Revalidate(*this, 0, sizeof(State.Memory));
+    }
+}
+
+void Chip8::SetProfilerEnabled(bool Enabled)
+{
+#if CHIP8_PROFILER
+    if (Enabled && Profiler == NULL) {
+        Profiler = new Chip8Profiler();
+        
+    } else if (!Enabled && Profiler != NULL) {
+        delete Profiler;
+        Profiler = NULL;
+    }
+#else
+    (void) Enabled;
+#endif
+}
+
+void Chip8::WriteProfileReport(FILE *Out, int HotSpots)
+{
+#if CHIP8_PROFILER
+    if (Profiler == NULL) {
+        fprintf(Out, "Profiling is off\n");
+        return;
+    }
+    
+    Profiler->Report(Out, State.Memory, HotSpots);
+#else
+    (void) HotSpots;
+    fprintf(Out, "Profiler compiled out (CHIP8_PROFILER is 0)\n");
+#endif
+}
+
+void Chip8::ResetProfile()
+{
+    if (Profiler != NULL) {
+        Profiler->Reset();
+    }
+}
+
+//
+// The trace is created the first time it's asked for and stays around after that, so it can
+// still be saved after the categories are switched back off.
+//
+void Chip8::EnableTrace(uint32_t Categories, size_t Capacity)
+{
+    if (Trace == NULL) {
+        Trace = new Chip8Trace(Capacity);
+    }
+    
+    Trace->SetCategories(Categories & CHIP8_TRACE_CATEGORIES);
+}
+
+//
+// Record the instruction that just ran at Address, with the V register it wrote if any.
+//
+void Chip8::TraceInstruction(unsigned short Address, const DecodedInstruction &Instruction)
+{
+    unsigned char Register = TRACE_NO_REGISTER;
+    
+    switch (Instruction.Opcode & FIRST_FOUR_BITMASK) {
             
+        case 0x6000:
+        case 0x7000:
+        case 0x8000:
         case 0xC000:
-            
-            //
-            // Set register to random number and given value
-            //
-            DbgPrint("0x%4X: Set register to random number and given value\n", Opcode);
-            
-            RegisterNum = GetRegister(First);
-            RandomNumber = (unsigned char) (std::rand() % 255);
-            UCharValue = Opcode & LAST_EIGHT_BITMASK;
-            
-            VRegisters[RegisterNum] = RandomNumber & UCharValue;
+            Register = Instruction.X;
             break;
             
-        case 0xD000:
-            
-            //
-            // Draw sprites stored at location in index register
-            //
-            DbgPrint("0x%4X: Draw sprites stored at location in index register\n", Opcode);
-            
-            DrawSprites();
-            
-            DrawFlag = true;
-            
+        case 0xF000:
+            if (Instruction.Kk == 0x07 || Instruction.Kk == 0x0A || Instruction.Kk == 0x65) {
+                Register = Instruction.X;
+            }
             break;
-            
-        case 0xE000:
-            
-            //
-            // Key functions
-            //
-            
-            switch (Opcode & LAST_EIGHT_BITMASK) {
-                case 0x9E:
-                    
-                    //
-                    // Skip the next instruction if the key stored in VX is pressed
-                    //
-                    DbgPrint("0x%4X: Skip the next instruction if the key stored in VX is pressed\n", Opcode);
-                    
-                    RegisterNum = GetRegister(First);
-                    UCharValue = VRegisters[RegisterNum];
-                    
-                    assert(0 <= UCharValue && UCharValue <= 16);
-                    
-                    if (KeyboardState[UCharValue] != 0) {
-                        //ProgramCounter += 2;
-                        SkipNextInstruction();
+    }
+    
+    Trace->Record(TRACE_INSTRUCTIONS,
+                  Address,
+                  Instruction.Opcode,
+                  State.IndexRegister,
+                  Register,
+                  Register != TRACE_NO_REGISTER ? State.VRegisters[Register] : 0,
+                  State.VRegisters[0xF]);
+}
+
+//
+// A backward jump closing a short loop made only of instructions that read the delay timer,
+// the keys and registers and write registers, so that a trip around it depends on nothing
+// but those. Loops that don't read the timer or the keys at all only count when they're a
+// jump to itself, anything else is just a loop that hasn't finished yet. Checked when the
+// jump is decoded, MeasureIdleLoop checks the body again before anything is skipped.
+//
+bool Chip8::IdleLoopCandidate(unsigned short JumpAddress)
+{
+    unsigned short JumpOpcode = State.Memory[JumpAddress] << 8 | State.Memory[(JumpAddress + 1) & ADDRESS_BITMASK];
+    unsigned short Target = JumpOpcode & LAST_TWELVE_BITMASK;
+    bool PollsInput = false;
+    
+    if ((JumpOpcode & FIRST_FOUR_BITMASK) != 0x1000 ||
+        Target > JumpAddress ||
+        (JumpAddress - Target) / 2 + 1 > IDLE_LOOP_MAX_INSTRUCTIONS ||
+        (JumpAddress - Target) % 2 != 0) {
+        return false;
+    }
+    
+    for (unsigned short Address = Target; Address < JumpAddress; Address += 2) {
+        
+        unsigned short BodyOpcode = State.Memory[Address] << 8 | State.Memory[Address + 1];
+        
+        switch (BodyOpcode & FIRST_FOUR_BITMASK) {
+            
+            case 0x3000:
+            case 0x4000:
+            case 0x5000:
+            case 0x6000:
+            case 0x9000:
+            case 0xA000:
+                break;
+            
+            case 0x8000:
+                if ((BodyOpcode & LAST_FOUR_BITMASK) != 0x0) {
+                    return false;
+                }
+                break;
+            
+            case 0xE000:
+                if ((BodyOpcode & LAST_EIGHT_BITMASK) != 0x9E && (BodyOpcode & LAST_EIGHT_BITMASK) != 0xA1) {
+                    return false;
+                }
+                PollsInput = true;
+                break;
+            
+            case 0xF000:
+                if ((BodyOpcode & LAST_EIGHT_BITMASK) != 0x07) {
+                    return false;
+                }
+                PollsInput = true;
+                break;
+            
+            default:
+                return false;
+        }
+    }
+    
+    return PollsInput || Target == JumpAddress;
+}
+
+//
+// Called just after the jump at JumpAddress went back to the top of its loop. Go around the
+// loop once more on copies of the registers, the way the handlers would, and if that comes
+// back to this jump with every register unchanged, every later trip will too. Returns the
+// instructions in a trip, or 0 if the loop isn't idle (or isn't a candidate any more because
+// the code changed since it was decoded).
+//
+unsigned int Chip8::MeasureIdleLoop(unsigned short JumpAddress)
+{
+    unsigned char VRegisters[16];
+    unsigned short IndexRegister = State.IndexRegister;
+    unsigned short Address = State.ProgramCounter;
+    unsigned short Target = State.ProgramCounter;
+    unsigned int Length = 0;
+    
+    memcpy(VRegisters, State.VRegisters, sizeof(VRegisters));
+    
+    while (Address >= Target && Address <= JumpAddress && Address != State.ProgramEnd) {
+        
+        unsigned short LoopOpcode = State.Memory[Address] << 8 | State.Memory[(Address + 1) & ADDRESS_BITMASK];
+        unsigned char X = (LoopOpcode & REGISTER_ONE_BITMASK) >> 8;
+        unsigned char Y = (LoopOpcode & REGISTER_TWO_BITMASK) >> 4;
+        unsigned char Kk = LoopOpcode & LAST_EIGHT_BITMASK;
+        
+        ++Length;
+        
+        if (Address == JumpAddress) {
+            
+            if (LoopOpcode != (0x1000 | Target)) {
+                return 0;
+            }
+            
+            return memcmp(VRegisters, State.VRegisters, sizeof(VRegisters)) == 0 && IndexRegister == State.IndexRegister ? Length : 0;
+        }
+        
+        Address += 2;
+        
+        switch (LoopOpcode & FIRST_FOUR_BITMASK) {
+            
+            case 0x3000:
+                if (VRegisters[X] == Kk) {
+                    Address += 2;
+                }
+                break;
+            
+            case 0x4000:
+                if (VRegisters[X] != Kk) {
+                    Address += 2;
+                }
+                break;
+            
+            case 0x5000:
+                if (VRegisters[X] == VRegisters[Y]) {
+                    Address += 2;
+                }
+                break;
+            
+            case 0x9000:
+                if (VRegisters[X] != VRegisters[Y]) {
+                    Address += 2;
+                }
+                break;
+            
+            case 0x6000:
+                VRegisters[X] = Kk;
+                break;
+            
+            case 0x8000:
+                if ((LoopOpcode & LAST_FOUR_BITMASK) != 0x0) {
+                    return 0;
+                }
+                VRegisters[X] = VRegisters[Y];
+                break;
+            
+            case 0xA000:
+                IndexRegister = LoopOpcode & LAST_TWELVE_BITMASK;
+                break;
+            
+            case 0xE000:
+                if (Kk == 0x9E) {
+                    if (State.Key[VRegisters[X] & 0xF] != 0) {
+                        Address += 2;
+                    }
+                } else if (Kk == 0xA1) {
+                    if (State.Key[VRegisters[X] & 0xF] == 0) {
+                        Address += 2;
                     }
+                } else {
+                    return 0;
+                }
+                break;
+            
+            case 0xF000:
+                if (Kk != 0x07) {
+                    return 0;
+                }
+                VRegisters[X] = State.DelayTimer;
+                break;
+            
+            default:
+                return 0;
+        }
+    }
+    
+    return 0;
+}
+
+//
+// Skipping would hide instructions from the profiler and the instruction trace.
+//
+bool Chip8::CanSkipIdle()
+{
+    return IdleSkip && Profiler == NULL && !TRACING(*this, TRACE_INSTRUCTIONS);
+}
+
+//
+// Keys only change between calls to Run or EmulateCycle, so a machine waiting on FX0A looks
+// at them once on the way in. The lowest key that went down since the last look ends the
+// wait and goes in the register. True if it's still waiting.
+//
+bool Chip8::StillWaitingForKey()
+{
+    uint16_t Keys = 0;
+    uint16_t Pressed;
+    unsigned char KeyNum = 0;
+    unsigned short Address;
+    
+    if (!State.WaitingForKey) {
+        return false;
+    }
+    
+    for (int KeyIndex = 0; KeyIndex < 16; ++KeyIndex) {
+        if (State.Key[KeyIndex] != 0) {
+            Keys |= 1 << KeyIndex;
+        }
+    }
+    
+    Pressed = Keys & ~State.KeysHeld;
+    State.KeysHeld = Keys;
+    
+    if (Pressed == 0) {
+        return true;
+    }
+    
+    while ((Pressed & 1) == 0) {
+        Pressed >>= 1;
+        ++KeyNum;
+    }
+    
+    Address = State.ProgramCounter;
+    
+    State.VRegisters[State.KeyWaitRegister] = KeyNum;
+    State.WaitingForKey = false;
+    State.ProgramCounter += 2;
+    
+    if (TRACING(*this, TRACE_INPUT)) {
+        Trace->Record(TRACE_INPUT, Address, 0xF00A | State.KeyWaitRegister << 8, State.IndexRegister, State.KeyWaitRegister, KeyNum, 0);
+    }
+    
+    return false;
+}
+
+void Chip8::PassKeyWaitCycles(unsigned long Cycles)
+{
+    KeyWaitCyclesPassed += Cycles;
+    
+#if CHIP8_PROFILER
+    if (Profiler != NULL) {
+        Profiler->CountKeyWaitCycles(Cycles);
+    }
+#endif
+}
+
+//
+// Compare the architectural state of two machines, used to check the JIT against the
+// interpreter.
+//
+bool Chip8::CompareState(const Chip8 &Other)
+{
+    return CompareStates(State, Other.State);
+}
+
+//
+// Same for two bare states, so anything else that runs machines (Chip8Lockstep) can be
+// checked against a Chip8.
+//
+bool Chip8::CompareStates(const Chip8State &First, const Chip8State &Second)
+{
+    return memcmp(First.Memory, Second.Memory, sizeof(First.Memory)) == 0 &&
+           memcmp(First.VRegisters, Second.VRegisters, sizeof(First.VRegisters)) == 0 &&
+           memcmp(First.Graphics, Second.Graphics, sizeof(First.Graphics)) == 0 &&
+           First.IndexRegister == Second.IndexRegister &&
+           First.ProgramCounter == Second.ProgramCounter &&
+           First.DelayTimer == Second.DelayTimer &&
+           First.SoundTimer == Second.SoundTimer &&
+           First.RandomState == Second.RandomState &&
+           First.StackPointer == Second.StackPointer &&
+           First.WaitingForKey == Second.WaitingForKey &&
+           (!First.WaitingForKey || (First.KeyWaitRegister == Second.KeyWaitRegister && First.KeysHeld == Second.KeysHeld)) &&
+           memcmp(First.Stack, Second.Stack, First.StackPointer * sizeof(First.Stack[0])) == 0 &&
+           First.Fault == Second.Fault &&
+           First.HiRes == Second.HiRes;
+}
+
+const char *Chip8::FaultMessage(Chip8Fault Fault)
+{
+    switch (Fault) {
+            
+        case FAULT_NONE:
+            return "no fault";
+            
+        case FAULT_STACK_OVERFLOW:
+            return "stack overflow";
+            
+        case FAULT_STACK_UNDERFLOW:
+            return "stack underflow";
+    }
+    
+    return "unknown fault";
+}
+
+//
+// Become a copy of another machine's state. The decode cache and the JIT only describe memory,
+// so they survive unless the memory is different, which forking a machine usually isn't.
+//
+void Chip8::SetState(const Chip8State &NewState)
+{
+    bool SameMemory = memcmp(State.Memory, NewState.Memory, sizeof(State.Memory)) == 0;
+    
+    memcpy(&State, &NewState, sizeof(State));
+    
+    if (!SameMemory) {
+        
+        memset(DecodeCache, 0, sizeof(DecodeCache));
+        
+        if (Jit != NULL) {
+            Jit->Flush();
+        }
+        
+        if (Static != NULL) {
+            Static->Revalidate(*this, 0, sizeof(State.Memory));
+        }
+    }
+}
+
+//
+// Turn the two bytes at Address into a handler plus the operands it needs, so the handlers
+// never have to mask anything out of the opcode themselves. Handlers that depend on a quirk
+// come out built for Profile.
+//
+template <typename Profile>
+void Chip8::DecodeFor(unsigned short Address, DecodedInstruction *Instruction)
+{
+    unsigned short InstructionOpcode;
+    OpcodeHandler Handler = &Chip8::OpNop;
+    
+    InstructionOpcode = State.Memory[Address] << 8 | State.Memory[(Address + 1) & ADDRESS_BITMASK];
+    
+    switch (InstructionOpcode & FIRST_FOUR_BITMASK) {
+            
+        case 0x0000:
+            switch (InstructionOpcode & LAST_EIGHT_BITMASK) {
+                case 0xE0:
+                    Handler = &Chip8::OpClearScreen;
+                    break;
                     
+                case 0xEE:
+                    Handler = &Chip8::OpReturn;
                     break;
                     
-                case 0xA1:
+                case 0xFB:
+                    Handler = &Chip8::OpScrollRight;
+                    break;
                     
-                    //
-                    // Skip the next instruction if the key stored in VX is NOT pressed
-                    //
-                    DbgPrint("0x%4X: Skip the next instruction if the key stored in VX is NOT pressed\n", Opcode);
+                case 0xFC:
+                    Handler = &Chip8::OpScrollLeft;
+                    break;
                     
-                    RegisterNum = GetRegister(First);
-                    UCharValue = VRegisters[RegisterNum];
+                case 0xFD:
+                    Handler = &Chip8::OpExit;
+                    break;
                     
-                    assert(0 <= UCharValue && UCharValue <= 16);
+                case 0xFE:
+                    Handler = &Chip8::OpLowRes;
+                    break;
                     
-                    if (KeyboardState[UCharValue] == 0) {
-                        //ProgramCounter += 2;
-                        SkipNextInstruction();
-                    }                    
+                case 0xFF:
+                    Handler = &Chip8::OpHighRes;
                     break;
                     
                 default:
+                    if ((InstructionOpcode & 0xFFF0) == 0x00C0) {
+                        Handler = &Chip8::OpScrollDown;
+                    }
                     break;
             }
+            break;
             
+        case 0x1000:
+            Handler = IdleLoopCandidate(Address) ? &Chip8::OpIdleJump : &Chip8::OpJump;
             break;
             
-        case 0xF000:
+        case 0x2000:
+            Handler = &Chip8::OpCall;
+            break;
             
-            RegisterNum = GetRegister(First);
+        case 0x3000:
+            Handler = &Chip8::OpSkipIfEqualValue;
+            break;
             
-            switch (Opcode & LAST_EIGHT_BITMASK) {
+        case 0x4000:
+            Handler = &Chip8::OpSkipIfNotEqualValue;
+            break;
+            
+        case 0x5000:
+            Handler = &Chip8::OpSkipIfRegistersEqual;
+            break;
+            
+        case 0x6000:
+            Handler = &Chip8::OpSetRegister;
+            break;
+            
+        case 0x7000:
+            Handler = &Chip8::OpAddToRegister;
+            break;
+            
+        case 0x8000:
+            switch (InstructionOpcode & LAST_FOUR_BITMASK) {
+                case 0x0:
+                    Handler = &Chip8::OpMove;
+                    break;
                     
-                case 0x07:
+                case 0x1:
+                    Handler = &Chip8::OpOr<Profile>;
+                    break;
                     
-                    //
-                    // Set register to delay timer value
-                    //
-                    DbgPrint("0x%4X: Set register to delay timer value\n", Opcode);
+                case 0x2:
+                    Handler = &Chip8::OpAnd<Profile>;
+                    break;
                     
-                    VRegisters[RegisterNum] = DelayTimer;
+                case 0x3:
+                    Handler = &Chip8::OpXor<Profile>;
+                    break;
                     
+                case 0x4:
+                    Handler = &Chip8::OpAddRegisters;
                     break;
                     
-                case 0x0A:
+                case 0x5:
+                    Handler = &Chip8::OpSubtractRegisters;
+                    break;
                     
-                    //
-                    // A key press is awaited, and then stored in register
-                    //
-                    DbgPrint("0x%4X: Wait for key press then store value in register\n", Opcode);
+                case 0x6:
+                    Handler = &Chip8::OpShiftRight<Profile>;
+                    break;
                     
-                    ValidKeyPressed = false;
+                case 0x7:
+                    Handler = &Chip8::OpSubtractReversed;
+                    break;
                     
-                    for (;;) {
-                        while (SDL_PollEvent(&Event)) {
-                            if (Event.type == SDL_KEYDOWN) {
-                                UCharValue = GetKeyNum(Event.key.keysym);
-                                
-                                if (UCharValue <= 15) {
-                                    VRegisters[RegisterNum] = UCharValue;
-                                    ValidKeyPressed = true;
-                                    break;
-                                }
-                            }
-                        }
-                        if (ValidKeyPressed != false) {
-                            break;
-                        }
-                    }
+                case 0xE:
+                    Handler = &Chip8::OpShiftLeft<Profile>;
+                    break;
                     
+                default:
+                    break;
+            }
+            break;
+            
+        case 0x9000:
+            Handler = &Chip8::OpSkipIfRegistersNotEqual;
+            break;
+            
+        case 0xA000:
+            Handler = &Chip8::OpSetIndex;
+            break;
+            
+        case 0xB000:
+            Handler = &Chip8::OpJumpPlusV0<Profile>;
+            break;
+            
+        case 0xC000:
+            Handler = &Chip8::OpRandom;
+            break;
+            
+        case 0xD000:
+            Handler = &Chip8::OpDraw<Profile>;
+            break;
+            
+        case 0xE000:
+            switch (InstructionOpcode & LAST_EIGHT_BITMASK) {
+                case 0x9E:
+                    Handler = &Chip8::OpSkipIfKeyPressed;
                     break;
-                
-                case 0x15:
                     
-                    //
-                    // Set delay timer to register value
-                    //
-                    DbgPrint("0x%4X: Set delay tmer to register value\n", Opcode);
+                case 0xA1:
+                    Handler = &Chip8::OpSkipIfKeyNotPressed;
+                    break;
                     
-                    DelayTimer = VRegisters[RegisterNum];
+                default:
+                    break;
+            }
+            break;
+            
+        case 0xF000:
+            switch (InstructionOpcode & LAST_EIGHT_BITMASK) {
+                case 0x07:
+                    Handler = &Chip8::OpGetDelayTimer;
                     break;
                     
-                case 0x18:
+                case 0x0A:
+                    Handler = &Chip8::OpWaitForKey;
+                    break;
                     
-                    //
-                    // Set sound timer to register value
-                    //
-                    DbgPrint("0x%4X: Set sound timer to register value\n", Opcode);
+                case 0x15:
+                    Handler = &Chip8::OpSetDelayTimer;
+                    break;
                     
-                    SoundTimer = VRegisters[RegisterNum];
+                case 0x18:
+                    Handler = &Chip8::OpSetSoundTimer;
                     break;
                     
                 case 0x1E:
-                    
-                    //
-                    // Add register value to index register
-                    //
-                    DbgPrint("0x%4X: Add register value to index register\n", Opcode);
-                    
-                    IndexRegister += VRegisters[RegisterNum];
+                    Handler = &Chip8::OpAddToIndex;
                     break;
                     
                 case 0x29:
-                    
-                    //
-                    // Set index register to location of the sprite for the character in VX,
-                    //    index register locations are all relevant to where ever memory starts
-                    //
-                    DbgPrint("0x%4X: Set index register to location of the sprite for the character in VX\n", Opcode);
-                    
-                    //IndexRegister = VRegisters[RegisterNum] * CHARACTER_SPRITE_SIZE;
-                    UCharValue = VRegisters[RegisterNum];
-                    Uint32 CharacterIndex;
-                    
-                    if ('0' <= UCharValue && UCharValue <= '9') {
-                        CharacterIndex = UCharValue - '0';
-                        
-                    } else if ('a' <= UCharValue && UCharValue <= 'f') {
-                        CharacterIndex = UCharValue - 'a' + 10;
-                        
-                    } else if ('A' <= UCharValue && UCharValue <= 'F') {
-                        CharacterIndex = UCharValue - 'A' + 10;
-                        
-                    } else {
-                        CharacterIndex = 0;
-                    }
-                    
-                    IndexRegister = CharacterIndex * CHARACTER_SPRITE_SIZE;
+                    Handler = &Chip8::OpSetIndexToCharacter;
                     break;
                     
                 case 0x33:
-                    
-                    //
-                    // Put decimal representation of register value into memory at index register
-                    //
-                    DbgPrint("0x%4X: Put decimal representation of register value into memory at index register\n", Opcode);
-                    
-                    Memory[IndexRegister] = '0' + ((unsigned char) VRegisters[RegisterNum] / 100);
-                    Memory[IndexRegister + 1] = '0' + (((unsigned char) VRegisters[RegisterNum] / 10) % 10);
-                    Memory[IndexRegister + 2] = '0' + ((unsigned char) VRegisters[RegisterNum] % 10);
+                    Handler = &Chip8::OpStoreBcd;
                     break;
                     
                 case 0x55:
-                    
-                    //
-                    // Store V0 to VX into memory starting at index register
-                    //
-                    DbgPrint("0x%4X: Store Vregisters into memory starting at index register\n", Opcode);
-                    
-                    memcpy(Memory + IndexRegister, VRegisters, (RegisterNum + 1) * sizeof(unsigned char));
+                    Handler = &Chip8::OpStoreRegisters<Profile>;
                     break;
                     
                 case 0x65:
-                    
-                    //
-                    // Put memory starting at index register into V0 to VX
-                    //
-                    DbgPrint("0x%4X: Put memory starting at index register into Vregisters\n", Opcode);
-                    
-                    memcpy(VRegisters, Memory + IndexRegister, (RegisterNum + 1) * sizeof(unsigned char));
+                    Handler = &Chip8::OpLoadRegisters<Profile>;
+                    break;
                     
                 default:
                     break;
             }
-            
+            break;
             
         default:
             break;
     }
     
-    DebugDumpState();
+    Instruction->Handler = Handler;
+    Instruction->Opcode = InstructionOpcode;
+    Instruction->Nnn = InstructionOpcode & LAST_TWELVE_BITMASK;
+    Instruction->X = (InstructionOpcode & REGISTER_ONE_BITMASK) >> 8;
+    Instruction->Y = (InstructionOpcode & REGISTER_TWO_BITMASK) >> 4;
+    Instruction->N = InstructionOpcode & LAST_FOUR_BITMASK;
+    Instruction->Kk = InstructionOpcode & LAST_EIGHT_BITMASK;
+}
+
+//
+// Memory at Address was written to. Drop every decoded instruction that overlaps the written
+// bytes, including the one starting the byte before, so they get decoded again from memory.
+//
+void Chip8::InvalidateDecodeCache(unsigned short Address, unsigned short Length)
+{
+    unsigned short FirstAddress = (Address - 1) & ADDRESS_BITMASK;
+    
+    for (unsigned short Index = 0; Index <= Length; ++Index) {
+        DecodeCache[(FirstAddress + Index) & ADDRESS_BITMASK].Handler = NULL;
+    }
+    
+    if (Jit != NULL) {
+        Jit->Invalidate(Address, Length);
+    }
+    
+    if (Static != NULL) {
+        Static->Revalidate(*this, Address, Length);
+    }
+}
+
+//
+// Opcode handlers. Each one gets the decoded instruction with the program counter already
+// pointing at the next instruction.
+//
+
+void Chip8::OpNop(Chip8 &, const DecodedInstruction &)
+{
+}
+
+void Chip8::OpClearScreen(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Clear the screen
+    //
+    
+    int RowWords = GRAPHICS_ROW_WORDS(Cpu.State.HiRes);
+    
+    for (int Word = 0; Word < GRAPHICS_USED_WORDS(Cpu.State.HiRes); ++Word) {
+        if (Cpu.State.Graphics[Word] != 0) {
+            Cpu.State.DirtyRows |= 1ull << (Word / RowWords);
+        }
+    }
+    
+    memset(Cpu.State.Graphics, 0, sizeof(Cpu.State.Graphics));
+    
+    if (TRACING(Cpu, TRACE_DRAW)) {
+        Cpu.Trace->Record(TRACE_DRAW, Cpu.State.ProgramCounter - 2, Instruction.Opcode, Cpu.State.IndexRegister, TRACE_NO_REGISTER, 0, 0);
+    }
+    
+    Cpu.State.DrawFlag = true;
+}
+
+void Chip8::OpScrollDown(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Scroll the display down N rows, blank rows come in at the top. Rows move as whole
+    // words, working up from the bottom so nothing is overwritten before it's moved.
+    //
+    
+    uint64_t *Graphics = Cpu.State.Graphics;
+    int RowWords = GRAPHICS_ROW_WORDS(Cpu.State.HiRes);
+    
+    for (int Row = GRAPHICS_ROWS(Cpu.State.HiRes) - 1; Row >= 0; --Row) {
+        for (int Word = Row * RowWords; Word < (Row + 1) * RowWords; ++Word) {
+            
+            uint64_t Moved = Row >= Instruction.N ? Graphics[Word - Instruction.N * RowWords] : 0;
+            
+            if (Graphics[Word] != Moved) {
+                Graphics[Word] = Moved;
+                Cpu.State.DirtyRows |= 1ull << Row;
+            }
+        }
+    }
+    
+    if (TRACING(Cpu, TRACE_DRAW)) {
+        Cpu.Trace->Record(TRACE_DRAW, Cpu.State.ProgramCounter - 2, Instruction.Opcode, Cpu.State.IndexRegister, TRACE_NO_REGISTER, 0, 0);
+    }
+    
+    Cpu.State.DrawFlag = true;
+}
+
+void Chip8::OpScrollRight(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Scroll the display right 4 pixels. A row is one shift, or in hi-res two with the
+    // bits carried from the left word into the right one.
+    //
+    
+    uint64_t *Graphics = Cpu.State.Graphics;
+    
+    if (!Cpu.State.HiRes) {
+        
+        for (int Row = 0; Row < GRAPHICS_Y_AXIS; ++Row) {
+            if (Graphics[Row] != 0) {
+                Graphics[Row] >>= 4;
+                Cpu.State.DirtyRows |= 1ull << Row;
+            }
+        }
+        
+    } else {
+        
+        for (int Row = 0; Row < GRAPHICS_HIRES_Y_AXIS; ++Row) {
+            
+            uint64_t Left = Graphics[Row * 2];
+            uint64_t Right = Graphics[Row * 2 + 1];
+            
+            if ((Left | Right) != 0) {
+                Graphics[Row * 2] = Left >> 4;
+                Graphics[Row * 2 + 1] = Right >> 4 | Left << 60;
+                Cpu.State.DirtyRows |= 1ull << Row;
+            }
+        }
+    }
+    
+    if (TRACING(Cpu, TRACE_DRAW)) {
+        Cpu.Trace->Record(TRACE_DRAW, Cpu.State.ProgramCounter - 2, Instruction.Opcode, Cpu.State.IndexRegister, TRACE_NO_REGISTER, 0, 0);
+    }
+    
+    Cpu.State.DrawFlag = true;
+}
+
+void Chip8::OpScrollLeft(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Scroll the display left 4 pixels, the other way round from OpScrollRight.
+    //
+    
+    uint64_t *Graphics = Cpu.State.Graphics;
+    
+    if (!Cpu.State.HiRes) {
+        
+        for (int Row = 0; Row < GRAPHICS_Y_AXIS; ++Row) {
+            if (Graphics[Row] != 0) {
+                Graphics[Row] <<= 4;
+                Cpu.State.DirtyRows |= 1ull << Row;
+            }
+        }
+        
+    } else {
+        
+        for (int Row = 0; Row < GRAPHICS_HIRES_Y_AXIS; ++Row) {
+            
+            uint64_t Left = Graphics[Row * 2];
+            uint64_t Right = Graphics[Row * 2 + 1];
+            
+            if ((Left | Right) != 0) {
+                Graphics[Row * 2] = Left << 4 | Right >> 60;
+                Graphics[Row * 2 + 1] = Right << 4;
+                Cpu.State.DirtyRows |= 1ull << Row;
+            }
+        }
+    }
+    
+    if (TRACING(Cpu, TRACE_DRAW)) {
+        Cpu.Trace->Record(TRACE_DRAW, Cpu.State.ProgramCounter - 2, Instruction.Opcode, Cpu.State.IndexRegister, TRACE_NO_REGISTER, 0, 0);
+    }
+    
+    Cpu.State.DrawFlag = true;
+}
+
+void Chip8::OpExit(Chip8 &Cpu, const DecodedInstruction &)
+{
+    //
+    // Exit the interpreter. Stopping is what the end of the program does, so the program
+    // ends here: the program counter stays on the 00FD and the machine is halted.
+    //
+    
+    Cpu.State.ProgramCounter -= 2;
+    Cpu.State.ProgramEnd = Cpu.State.ProgramCounter;
+}
+
+void Chip8::OpLowRes(Chip8 &Cpu, const DecodedInstruction &)
+{
+    //
+    // Back to the 64x32 display
+    //
+    
+    Cpu.SetHiRes(false);
+}
+
+void Chip8::OpHighRes(Chip8 &Cpu, const DecodedInstruction &)
+{
+    //
+    // Switch to the 128x64 display
+    //
+    
+    Cpu.SetHiRes(true);
+}
+
+void Chip8::OpReturn(Chip8 &Cpu, const DecodedInstruction &)
+{
+    //
+    // Return from subroutine. Returning with nothing on the stack faults the machine rather
+    // than making up an address.
+    //
+    
+    if (Cpu.State.StackPointer == 0) {
+        Cpu.State.Fault = FAULT_STACK_UNDERFLOW;
+        Cpu.State.ProgramCounter -= 2;
+        return;
+    }
+    
+    Cpu.State.ProgramCounter = Cpu.State.Stack[--Cpu.State.StackPointer];
+}
+
+void Chip8::OpJump(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Jump to address
+    //
+    
+    Cpu.State.ProgramCounter = Instruction.Nnn;
+}
+
+void Chip8::OpIdleJump(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    unsigned short JumpAddress = Cpu.State.ProgramCounter - 2;
+    
+    Cpu.State.ProgramCounter = Instruction.Nnn;
+    
+    if (Cpu.CanSkipIdle()) {
+        Cpu.IdleLoopLength = Cpu.MeasureIdleLoop(JumpAddress);
+    }
+}
+
+void Chip8::OpCall(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Call Subroutine. The stack has room for STACK_DEPTH returns, one more faults.
+    //
+    
+    if (Cpu.State.StackPointer == STACK_DEPTH) {
+        Cpu.State.Fault = FAULT_STACK_OVERFLOW;
+        Cpu.State.ProgramCounter -= 2;
+        return;
+    }
+    
+    Cpu.State.Stack[Cpu.State.StackPointer++] = Cpu.State.ProgramCounter;
+    Cpu.State.ProgramCounter = Instruction.Nnn;
+}
+
+void Chip8::OpSkipIfEqualValue(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Skip next instruction if register equals value
+    //
+    
+    if (Cpu.State.VRegisters[Instruction.X] == Instruction.Kk) {
+        Cpu.SkipNextInstruction();
+    }
+}
+
+void Chip8::OpSkipIfNotEqualValue(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Skip next instruction if register doesn't equal value
+    //
+    
+    if (Cpu.State.VRegisters[Instruction.X] != Instruction.Kk) {
+        Cpu.SkipNextInstruction();
+    }
+}
+
+void Chip8::OpSkipIfRegistersEqual(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Skip next instruction if registers are equal
+    //
+    
+    if (Cpu.State.VRegisters[Instruction.X] == Cpu.State.VRegisters[Instruction.Y]) {
+        Cpu.SkipNextInstruction();
+    }
+}
+
+void Chip8::OpSetRegister(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Set register to value
+    //
+    
+    Cpu.State.VRegisters[Instruction.X] = Instruction.Kk;
+}
+
+void Chip8::OpAddToRegister(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Add value to register
+    //
+    
+    Cpu.State.VRegisters[Instruction.X] += Instruction.Kk;
+}
+
+//
+// Register operations, 8XY0 through 8XYE. Where an instruction sets VF it's written before
+// VX, so a result going into VF wins over the flag.
+//
+
+void Chip8::OpMove(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    Cpu.State.VRegisters[Instruction.X] = Cpu.State.VRegisters[Instruction.Y];
+}
+
+template <typename Profile>
+void Chip8::OpOr(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    if (Profile::LogicClearsCarry) {
+        Cpu.SetCarry(0);
+    }
+    
+    Cpu.State.VRegisters[Instruction.X] = Cpu.State.VRegisters[Instruction.X] | Cpu.State.VRegisters[Instruction.Y];
+}
+
+template <typename Profile>
+void Chip8::OpAnd(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    if (Profile::LogicClearsCarry) {
+        Cpu.SetCarry(0);
+    }
+    
+    Cpu.State.VRegisters[Instruction.X] = Cpu.State.VRegisters[Instruction.X] & Cpu.State.VRegisters[Instruction.Y];
+}
+
+template <typename Profile>
+void Chip8::OpXor(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    if (Profile::LogicClearsCarry) {
+        Cpu.SetCarry(0);
+    }
+    
+    Cpu.State.VRegisters[Instruction.X] = Cpu.State.VRegisters[Instruction.X] ^ Cpu.State.VRegisters[Instruction.Y];
+}
+
+void Chip8::OpAddRegisters(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    Cpu.CheckAndSetCarry(Cpu.State.VRegisters[Instruction.X],
+                         Cpu.State.VRegisters[Instruction.Y],
+                         Add);
+    
+    Cpu.State.VRegisters[Instruction.X] = Cpu.State.VRegisters[Instruction.X] + Cpu.State.VRegisters[Instruction.Y];
+}
+
+void Chip8::OpSubtractRegisters(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    Cpu.CheckAndSetCarry(Cpu.State.VRegisters[Instruction.X],
+                         Cpu.State.VRegisters[Instruction.Y],
+                         Subtract);
+    
+    Cpu.State.VRegisters[Instruction.X] = Cpu.State.VRegisters[Instruction.X] - Cpu.State.VRegisters[Instruction.Y];
+}
+
+template <typename Profile>
+void Chip8::OpShiftRight(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    unsigned char Source = Cpu.State.VRegisters[Profile::ShiftReadsVY ? Instruction.Y : Instruction.X];
+    
+    Cpu.SetCarry(Source & 1);
+    
+    Cpu.State.VRegisters[Instruction.X] = Source >> 1;
+}
+
+void Chip8::OpSubtractReversed(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    Cpu.CheckAndSetCarry(Cpu.State.VRegisters[Instruction.Y],
+                         Cpu.State.VRegisters[Instruction.X],
+                         Subtract);
+    
+    Cpu.State.VRegisters[Instruction.X] = Cpu.State.VRegisters[Instruction.Y] - Cpu.State.VRegisters[Instruction.X];
+}
+
+template <typename Profile>
+void Chip8::OpShiftLeft(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    unsigned char Source = Cpu.State.VRegisters[Profile::ShiftReadsVY ? Instruction.Y : Instruction.X];
+    
+    Cpu.SetCarry(Source >> 7);
+    
+    Cpu.State.VRegisters[Instruction.X] = (unsigned char) (Source << 1);
+}
+
+void Chip8::OpSkipIfRegistersNotEqual(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Skip next instruction if registers are not equal
+    //
+    
+    if (Cpu.State.VRegisters[Instruction.X] != Cpu.State.VRegisters[Instruction.Y]) {
+        Cpu.SkipNextInstruction();
+    }
+}
+
+void Chip8::OpSetIndex(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Set index register to the given address
+    //
+    
+    Cpu.State.IndexRegister = Instruction.Nnn;
+}
+
+template <typename Profile>
+void Chip8::OpJumpPlusV0(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Jump to address given plus value in register 0, or in register X for BXNN
+    //
+    
+    Cpu.State.ProgramCounter = Instruction.Nnn + Cpu.State.VRegisters[Profile::JumpUsesVX ? Instruction.X : 0];
+}
+
+void Chip8::OpRandom(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    unsigned char RandomNumber;
+    
+    //
+    // Set register to random number and given value. Top byte of the xorshift state, all 256
+    // values equally likely.
+    //
+    
+    RandomNumber = (unsigned char) (Cpu.NextRandom() >> 24);
+    
+    Cpu.State.VRegisters[Instruction.X] = RandomNumber & Instruction.Kk;
+}
+
+template <typename Profile>
+void Chip8::OpDraw(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Draw sprites stored at location in index register
+    //
+    
+#if CHIP8_PROFILER
+    if (Cpu.Profiler != NULL) {
+        uint64_t StartTime = Chip8Profiler::Now();
+        
+        Cpu.DrawSprites<Profile>(Instruction.X, Instruction.Y, Instruction.N);
+        Cpu.Profiler->CountDraw(Chip8Profiler::Now() - StartTime);
+        
+    } else {
+        Cpu.DrawSprites<Profile>(Instruction.X, Instruction.Y, Instruction.N);
+    }
+#else
+    Cpu.DrawSprites<Profile>(Instruction.X, Instruction.Y, Instruction.N);
+#endif
+    
+    if (TRACING(Cpu, TRACE_DRAW)) {
+        Cpu.Trace->Record(TRACE_DRAW, Cpu.State.ProgramCounter - 2, Instruction.Opcode, Cpu.State.IndexRegister, 0xF, Cpu.State.VRegisters[0xF], 0);
+    }
+    
+    Cpu.State.DrawFlag = true;
+}
+
+void Chip8::OpSkipIfKeyPressed(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    unsigned char KeyNum;
+    
+    //
+    // Skip the next instruction if the key stored in VX is pressed
+    //
+    
+    KeyNum = Cpu.State.VRegisters[Instruction.X] & 0xF;
+    
+    if (Cpu.State.Key[KeyNum] != 0) {
+        Cpu.SkipNextInstruction();
+    }
+}
+
+void Chip8::OpSkipIfKeyNotPressed(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    unsigned char KeyNum;
+    
+    //
+    // Skip the next instruction if the key stored in VX is NOT pressed
+    //
     
-    return true;
+    KeyNum = Cpu.State.VRegisters[Instruction.X] & 0xF;
+    
+    if (Cpu.State.Key[KeyNum] == 0) {
+        Cpu.SkipNextInstruction();
+    }
+}
+
+void Chip8::OpGetDelayTimer(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Set register to delay timer value
+    //
+    
+    Cpu.State.VRegisters[Instruction.X] = Cpu.State.DelayTimer;
+}
+
+void Chip8::OpWaitForKey(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // A key press is awaited, and then stored in register
+    //
+    
+    //
+    // The core has no event loop of its own, so rather than blocking here the machine goes
+    // into a wait with the program counter back on this instruction. Run and EmulateCycle
+    // finish it once a key goes down that wasn't down now, see StillWaitingForKey.
+    //
+    
+    Cpu.State.ProgramCounter -= 2;
+    Cpu.State.WaitingForKey = true;
+    Cpu.State.KeyWaitRegister = Instruction.X;
+    Cpu.State.KeysHeld = 0;
+    
+    for (int KeyIndex = 0; KeyIndex < 16; ++KeyIndex) {
+        if (Cpu.State.Key[KeyIndex] != 0) {
+            Cpu.State.KeysHeld |= 1 << KeyIndex;
+        }
+    }
+    
+#if CHIP8_PROFILER
+    if (Cpu.Profiler != NULL) {
+        Cpu.Profiler->CountKeyWait();
+    }
+#endif
+}
+
+void Chip8::OpSetDelayTimer(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Set delay timer to register value
+    //
+    
+    Cpu.State.DelayTimer = Cpu.State.VRegisters[Instruction.X];
+}
+
+void Chip8::OpSetSoundTimer(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Set sound timer to register value
+    //
+    
+    Cpu.State.SoundTimer = Cpu.State.VRegisters[Instruction.X];
+}
+
+void Chip8::OpAddToIndex(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Add register value to index register
+    //
+    
+    Cpu.State.IndexRegister += Cpu.State.VRegisters[Instruction.X];
+}
+
+void Chip8::OpSetIndexToCharacter(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    unsigned char Character;
+    unsigned int CharacterIndex;
+    
+    //
+    // Set index register to location of the sprite for the character in VX,
+    //    index register locations are all relevant to where ever memory starts
+    //
+    
+    Character = Cpu.State.VRegisters[Instruction.X];
+    
+    if ('0' <= Character && Character <= '9') {
+        CharacterIndex = Character - '0';
+        
+    } else if ('a' <= Character && Character <= 'f') {
+        CharacterIndex = Character - 'a' + 10;
+        
+    } else if ('A' <= Character && Character <= 'F') {
+        CharacterIndex = Character - 'A' + 10;
+        
+    } else {
+        CharacterIndex = 0;
+    }
+    
+    Cpu.State.IndexRegister = CharacterIndex * CHARACTER_SPRITE_SIZE;
+}
+
+void Chip8::OpStoreBcd(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    unsigned char Value = Cpu.State.VRegisters[Instruction.X];
+    
+    //
+    // Put decimal representation of register value into memory at index register
+    //
+    
+    Cpu.State.Memory[Cpu.State.IndexRegister & ADDRESS_BITMASK] = '0' + (Value / 100);
+    Cpu.State.Memory[(Cpu.State.IndexRegister + 1) & ADDRESS_BITMASK] = '0' + ((Value / 10) % 10);
+    Cpu.State.Memory[(Cpu.State.IndexRegister + 2) & ADDRESS_BITMASK] = '0' + (Value % 10);
+    
+    Cpu.InvalidateDecodeCache(Cpu.State.IndexRegister & ADDRESS_BITMASK, 3);
+}
+
+template <typename Profile>
+void Chip8::OpStoreRegisters(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Store V0 to VX into memory starting at index register. I can point anywhere, so the
+    // addresses wrap at the top of memory like every other access.
+    //
+    
+    for (int Register = 0; Register <= Instruction.X; ++Register) {
+        Cpu.State.Memory[(Cpu.State.IndexRegister + Register) & ADDRESS_BITMASK] = Cpu.State.VRegisters[Register];
+    }
+    
+    Cpu.InvalidateDecodeCache(Cpu.State.IndexRegister & ADDRESS_BITMASK, Instruction.X + 1);
+    
+    if (Profile::LoadStoreMovesIndex) {
+        Cpu.State.IndexRegister += Instruction.X + 1;
+    }
+}
+
+template <typename Profile>
+void Chip8::OpLoadRegisters(Chip8 &Cpu, const DecodedInstruction &Instruction)
+{
+    //
+    // Put memory starting at index register into V0 to VX
+    //
+    
+    for (int Register = 0; Register <= Instruction.X; ++Register) {
+        Cpu.State.VRegisters[Register] = Cpu.State.Memory[(Cpu.State.IndexRegister + Register) & ADDRESS_BITMASK];
+    }
+    
+    if (Profile::LoadStoreMovesIndex) {
+        Cpu.State.IndexRegister += Instruction.X + 1;
+    }
 }
 
 //
-// Subroutine for drawing sprites. There's no color in chip 8, so pixels are just bits on or off.
-// We have our graphics pixel array represented as unsigned chars though, se we'll only use the first
-// bit in each entry and use a mask to iterate bit by bit through the sprites stored in memory in order
-// to XOR them into the graphics array.
+// Subroutine for drawing sprites. There's no color in chip 8, so pixels are just bits on or off,
+// and each row of the display is packed into one 64 bit word with the leftmost pixel in the top
+// bit. A sprite row is one byte, so we put it at the top of a word, rotate it across to the X
+// position (which wraps anything hanging off the right edge back around to the left) and XOR
+// the whole thing into the display row at once. Any bit set in both before the XOR is a collision.
+// Profiles that clip shift instead of rotating, and stop at the bottom row.
 //
-void Chip8::DrawSprites()
+template <typename Profile>
+void Chip8::DrawSprites(unsigned char RegisterNum1, unsigned char RegisterNum2, unsigned char SpriteRows)
 {
-    unsigned char SpritePixelBitMask;
-    unsigned char SpritePixelValue;
-    int GraphicsDrawLoc;
+    if (State.HiRes) {
+        DrawSpritesHiRes<Profile>(RegisterNum1, RegisterNum2, SpriteRows);
+        return;
+    }
+    
+    unsigned int DrawLocX = State.VRegisters[RegisterNum1] % GRAPHICS_X_AXIS;
+    unsigned int DrawLocY = State.VRegisters[RegisterNum2] % GRAPHICS_Y_AXIS;
+    uint64_t Collision = 0;
+    
+    if (Profile::SpritesClip) {
+        SpriteRows = (unsigned char) std::min<unsigned int>(SpriteRows, GRAPHICS_Y_AXIS - DrawLocY);
+    }
     
-    unsigned char SpriteRows = Opcode & LAST_FOUR_BITMASK;
-    unsigned short RegisterNum1 = GetRegister(First);
-    unsigned short RegisterNum2 = GetRegister(Second);
+    for (int SpriteRowIndex = 0; SpriteRowIndex < SpriteRows; ++SpriteRowIndex) {
+        
+        uint64_t SpriteRow = (uint64_t) State.Memory[(State.IndexRegister + SpriteRowIndex) & ADDRESS_BITMASK] << (GRAPHICS_X_AXIS - 8);
+        unsigned int GraphicsRowIndex = (DrawLocY + SpriteRowIndex) % GRAPHICS_Y_AXIS;
+        uint64_t &GraphicsRow = State.Graphics[GraphicsRowIndex];
+        
+        if (Profile::SpritesClip) {
+            SpriteRow >>= DrawLocX;
+        } else {
+            SpriteRow = (SpriteRow >> DrawLocX) | (SpriteRow << ((GRAPHICS_X_AXIS - DrawLocX) % GRAPHICS_X_AXIS));
+        }
+        
+        Collision |= GraphicsRow & SpriteRow;
+        GraphicsRow ^= SpriteRow;
+        
+        if (SpriteRow != 0) {
+            State.DirtyRows |= 1ull << GraphicsRowIndex;
+        }
+    }
+    
+    SetCarry(Collision != 0 ? 1 : 0);
+}
+
+//
+// Same again for the 128x64 display, where a row is two words. DXY0 draws a 16x16 sprite,
+// two bytes a row. The sprite row goes at the top of the left word and the pair gets rotated
+// right by X as one 128 bit value: shift across by X mod 64, then swap the words if X is past
+// the middle, where clipping drops what would have wrapped instead.
+//
+template <typename Profile>
+void Chip8::DrawSpritesHiRes(unsigned char RegisterNum1, unsigned char RegisterNum2, unsigned char SpriteRows)
+{
+    unsigned int DrawLocX = State.VRegisters[RegisterNum1] % GRAPHICS_HIRES_X_AXIS;
+    unsigned int DrawLocY = State.VRegisters[RegisterNum2] % GRAPHICS_HIRES_Y_AXIS;
+    unsigned int Shift = DrawLocX % 64;
+    bool Wide = SpriteRows == 0;
+    unsigned short Address = State.IndexRegister;
+    uint64_t Collision = 0;
     
-    unsigned short DrawLocX = VRegisters[RegisterNum1];
-    unsigned short DrawLocY = VRegisters[RegisterNum2];
+    if (Wide) {
+        SpriteRows = 16;
+    }
     
-    SetCarry(0);
+    if (Profile::SpritesClip) {
+        SpriteRows = (unsigned char) std::min<unsigned int>(SpriteRows, GRAPHICS_HIRES_Y_AXIS - DrawLocY);
+    }
     
     for (int SpriteRowIndex = 0; SpriteRowIndex < SpriteRows; ++SpriteRowIndex) {
         
-        //
-        // Get sprite row from memory
-        //
+        unsigned int GraphicsRowIndex = (DrawLocY + SpriteRowIndex) % GRAPHICS_HIRES_Y_AXIS;
+        uint64_t *GraphicsRow = &State.Graphics[GraphicsRowIndex * 2];
+        uint64_t Left;
+        uint64_t Right = 0;
         
-        unsigned char SpritePixelRow = Memory[IndexRegister + SpriteRowIndex];
+        if (Wide) {
+            Left = (uint64_t) (State.Memory[Address & ADDRESS_BITMASK] << 8 | State.Memory[(Address + 1) & ADDRESS_BITMASK]) << 48;
+            Address += 2;
+        } else {
+            Left = (uint64_t) State.Memory[Address & ADDRESS_BITMASK] << 56;
+            Address += 1;
+        }
         
-        //
-        // Iterate through pixels in sprite row and XOR them into graphics array
-        //
+        if (Shift != 0) {
+            Right = Left << (64 - Shift);
+            Left >>= Shift;
+        }
         
-        for (int SpritePixelIndex = 0; SpritePixelIndex < 8; ++SpritePixelIndex) {
-            
-            if (DrawLocY + SpriteRowIndex > 32 || DrawLocX + SpritePixelIndex > 64) {
-                continue;
-            }
-            
-            GraphicsDrawLoc = TWO_DIM_TO_ONE(DrawLocX + SpritePixelIndex, DrawLocY + SpriteRowIndex, GRAPHICS_X_AXIS);
-            
-            SpritePixelBitMask = 1 << (7 - SpritePixelIndex);
-            SpritePixelValue = (SpritePixelRow & SpritePixelBitMask) >> (7 - SpritePixelIndex);
-            
-            if (SpritePixelValue != 1) {
-                continue;
-            }
+        if (DrawLocX >= 64) {
+            std::swap(Left, Right);
             
-            if (Graphics[GraphicsDrawLoc] == 1) {
-                SetCarry(1);
+            if (Profile::SpritesClip) {
+                Left = 0;
             }
-            
-            Graphics[GraphicsDrawLoc] ^= SpritePixelValue;
+        }
+        
+        Collision |= (GraphicsRow[0] & Left) | (GraphicsRow[1] & Right);
+        GraphicsRow[0] ^= Left;
+        GraphicsRow[1] ^= Right;
+        
+        if ((Left | Right) != 0) {
+            State.DirtyRows |= 1ull << GraphicsRowIndex;
         }
     }
+    
+    SetCarry(Collision != 0 ? 1 : 0);
 }
 
 //
-// Parse the registers out of the opcode
+// Changing modes clears the display, the two modes don't read the words the same way.
 //
-unsigned short Chip8::GetRegister(RegisterLocationInOpcode RegLoc)
+void Chip8::SetHiRes(bool HiRes)
 {
-    unsigned char RegisterNum;
-    assert (RegLoc == First || RegLoc == Second);
-    
-    if (RegLoc == First) {
-        RegisterNum = (Opcode & REGISTER_ONE_BITMASK) >> 8;
-    }
-    else {
-        RegisterNum = (Opcode & REGISTER_TWO_BITMASK) >> 4;
+    if (State.HiRes == HiRes) {
+        return;
     }
     
-    assert(0 <= RegisterNum && RegisterNum <= 16);
+    memset(State.Graphics, 0, sizeof(State.Graphics));
     
-    return RegisterNum;
+    State.HiRes = HiRes;
+    State.DirtyRows = ALL_ROWS_DIRTY;
+    State.DrawFlag = true;
 }
 
+//
+// Hand the frontend the rows that changed since it last asked, and start collecting again.
+//
+uint64_t Chip8::TakeDirtyRows()
+{
+    uint64_t Rows = State.DirtyRows;
+    
+    State.DirtyRows = 0;
+    State.DrawFlag = false;
+    
+    return Rows;
+}
 
 //
 // Check if values result in carry or borrow
@@ -667,7 +1787,7 @@ void Chip8::CheckAndSetCarry(unsigned short Value1,
 void Chip8::SetCarry(int OneOrZero)
 {
     assert(OneOrZero == 0 || OneOrZero == 1);
-    VRegisters[0xF] = OneOrZero;
+    State.VRegisters[0xF] = OneOrZero;
 }
 
 
@@ -676,84 +1796,261 @@ void Chip8::SetCarry(int OneOrZero)
 //
 void Chip8::SkipNextInstruction()
 {
-    ProgramCounter += 2;
+    State.ProgramCounter += 2;
 }
 
 
 //
-// Load ROM into memory.
+// Load ROM into memory. The file is mapped rather than read and has to fit in program
+// memory. Running stops when the program counter walks off the end of it, as with
+// LoadProgram.
 //
 bool Chip8::LoadRom (char* FileName)
 {
-    std::ifstream RomFile;
-    char *MemoryLocation;
+    RomImage Rom;
     
-    RomFile.open(FileName, std::ios::binary | std::ios::in);
+    if (Rom.Open(FileName) != ROM_OK) {
+        return false;
+    }
     
-    if (!RomFile.is_open()) {
-        assert(false);
+    return LoadProgram(Rom.Bytes(), Rom.Size());
+}
+
+//
+// Load a program that's already in memory, for tools that build their own. Running stops
+// when the program counter walks off the end of it.
+//
+bool Chip8::LoadProgram(const unsigned char *Program, size_t Length)
+{
+    if (Length > sizeof(State.Memory) - PROGRAM_START_LOCATION) {
+        return false;
     }
     
-    MemoryLocation = (char *) (Memory + PROGRAM_START_LOCATION);
+    memcpy(State.Memory + PROGRAM_START_LOCATION, Program, Length);
+    State.ProgramEnd = (unsigned short) (PROGRAM_START_LOCATION + Length);
     
-    while (RomFile.read(MemoryLocation, 1024)) {
-        MemoryLocation += 1024;
+    memset(DecodeCache, 0, sizeof(DecodeCache));
+    
+    if (Jit != NULL) {
+        Jit->Flush();
     }
     
-    MemoryLocation--;
-    ProgramEnd = (unsigned char *) MemoryLocation;
+    if (Static != NULL) {
+        Static->Revalidate(*this, 0, sizeof(State.Memory));
+    }
     
     return true;
+}
+
+//
+// Little endian helpers for save states. The writers return where the next field goes, the
+// readers advance Cursor. Callers check the length up front so the readers never run off
+// the end.
+//
+static unsigned char *PutWord(unsigned char *Out, uint16_t Value)
+{
+    Out[0] = (unsigned char) Value;
+    Out[1] = (unsigned char) (Value >> 8);
+    return Out + 2;
+}
+
+static unsigned char *PutDword(unsigned char *Out, uint32_t Value)
+{
+    Out = PutWord(Out, (uint16_t) Value);
+    return PutWord(Out, (uint16_t) (Value >> 16));
+}
+
+static unsigned char *PutQword(unsigned char *Out, uint64_t Value)
+{
+    Out = PutDword(Out, (uint32_t) Value);
+    return PutDword(Out, (uint32_t) (Value >> 32));
+}
+
+static uint16_t GetWord(const unsigned char *&Cursor)
+{
+    uint16_t Value = (uint16_t) (Cursor[0] | (Cursor[1] << 8));
+    Cursor += 2;
+    return Value;
+}
+
+static uint32_t GetDword(const unsigned char *&Cursor)
+{
+    uint32_t Low = GetWord(Cursor);
+    return Low | ((uint32_t) GetWord(Cursor) << 16);
+}
+
+static uint64_t GetQword(const unsigned char *&Cursor)
+{
+    uint64_t Low = GetDword(Cursor);
+    return Low | ((uint64_t) GetDword(Cursor) << 32);
+}
+
+//
+// Snapshot the whole machine into Blob, replacing whatever was in it.
+//
+void Chip8::SaveState(std::vector<unsigned char> &Blob)
+{
+    unsigned char *Out;
+    
+    Blob.resize(SAVE_STATE_FIXED_SIZE + State.StackPointer * 2);
+    Out = &Blob[0];
+    
+    Out = PutDword(Out, SAVE_STATE_MAGIC);
+    Out = PutWord(Out, SAVE_STATE_VERSION);
+    Out = PutWord(Out, State.StackPointer);
+    Out = PutWord(Out, (uint16_t) Quirks);
+    
+    memcpy(Out, State.Memory, sizeof(State.Memory));
+    Out += sizeof(State.Memory);
+    memcpy(Out, State.VRegisters, sizeof(State.VRegisters));
+    Out += sizeof(State.VRegisters);
+    
+    Out = PutWord(Out, State.IndexRegister);
+    Out = PutWord(Out, State.ProgramCounter);
+    *Out++ = State.DelayTimer;
+    *Out++ = State.SoundTimer;
+    
+    memcpy(Out, State.Key, sizeof(State.Key));
+    Out += sizeof(State.Key);
+    
+    *Out++ = State.HiRes ? 1 : 0;
+    
+    for (int Word = 0; Word < GRAPHICS_WORDS; ++Word) {
+        Out = PutQword(Out, State.Graphics[Word]);
+    }
+    
+    Out = PutDword(Out, State.RandomState);
+    Out = PutWord(Out, State.ProgramEnd);
+    
+    *Out++ = State.WaitingForKey ? 1 : 0;
+    *Out++ = State.KeyWaitRegister;
+    Out = PutWord(Out, State.KeysHeld);
+    
+    for (int Entry = 0; Entry < State.StackPointer; ++Entry) {
+        Out = PutWord(Out, State.Stack[Entry]);
+    }
     
+    assert(Out == &Blob[0] + Blob.size());
 }
 
-unsigned char Chip8::GetKeyNum(SDL_Keysym Symbol)
-{
-    switch (Symbol.sym) {
-            
-        case SDLK_1:
-            return 0;
-        case SDLK_2:
-            return 1;
-        case SDLK_3:
-            return 2;
-        case SDLK_4:
-            return 3;
-            
-        case SDLK_q:
-            return 4;
-        case SDLK_w:
-            return 5;
-        case SDLK_e:
-            return 6;
-        case SDLK_r:
-            return 7;
-            
-        case SDLK_a:
-            return 8;
-        case SDLK_s:
-            return 9;
-        case SDLK_d:
-            return 10;
-        case SDLK_f:
-            return 11;
-            
-        case SDLK_z:
-            return 12;
-        case SDLK_x:
-            return 13;
-        case SDLK_c:
-            return 14;
-        case SDLK_v:
-            return 15;
-        
-        //
-        // No valid key was touched
-        //
-            
-        default:
-            return 0xFF;
+//
+// Restore a snapshot taken by SaveState. Everything is checked before anything changes, so
+// a bad blob leaves the machine as it was.
+//
+bool Chip8::LoadState(const unsigned char *Blob, size_t Length)
+{
+    const unsigned char *Cursor = Blob;
+    uint16_t StackDepth;
+    uint16_t Profile;
+    
+    if (Blob == NULL || Length < SAVE_STATE_HEADER_SIZE) {
+        return false;
+    }
+    
+    if (GetDword(Cursor) != SAVE_STATE_MAGIC || GetWord(Cursor) != SAVE_STATE_VERSION) {
+        return false;
+    }
+    
+    StackDepth = GetWord(Cursor);
+    Profile = GetWord(Cursor);
+    
+    if (Profile > QUIRKS_XO_CHIP) {
+        return false;
+    }
+    
+    if (StackDepth > STACK_DEPTH || Length != SAVE_STATE_FIXED_SIZE + (size_t) StackDepth * 2) {
+        return false;
+    }
+    
+    //
+    // The FX0A wait is the last thing before the stack: a flag, then the register.
+    //
+    
+    if (Blob[SAVE_STATE_FIXED_SIZE - 4] > 1 || Blob[SAVE_STATE_FIXED_SIZE - 3] > 0xF) {
+        return false;
+    }
+    
+    memcpy(State.Memory, Cursor, sizeof(State.Memory));
+    Cursor += sizeof(State.Memory);
+    memcpy(State.VRegisters, Cursor, sizeof(State.VRegisters));
+    Cursor += sizeof(State.VRegisters);
+    
+    State.IndexRegister = GetWord(Cursor);
+    State.ProgramCounter = GetWord(Cursor);
+    State.DelayTimer = *Cursor++;
+    State.SoundTimer = *Cursor++;
+    
+    memcpy(State.Key, Cursor, sizeof(State.Key));
+    Cursor += sizeof(State.Key);
+    
+    State.HiRes = *Cursor++ != 0;
+    
+    for (int Word = 0; Word < GRAPHICS_WORDS; ++Word) {
+        State.Graphics[Word] = GetQword(Cursor);
+    }
+    
+    State.RandomState = GetDword(Cursor);
+    State.ProgramEnd = GetWord(Cursor);
+    State.WaitingForKey = *Cursor++ != 0;
+    State.KeyWaitRegister = *Cursor++;
+    State.KeysHeld = GetWord(Cursor);
+    State.StackPointer = (unsigned char) StackDepth;
+    State.Fault = FAULT_NONE;
+    
+    for (int Entry = 0; Entry < StackDepth; ++Entry) {
+        State.Stack[Entry] = GetWord(Cursor);
     }
+    
+    //
+    // Memory changed wholesale, so nothing decoded or compiled can be trusted, and the
+    // frontend has to redraw everything. Putting the profile back throws away everything
+    // decoded or compiled either way.
+    //
+    
+    SetQuirkProfile((Chip8QuirkProfile) Profile);
+    
+    State.DirtyRows = ALL_ROWS_DIRTY;
+    State.DrawFlag = true;
+    
+    return true;
+}
+
+bool Chip8::SaveState(const char *FileName)
+{
+    std::vector<unsigned char> Blob;
+    std::ofstream StateFile;
+    
+    SaveState(Blob);
+    
+    StateFile.open(FileName, std::ios::binary | std::ios::out | std::ios::trunc);
+    
+    if (!StateFile.is_open()) {
+        return false;
+    }
+    
+    StateFile.write((const char *) &Blob[0], Blob.size());
+    
+    return StateFile.good();
+}
+
+bool Chip8::LoadState(const char *FileName)
+{
+    std::vector<unsigned char> Blob;
+    std::ifstream StateFile;
+    
+    StateFile.open(FileName, std::ios::binary | std::ios::in);
+    
+    if (!StateFile.is_open()) {
+        return false;
+    }
+    
+    Blob.assign(std::istreambuf_iterator<char>(StateFile), std::istreambuf_iterator<char>());
+    
+    if (Blob.empty()) {
+        return false;
+    }
+    
+    return LoadState(&Blob[0], Blob.size());
 }
 
 void Chip8::HandleKeyboard(unsigned char Key, int x, int y)
@@ -766,10 +2063,6 @@ void Chip8::HandleKeyboard(unsigned char Key, int x, int y)
 //
 void Chip8::DebugDumpState()
 {
-    if (!DEBUG) {
-        return;
-    }
-    
     printf("Registers:\n"
            "    V0: %4X\n"
            "    V1: %4X\n"
@@ -787,34 +2080,34 @@ void Chip8::DebugDumpState()
            "    VD: %4X\n"
            "    VE: %4X\n"
            "    VF: %4X\n",
-           VRegisters[0],
-           VRegisters[1],
-           VRegisters[2],
-           VRegisters[3],
-           VRegisters[4],
-           VRegisters[5],
-           VRegisters[6],
-           VRegisters[7],
-           VRegisters[8],
-           VRegisters[9],
-           VRegisters[10],
-           VRegisters[11],
-           VRegisters[12],
-           VRegisters[13],
-           VRegisters[14],
-           VRegisters[15]);
+           State.VRegisters[0],
+           State.VRegisters[1],
+           State.VRegisters[2],
+           State.VRegisters[3],
+           State.VRegisters[4],
+           State.VRegisters[5],
+           State.VRegisters[6],
+           State.VRegisters[7],
+           State.VRegisters[8],
+           State.VRegisters[9],
+           State.VRegisters[10],
+           State.VRegisters[11],
+           State.VRegisters[12],
+           State.VRegisters[13],
+           State.VRegisters[14],
+           State.VRegisters[15]);
     
     printf("IndexRegister:  %4X\n"
            "ProgramCounter: %4X\n"
            "Opcode:         %4X\n",
-           IndexRegister,
-           ProgramCounter,
+           State.IndexRegister,
+           State.ProgramCounter,
            Opcode);
     
     printf("Stack:\n");
     
-    for (auto i = Stack.rbegin(); i != Stack.rend(); ++i) {
-        printf("%4X\n", *i);
+    for (int Entry = State.StackPointer - 1; Entry >= 0; --Entry) {
+        printf("%4X\n", State.Stack[Entry]);
     }
     
     printf("\n\n");
@@ -15,14 +15,20 @@
 #include <ctime>
 #include <assert.h>
 #include <vector>
+#include <algorithm>
 #include <stdarg.h>
-#include <SDL2/SDL.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+#include <new>
 
-#define DEBUG 0
-
-#define LOGFILE stdout
-
-#define DbgPrint(...) if(DEBUG){ fprintf (LOGFILE, __VA_ARGS__); }
+#include "Chip8Jit.h"
+#include "Chip8Static.h"
+#include "Chip8Quirks.h"
+#include "Chip8Profiler.h"
+#include "Chip8Trace.h"
+#include "RomLibrary.h"
 
 //
 // Useful BitMasks
@@ -34,6 +40,8 @@
 #define LAST_EIGHT_BITMASK (0x00FF)
 #define LAST_TWELVE_BITMASK (0x0FFF)
 
+#define ADDRESS_BITMASK (0x0FFF)
+
 #define REGISTER_ONE_BITMASK (0x0F00)
 #define REGISTER_TWO_BITMASK (0x00F0)
 
@@ -44,66 +52,380 @@
 #define GRAPHICS_X_AXIS (64)
 #define GRAPHICS_Y_AXIS (32)
 
+//
+// SUPER-CHIP's hi-res mode.
+//
+
+#define GRAPHICS_HIRES_X_AXIS (128)
+#define GRAPHICS_HIRES_Y_AXIS (64)
+
+//
+// The display is packed into 64 bit words, leftmost pixel in the top bit. At 64x32 each of
+// the first 32 words is a row. In hi-res a row takes two words, left half first, so row N is
+// words 2N and 2N + 1. There's room for hi-res either way and the mode says how to read it.
+//
+
+#define GRAPHICS_WORDS (GRAPHICS_HIRES_X_AXIS / 64 * GRAPHICS_HIRES_Y_AXIS)
+
+#define GRAPHICS_ROWS(HiRes) ((HiRes) ? GRAPHICS_HIRES_Y_AXIS : GRAPHICS_Y_AXIS)
+#define GRAPHICS_ROW_WORDS(HiRes) ((HiRes) ? 2 : 1)
+#define GRAPHICS_USED_WORDS(HiRes) (GRAPHICS_ROWS(HiRes) * GRAPHICS_ROW_WORDS(HiRes))
+
+#define GRAPHICS_PIXEL(Rows, x, y) (((Rows)[(y)] >> (GRAPHICS_X_AXIS - 1 - (x))) & 1)
+#define GRAPHICS_HIRES_PIXEL(Words, x, y) (((Words)[(y) * 2 + (x) / 64] >> (63 - (x) % 64)) & 1)
+
+//
+// One bit per display row, enough for hi-res.
+//
+
+#define ALL_ROWS_DIRTY (0xFFFFFFFFFFFFFFFFull)
+
+//
+// Save states are a little endian blob: a header of magic, version, stack depth and quirk
+// profile, then memory, registers, timers, keys, the display mode and every display word,
+// the random state, where the ROM ends, the FX0A wait and the stack. Bump the version
+// whenever the layout changes, LoadState refuses anything else.
+//
+
+#define SAVE_STATE_MAGIC (0x54533843) // "C8ST"
+#define SAVE_STATE_VERSION (4)
+#define SAVE_STATE_HEADER_SIZE (4 + 2 + 2 + 2)
+#define SAVE_STATE_FIXED_SIZE (SAVE_STATE_HEADER_SIZE + 4096 + 16 + 2 + 2 + 1 + 1 + 16 + 1 + GRAPHICS_WORDS * 8 + 4 + 2 + 1 + 1 + 2)
+
+#define STACK_DEPTH (16)
+
+//
+// Longest loop, jump included, that gets checked for spinning idle.
+//
+
+#define IDLE_LOOP_MAX_INSTRUCTIONS (8)
+
+//
+// Stored as the program end when there's no end to stop at, in the state and in save states.
+//
+
+#define NO_PROGRAM_END (0xFFFF)
+
+//
+// Why a machine stopped. A faulted machine doesn't run another instruction until it's
+// reinitialized or given a new state, and its program counter stays on the instruction that
+// faulted.
+//
+
+typedef enum Chip8Fault {
+    FAULT_NONE,
+    FAULT_STACK_OVERFLOW,
+    FAULT_STACK_UNDERFLOW
+} Chip8Fault;
+
+//
+// Everything that makes up one machine, in one fixed block with no pointers in it, so copying
+// a machine is a single memcpy and any copy is as good as the original. Addresses are
+// offsets into Memory. Memory comes first and the whole thing is cache line aligned, so the
+// registers and the display sit on lines of their own.
+//
+
+struct alignas(64) Chip8State {
+    unsigned char Memory[4096];
+    uint64_t Graphics[GRAPHICS_WORDS];
+    
+    unsigned char VRegisters[16];
+    unsigned short IndexRegister;
+    unsigned short ProgramCounter;
+    unsigned char DelayTimer;
+    unsigned char SoundTimer;
+    unsigned char StackPointer;
+    unsigned char Fault;
+    
+    unsigned short Stack[STACK_DEPTH];
+    
+    //
+    // Where the loaded program ends, NO_PROGRAM_END if there's no end to stop at.
+    //
+    
+    unsigned short ProgramEnd;
+    
+    unsigned char Key[16];
+    
+    //
+    // Set while FX0A waits for a key, with the program counter left on the FX0A. A waiting
+    // machine runs nothing, but its timers still tick. Only a key going down ends the wait:
+    // KeysHeld is the key mask as of the last look, so a key that was already held when the
+    // wait began has to be let go and pressed again.
+    //
+    
+    bool WaitingForKey;
+    unsigned char KeyWaitRegister;
+    uint16_t KeysHeld;
+    
+    //
+    // Random number state for CXKK. Every machine has its own so several can run side by
+    // side, and a given seed always gives the same run.
+    //
+    
+    uint32_t RandomState;
+    
+    //
+    // Bit N set when display row N changed since the frontend last took the dirty rows.
+    //
+    
+    uint64_t DirtyRows;
+    bool DrawFlag;
+    
+    //
+    // 128x64 after 00FF, back to 64x32 after 00FE. Switching clears the display.
+    //
+    
+    bool HiRes;
+};
+
+static_assert(std::is_trivially_copyable<Chip8State>::value, "Chip8State has to stay memcpy-able");
+
+class Chip8;
+
+//
+// An instruction as it sits in the decode cache. Opcode fields are pulled apart once when the
+// instruction is first decoded so the handlers never have to mask anything out themselves.
+//
+
+struct DecodedInstruction;
+
+typedef void (*OpcodeHandler)(Chip8 &Cpu, const DecodedInstruction &Instruction);
+
+struct DecodedInstruction {
+    OpcodeHandler Handler;
+    unsigned short Opcode;
+    unsigned short Nnn;
+    unsigned char X;
+    unsigned char Y;
+    unsigned char N;
+    unsigned char Kk;
+};
 
 class Chip8 {
     
+    friend class Chip8Jit;
+    friend class Chip8Static;
+    
 private:
     
-    unsigned char Memory[4096];
+    Chip8State State;
     
-    unsigned char *ProgramEnd;
+    unsigned short Opcode;
     
-    unsigned char *FontsetLocation;
+    //
+    // One entry per address, filled in the first time the program counter lands there.
+    // Anything that writes to Memory has to invalidate the entries it overlaps.
+    //
     
-    unsigned char VRegisters[16];
+    DecodedInstruction DecodeCache[4096];
     
-    unsigned short IndexRegister;
+    Chip8Jit *Jit;
     
-    unsigned short ProgramCounter;
+    //
+    // NULL unless a recompiled program is attached, see Chip8Static.h.
+    //
     
-    unsigned char DelayTimer;
-    unsigned char SoundTimer;
+    Chip8Static *Static;
     
-    std::vector<short> Stack;
+    //
+    // NULL unless profiling is switched on, see Chip8Profiler.h.
+    //
     
-    unsigned short StackPointer;
+    Chip8Profiler *Profiler;
     
-    unsigned char Key[16];
+    //
+    // NULL until a trace is switched on, see Chip8Trace.h.
+    //
     
-    unsigned short Opcode;
+    Chip8Trace *Trace;
     
-    bool DrawFlag;
+    //
+    // Idle loops are loops that only poll the delay timer or the keys, like FX07 3X00 1NNN,
+    // and can't get out until one of them changes, which is never in the middle of a Run.
+    // When a jump back to the top of one finds a trip around the loop would leave every
+    // register as it is, it sets IdleLoopLength to the instructions in one trip and Run
+    // counts off as many whole trips as fit in what's left of the frame without running
+    // them. The machine ends up exactly where running them would have left it.
+    //
     
-    typedef enum RegisterLocationInOpcode {
-        First,
-        Second
-    };
+    bool IdleSkip;
+    unsigned int IdleLoopLength;
+    unsigned long long IdleCyclesSkipped;
+    
+    //
+    // Cycles handed to Run or EmulateCycle while the machine sat waiting on FX0A.
+    //
+    
+    unsigned long long KeyWaitCyclesPassed;
+    
+    //
+    // The quirk profile, and Decode for it. Switching profiles flushes everything decoded
+    // or compiled under the old one.
+    //
+    
+    Chip8QuirkProfile Quirks;
+    void (Chip8::*Decoder)(unsigned short Address, DecodedInstruction *Instruction);
     
     typedef enum RegisterOperation {
         Add,
         Subtract
     };
     
-    unsigned short GetRegister(RegisterLocationInOpcode RegLoc);
+    void Decode(unsigned short Address, DecodedInstruction *Instruction) {(this->*Decoder)(Address, Instruction);};
+    template <typename Profile> void DecodeFor(unsigned short Address, DecodedInstruction *Instruction);
+    void InvalidateDecodeCache(unsigned short Address, unsigned short Length);
+    
     void CheckAndSetCarry(unsigned short Value1,
                           unsigned short Value2,
                           RegisterOperation Operator);
     void SetCarry(int OneOrZero);
     void SkipNextInstruction();
-    void DrawSprites();
+    uint32_t NextRandom();
+    bool Step();
+    bool Halted() {return State.ProgramCounter == State.ProgramEnd || State.Fault != FAULT_NONE;};
+    template <typename Profile> void DrawSprites(unsigned char RegisterNum1, unsigned char RegisterNum2, unsigned char SpriteRows);
+    template <typename Profile> void DrawSpritesHiRes(unsigned char RegisterNum1, unsigned char RegisterNum2, unsigned char SpriteRows);
+    void SetHiRes(bool HiRes);
+    void TraceInstruction(unsigned short Address, const DecodedInstruction &Instruction);
+    bool IdleLoopCandidate(unsigned short JumpAddress);
+    unsigned int MeasureIdleLoop(unsigned short JumpAddress);
+    bool CanSkipIdle();
+    bool StillWaitingForKey();
+    void PassKeyWaitCycles(unsigned long Cycles);
     
-    unsigned char GetKeyNum(SDL_Keysym Symbol);
+    static void OpNop(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpClearScreen(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpScrollDown(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpScrollRight(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpScrollLeft(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpExit(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpLowRes(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpHighRes(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpReturn(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpJump(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpIdleJump(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpCall(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpSkipIfEqualValue(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpSkipIfNotEqualValue(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpSkipIfRegistersEqual(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpSetRegister(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpAddToRegister(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpMove(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    template <typename Profile> static void OpOr(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    template <typename Profile> static void OpAnd(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    template <typename Profile> static void OpXor(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpAddRegisters(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpSubtractRegisters(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    template <typename Profile> static void OpShiftRight(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpSubtractReversed(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    template <typename Profile> static void OpShiftLeft(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpSkipIfRegistersNotEqual(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpSetIndex(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    template <typename Profile> static void OpJumpPlusV0(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpRandom(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    template <typename Profile> static void OpDraw(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpSkipIfKeyPressed(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpSkipIfKeyNotPressed(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpGetDelayTimer(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpWaitForKey(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpSetDelayTimer(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpSetSoundTimer(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpAddToIndex(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpSetIndexToCharacter(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    static void OpStoreBcd(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    template <typename Profile> static void OpStoreRegisters(Chip8 &Cpu, const DecodedInstruction &Instruction);
+    template <typename Profile> static void OpLoadRegisters(Chip8 &Cpu, const DecodedInstruction &Instruction);
     
     
+    Chip8(const Chip8 &Other);
+    Chip8 &operator=(const Chip8 &Other);
+    
 public:
+    Chip8();
+    ~Chip8();
+    
+    static void *operator new(size_t Size);
+    static void operator delete(void *Block);
+    
     void Initialize();
     bool EmulateCycle(unsigned char *KeyboardState);
+    unsigned long Run(unsigned char *KeyboardState, unsigned long Cycles);
+    void TickTimers();
+    void SeedRandom(uint32_t Seed);
+    void SetJitEnabled(bool Enabled);
+    bool JitEnabled() {return Jit != NULL;};
+    
+    //
+    // Run the blocks of a recompiled ROM where they match memory, before the JIT or the
+    // interpreter get a look. NULL detaches it. The program has to outlive the machine.
+    //
+    
+    void SetStaticProgram(const StaticProgram *Program);
+    bool StaticProgramAttached() {return Static != NULL;};
+    void SetProfilerEnabled(bool Enabled);
+    bool ProfilerEnabled() {return Profiler != NULL;};
+    void WriteProfileReport(FILE *Out, int HotSpots = PROFILER_DEFAULT_HOT_SPOTS);
+    void ResetProfile();
+    void EnableTrace(uint32_t Categories, size_t Capacity = TRACE_DEFAULT_CAPACITY);
+    Chip8Trace *GetTrace() {return Trace;};
+    
+    //
+    // Idle loop skipping is on by default, it never changes where a machine ends up. It's
+    // off while profiling or tracing instructions, which want to see every one.
+    //
+    
+    void SetIdleSkipEnabled(bool Enabled) {IdleSkip = Enabled;};
+    bool IdleSkipEnabled() {return IdleSkip;};
+    unsigned long long IdleCycles() {return IdleCyclesSkipped;};
+    
+    //
+    // True while FX0A is waiting for a key press. Nothing but the timers can change until
+    // one comes, so a frontend with nothing else to do can sleep on its input instead of
+    // running frames.
+    //
+    
+    bool WaitingForKey() {return State.WaitingForKey;};
+    unsigned long long KeyWaitCycles() {return KeyWaitCyclesPassed;};
+    
+    //
+    // Which interpreter's quirks to follow, see Chip8Quirks.h. Meant to be picked once when
+    // the ROM is loaded, it's not part of Chip8State. Initialize leaves it alone, but save
+    // states record it and LoadState puts it back.
+    //
+    
+    void SetQuirkProfile(Chip8QuirkProfile Profile);
+    Chip8QuirkProfile QuirkProfile() {return Quirks;};
+    
+    bool CompareState(const Chip8 &Other);
+    static bool CompareStates(const Chip8State &First, const Chip8State &Second);
     void DebugDumpState();
     bool LoadRom (char* FileName);
+    bool LoadProgram(const unsigned char *Program, size_t Length);
+    
+    void SaveState(std::vector<unsigned char> &Blob);
+    bool LoadState(const unsigned char *Blob, size_t Length);
+    bool SaveState(const char *FileName);
+    bool LoadState(const char *FileName);
     void HandleKeyboard (unsigned char Key, int x, int y);
-    bool Draw() {return DrawFlag;};
+    bool Draw() {return State.DrawFlag;};
+    uint64_t TakeDirtyRows();
+    
+    unsigned char GetRegister(int Register) {return State.VRegisters[Register & 0xF];};
+    unsigned short GetIndexRegister() {return State.IndexRegister;};
+    unsigned short GetProgramCounter() {return State.ProgramCounter;};
+    const uint64_t *GetGraphics() {return State.Graphics;};
+    bool HiRes() {return State.HiRes;};
+    Chip8Fault GetFault() {return (Chip8Fault) State.Fault;};
+    static const char *FaultMessage(Chip8Fault Fault);
+    
+    //
+    // The whole machine state, for snapshots and for forking one machine into several.
+    // SetState is a memcpy, plus a decode cache flush if the memory differs.
+    //
     
-    unsigned char Graphics[64 * 32];
+    const Chip8State &GetState() {return State;};
+    void SetState(const Chip8State &NewState);
     
 };
 
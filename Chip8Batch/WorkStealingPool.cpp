@@ -0,0 +1,100 @@
+//
+//  WorkStealingPool.cpp
+//  Chip8Batch
+//
+
+#include <thread>
+
+#include "WorkStealingPool.h"
+
+WorkStealingPool::WorkStealingPool(unsigned int ThreadCount)
+{
+    if (ThreadCount == 0) {
+        ThreadCount = 1;
+    }
+    
+    for (unsigned int Worker = 0; Worker < ThreadCount; ++Worker) {
+        Queues.push_back(new WorkerQueue());
+    }
+    
+    NextQueue = 0;
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    for (size_t Worker = 0; Worker < Queues.size(); ++Worker) {
+        delete Queues[Worker];
+    }
+}
+
+void WorkStealingPool::Submit(const std::function<void()> &Task)
+{
+    //
+    // Deal tasks out round robin, stealing evens out whatever imbalance is left.
+    //
+    
+    Queues[NextQueue]->Tasks.push_back(Task);
+    NextQueue = (NextQueue + 1) % Queues.size();
+}
+
+void WorkStealingPool::Run()
+{
+    std::vector<std::thread> Threads;
+    
+    //
+    // The calling thread works too, as worker 0.
+    //
+    
+    for (size_t Worker = 1; Worker < Queues.size(); ++Worker) {
+        Threads.push_back(std::thread(&WorkStealingPool::WorkerLoop, this, Worker));
+    }
+    
+    WorkerLoop(0);
+    
+    for (size_t Thread = 0; Thread < Threads.size(); ++Thread) {
+        Threads[Thread].join();
+    }
+}
+
+bool WorkStealingPool::TakeTask(size_t Worker, std::function<void()> &Task)
+{
+    //
+    // Our own queue first, newest task first. Then everyone else's, oldest first, starting
+    // with our neighbour so the thieves don't all pile onto the same queue.
+    //
+    
+    for (size_t Offset = 0; Offset < Queues.size(); ++Offset) {
+        
+        WorkerQueue *Queue = Queues[(Worker + Offset) % Queues.size()];
+        std::lock_guard<std::mutex> Guard(Queue->Lock);
+        
+        if (Queue->Tasks.empty()) {
+            continue;
+        }
+        
+        if (Offset == 0) {
+            Task = Queue->Tasks.back();
+            Queue->Tasks.pop_back();
+        } else {
+            Task = Queue->Tasks.front();
+            Queue->Tasks.pop_front();
+        }
+        
+        return true;
+    }
+    
+    return false;
+}
+
+void WorkStealingPool::WorkerLoop(size_t Worker)
+{
+    std::function<void()> Task;
+    
+    //
+    // Nothing adds tasks once we're running, so once every queue is empty we're done.
+    //
+    
+    while (TakeTask(Worker, Task)) {
+        Task();
+    }
+}
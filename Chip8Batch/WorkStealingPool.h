@@ -0,0 +1,55 @@
+//
+//  WorkStealingPool.h
+//  Chip8Batch
+//
+
+#ifndef __Chip8Batch__WorkStealingPool__
+#define __Chip8Batch__WorkStealingPool__
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+//
+// Runs a fixed set of independent tasks across a number of threads. Every thread has its own
+// queue and works through it from the back. When it runs dry it steals from the front of
+// somebody else's, so threads that drew short jobs help out with the long ones instead of
+// sitting idle. All tasks are submitted before Run, tasks can't submit more.
+//
+
+class WorkStealingPool {
+
+private:
+    
+    struct WorkerQueue {
+        std::mutex Lock;
+        std::deque< std::function<void()> > Tasks;
+    };
+    
+    std::vector<WorkerQueue *> Queues;
+    size_t NextQueue;
+    
+    bool TakeTask(size_t Worker, std::function<void()> &Task);
+    void WorkerLoop(size_t Worker);
+    
+    WorkStealingPool(const WorkStealingPool &Other);
+    WorkStealingPool &operator=(const WorkStealingPool &Other);
+
+public:
+    WorkStealingPool(unsigned int ThreadCount);
+    ~WorkStealingPool();
+    
+    void Submit(const std::function<void()> &Task);
+    
+    //
+    // Run everything submitted so far and return once it has all finished.
+    //
+    
+    void Run();
+    
+    unsigned int ThreadCount() {return (unsigned int) Queues.size();};
+    
+};
+
+#endif /* defined(__Chip8Batch__WorkStealingPool__) */
@@ -0,0 +1,644 @@
+//
+//  main.cpp
+//  Chip8Batch
+//
+
+//
+// Batch runner. Reads a manifest of jobs, runs each one on its own Chip8 across every core
+// and prints where each machine ended up, so a whole ROM collection can be checked against
+// known good results in one go. Manifest lines are
+//
+//     <rom> <input script or -> <cycles>
+//
+// and lines starting with '#' are comments. Results come out in manifest order, one line per
+// job: rom, instructions run, a hash of the final framebuffer, PC, I and V0-VF.
+//
+// Each ROM is mapped once and shared by every job that runs it. With --index, ROMs are looked
+// up in a ROM library index (see RomLibrary.h) first, which only stats files it already knows
+// and gives each game its own instructions per frame and quirk profile if the index has them.
+//
+// --lockstep runs jobs that share a ROM and instructions per frame as lanes of a
+// Chip8Lockstep instead, up to LOCKSTEP_GROUP_LANES to a task, with the same results. Lanes
+// only have the default quirk profile, so jobs with any other still run on a Chip8 each.
+// --verify runs a Chip8 next to every lane and fails any job whose lane ever differs from it
+// at the end of a frame.
+//
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Chip8.h"
+#include "Chip8Lockstep.h"
+#include "InputScript.h"
+#include "RomLibrary.h"
+#include "WorkStealingPool.h"
+
+#define DEFAULT_CYCLES_PER_FRAME (10)
+#define DEFAULT_SEED (1)
+
+//
+// Lanes per lockstep task. Enough blocks to be worth setting up, few enough that a big
+// manifest still spreads across every core.
+//
+
+#define LOCKSTEP_GROUP_LANES (8 * LOCKSTEP_BLOCK_LANES)
+
+struct BatchJob {
+    std::string RomFileName;
+    std::string ScriptFileName;
+    unsigned long CycleBudget;
+    
+    //
+    // Filled in before the pool starts. The image is shared with every other job running the
+    // same ROM.
+    //
+    
+    const RomImage *Rom;
+    unsigned long CyclesPerFrame;
+    Chip8QuirkProfile Quirks;
+    
+    //
+    // Filled in by whichever thread ran the job.
+    //
+    
+    std::string Error;
+    unsigned long CyclesRun;
+    uint64_t FramebufferHash;
+    unsigned char VRegisters[16];
+    unsigned short IndexRegister;
+    unsigned short ProgramCounter;
+};
+
+//
+// Jobs run together as the lanes of one Chip8Lockstep, and how their instructions ran.
+//
+
+struct LockstepGroup {
+    std::vector<BatchJob *> Jobs;
+    bool Verify;
+    unsigned long long VectorInstructions;
+    unsigned long long ScalarInstructions;
+};
+
+bool LoadManifest(const char *FileName, std::vector<BatchJob> &Jobs);
+void RunJob(BatchJob *Job, uint32_t Seed, bool UseJit);
+void RunLockstepGroup(LockstepGroup *Group, uint32_t Seed);
+void RecordResult(BatchJob *Job, const Chip8State &State);
+uint64_t HashFramebuffer(const uint64_t *Graphics, bool HiRes);
+void PrintUsage(const char *ProgramName);
+
+int main(int argc, char * argv[])
+{
+    std::vector<BatchJob> Jobs;
+    char *ManifestFileName = NULL;
+    char *IndexFileName = NULL;
+    RomLibrary Library;
+    std::map<std::string, RomImage *> Roms;
+    bool CyclesPerFrameGiven = false;
+    unsigned int ThreadCount = std::thread::hardware_concurrency();
+    unsigned long CyclesPerFrame = DEFAULT_CYCLES_PER_FRAME;
+    uint32_t Seed = DEFAULT_SEED;
+    bool UseJit = false;
+    bool Lockstep = false;
+    bool Verify = false;
+    std::vector<LockstepGroup> Groups;
+    size_t LoneJobs = 0;
+    unsigned long long VectorInstructions = 0;
+    unsigned long long ScalarInstructions = 0;
+    unsigned long TotalCycles = 0;
+    int Failures = 0;
+    
+    for (int ArgIndex = 1; ArgIndex < argc; ++ArgIndex) {
+        
+        if (strcmp(argv[ArgIndex], "--threads") == 0 && ArgIndex + 1 < argc) {
+            ThreadCount = (unsigned int) strtoul(argv[++ArgIndex], NULL, 0);
+            
+        } else if (strcmp(argv[ArgIndex], "--ipf") == 0 && ArgIndex + 1 < argc) {
+            CyclesPerFrame = strtoul(argv[++ArgIndex], NULL, 0);
+            CyclesPerFrameGiven = true;
+            
+        } else if (strcmp(argv[ArgIndex], "--seed") == 0 && ArgIndex + 1 < argc) {
+            Seed = (uint32_t) strtoul(argv[++ArgIndex], NULL, 0);
+            
+        } else if (strcmp(argv[ArgIndex], "--index") == 0 && ArgIndex + 1 < argc) {
+            IndexFileName = argv[++ArgIndex];
+            
+        } else if (strcmp(argv[ArgIndex], "--jit") == 0) {
+            UseJit = true;
+            
+        } else if (strcmp(argv[ArgIndex], "--lockstep") == 0) {
+            Lockstep = true;
+            
+        } else if (strcmp(argv[ArgIndex], "--verify") == 0) {
+            Verify = true;
+            
+        } else if (argv[ArgIndex][0] != '-' && ManifestFileName == NULL) {
+            ManifestFileName = argv[ArgIndex];
+            
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (ManifestFileName == NULL || CyclesPerFrame == 0 || (Verify && !Lockstep) || (Lockstep && UseJit)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    
+    if (ThreadCount == 0) {
+        ThreadCount = 1;
+    }
+    
+    if (!LoadManifest(ManifestFileName, Jobs)) {
+        fprintf(stderr, "Couldn't read manifest %s\n", ManifestFileName);
+        return 1;
+    }
+    
+    //
+    // Map every distinct ROM once, up front. A ROM the index already knows isn't read here at
+    // all, its pages only come in when a job loads it.
+    //
+    
+    if (IndexFileName != NULL) {
+        Library.LoadIndex(IndexFileName);
+    }
+    
+    for (size_t JobIndex = 0; JobIndex < Jobs.size(); ++JobIndex) {
+        
+        BatchJob &Job = Jobs[JobIndex];
+        RomStatus Status = ROM_OK;
+        RomInfo Info;
+        
+        Job.Rom = NULL;
+        Job.CyclesPerFrame = CyclesPerFrame;
+        Job.Quirks = QUIRKS_DEFAULT;
+        
+        if (IndexFileName != NULL) {
+            
+            Status = Library.Lookup(Job.RomFileName.c_str(), &Info);
+            
+            if (Status == ROM_OK && Info.CyclesPerFrame != 0 && !CyclesPerFrameGiven) {
+                Job.CyclesPerFrame = Info.CyclesPerFrame;
+            }
+            
+            if (Status == ROM_OK && !ParseQuirkProfile(Info.Quirks.c_str(), &Job.Quirks)) {
+                Job.Error = "unknown quirk profile " + Info.Quirks;
+                continue;
+            }
+        }
+        
+        if (Status == ROM_OK && Roms.find(Job.RomFileName) == Roms.end()) {
+            
+            RomImage *Image = new RomImage();
+            
+            Status = Image->Open(Job.RomFileName.c_str());
+            
+            if (Status == ROM_OK) {
+                Roms[Job.RomFileName] = Image;
+            } else {
+                delete Image;
+            }
+        }
+        
+        if (Status != ROM_OK) {
+            Job.Error = std::string("couldn't load ROM: ") + RomImage::StatusMessage(Status);
+            continue;
+        }
+        
+        Job.Rom = Roms[Job.RomFileName];
+    }
+    
+    if (IndexFileName != NULL && Library.IndexChanged() && !Library.SaveIndex(IndexFileName)) {
+        fprintf(stderr, "Couldn't write ROM index %s\n", IndexFileName);
+    }
+    
+    //
+    // The jobs vector doesn't change size from here on, so pointers into it stay good while
+    // the pool runs. Lockstep groups fill up in manifest order, a new one starting whenever
+    // the last one for that ROM and frame size is full.
+    //
+    
+    if (Lockstep) {
+        
+        std::map<std::pair<const RomImage *, unsigned long>, size_t> OpenGroups;
+        
+        for (size_t JobIndex = 0; JobIndex < Jobs.size(); ++JobIndex) {
+            
+            BatchJob *Job = &Jobs[JobIndex];
+            std::pair<const RomImage *, unsigned long> Key(Job->Rom, Job->CyclesPerFrame);
+            
+            if (Job->Rom == NULL) {
+                continue;
+            }
+            
+            if (Job->Quirks != QUIRKS_DEFAULT) {
+                ++LoneJobs;
+                continue;
+            }
+            
+            if (OpenGroups.find(Key) == OpenGroups.end() || Groups[OpenGroups[Key]].Jobs.size() == LOCKSTEP_GROUP_LANES) {
+                
+                LockstepGroup NewGroup;
+                
+                NewGroup.Verify = Verify;
+                NewGroup.VectorInstructions = 0;
+                NewGroup.ScalarInstructions = 0;
+                
+                OpenGroups[Key] = Groups.size();
+                Groups.push_back(NewGroup);
+            }
+            
+            Groups[OpenGroups[Key]].Jobs.push_back(Job);
+        }
+    }
+    
+    size_t TaskCount = Lockstep ? Groups.size() + LoneJobs : Jobs.size();
+    WorkStealingPool Pool(std::min(ThreadCount, (unsigned int) std::max(TaskCount, (size_t) 1)));
+    
+    for (size_t GroupIndex = 0; GroupIndex < Groups.size(); ++GroupIndex) {
+        LockstepGroup *Group = &Groups[GroupIndex];
+        
+        Pool.Submit([=]() {RunLockstepGroup(Group, Seed);});
+    }
+    
+    for (size_t JobIndex = 0; JobIndex < Jobs.size(); ++JobIndex) {
+        BatchJob *Job = &Jobs[JobIndex];
+        
+        if (Job->Rom != NULL && (!Lockstep || Job->Quirks != QUIRKS_DEFAULT)) {
+            Pool.Submit([=]() {RunJob(Job, Seed, UseJit);});
+        }
+    }
+    
+    std::chrono::steady_clock::time_point StartTime = std::chrono::steady_clock::now();
+    
+    Pool.Run();
+    
+    std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - StartTime;
+    
+    for (size_t JobIndex = 0; JobIndex < Jobs.size(); ++JobIndex) {
+        
+        BatchJob &Job = Jobs[JobIndex];
+        
+        if (!Job.Error.empty()) {
+            printf("%s\terror\t%s\n", Job.RomFileName.c_str(), Job.Error.c_str());
+            ++Failures;
+            continue;
+        }
+        
+        printf("%s\t%lu\t%016llx\tpc=%03X\ti=%03X\tv=",
+               Job.RomFileName.c_str(),
+               Job.CyclesRun,
+               (unsigned long long) Job.FramebufferHash,
+               Job.ProgramCounter,
+               Job.IndexRegister);
+        
+        for (int Register = 0; Register < 16; ++Register) {
+            printf("%02X", Job.VRegisters[Register]);
+        }
+        
+        printf("\n");
+        
+        TotalCycles += Job.CyclesRun;
+    }
+    
+    fprintf(stderr,
+            "%lu jobs on %u threads, %lu instructions in %.3f seconds (%.0f instr/sec)\n",
+            (unsigned long) Jobs.size(),
+            Pool.ThreadCount(),
+            TotalCycles,
+            Elapsed.count(),
+            Elapsed.count() > 0 ? TotalCycles / Elapsed.count() : 0.0);
+    
+    for (size_t GroupIndex = 0; GroupIndex < Groups.size(); ++GroupIndex) {
+        VectorInstructions += Groups[GroupIndex].VectorInstructions;
+        ScalarInstructions += Groups[GroupIndex].ScalarInstructions;
+    }
+    
+    if (Lockstep) {
+        fprintf(stderr,
+                "lockstep: %lu groups, %s, %.1f%% of instructions in vector steps\n",
+                (unsigned long) Groups.size(),
+                Chip8Lockstep::VectorAvailable() ? "AVX2" : "scalar only",
+                VectorInstructions + ScalarInstructions > 0 ? 100.0 * VectorInstructions / (VectorInstructions + ScalarInstructions) : 0.0);
+    }
+    
+    for (std::map<std::string, RomImage *>::iterator Rom = Roms.begin(); Rom != Roms.end(); ++Rom) {
+        delete Rom->second;
+    }
+    
+    return Failures == 0 ? 0 : 2;
+}
+
+bool LoadManifest(const char *FileName, std::vector<BatchJob> &Jobs)
+{
+    FILE *Manifest;
+    char Line[1024];
+    char RomFileName[512];
+    char ScriptFileName[512];
+    unsigned long CycleBudget;
+    
+    Manifest = fopen(FileName, "r");
+    
+    if (Manifest == NULL) {
+        return false;
+    }
+    
+    while (fgets(Line, sizeof(Line), Manifest) != NULL) {
+        
+        if (Line[0] == '#') {
+            continue;
+        }
+        
+        if (sscanf(Line, "%511s %511s %lu", RomFileName, ScriptFileName, &CycleBudget) != 3) {
+            continue;
+        }
+        
+        BatchJob NewJob;
+        
+        NewJob.RomFileName = RomFileName;
+        NewJob.ScriptFileName = strcmp(ScriptFileName, "-") == 0 ? "" : ScriptFileName;
+        NewJob.CycleBudget = CycleBudget;
+        NewJob.CyclesRun = 0;
+        NewJob.FramebufferHash = 0;
+        
+        Jobs.push_back(NewJob);
+    }
+    
+    fclose(Manifest);
+    
+    return true;
+}
+
+//
+// Same frame loop as the headless runner: input changes on frame boundaries and the timers
+// tick once a frame. Everything the machine needs lives in the machine, so any number of
+// these can run at once.
+//
+void RunJob(BatchJob *Job, uint32_t Seed, bool UseJit)
+{
+    Chip8 *Cpu;
+    InputScript Script;
+    unsigned char Keyboard[16];
+    unsigned long Frame = 0;
+    unsigned long FrameCycles;
+    unsigned long FrameCyclesRun;
+    
+    if (!Job->ScriptFileName.empty() && !Script.Load(Job->ScriptFileName.c_str())) {
+        Job->Error = "couldn't read input script " + Job->ScriptFileName;
+        return;
+    }
+    
+    Cpu = new Chip8();
+    Cpu->Initialize();
+    Cpu->SeedRandom(Seed);
+    
+    Cpu->LoadProgram(Job->Rom->Bytes(), Job->Rom->Size());
+    
+    Cpu->SetQuirkProfile(Job->Quirks);
+    Cpu->SetJitEnabled(UseJit);
+    
+    memset(Keyboard, 0, 16 * sizeof(unsigned char));
+    
+    while (Job->CyclesRun < Job->CycleBudget) {
+        
+        Script.KeysForFrame(Frame, Keyboard);
+        
+        FrameCycles = std::min(Job->CyclesPerFrame, Job->CycleBudget - Job->CyclesRun);
+        FrameCyclesRun = Cpu->Run(Keyboard, FrameCycles);
+        Job->CyclesRun += FrameCyclesRun;
+        
+        Cpu->TickTimers();
+        
+        if (FrameCyclesRun != FrameCycles) {
+            break;
+        }
+        
+        ++Frame;
+    }
+    
+    RecordResult(Job, Cpu->GetState());
+    
+    delete Cpu;
+}
+
+//
+// The same frame loop as RunJob for every job in the group at once, one lane each. Jobs
+// whose input script won't load never get a lane.
+//
+void RunLockstepGroup(LockstepGroup *Group, uint32_t Seed)
+{
+    std::vector<BatchJob *> Jobs;
+    std::vector<InputScript> Scripts(Group->Jobs.size());
+    std::vector<Chip8 *> Checks;
+    std::vector<unsigned long> CheckCycles;
+    std::vector<unsigned short> KeyMasks;
+    Chip8Lockstep *Machines;
+    Chip8State State;
+    unsigned char Keyboard[16];
+    unsigned long CyclesPerFrame = Group->Jobs[0]->CyclesPerFrame;
+    unsigned long Frame = 0;
+    bool Running = true;
+    
+    for (size_t JobIndex = 0; JobIndex < Group->Jobs.size(); ++JobIndex) {
+        
+        BatchJob *Job = Group->Jobs[JobIndex];
+        
+        if (!Job->ScriptFileName.empty() && !Scripts[Jobs.size()].Load(Job->ScriptFileName.c_str())) {
+            Job->Error = "couldn't read input script " + Job->ScriptFileName;
+            Scripts[Jobs.size()] = InputScript();
+            continue;
+        }
+        
+        Jobs.push_back(Job);
+    }
+    
+    if (Jobs.empty()) {
+        return;
+    }
+    
+    KeyMasks.assign(Jobs.size(), 0);
+    
+    Machines = new Chip8Lockstep(Jobs.size());
+    Machines->LoadProgram(Jobs[0]->Rom->Bytes(), Jobs[0]->Rom->Size());
+    
+    for (size_t Lane = 0; Lane < Jobs.size(); ++Lane) {
+        
+        Machines->SeedRandom(Lane, Seed);
+        Machines->SetCycleBudget(Lane, Jobs[Lane]->CycleBudget);
+        
+        if (Group->Verify) {
+            
+            Chip8 *Check = new Chip8();
+            
+            Check->Initialize();
+            Check->SeedRandom(Seed);
+            Check->LoadProgram(Jobs[Lane]->Rom->Bytes(), Jobs[Lane]->Rom->Size());
+            
+            Checks.push_back(Check);
+            CheckCycles.push_back(0);
+        }
+    }
+    
+    memset(Keyboard, 0, sizeof(Keyboard));
+    
+    while (Running) {
+        
+        //
+        // Keys only go into a lane when its script changes them, most frames they don't.
+        //
+        
+        for (size_t Lane = 0; Lane < Jobs.size(); ++Lane) {
+            
+            unsigned short KeyMask;
+            
+            if (Machines->LaneDone(Lane)) {
+                continue;
+            }
+            
+            KeyMask = Scripts[Lane].KeyMaskForFrame(Frame);
+            
+            if (Frame == 0 || KeyMask != KeyMasks[Lane]) {
+                
+                for (int Key = 0; Key < 16; ++Key) {
+                    Keyboard[Key] = (KeyMask >> Key) & 1;
+                }
+                
+                Machines->SetKeys(Lane, Keyboard);
+                KeyMasks[Lane] = KeyMask;
+            }
+        }
+        
+        Running = Machines->RunFrame(CyclesPerFrame);
+        
+        //
+        // Step every check machine through the same frame, exactly as RunJob would, and
+        // compare. The first difference is the one worth reporting.
+        //
+        
+        for (size_t Lane = 0; Lane < Checks.size(); ++Lane) {
+            
+            BatchJob *Job = Jobs[Lane];
+            unsigned long FrameCycles;
+            
+            unsigned long FrameCyclesRun;
+            
+            if (Checks[Lane] == NULL || CheckCycles[Lane] >= Job->CycleBudget) {
+                continue;
+            }
+            
+            Scripts[Lane].KeysForFrame(Frame, Keyboard);
+            
+            FrameCycles = std::min(CyclesPerFrame, Job->CycleBudget - CheckCycles[Lane]);
+            FrameCyclesRun = Checks[Lane]->Run(Keyboard, FrameCycles);
+            CheckCycles[Lane] += FrameCyclesRun;
+            Checks[Lane]->TickTimers();
+            
+            Machines->GetState(Lane, &State);
+            
+            if (!Chip8::CompareStates(State, Checks[Lane]->GetState()) || CheckCycles[Lane] != Machines->LaneCyclesRun(Lane)) {
+                
+                char Message[64];
+                
+                snprintf(Message, sizeof(Message), "lockstep differs from the interpreter at frame %lu", Frame);
+                Job->Error = Message;
+                
+                delete Checks[Lane];
+                Checks[Lane] = NULL;
+                
+            } else if (FrameCyclesRun != FrameCycles) {
+                
+                //
+                // Halted or faulted, RunJob would stop here.
+                //
+                
+                delete Checks[Lane];
+                Checks[Lane] = NULL;
+            }
+        }
+        
+        ++Frame;
+    }
+    
+    for (size_t Lane = 0; Lane < Jobs.size(); ++Lane) {
+    
+        Machines->GetState(Lane, &State);
+        
+        Jobs[Lane]->CyclesRun = Machines->LaneCyclesRun(Lane);
+        
+        if (Jobs[Lane]->Error.empty()) {
+            RecordResult(Jobs[Lane], State);
+        }
+    }
+    
+    for (size_t Lane = 0; Lane < Checks.size(); ++Lane) {
+        delete Checks[Lane];
+    }
+    
+    Group->VectorInstructions = Machines->VectorInstructions();
+    Group->ScalarInstructions = Machines->ScalarInstructions();
+    
+    delete Machines;
+}
+
+//
+// Where a machine ended up, or why it stopped if it faulted.
+//
+void RecordResult(BatchJob *Job, const Chip8State &State)
+{
+    if (State.Fault != FAULT_NONE) {
+        
+        char Message[64];
+        
+        snprintf(Message, sizeof(Message), "%s at %03X", Chip8::FaultMessage((Chip8Fault) State.Fault), State.ProgramCounter);
+        Job->Error = Message;
+    }
+    
+    Job->FramebufferHash = HashFramebuffer(State.Graphics, State.HiRes);
+    Job->IndexRegister = State.IndexRegister;
+    Job->ProgramCounter = State.ProgramCounter;
+    
+    for (int Register = 0; Register < 16; ++Register) {
+        Job->VRegisters[Register] = State.VRegisters[Register];
+    }
+}
+
+//
+// 64 bit FNV-1a over the display words the mode uses.
+//
+uint64_t HashFramebuffer(const uint64_t *Graphics, bool HiRes)
+{
+    uint64_t Hash = 0xCBF29CE484222325ull;
+    
+    for (int Word = 0; Word < GRAPHICS_USED_WORDS(HiRes); ++Word) {
+        for (int Byte = 0; Byte < 8; ++Byte) {
+            Hash ^= (Graphics[Word] >> (Byte * 8)) & 0xFF;
+            Hash *= 0x100000001B3ull;
+        }
+    }
+    
+    return Hash;
+}
+
+void PrintUsage(const char *ProgramName)
+{
+    fprintf(stderr,
+            "Usage: %s <manifest> [--threads N] [--ipf N] [--seed N] [--index F] [--jit | --lockstep [--verify]]\n"
+            "    --threads N  worker threads (default one per core)\n"
+            "    --ipf N      instructions per frame (default %d, or the index's per ROM setting)\n"
+            "    --seed N     random seed every job starts from (default %d)\n"
+            "    --index F    ROM library index to look ROMs up in and add new ones to\n"
+            "    --jit        run compiled blocks where possible\n"
+            "    --lockstep   run jobs sharing a ROM side by side in a Chip8Lockstep\n"
+            "    --verify     with --lockstep, check every lane against a Chip8 each frame\n",
+            ProgramName,
+            DEFAULT_CYCLES_PER_FRAME,
+            DEFAULT_SEED);
+}
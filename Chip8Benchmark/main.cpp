@@ -0,0 +1,671 @@
+//
+//  main.cpp
+//  Chip8Benchmark
+//
+
+//
+// Microbenchmarks for the core. Each benchmark runs a few warmup samples that are thrown
+// away, then a number of timed samples, and reports the min, median, mean and standard
+// deviation of the time per unit (an instruction, a frame). Covers:
+//
+//     opcode/...   EmulateCycle on a loop of one instruction class
+//     draw/...     DXYN across sprite heights, aligned, unaligned and wrapping, and the
+//                  16x16 DXY0 on the hi-res display
+//     raster/...   TransferGraphicsToPixels, whole frames and single rows, both displays
+//     rom/...      whole frames of the bundled ROMs, rasterizing whatever changed
+//     env/...      Chip8VecEnv steps on the bundled ROMs, one thread per core, plain and
+//                  lockstep
+//
+// --json prints one JSON object per line instead of a table, for comparing builds.
+//
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "Chip8.h"
+#include "Chip8Env.h"
+#include "Rasterizer.h"
+#include "RomLibrary.h"
+
+#define DEFAULT_SAMPLES (10)
+#define DEFAULT_WARMUP (2)
+#define DEFAULT_ROM_DIRECTORY "Roms"
+
+#define OPCODE_CYCLES_PER_SAMPLE (2000000)
+#define RASTER_FRAMES_PER_SAMPLE (2000)
+#define ROM_FRAMES_PER_SAMPLE (600)
+#define ROM_CYCLES_PER_FRAME (10)
+
+#define ENV_COUNT (256)
+#define ENV_STEPS_PER_SAMPLE (100)
+#define ENV_FRAME_SKIP (4)
+
+//
+// Instructions in the body of a synthetic loop before it jumps back to the start.
+//
+
+#define LOOP_BODY_INSTRUCTIONS (64)
+#define LOOP_TRAILER_ADDRESS (PROGRAM_START_LOCATION + LOOP_BODY_INSTRUCTIONS * 2 + 2)
+
+struct BenchmarkOptions {
+    unsigned int Samples;
+    unsigned int Warmup;
+    const char *Filter;
+    const char *RomDirectory;
+    bool Json;
+    bool UseJit;
+};
+
+//
+// One sample of a benchmark: do the work and return how many units were done.
+//
+
+typedef double (*SampleFunction)(void *Context);
+
+void RunBenchmark(const BenchmarkOptions &Options, const std::string &Name, const char *Unit, SampleFunction Sample, void *Context);
+void PrintUsage(const char *ProgramName);
+
+//
+// Opcode benchmarks
+//
+
+struct OpcodeBenchmark {
+    const char *Name;
+    unsigned short Body[4];
+};
+
+//
+// What OpcodeSample is handed: a table entry and whether this run uses the JIT.
+//
+
+struct OpcodeRun {
+    const OpcodeBenchmark *Benchmark;
+    bool UseJit;
+};
+
+std::vector<unsigned char> BuildLoopProgram(const unsigned short *Body, int BodyLength, const unsigned char *Trailer, int TrailerLength);
+double OpcodeSample(void *Context);
+double JumpChainSample(void *Context);
+double CallReturnSample(void *Context);
+double RunProgram(const std::vector<unsigned char> &Program, bool UseJit);
+
+static const OpcodeBenchmark OpcodeBenchmarks[] = {
+    {"opcode/6xkk-load",        {0x6A12}},
+    {"opcode/7xkk-add",         {0x7A01}},
+    {"opcode/8xy0-move",        {0x8AB0}},
+    {"opcode/8xy4-add",         {0x8AB4}},
+    {"opcode/8xy5-sub",         {0x8AB5}},
+    {"opcode/3xkk-skip-not",    {0x3AFF}},
+    {"opcode/annn-index",       {0xA300}},
+    {"opcode/fx1e-add-index",   {0xFA1E}},
+    {"opcode/cxkk-random",      {0xCAFF}},
+    {"opcode/fx15-fx07-timers", {0xFA15, 0xFA07}},
+    {"opcode/ex9e-key",         {0xEA9E}},
+    {"opcode/fx33-bcd",         {0xA400, 0xFA33}},
+    {"opcode/fx55-store",       {0xA400, 0xF355}},
+    {"opcode/fx65-load",        {0xA400, 0xF365}},
+    
+    //
+    // The scrolls on the hi-res display, with a sprite drawn each time round so there's
+    // something to move.
+    //
+    
+    {"opcode/00fb-00fc-scroll-hires", {0x00FF, 0xD010, 0x00FB, 0x00FC}},
+    {"opcode/00cn-scroll-down-hires", {0x00FF, 0xD010, 0x00C1}},
+};
+
+//
+// Sprite benchmarks
+//
+
+struct DrawBenchmark {
+    std::string Name;
+    unsigned char X;
+    unsigned char Y;
+    unsigned char Rows;
+    bool HiRes;
+    bool UseJit;
+};
+
+double DrawSample(void *Context);
+
+//
+// Rasterizer and ROM benchmarks
+//
+
+struct RasterBenchmark {
+    uint64_t Graphics[GRAPHICS_WORDS];
+    bool HiRes;
+    uint32_t *Pixels;
+    int RowsPerCall;
+};
+
+double RasterSample(void *Context);
+
+struct RomBenchmark {
+    std::string FileName;
+    uint32_t *Pixels;
+    bool UseJit;
+};
+
+double RomSample(void *Context);
+
+//
+// Environments, buffers and actions are set up once per benchmark, a sample is only steps.
+//
+
+struct EnvBenchmark {
+    Chip8VecEnv *Envs;
+    std::vector<uint32_t> Seeds;
+    std::vector<uint16_t> Actions;
+    std::vector<unsigned char> Observations;
+    std::vector<unsigned char> Dones;
+};
+
+double EnvSample(void *Context);
+
+int main(int argc, char * argv[])
+{
+    BenchmarkOptions Options;
+    
+    Options.Samples = DEFAULT_SAMPLES;
+    Options.Warmup = DEFAULT_WARMUP;
+    Options.Filter = NULL;
+    Options.RomDirectory = DEFAULT_ROM_DIRECTORY;
+    Options.Json = false;
+    Options.UseJit = false;
+    
+    for (int ArgIndex = 1; ArgIndex < argc; ++ArgIndex) {
+        
+        if (strcmp(argv[ArgIndex], "--samples") == 0 && ArgIndex + 1 < argc) {
+            Options.Samples = (unsigned int) strtoul(argv[++ArgIndex], NULL, 0);
+            
+        } else if (strcmp(argv[ArgIndex], "--warmup") == 0 && ArgIndex + 1 < argc) {
+            Options.Warmup = (unsigned int) strtoul(argv[++ArgIndex], NULL, 0);
+            
+        } else if (strcmp(argv[ArgIndex], "--filter") == 0 && ArgIndex + 1 < argc) {
+            Options.Filter = argv[++ArgIndex];
+            
+        } else if (strcmp(argv[ArgIndex], "--roms") == 0 && ArgIndex + 1 < argc) {
+            Options.RomDirectory = argv[++ArgIndex];
+            
+        } else if (strcmp(argv[ArgIndex], "--json") == 0) {
+            Options.Json = true;
+            
+        } else if (strcmp(argv[ArgIndex], "--jit") == 0) {
+            Options.UseJit = true;
+            
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (Options.Samples == 0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    
+    if (!Options.Json) {
+        printf("%-32s %14s %12s %12s %12s %10s %16s\n", "benchmark", "units/sample", "min ns", "median ns", "mean ns", "stddev ns", "units/sec");
+    }
+    
+    //
+    // Instruction classes
+    //
+    
+    for (size_t Index = 0; Index < sizeof(OpcodeBenchmarks) / sizeof(OpcodeBenchmarks[0]); ++Index) {
+        OpcodeRun Run = {&OpcodeBenchmarks[Index], Options.UseJit};
+        
+        RunBenchmark(Options, OpcodeBenchmarks[Index].Name, "instr", OpcodeSample, &Run);
+    }
+    
+    RunBenchmark(Options, "opcode/1nnn-jump", "instr", JumpChainSample, &Options.UseJit);
+    RunBenchmark(Options, "opcode/2nnn-00ee-call-return", "instr", CallReturnSample, &Options.UseJit);
+    
+    //
+    // Sprites: every height we care about, at an aligned spot, an unaligned one and one that
+    // wraps off the right and bottom edges.
+    //
+    
+    const unsigned char SpriteHeights[] = {1, 5, 8, 15};
+    const unsigned char Positions[][2] = {{0, 0}, {3, 5}, {60, 28}};
+    const char *PositionNames[] = {"aligned", "unaligned", "wrapped"};
+    
+    for (size_t Height = 0; Height < sizeof(SpriteHeights); ++Height) {
+        for (size_t Position = 0; Position < 3; ++Position) {
+            
+            DrawBenchmark Benchmark;
+            char Name[64];
+            
+            snprintf(Name, sizeof(Name), "draw/h%d-%s", SpriteHeights[Height], PositionNames[Position]);
+            
+            Benchmark.Name = Name;
+            Benchmark.X = Positions[Position][0];
+            Benchmark.Y = Positions[Position][1];
+            Benchmark.Rows = SpriteHeights[Height];
+            Benchmark.HiRes = false;
+            Benchmark.UseJit = Options.UseJit;
+            
+            RunBenchmark(Options, Benchmark.Name, "instr", DrawSample, &Benchmark);
+        }
+    }
+    
+    const unsigned char HiResPositions[][2] = {{0, 0}, {67, 5}, {120, 60}};
+    
+    for (size_t Position = 0; Position < 3; ++Position) {
+        
+        DrawBenchmark Benchmark;
+        
+        Benchmark.Name = std::string("draw/hires-16x16-") + PositionNames[Position];
+        Benchmark.X = HiResPositions[Position][0];
+        Benchmark.Y = HiResPositions[Position][1];
+        Benchmark.Rows = 0;
+        Benchmark.HiRes = true;
+        Benchmark.UseJit = Options.UseJit;
+        
+        RunBenchmark(Options, Benchmark.Name, "instr", DrawSample, &Benchmark);
+    }
+    
+    //
+    // Rasterizing a checkerboard-ish screen, whole frames and a row at a time.
+    //
+    
+    RasterBenchmark Raster;
+    
+    for (int Word = 0; Word < GRAPHICS_WORDS; ++Word) {
+        Raster.Graphics[Word] = Word & 1 ? 0xAAAAAAAAAAAAAAAAull : 0x0F0F0F0F0F0F0F0Full;
+    }
+    
+    Raster.Pixels = new uint32_t[GRAPHICS_X_AXIS * PIXEL_SCALE * GRAPHICS_Y_AXIS * PIXEL_SCALE];
+    
+    for (int HiRes = 0; HiRes < 2; ++HiRes) {
+        
+        Raster.HiRes = HiRes != 0;
+        
+        Raster.RowsPerCall = GRAPHICS_ROWS(Raster.HiRes);
+        RunBenchmark(Options, HiRes ? "raster/hires-full-frame" : "raster/full-frame", "frame", RasterSample, &Raster);
+        
+        Raster.RowsPerCall = 1;
+        RunBenchmark(Options, HiRes ? "raster/hires-single-row" : "raster/single-row", "row", RasterSample, &Raster);
+    }
+    
+    //
+    // Whole ROMs, in name order so runs line up.
+    //
+    
+    std::vector<std::string> RomNames;
+    DIR *RomDirectory = opendir(Options.RomDirectory);
+    
+    if (RomDirectory != NULL) {
+        
+        struct dirent *Entry;
+        
+        while ((Entry = readdir(RomDirectory)) != NULL) {
+            
+            size_t NameLength = strlen(Entry->d_name);
+            
+            if (NameLength > 4 && strcmp(Entry->d_name + NameLength - 4, ".ch8") == 0) {
+                RomNames.push_back(Entry->d_name);
+            }
+        }
+        
+        closedir(RomDirectory);
+        std::sort(RomNames.begin(), RomNames.end());
+        
+    } else {
+        fprintf(stderr, "No ROM directory %s, skipping ROM benchmarks\n", Options.RomDirectory);
+    }
+    
+    for (size_t Rom = 0; Rom < RomNames.size(); ++Rom) {
+        
+        RomBenchmark Benchmark;
+        
+        Benchmark.FileName = std::string(Options.RomDirectory) + "/" + RomNames[Rom];
+        Benchmark.Pixels = Raster.Pixels;
+        Benchmark.UseJit = Options.UseJit;
+        
+        RunBenchmark(Options, "rom/" + RomNames[Rom], "frame", RomSample, &Benchmark);
+    }
+    
+    //
+    // Environment steps, each environment holding a different key.
+    //
+    
+    for (size_t Rom = 0; Rom < RomNames.size(); ++Rom) {
+        for (int Lockstep = 0; Lockstep < 2; ++Lockstep) {
+            
+            std::string FileName = std::string(Options.RomDirectory) + "/" + RomNames[Rom];
+            std::string Name = std::string(Lockstep ? "env/lockstep-" : "env/") + RomNames[Rom];
+            EnvBenchmark Benchmark;
+            RomImage Image;
+            
+            if ((Options.Filter != NULL && Name.find(Options.Filter) == std::string::npos) || Image.Open(FileName.c_str()) != ROM_OK) {
+                continue;
+            }
+            
+            Benchmark.Envs = new Chip8VecEnv(ENV_COUNT, 0, Lockstep != 0);
+            Benchmark.Envs->LoadProgram(Image.Bytes(), Image.Size());
+            Benchmark.Envs->SetCyclesPerFrame(ROM_CYCLES_PER_FRAME);
+            Benchmark.Observations.resize(ENV_COUNT * ENV_OBSERVATION_SIZE);
+            Benchmark.Dones.resize(ENV_COUNT);
+            
+            for (uint32_t Env = 0; Env < ENV_COUNT; ++Env) {
+                Benchmark.Seeds.push_back(Env + 1);
+                Benchmark.Actions.push_back((uint16_t) (1u << (Env % 16)));
+            }
+            
+            RunBenchmark(Options, Name, "step", EnvSample, &Benchmark);
+            
+            delete Benchmark.Envs;
+        }
+    }
+    
+    delete [] Raster.Pixels;
+    
+    return 0;
+}
+
+void RunBenchmark(const BenchmarkOptions &Options, const std::string &Name, const char *Unit, SampleFunction Sample, void *Context)
+{
+    std::vector<double> NanosecondsPerUnit;
+    double Units = 0;
+    double Mean = 0;
+    double Variance = 0;
+    double Median;
+    
+    if (Options.Filter != NULL && Name.find(Options.Filter) == std::string::npos) {
+        return;
+    }
+    
+    for (unsigned int Run = 0; Run < Options.Warmup + Options.Samples; ++Run) {
+        
+        std::chrono::steady_clock::time_point StartTime = std::chrono::steady_clock::now();
+        
+        Units = Sample(Context);
+        
+        std::chrono::duration<double, std::nano> Elapsed = std::chrono::steady_clock::now() - StartTime;
+        
+        if (Run >= Options.Warmup && Units > 0) {
+            NanosecondsPerUnit.push_back(Elapsed.count() / Units);
+        }
+    }
+    
+    if (NanosecondsPerUnit.empty()) {
+        fprintf(stderr, "%s did no work\n", Name.c_str());
+        return;
+    }
+    
+    std::sort(NanosecondsPerUnit.begin(), NanosecondsPerUnit.end());
+    
+    for (size_t Index = 0; Index < NanosecondsPerUnit.size(); ++Index) {
+        Mean += NanosecondsPerUnit[Index];
+    }
+    
+    Mean /= NanosecondsPerUnit.size();
+    
+    for (size_t Index = 0; Index < NanosecondsPerUnit.size(); ++Index) {
+        Variance += (NanosecondsPerUnit[Index] - Mean) * (NanosecondsPerUnit[Index] - Mean);
+    }
+    
+    Variance /= NanosecondsPerUnit.size();
+    
+    Median = NanosecondsPerUnit[NanosecondsPerUnit.size() / 2];
+    
+    if (NanosecondsPerUnit.size() % 2 == 0) {
+        Median = (Median + NanosecondsPerUnit[NanosecondsPerUnit.size() / 2 - 1]) / 2;
+    }
+    
+    if (Options.Json) {
+        printf("{\"benchmark\": \"%s\", \"unit\": \"%s\", \"units_per_sample\": %.0f, \"samples\": %lu, \"jit\": %s, "
+               "\"min_ns\": %.3f, \"median_ns\": %.3f, \"mean_ns\": %.3f, \"stddev_ns\": %.3f, \"per_sec\": %.1f}\n",
+               Name.c_str(),
+               Unit,
+               Units,
+               (unsigned long) NanosecondsPerUnit.size(),
+               Options.UseJit ? "true" : "false",
+               NanosecondsPerUnit.front(),
+               Median,
+               Mean,
+               sqrt(Variance),
+               1e9 / Median);
+    } else {
+        printf("%-32s %14.0f %12.3f %12.3f %12.3f %10.3f %16.1f\n",
+               Name.c_str(),
+               Units,
+               NanosecondsPerUnit.front(),
+               Median,
+               Mean,
+               sqrt(Variance),
+               1e9 / Median);
+    }
+    
+    fflush(stdout);
+}
+
+//
+// Body repeated to fill LOOP_BODY_INSTRUCTIONS, then a jump back to the start. Trailer (sprite
+// data, a subroutine) goes right after the jump, at LOOP_TRAILER_ADDRESS.
+//
+std::vector<unsigned char> BuildLoopProgram(const unsigned short *Body, int BodyLength, const unsigned char *Trailer, int TrailerLength)
+{
+    std::vector<unsigned char> Program;
+    
+    for (int Instruction = 0; Instruction < LOOP_BODY_INSTRUCTIONS; ++Instruction) {
+        unsigned short Word = Body[Instruction % BodyLength];
+        
+        Program.push_back((unsigned char) (Word >> 8));
+        Program.push_back((unsigned char) Word);
+    }
+    
+    Program.push_back(0x12);
+    Program.push_back(0x00);
+    
+    for (int Byte = 0; Byte < TrailerLength; ++Byte) {
+        Program.push_back(Trailer[Byte]);
+    }
+    
+    return Program;
+}
+
+//
+// Run the program for a sample's worth of cycles. The interpreter goes through EmulateCycle
+// an instruction at a time, the JIT through Run.
+//
+double RunProgram(const std::vector<unsigned char> &Program, bool UseJit)
+{
+    Chip8 *Cpu = new Chip8();
+    unsigned char Keyboard[16];
+    unsigned long CyclesRun = 0;
+    
+    memset(Keyboard, 0, sizeof(Keyboard));
+    
+    Cpu->Initialize();
+    Cpu->SeedRandom(1);
+    Cpu->LoadProgram(&Program[0], Program.size());
+    Cpu->SetJitEnabled(UseJit);
+    
+    if (UseJit) {
+        CyclesRun = Cpu->Run(Keyboard, OPCODE_CYCLES_PER_SAMPLE);
+    } else {
+        while (CyclesRun < OPCODE_CYCLES_PER_SAMPLE && Cpu->EmulateCycle(Keyboard)) {
+            ++CyclesRun;
+        }
+    }
+    
+    delete Cpu;
+    
+    return (double) CyclesRun;
+}
+
+double OpcodeSample(void *Context)
+{
+    OpcodeRun *Run = (OpcodeRun *) Context;
+    const OpcodeBenchmark *Benchmark = Run->Benchmark;
+    int BodyLength = 0;
+    
+    while (BodyLength < 4 && Benchmark->Body[BodyLength] != 0) {
+        ++BodyLength;
+    }
+    
+    return RunProgram(BuildLoopProgram(Benchmark->Body, BodyLength, NULL, 0), Run->UseJit);
+}
+
+//
+// Every instruction a jump to the next one.
+//
+double JumpChainSample(void *Context)
+{
+    unsigned short Body[LOOP_BODY_INSTRUCTIONS];
+    
+    for (int Instruction = 0; Instruction < LOOP_BODY_INSTRUCTIONS; ++Instruction) {
+        Body[Instruction] = 0x1000 | (PROGRAM_START_LOCATION + 2 * (Instruction + 1));
+    }
+    
+    return RunProgram(BuildLoopProgram(Body, LOOP_BODY_INSTRUCTIONS, NULL, 0), *(bool *) Context);
+}
+
+//
+// Calls to a subroutine that just returns, which sits right after the loop's jump back.
+//
+double CallReturnSample(void *Context)
+{
+    unsigned short Body[] = {0x2000 | LOOP_TRAILER_ADDRESS};
+    unsigned char Return[] = {0x00, 0xEE};
+    
+    return RunProgram(BuildLoopProgram(Body, 1, Return, 2), *(bool *) Context);
+}
+
+double DrawSample(void *Context)
+{
+    DrawBenchmark *Benchmark = (DrawBenchmark *) Context;
+    unsigned short Body[LOOP_BODY_INSTRUCTIONS];
+    unsigned char Sprite[32];
+    int FirstDraw = 3;
+    
+    //
+    // V0 and V1 hold the position and I the sprite, which lives right after the loop. A
+    // hi-res loop switches modes first, which only clears the display the first time round.
+    //
+    
+    Body[0] = 0x6000 | Benchmark->X;
+    Body[1] = 0x6100 | Benchmark->Y;
+    Body[2] = 0xA000 | LOOP_TRAILER_ADDRESS;
+    
+    if (Benchmark->HiRes) {
+        Body[FirstDraw++] = 0x00FF;
+    }
+    
+    for (int Instruction = FirstDraw; Instruction < LOOP_BODY_INSTRUCTIONS; ++Instruction) {
+        Body[Instruction] = 0xD010 | Benchmark->Rows;
+    }
+    
+    for (int Row = 0; Row < 32; ++Row) {
+        Sprite[Row] = (unsigned char) (0xA5 ^ (Row * 0x11));
+    }
+    
+    return RunProgram(BuildLoopProgram(Body, LOOP_BODY_INSTRUCTIONS, Sprite, Benchmark->Rows != 0 ? Benchmark->Rows : 32), Benchmark->UseJit);
+}
+
+double RasterSample(void *Context)
+{
+    RasterBenchmark *Benchmark = (RasterBenchmark *) Context;
+    int Pitch = GRAPHICS_X_AXIS * PIXEL_SCALE * sizeof(uint32_t);
+    int Rows = GRAPHICS_ROWS(Benchmark->HiRes);
+    int Scale = PIXEL_SCALE_FOR(Benchmark->HiRes);
+    
+    for (int Frame = 0; Frame < RASTER_FRAMES_PER_SAMPLE; ++Frame) {
+        
+        int FirstRow = Benchmark->RowsPerCall == Rows ? 0 : Frame % Rows;
+        int LastRow = FirstRow + Benchmark->RowsPerCall - 1;
+        
+        TransferGraphicsToPixels(Benchmark->Graphics, Benchmark->HiRes, FirstRow, LastRow, Benchmark->Pixels + FirstRow * Scale * Pitch / sizeof(uint32_t), Pitch);
+    }
+    
+    return RASTER_FRAMES_PER_SAMPLE;
+}
+
+//
+// What the frontend does every frame, minus SDL: run a frame's instructions, tick the
+// timers, rasterize the rows that changed.
+//
+double RomSample(void *Context)
+{
+    RomBenchmark *Benchmark = (RomBenchmark *) Context;
+    Chip8 *Cpu = new Chip8();
+    unsigned char Keyboard[16];
+    int Pitch = GRAPHICS_X_AXIS * PIXEL_SCALE * sizeof(uint32_t);
+    int Frame;
+    
+    memset(Keyboard, 0, sizeof(Keyboard));
+    
+    Cpu->Initialize();
+    Cpu->SeedRandom(1);
+    
+    if (!Cpu->LoadRom((char *) Benchmark->FileName.c_str())) {
+        delete Cpu;
+        return 0;
+    }
+    
+    Cpu->SetJitEnabled(Benchmark->UseJit);
+    
+    for (Frame = 0; Frame < ROM_FRAMES_PER_SAMPLE; ++Frame) {
+        
+        Cpu->Run(Keyboard, ROM_CYCLES_PER_FRAME);
+        Cpu->TickTimers();
+        
+        if (Cpu->Draw()) {
+            
+            bool HiRes = Cpu->HiRes();
+            uint64_t DirtyRows = Cpu->TakeDirtyRows();
+            
+            for (int Row = 0; Row < GRAPHICS_ROWS(HiRes); ++Row) {
+                if ((DirtyRows >> Row) & 1) {
+                    TransferGraphicsToPixels(Cpu->GetGraphics(), HiRes, Row, Row, Benchmark->Pixels + Row * PIXEL_SCALE_FOR(HiRes) * Pitch / sizeof(uint32_t), Pitch);
+                }
+            }
+        }
+    }
+    
+    delete Cpu;
+    
+    return Frame;
+}
+
+void PrintUsage(const char *ProgramName)
+{
+    fprintf(stderr,
+            "Usage: %s [--samples N] [--warmup N] [--filter S] [--roms DIR] [--json] [--jit]\n"
+            "    --samples N     timed samples per benchmark (default %d)\n"
+            "    --warmup N      untimed samples first (default %d)\n"
+            "    --filter S      only benchmarks with S in their name\n"
+            "    --roms DIR      where the ROMs for rom/ and env/ benchmarks are (default %s)\n"
+            "    --json          one JSON object per line instead of a table\n"
+            "    --jit           run compiled blocks where possible\n",
+            ProgramName,
+            DEFAULT_SAMPLES,
+            DEFAULT_WARMUP,
+            DEFAULT_ROM_DIRECTORY);
+}
+
+double EnvSample(void *Context)
+{
+    EnvBenchmark *Benchmark = (EnvBenchmark *) Context;
+    int Step;
+    
+    Benchmark->Envs->Reset(&Benchmark->Seeds[0], &Benchmark->Observations[0]);
+    
+    for (Step = 0; Step < ENV_STEPS_PER_SAMPLE; ++Step) {
+        Benchmark->Envs->Step(&Benchmark->Actions[0], ENV_FRAME_SKIP, &Benchmark->Observations[0], &Benchmark->Dones[0]);
+    }
+    
+    return (double) Step * ENV_COUNT;
+}
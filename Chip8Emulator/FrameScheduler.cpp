@@ -0,0 +1,53 @@
+//
+//  FrameScheduler.cpp
+//  Chip8Emulator
+//
+
+#include <thread>
+
+#include "FrameScheduler.h"
+
+FrameScheduler::FrameScheduler(unsigned int FramesPerSecond)
+{
+    FrameLength = std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(1000000000 / FramesPerSecond));
+    FramesRun = 0;
+    FramesDropped = 0;
+    
+    Start();
+}
+
+void FrameScheduler::Start()
+{
+    NextFrame = Clock::now();
+}
+
+unsigned int FrameScheduler::WaitForFrames(unsigned int &Dropped)
+{
+    Clock::time_point Now = Clock::now();
+    unsigned long Due;
+    
+    Dropped = 0;
+    
+    if (Now < NextFrame) {
+        std::this_thread::sleep_until(NextFrame);
+        Now = Clock::now();
+    }
+    
+    //
+    // Every frame whose start time has passed is due. NextFrame only ever moves by whole
+    // frames so the pace doesn't drift with however late we happened to wake up.
+    //
+    
+    Due = (unsigned long) ((Now - NextFrame) / FrameLength) + 1;
+    
+    if (Due > MAX_CATCH_UP_FRAMES) {
+        Dropped = (unsigned int) (Due - MAX_CATCH_UP_FRAMES);
+        FramesDropped += Dropped;
+        Due = MAX_CATCH_UP_FRAMES;
+    }
+    
+    NextFrame += FrameLength * (Due + Dropped);
+    FramesRun += Due;
+    
+    return (unsigned int) Due;
+}
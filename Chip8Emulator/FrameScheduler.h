@@ -0,0 +1,55 @@
+//
+//  FrameScheduler.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__FrameScheduler__
+#define __Chip8Emulator__FrameScheduler__
+
+#include <chrono>
+
+#define FRAMES_PER_SECOND (60)
+
+//
+// If we fall further behind than this (debugger, window drag, slow host) we stop trying to
+// run the missed frames and count them as dropped instead.
+//
+
+#define MAX_CATCH_UP_FRAMES (4)
+
+//
+// Paces the emulator at a fixed frame rate. The main loop asks how many frames are due,
+// runs that many batches of instructions and draws once. Normally that's one frame and we
+// sleep once per frame on the steady clock. After a stall it's a few frames back to back
+// until we've caught up.
+//
+
+class FrameScheduler {
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    
+    Clock::duration FrameLength;
+    Clock::time_point NextFrame;
+    unsigned long FramesRun;
+    unsigned long FramesDropped;
+
+public:
+    FrameScheduler(unsigned int FramesPerSecond = FRAMES_PER_SECOND);
+    
+    void Start();
+    
+    //
+    // Sleep until the next frame is due, then return how many frames should be run now,
+    // between 1 and MAX_CATCH_UP_FRAMES. Returns the number of frames given up on since the
+    // last call through Dropped.
+    //
+    
+    unsigned int WaitForFrames(unsigned int &Dropped);
+    
+    unsigned long TotalFrames() {return FramesRun;};
+    unsigned long DroppedFrames() {return FramesDropped;};
+    
+};
+
+#endif /* defined(__Chip8Emulator__FrameScheduler__) */
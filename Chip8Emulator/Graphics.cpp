@@ -11,26 +11,16 @@
 
 #define TWO_DIM_TO_ONE(x,y,RowLength) ((x) + (y) * (RowLength))
 
-void Graphics::Initialize()
+void Graphics::Initialize(TextureMode Mode)
 {
-    DbgPrint("Initializing Graphics Class\n");
-    
     Window = NULL;
     Renderer = NULL;
-    
-    Pixels = (Uint32 *) malloc(SCREEN_X_AXIS * SCREEN_Y_AXIS * sizeof(Uint32));
-    assert(Pixels != NULL);
-    
-    //
-    // Set screen to all white to begin with, we'll draw with black just because
-    // everyone else draws with white.
-    //
-    
-    memset(Pixels, 0xFF, SCREEN_X_AXIS * SCREEN_Y_AXIS * sizeof(Uint32));
+    Pixels = NULL;
+    this->Mode = Mode;
     
     SDL_Init(SDL_INIT_VIDEO);
     
-    Window = SDL_CreateWindow("Chip8",
+    Window = SDL_CreateWindow(WINDOW_TITLE,
                               SDL_WINDOWPOS_UNDEFINED,
                               SDL_WINDOWPOS_UNDEFINED,
                               SCREEN_X_AXIS,
@@ -45,69 +35,110 @@ void Graphics::Initialize()
     
     Texture = SDL_CreateTexture(Renderer,
                                 SDL_PIXELFORMAT_ABGR8888,
-                                SDL_TEXTUREACCESS_STATIC,
+                                Mode == TEXTURE_MODE_STREAMING ? SDL_TEXTUREACCESS_STREAMING : SDL_TEXTUREACCESS_STATIC,
                                 SCREEN_X_AXIS,
                                 SCREEN_Y_AXIS);
     
     assert(Texture != NULL);
     
-    SDL_UpdateTexture(Texture, NULL, Pixels, SCREEN_X_AXIS * sizeof(Uint32));
+    if (Mode == TEXTURE_MODE_STATIC) {
+        Pixels = (Uint32 *) malloc(SCREEN_X_AXIS * SCREEN_Y_AXIS * sizeof(Uint32));
+        assert(Pixels != NULL);
+    }
+    
+    //
+    // Set screen to all white to begin with, we'll draw with black just because
+    // everyone else draws with white.
+    //
+    
+    uint64_t BlankScreen[GRAPHICS_Y_AXIS];
+    
+    memset(BlankScreen, 0, sizeof(BlankScreen));
+    UploadRows(BlankScreen, false, 0, GRAPHICS_Y_AXIS - 1);
+    
     SDL_RenderClear(Renderer);
     SDL_RenderCopy(Renderer, Texture, NULL, NULL);
     SDL_RenderPresent(Renderer);
 }
 
-void Graphics::Draw(const unsigned char *Graphics)
+void Graphics::SetTitle(const char *Title)
 {
+    SDL_SetWindowTitle(Window, Title);
+}
+
+void Graphics::Draw(const uint64_t *Graphics, bool HiRes, uint64_t DirtyRows)
+{
+    int Rows = GRAPHICS_ROWS(HiRes);
+    int FirstRow = 0;
+    int LastRow;
+    
     //
-    // Update our pixels array
+    // Only redo the rows that changed. Each run of dirty rows gets rasterized and uploaded
+    // to the texture as one rect.
     //
     
-    TransferGraphicsToPixels(Graphics);
+    while (FirstRow < Rows) {
+        
+        if (((DirtyRows >> FirstRow) & 1) == 0) {
+            ++FirstRow;
+            continue;
+        }
+        
+        LastRow = FirstRow;
+        
+        while (LastRow + 1 < Rows && ((DirtyRows >> (LastRow + 1)) & 1) != 0) {
+            ++LastRow;
+        }
+        
+        UploadRows(Graphics, HiRes, FirstRow, LastRow);
+        
+        FirstRow = LastRow + 1;
+    }
     
     //
-    // Update our texture and get it onto the screen
+    // Get the texture onto the screen
     //
     
-    SDL_UpdateTexture(Texture, NULL, Pixels, SCREEN_X_AXIS * sizeof(Uint32));
     SDL_RenderClear(Renderer);
     SDL_RenderCopy(Renderer, Texture, NULL, NULL);
     SDL_RenderPresent(Renderer);
     
 }
 
-void Graphics::TransferGraphicsToPixels(const unsigned char *Graphics)
+//
+// The window is the same size in either mode, the scale is what changes.
+//
+void Graphics::UploadRows(const uint64_t *Graphics, bool HiRes, int FirstRow, int LastRow)
 {
-    //
-    // Each "pixel" in our graphics array is going to represent an 8x8 pixel block on
-    // our actual screen. Do the array translation to map this.
-    //
+    SDL_Rect DirtyRect;
+    void *LockedPixels;
+    int LockedPitch;
     
-    Uint32 Color;
+    DirtyRect.x = 0;
+    DirtyRect.y = FirstRow * PIXEL_SCALE_FOR(HiRes);
+    DirtyRect.w = SCREEN_X_AXIS;
+    DirtyRect.h = (LastRow - FirstRow + 1) * PIXEL_SCALE_FOR(HiRes);
     
-    for (int xIndex = 0; xIndex < GRAPHICS_X_AXIS; ++xIndex) {
+    if (Mode == TEXTURE_MODE_STREAMING) {
+        
+        //
+        // The locked buffer is write only and its pitch is whatever the driver likes, so
+        // every pixel in the rect gets written and lines are stepped by the pitch we're given.
+        //
         
-        for (int yIndex = 0; yIndex < GRAPHICS_Y_AXIS; ++yIndex) {
-            
-            if (Graphics[TWO_DIM_TO_ONE(xIndex, yIndex, GRAPHICS_X_AXIS)] == 1) {
-                Color = 0; // black
-            } else {
-                Color = 0xFF; // white
-            }
-            
-            ColorEightbyEightBlock(xIndex, yIndex, Color);
+        if (SDL_LockTexture(Texture, &DirtyRect, &LockedPixels, &LockedPitch) != 0) {
+            fprintf(stderr, "SDL_LockTexture failed: %s\n", SDL_GetError());
+            return;
         }
-    }
-}
-
-void Graphics::ColorEightbyEightBlock(int xPos, int yPos, Uint32 Color)
-{
-    int xPixel = xPos * 8;
-    int yPixel = yPos * 8;
-    
-    for (int i = 0; i < 8; ++i) {
         
-        memset(&(Pixels[TWO_DIM_TO_ONE(xPixel, yPixel + i, SCREEN_X_AXIS)]), Color, 8 * sizeof(Uint32));
+        TransferGraphicsToPixels(Graphics, HiRes, FirstRow, LastRow, (Uint32 *) LockedPixels, LockedPitch);
+        SDL_UnlockTexture(Texture);
+        
+    } else {
         
+        Uint32 *Destination = &Pixels[TWO_DIM_TO_ONE(0, DirtyRect.y, SCREEN_X_AXIS)];
+        
+        TransferGraphicsToPixels(Graphics, HiRes, FirstRow, LastRow, Destination, SCREEN_X_AXIS * sizeof(Uint32));
+        SDL_UpdateTexture(Texture, &DirtyRect, Destination, SCREEN_X_AXIS * sizeof(Uint32));
     }
-}
\ No newline at end of file
+}
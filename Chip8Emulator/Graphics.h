@@ -10,10 +10,25 @@
 #define __Chip8Emulator__Graphics__
 
 #include <iostream>
+#include <stdint.h>
 #include <SDL2/SDL.h>
 
-#define SCREEN_X_AXIS (64 * 8)
-#define SCREEN_Y_AXIS (32 * 8)
+#include "Rasterizer.h"
+
+#define SCREEN_X_AXIS (64 * PIXEL_SCALE)
+#define SCREEN_Y_AXIS (32 * PIXEL_SCALE)
+
+#define WINDOW_TITLE "Chip8"
+
+//
+// How frames get into the texture. Static keeps our own Pixels array and copies it up with
+// SDL_UpdateTexture, streaming rasterizes straight into the buffer SDL_LockTexture hands us.
+//
+
+enum TextureMode {
+    TEXTURE_MODE_STATIC,
+    TEXTURE_MODE_STREAMING
+};
 
 class Graphics {
     
@@ -21,14 +36,20 @@ private:
     SDL_Window *Window;
     SDL_Renderer *Renderer;
     SDL_Texture *Texture;
-    Uint32 *Pixels; //[SCREEN_X_AXIS * SCREEN_Y_AXIS];
+    TextureMode Mode;
+    Uint32 *Pixels; //[SCREEN_X_AXIS * SCREEN_Y_AXIS], static mode only
     
-    void TransferGraphicsToPixels(const unsigned char *Graphics);
-    void ColorEightbyEightBlock(int xPos, int yPos, Uint32 Color);
+    void UploadRows(const uint64_t *Graphics, bool HiRes, int FirstRow, int LastRow);
     
 public:
-    void Initialize();
-    void Draw(const unsigned char *Graphics);
+    void Initialize(TextureMode Mode = TEXTURE_MODE_STATIC);
+    
+    //
+    // DirtyRows counts rows of the mode the display is in, so 64 of them in hi-res.
+    //
+    
+    void Draw(const uint64_t *Graphics, bool HiRes, uint64_t DirtyRows);
+    void SetTitle(const char *Title);
     
     
 };
@@ -0,0 +1,49 @@
+//
+//  TripleBuffer.cpp
+//  Chip8Emulator
+//
+
+#include "TripleBuffer.h"
+
+TripleBuffer::TripleBuffer()
+{
+    memset(Slots, 0, sizeof(Slots));
+    
+    Back = 0;
+    Middle.store(1);
+    Front = 2;
+    UntakenRows = 0;
+}
+
+void TripleBuffer::Publish()
+{
+    //
+    // Once the middle slot isn't fresh the reader has taken everything published so far.
+    // If it takes the last frame between here and the exchange, this one just redraws a
+    // few rows it didn't need to.
+    //
+    
+    if ((Middle.load(std::memory_order_relaxed) & FRESH_FRAME_BIT) == 0) {
+        UntakenRows = 0;
+    }
+    
+    Slots[Back].DirtyRows |= UntakenRows;
+    UntakenRows = Slots[Back].DirtyRows;
+    
+    //
+    // Release so the frame contents are visible before the reader can see the slot.
+    //
+    
+    Back = Middle.exchange(Back | FRESH_FRAME_BIT, std::memory_order_acq_rel) & SLOT_INDEX_MASK;
+}
+
+bool TripleBuffer::TakeLatest()
+{
+    if ((Middle.load(std::memory_order_relaxed) & FRESH_FRAME_BIT) == 0) {
+        return false;
+    }
+    
+    Front = Middle.exchange(Front, std::memory_order_acq_rel) & SLOT_INDEX_MASK;
+    
+    return true;
+}
@@ -0,0 +1,79 @@
+//
+//  TripleBuffer.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__TripleBuffer__
+#define __Chip8Emulator__TripleBuffer__
+
+#include <atomic>
+#include <stdint.h>
+
+#include "Chip8.h"
+
+//
+// Hands finished frames from the emulation thread to the render thread without either side
+// ever waiting on the other. There are three slots: the writer owns one, the reader owns one
+// and the third sits in the middle holding the newest frame nobody has picked up yet. Both
+// sides only ever swap their slot with the middle one, so a slow reader just skips frames
+// and a slow writer just means the reader keeps showing the last one.
+//
+// DirtyRows is filled in by the writer with the rows its own frame changed. Publish adds in
+// the rows of any frame the reader might not have taken, so a frame the reader takes covers
+// everything that changed since the one it took before.
+//
+
+struct DisplayFrame {
+    uint64_t Graphics[GRAPHICS_WORDS];
+    uint64_t DirtyRows;
+    bool HiRes;
+};
+
+class TripleBuffer {
+
+private:
+    
+    //
+    // Middle holds a slot index, plus FRESH_FRAME_BIT when the writer has put something
+    // there the reader hasn't taken yet.
+    //
+    
+    enum {
+        SLOT_INDEX_MASK = 0x3,
+        FRESH_FRAME_BIT = 0x4
+    };
+    
+    DisplayFrame Slots[3];
+    std::atomic<unsigned int> Middle;
+    unsigned int Back;
+    unsigned int Front;
+    
+    //
+    // Writer side. Rows changed by every frame published since the last one we know the
+    // reader took.
+    //
+    
+    uint64_t UntakenRows;
+
+public:
+    TripleBuffer();
+    
+    //
+    // Writer side. Fill in BackFrame() and Publish() it, after which BackFrame() is a
+    // different slot with stale contents.
+    //
+    
+    DisplayFrame *BackFrame() {return &Slots[Back];};
+    void Publish();
+    
+    //
+    // Reader side. Returns true and moves FrontFrame() to the newest published frame if
+    // there is one we haven't seen.
+    //
+    
+    bool TakeLatest();
+    const DisplayFrame *FrontFrame() {return &Slots[Front];};
+    
+};
+
+#endif /* defined(__Chip8Emulator__TripleBuffer__) */
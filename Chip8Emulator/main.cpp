@@ -12,16 +12,36 @@
 #include <GLUT/GLUT.h>
 #include <SDL2/SDL.h>
 #include <ctime>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include "Chip8.h"
 #include "Graphics.h"
+#include "FrameScheduler.h"
+#include "TripleBuffer.h"
+#include "RewindBuffer.h"
+#include "InputMovie.h"
 
 //
-// Cpu is 60Hz. So clocks/cycle = (clocks/sec) / 60
+// Instructions run per 60 Hz frame at speed level 1. The J and K keys move the speed level
+// between 1 and 10, --ipf N changes the base.
 //
 
-#define CPU_HZ (100)
-#define CLOCKS_PER_CYCLE (CLOCKS_PER_SEC/60)
+#define DEFAULT_CYCLES_PER_FRAME (2)
+#define DEFAULT_SPEED_LEVEL (3)
+
+//
+// Tab (or --turbo) switches turbo on and off. Turbo runs frames back to back as fast as the
+// host allows, still looking at the keys and handing a frame to the render thread about once
+// per refresh, and checks the clock every TURBO_CLOCK_CHECK_FRAMES frames. The window title
+// then shows how many times real speed we're managing, measured over SPEED_SAMPLE_REFRESHES
+// refreshes.
+//
+
+#define TURBO_CLOCK_CHECK_FRAMES (16)
+#define SPEED_SAMPLE_REFRESHES (30)
 
 //
 // Keyboard State Array
@@ -33,13 +53,69 @@
 
 unsigned char Keyboard[16];
 
+//
+// Everything the render thread and the emulation thread share. Keys travel as a 16 bit
+// mask with bit N set when key N is down.
+//
+
+struct EmulationControl {
+    Chip8 *Cpu;
+    TripleBuffer *Frames;
+    unsigned long CyclesPerFrame;
+    std::atomic<bool> Quit;
+    std::atomic<unsigned short> KeyMask;
+    std::atomic<int> SpeedLevel;
+    std::atomic<bool> Turbo;
+    
+    //
+    // Frames run so far, for working out the speed.
+    //
+    
+    std::atomic<unsigned long long> FramesEmulated;
+    
+    //
+    // NULL when rewind is off. Only the emulation thread touches it, the render thread just
+    // says whether the rewind key is held.
+    //
+    
+    RewindBuffer *Rewind;
+    std::atomic<bool> Rewinding;
+    
+    //
+    // NULL unless we're recording an input movie.
+    //
+    
+    InputMovie *Movie;
+    
+    //
+    // Set by the render thread when P is pressed, the emulation thread prints the profile
+    // between frames so it never races the counters.
+    //
+    
+    std::atomic<bool> ReportProfile;
+    
+    //
+    // While the machine waits on FX0A with both timers run down, the emulation thread sleeps
+    // on Wake instead of running frames that can't change anything. The render thread
+    // signals it whenever the keys, the rewind key, a profile request or Quit change.
+    //
+    
+    std::mutex WakeLock;
+    std::condition_variable Wake;
+};
+
 //
 // Helper Functions
 //
 
+void EmulationThread (EmulationControl *Control);
+void RunFrame (EmulationControl *Control, unsigned char *Keyboard, unsigned short KeyMask);
 void TranslateKeyboardStates (const Uint8 *SdlKeyStates, unsigned char *Keyboard);
-int AdjustSpeed (const Uint8 *SdlKeyStates, int CurrentSpeed);
-void WaitForNextCycle (Uint32 TargetHz, Uint32 PreviousTicks, int SpeedLevel);
+unsigned short KeyboardToMask (const unsigned char *Keyboard);
+int AdjustSpeed (SDL_Scancode Key, int CurrentSpeed);
+void SaveTrace (Chip8 *Cpu, const char *FileName);
+void WakeEmulation (EmulationControl *Control);
+void SleepUntilInput (EmulationControl *Control, unsigned short KeyMask);
 
 int main(int argc, char * argv[])
 {
@@ -49,8 +125,37 @@ int main(int argc, char * argv[])
     SDL_Event Event;
     const Uint8* CurrentKeyStates;
     unsigned char Keyboard[16];
-    Uint32 Ticks;
-    int SpeedLevel;
+    unsigned long CyclesPerFrame = DEFAULT_CYCLES_PER_FRAME;
+    TextureMode DisplayMode = TEXTURE_MODE_STATIC;
+    FrameScheduler RenderScheduler;
+    unsigned int FramesDropped;
+    TripleBuffer Frames;
+    EmulationControl Control;
+    unsigned short KeyMask;
+    bool Rewinding;
+    bool Turbo = false;
+    unsigned int SpeedRefreshes = 0;
+    unsigned long long SpeedSampleFrames = 0;
+    std::chrono::steady_clock::time_point SpeedSampleStart;
+    double Seconds;
+    char Title[64];
+    bool TitleShowsSpeed = false;
+    unsigned int RewindSeconds = REWIND_DEFAULT_SECONDS;
+    size_t RewindBudget = REWIND_DEFAULT_BUDGET;
+    char *RecordFileName = NULL;
+    uint32_t Seed = (uint32_t) time(NULL);
+    bool Profile = false;
+    char *TraceFileName = NULL;
+    uint32_t TraceCategories = TRACE_ALL;
+    char *RomFileName = NULL;
+    char *IndexFileName = NULL;
+    bool CyclesPerFrameGiven = false;
+    Chip8QuirkProfile Quirks = QUIRKS_DEFAULT;
+    bool QuirksGiven = false;
+    RomLibrary Library;
+    RomInfo Info;
+    RomImage Rom;
+    RomStatus Status;
     
     std::cout << "Emulatin' shit\n";
     
@@ -61,27 +166,164 @@ int main(int argc, char * argv[])
     Cpu = new Chip8();
     Cpu->Initialize();
     
-    Display = new Graphics();
-    Display->Initialize();
+    //
+    // --streaming-texture rasterizes straight into a locked streaming texture instead of
+    // going through our own pixel buffer and SDL_UpdateTexture.
+    //
     
-    memset(Keyboard, 0, 16 * sizeof(unsigned char));
+    for (int ArgIndex = 1; ArgIndex < argc; ++ArgIndex) {
+        if (strcmp(argv[ArgIndex], "--streaming-texture") == 0) {
+            DisplayMode = TEXTURE_MODE_STREAMING;
+            
+        } else if (strcmp(argv[ArgIndex], "--turbo") == 0) {
+            Turbo = true;
+            
+        } else if (strcmp(argv[ArgIndex], "--ipf") == 0 && ArgIndex + 1 < argc) {
+            CyclesPerFrame = std::max(strtoul(argv[++ArgIndex], NULL, 0), 1ul);
+            CyclesPerFrameGiven = true;
+            
+        } else if (strcmp(argv[ArgIndex], "--quirks") == 0 && ArgIndex + 1 < argc) {
+            
+            if (!ParseQuirkProfile(argv[++ArgIndex], &Quirks)) {
+                fprintf(stderr, "Unknown quirk profile %s\n", argv[ArgIndex]);
+                return 1;
+            }
+            
+            QuirksGiven = true;
+            
+        } else if (strcmp(argv[ArgIndex], "--rewind-seconds") == 0 && ArgIndex + 1 < argc) {
+            RewindSeconds = (unsigned int) strtoul(argv[++ArgIndex], NULL, 0);
+            
+        } else if (strcmp(argv[ArgIndex], "--rewind-kb") == 0 && ArgIndex + 1 < argc) {
+            RewindBudget = strtoul(argv[++ArgIndex], NULL, 0) * 1024;
+            
+        } else if (strcmp(argv[ArgIndex], "--record") == 0 && ArgIndex + 1 < argc) {
+            RecordFileName = argv[++ArgIndex];
+            
+        } else if (strcmp(argv[ArgIndex], "--seed") == 0 && ArgIndex + 1 < argc) {
+            Seed = (uint32_t) strtoul(argv[++ArgIndex], NULL, 0);
+            
+        } else if (strcmp(argv[ArgIndex], "--profile") == 0) {
+            Profile = true;
+            
+        } else if (strcmp(argv[ArgIndex], "--trace") == 0 && ArgIndex + 1 < argc) {
+            TraceFileName = argv[++ArgIndex];
+            
+        } else if (strcmp(argv[ArgIndex], "--trace-categories") == 0 && ArgIndex + 1 < argc) {
+            
+            if (!Chip8Trace::ParseCategories(argv[++ArgIndex], &TraceCategories)) {
+                fprintf(stderr, "Unknown trace category in %s\n", argv[ArgIndex]);
+                return 1;
+            }
+            
+        } else if (strcmp(argv[ArgIndex], "--index") == 0 && ArgIndex + 1 < argc) {
+            IndexFileName = argv[++ArgIndex];
+            
+        } else if (argv[ArgIndex][0] != '-' && RomFileName == NULL) {
+            RomFileName = argv[ArgIndex];
+        }
+    }
+    
+    if (RomFileName == NULL) {
+        fprintf(stderr, "Usage: %s <rom> [options], see the README\n", argv[0]);
+        return 1;
+    }
+    
+    //
+    // With a ROM index, a game can bring its own speed and quirk profile. --ipf and --quirks
+    // still win.
+    //
+    
+    if (IndexFileName != NULL) {
+        
+        Library.LoadIndex(IndexFileName);
+        
+        if (Library.Lookup(RomFileName, &Info) == ROM_OK) {
+            
+            if (Info.CyclesPerFrame != 0 && !CyclesPerFrameGiven) {
+                CyclesPerFrame = Info.CyclesPerFrame;
+            }
+            
+            if (!QuirksGiven && !ParseQuirkProfile(Info.Quirks.c_str(), &Quirks)) {
+                fprintf(stderr, "Unknown quirk profile %s in the ROM index, using the default\n", Info.Quirks.c_str());
+            }
+            
+            if (Library.IndexChanged() && !Library.SaveIndex(IndexFileName)) {
+                fprintf(stderr, "Couldn't write ROM index %s\n", IndexFileName);
+            }
+        }
+    }
     
     //
     // Load ROM
     //
     
-    if (!Cpu->LoadRom("/Users/thomasmiller/cmps/emulation/Chip8Emulator/Roms/BRIX")) {
-        assert(false);
-    };
+    Status = Rom.Open(RomFileName);
+    
+    if (Status != ROM_OK) {
+        fprintf(stderr, "Couldn't load ROM %s: %s\n", RomFileName, RomImage::StatusMessage(Status));
+        return 1;
+    }
+    
+    Cpu->LoadProgram(Rom.Bytes(), Rom.Size());
+    Cpu->SetQuirkProfile(Quirks);
+    Rom.Close();
+    
+    Display = new Graphics();
+    Display->Initialize(DisplayMode);
+    
+    memset(Keyboard, 0, 16 * sizeof(unsigned char));
+    
+    Cpu->SeedRandom(Seed);
+    Cpu->SetProfilerEnabled(Profile);
+    
+    if (TraceFileName != NULL) {
+        Cpu->EnableTrace(TraceCategories);
+    }
     
     //
-    // Main emulator loop. Simluate 60 Hz.
+    // Emulation runs on its own thread and only ever hands frames over through the triple
+    // buffer, so a slow present (vsync, compositor) can't hold up the CPU. SDL wants video and
+    // events on the main thread, so this thread is the render thread.
     //
-    SpeedLevel = 3;
+    
+    Control.Cpu = Cpu;
+    Control.Frames = &Frames;
+    Control.CyclesPerFrame = CyclesPerFrame;
+    Control.Quit.store(false);
+    Control.KeyMask.store(0);
+    Control.SpeedLevel.store(DEFAULT_SPEED_LEVEL);
+    Control.Turbo.store(Turbo);
+    Control.FramesEmulated.store(0);
+    Control.Rewind = RewindSeconds != 0 ? new RewindBuffer(RewindSeconds, RewindBudget) : NULL;
+    Control.Rewinding.store(false);
+    Control.Movie = NULL;
+    Control.ReportProfile.store(false);
+    
+    if (RecordFileName != NULL) {
+        Control.Movie = new InputMovie();
+        Control.Movie->Start(Seed, Quirks);
+    }
+    
+    if (Control.Rewind != NULL) {
+        printf("Rewind: hold backspace, up to %u seconds in %lu KB\n", RewindSeconds, (unsigned long) (RewindBudget / 1024));
+    }
+    
+    if (Cpu->ProfilerEnabled()) {
+        printf("Profiling: press P for a report\n");
+    }
+    
+    if (TraceFileName != NULL) {
+        printf("Tracing: press T to write the trace to %s\n", TraceFileName);
+    }
+    
+    SpeedSampleStart = std::chrono::steady_clock::now();
+    
+    std::thread Emulation(EmulationThread, &Control);
     
     while (!Quit) {
         
-        Ticks = SDL_GetTicks();
+        RenderScheduler.WaitForFrames(FramesDropped);
         
         //
         // Check for quit event
@@ -90,54 +332,315 @@ int main(int argc, char * argv[])
         while (SDL_PollEvent(&Event) != 0) {
             if (Event.type == SDL_QUIT) {
                 Quit = true;
+                
+            } else if (Event.type == SDL_KEYDOWN && !Event.key.repeat) {
+                Control.SpeedLevel.store(AdjustSpeed((SDL_Scancode) Event.key.keysym.scancode, Control.SpeedLevel.load()));
+                
+                if (Event.key.keysym.scancode == SDL_SCANCODE_TAB) {
+                    Control.Turbo.store(!Control.Turbo.load());
+                }
+                
+                if (Event.key.keysym.scancode == SDL_SCANCODE_P) {
+                    Control.ReportProfile.store(true);
+                    WakeEmulation(&Control);
+                }
+                
+                //
+                // The trace can be read while the emulation thread keeps writing it, no
+                // need to stop anything.
+                //
+                
+                if (Event.key.keysym.scancode == SDL_SCANCODE_T && TraceFileName != NULL) {
+                    SaveTrace(Cpu, TraceFileName);
+                }
             }
         }
         
         CurrentKeyStates = SDL_GetKeyboardState(NULL);
         TranslateKeyboardStates (CurrentKeyStates, Keyboard);
+        KeyMask = KeyboardToMask(Keyboard);
+        Rewinding = CurrentKeyStates[SDL_SCANCODE_BACKSPACE] != 0;
+        
+        if (Control.KeyMask.load() != KeyMask || Control.Rewinding.load() != Rewinding) {
+            Control.KeyMask.store(KeyMask);
+            Control.Rewinding.store(Rewinding);
+            WakeEmulation(&Control);
+        }
+        
+        //
+        // Present the newest finished frame if there is one, redrawing the rows the core says
+        // changed since the last frame we took. However fast turbo runs, that's one Draw per
+        // refresh and the frames in between are never drawn at all.
+        //
+        
+        if (Frames.TakeLatest()) {
+            
+            const DisplayFrame *Latest = Frames.FrontFrame();
+            
+            if (Latest->DirtyRows != 0) {
+                Display->Draw(Latest->Graphics, Latest->HiRes, Latest->DirtyRows);
+            }
+        }
+        
+        if (++SpeedRefreshes >= SPEED_SAMPLE_REFRESHES) {
+            
+            std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now();
+            unsigned long long FramesEmulated = Control.FramesEmulated.load();
+            
+            Seconds = std::chrono::duration<double>(Now - SpeedSampleStart).count();
+            
+            if (Control.Turbo.load()) {
+                snprintf(Title, sizeof(Title), WINDOW_TITLE " - turbo %.1fx",
+                         Seconds > 0 ? (FramesEmulated - SpeedSampleFrames) / Seconds / FRAMES_PER_SECOND : 0.0);
+                Display->SetTitle(Title);
+                TitleShowsSpeed = true;
+                
+            } else if (TitleShowsSpeed) {
+                Display->SetTitle(WINDOW_TITLE);
+                TitleShowsSpeed = false;
+            }
+            
+            SpeedRefreshes = 0;
+            SpeedSampleFrames = FramesEmulated;
+            SpeedSampleStart = Now;
+        }
+    }
+    
+    Control.Quit.store(true);
+    WakeEmulation(&Control);
+    Emulation.join();
+    
+    if (Cpu->ProfilerEnabled()) {
+        Cpu->WriteProfileReport(stdout);
+    }
+    
+    if (TraceFileName != NULL) {
+        SaveTrace(Cpu, TraceFileName);
+    }
+    
+    if (Control.Rewind != NULL) {
+        printf("Rewind: %lu frames in %lu of %lu KB, capture %.1f us average, %.1f us worst\n",
+               (unsigned long) Control.Rewind->FramesStored(),
+               (unsigned long) (Control.Rewind->MemoryUsed() / 1024),
+               (unsigned long) (Control.Rewind->MemoryBudget() / 1024),
+               Control.Rewind->AverageCaptureMicroseconds(),
+               Control.Rewind->WorstCaptureMicroseconds());
         
-        Cpu->EmulateCycle(Keyboard);
+        delete Control.Rewind;
+    }
+    
+    if (Control.Movie != NULL) {
+        Control.Movie->Finish(*Cpu);
         
-        if (Cpu->Draw()) {
-            Display->Draw(Cpu->Graphics);
+        if (!Control.Movie->Save(RecordFileName)) {
+            fprintf(stderr, "Couldn't write input movie %s\n", RecordFileName);
+        } else {
+            printf("Recorded %lu frames to %s\n", (unsigned long) Control.Movie->FrameCount(), RecordFileName);
         }
         
-        SpeedLevel = AdjustSpeed (CurrentKeyStates, SpeedLevel);
-     
-        memset(Keyboard, 0, 16 * sizeof(unsigned char));
-        WaitForNextCycle(CPU_HZ, Ticks, SpeedLevel);
+        delete Control.Movie;
     }
     
     return 0;
 }
 
-int AdjustSpeed (const Uint8 *SdlKeyStates, int CurrentSpeed) {
+void EmulationThread (EmulationControl *Control)
+{
+    FrameScheduler Scheduler;
+    unsigned int FramesDue = 0;
+    unsigned int FramesDropped;
+    unsigned char Keyboard[16];
+    unsigned short KeyMask;
+    bool Turbo;
+    bool Paced = true;
+    std::chrono::steady_clock::time_point SliceEnd;
     
-    assert(SdlKeyStates != NULL);
+    //
+    // Each 60 Hz frame runs a batch of instructions and ticks the timers once, and we only
+    // sleep between frames. Whatever is on screen after the batch gets published.
+    //
     
-    if (SdlKeyStates[SDL_SCANCODE_J] && CurrentSpeed > 1) {
-        return CurrentSpeed - 1;
+    Scheduler.Start();
+    
+    while (!Control->Quit.load()) {
+        
+        //
+        // Rewinding is always paced, turbo would go through the whole history at once.
+        //
+        
+        Turbo = Control->Turbo.load() && !Control->Rewinding.load();
+        
+        if (!Turbo) {
+            
+            //
+            // Coming out of turbo, start the pace over from now.
+            //
+            
+            if (!Paced) {
+                Scheduler.Start();
+                Paced = true;
+            }
+            
+            FramesDue = Scheduler.WaitForFrames(FramesDropped);
+            
+            if (FramesDropped != 0) {
+                fprintf(stderr, "Fell behind, dropped %u frames (%lu total)\n", FramesDropped, Scheduler.DroppedFrames());
+            }
+        }
+        
+        KeyMask = Control->KeyMask.load();
+        
+        for (int KeyIndex = 0; KeyIndex < 16; ++KeyIndex) {
+            Keyboard[KeyIndex] = (KeyMask >> KeyIndex) & 1;
+        }
+        
+        if (Turbo) {
+            
+            //
+            // Frames back to back until a refresh's worth of time has gone by, or the machine
+            // starts waiting on a key.
+            //
+            
+            Paced = false;
+            SliceEnd = std::chrono::steady_clock::now() + std::chrono::microseconds(1000000 / FRAMES_PER_SECOND);
+            
+            do {
+                for (int Frame = 0; Frame < TURBO_CLOCK_CHECK_FRAMES; ++Frame) {
+                    RunFrame(Control, Keyboard, KeyMask);
+                }
+            } while (std::chrono::steady_clock::now() < SliceEnd && !Control->Cpu->WaitingForKey());
+            
+        } else {
+            
+            for (unsigned int Frame = 0; Frame < FramesDue; ++Frame) {
+                RunFrame(Control, Keyboard, KeyMask);
+            }
+        }
+        
+        if (Control->ReportProfile.exchange(false) && Control->Cpu->ProfilerEnabled()) {
+            Control->Cpu->WriteProfileReport(stdout);
+        }
+        
+        if (Control->Cpu->Draw()) {
+            Control->Frames->BackFrame()->DirtyRows = Control->Cpu->TakeDirtyRows();
+            memcpy(Control->Frames->BackFrame()->Graphics, Control->Cpu->GetGraphics(), sizeof(Control->Frames->BackFrame()->Graphics));
+            Control->Frames->BackFrame()->HiRes = Control->Cpu->HiRes();
+            Control->Frames->Publish();
+        }
+        
+        //
+        // Waiting on FX0A with no timer left to count down, every frame from here on is the
+        // same until a key changes. Sleep until one does, then pick the frame pace back up
+        // from now rather than counting the sleep as dropped frames. The movie and the rewind
+        // history skip the frames we slept through, which ran nothing.
+        //
+        
+        if (Control->Cpu->WaitingForKey() &&
+            Control->Cpu->GetState().DelayTimer == 0 &&
+            Control->Cpu->GetState().SoundTimer == 0 &&
+            !Control->Rewinding.load()) {
+            
+            SleepUntilInput(Control, KeyMask);
+            Scheduler.Start();
+        }
     }
-    if (SdlKeyStates[SDL_SCANCODE_K] && CurrentSpeed < 10) {
-        return CurrentSpeed + 1;
+    
+    printf("Ran %llu frames, dropped %lu, skipped %llu idle instructions, %llu cycles waiting for keys\n",
+           Control->FramesEmulated.load(),
+           Scheduler.DroppedFrames(),
+           Control->Cpu->IdleCycles(),
+           Control->Cpu->KeyWaitCycles());
+}
+
+//
+// One frame's instructions and timer tick, remembered for rewind and the movie. While the
+// rewind key is held it's a step back through history instead.
+//
+void RunFrame (EmulationControl *Control, unsigned char *Keyboard, unsigned short KeyMask)
+{
+    unsigned long FrameCycles;
+    
+    if (Control->Rewind != NULL && Control->Rewinding.load()) {
+        
+        if (Control->Rewind->StepBack(*Control->Cpu) && Control->Movie != NULL) {
+            Control->Movie->DropLastFrame();
+        }
+        
+        return;
     }
-    return CurrentSpeed;
+    
+    FrameCycles = Control->CyclesPerFrame * Control->SpeedLevel.load();
+    
+    Control->Cpu->Run(Keyboard, FrameCycles);
+    Control->Cpu->TickTimers();
+    
+    if (Control->Movie != NULL) {
+        Control->Movie->RecordFrame(KeyMask, FrameCycles);
+    }
+    
+    if (Control->Rewind != NULL) {
+        Control->Rewind->Capture(*Control->Cpu);
+    }
+    
+    Control->FramesEmulated.fetch_add(1, std::memory_order_relaxed);
 }
 
-void WaitForNextCycle (Uint32 TargetHz, Uint32 PreviousTicks, int SpeedLevel)
+//
+// Taking the lock before notifying means the emulation thread is either not yet asleep, and
+// will see the change when it checks, or asleep and gets woken. It can't miss it in between.
+//
+void WakeEmulation (EmulationControl *Control)
 {
-    assert(0 < SpeedLevel && SpeedLevel < 11);
+    {
+        std::lock_guard<std::mutex> Guard(Control->WakeLock);
+    }
     
-    Uint32 TicksPerCycle = 1000 / (TargetHz + CPU_HZ * SpeedLevel);
-    Uint32 TicksPassed;
+    Control->Wake.notify_one();
+}
+
+void SleepUntilInput (EmulationControl *Control, unsigned short KeyMask)
+{
+    std::unique_lock<std::mutex> Guard(Control->WakeLock);
     
-    if (SDL_GetTicks() > PreviousTicks) {
-        TicksPassed = SDL_GetTicks() - PreviousTicks;
-        
-        if (TicksPerCycle > TicksPassed) {
-            SDL_Delay(TicksPerCycle - TicksPassed);
+    while (!Control->Quit.load() &&
+           Control->KeyMask.load() == KeyMask &&
+           !Control->Rewinding.load() &&
+           !Control->ReportProfile.load()) {
+        Control->Wake.wait(Guard);
+    }
+}
+
+unsigned short KeyboardToMask (const unsigned char *Keyboard)
+{
+    unsigned short KeyMask = 0;
+    
+    for (int KeyIndex = 0; KeyIndex < 16; ++KeyIndex) {
+        if (Keyboard[KeyIndex]) {
+            KeyMask |= 1 << KeyIndex;
         }
     }
+    
+    return KeyMask;
+}
+
+void SaveTrace (Chip8 *Cpu, const char *FileName)
+{
+    if (Cpu->GetTrace()->Save(FileName)) {
+        printf("Wrote trace to %s\n", FileName);
+    } else {
+        fprintf(stderr, "Couldn't write trace %s\n", FileName);
+    }
+}
+
+int AdjustSpeed (SDL_Scancode Key, int CurrentSpeed) {
+    
+    if (Key == SDL_SCANCODE_J && CurrentSpeed > 1) {
+        return CurrentSpeed - 1;
+    }
+    if (Key == SDL_SCANCODE_K && CurrentSpeed < 10) {
+        return CurrentSpeed + 1;
+    }
+    return CurrentSpeed;
 }
 
 void TranslateKeyboardStates (const Uint8 *SdlKeyStates, unsigned char *Keyboard)
@@ -0,0 +1,454 @@
+//
+//  Chip8Env.cpp
+//  Chip8Emulator
+//
+
+#include <string.h>
+#include <algorithm>
+
+#include "Chip8Env.h"
+#include "Rasterizer.h"
+
+//
+// Expand an action mask into the key array Chip8 takes.
+//
+static void KeysForAction(uint16_t ActionMask, unsigned char *Keys)
+{
+    for (int Key = 0; Key < 16; ++Key) {
+        Keys[Key] = (ActionMask >> Key) & 1;
+    }
+}
+
+//
+// State is cache line aligned, which Chip8's allocator already gives us.
+//
+static Chip8State *NewState(const Chip8State &From)
+{
+    Chip8State *State = (Chip8State *) Chip8::operator new(sizeof(Chip8State));
+    
+    memcpy(State, &From, sizeof(Chip8State));
+    
+    return State;
+}
+
+Chip8Env::Chip8Env()
+{
+    Cpu = new Chip8();
+    Cpu->Initialize();
+    
+    InitialState = NewState(Cpu->GetState());
+    CyclesPerFrame = ENV_DEFAULT_CYCLES_PER_FRAME;
+    EpisodeDone = true;
+}
+
+Chip8Env::~Chip8Env()
+{
+    Chip8::operator delete(InitialState);
+    delete Cpu;
+}
+
+bool Chip8Env::LoadProgram(const unsigned char *Program, size_t Length)
+{
+    Cpu->Initialize();
+    
+    if (!Cpu->LoadProgram(Program, Length)) {
+        return false;
+    }
+    
+    memcpy(InitialState, &Cpu->GetState(), sizeof(Chip8State));
+    EpisodeDone = false;
+    
+    return true;
+}
+
+void Chip8Env::Reset(uint32_t Seed, unsigned char *Observation)
+{
+    Cpu->SetState(*InitialState);
+    Cpu->SeedRandom(Seed);
+    EpisodeDone = false;
+    
+    if (Observation != NULL) {
+        TransferGraphicsToBytes(Cpu->GetGraphics(), Cpu->HiRes(), Observation);
+    }
+}
+
+//
+// Frames run the way every other frontend runs them: the frame's instructions, then the
+// timer tick. Coming up short means the machine halted or faulted.
+//
+bool Chip8Env::Step(uint16_t ActionMask, unsigned int FrameSkip, unsigned char *Observation)
+{
+    unsigned char Keys[16];
+    
+    KeysForAction(ActionMask, Keys);
+    
+    for (unsigned int Frame = 0; Frame < FrameSkip && !EpisodeDone; ++Frame) {
+        
+        unsigned long Ran = Cpu->Run(Keys, CyclesPerFrame);
+        
+        Cpu->TickTimers();
+        
+        if (Ran != CyclesPerFrame) {
+            EpisodeDone = true;
+        }
+    }
+    
+    if (Observation != NULL) {
+        TransferGraphicsToBytes(Cpu->GetGraphics(), Cpu->HiRes(), Observation);
+    }
+    
+    return EpisodeDone;
+}
+
+Chip8VecEnv::Chip8VecEnv(size_t Count, unsigned int ThreadCount, bool UseLockstep)
+{
+    Chip8 *Cpu = new Chip8();
+    size_t PerSlice;
+    
+    EnvCount = Count;
+    Lockstep = UseLockstep;
+    CyclesPerFrame = ENV_DEFAULT_CYCLES_PER_FRAME;
+    Generation = 0;
+    Pending = 0;
+    Command = ENV_COMMAND_RESET;
+    Seeds = NULL;
+    ActionMasks = NULL;
+    FrameSkip = 0;
+    Observations = NULL;
+    Dones = NULL;
+    
+    if (ThreadCount == 0) {
+        ThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    
+    //
+    // Even slices, but a lockstep slice bigger than a block is rounded up to whole blocks so
+    // no thread ends up with a mostly empty one.
+    //
+    
+    PerSlice = std::max((Count + ThreadCount - 1) / ThreadCount, (size_t) 1);
+    
+    if (Lockstep && PerSlice > LOCKSTEP_BLOCK_LANES) {
+        PerSlice = (PerSlice + LOCKSTEP_BLOCK_LANES - 1) / LOCKSTEP_BLOCK_LANES * LOCKSTEP_BLOCK_LANES;
+    }
+    
+    for (size_t First = 0; First < Count || Slices.empty(); First += PerSlice) {
+        
+        EnvSlice *Slice = new EnvSlice();
+        
+        Slice->First = First;
+        Slice->Count = std::min(PerSlice, Count - First);
+        Slice->Engine = NULL;
+        
+        if (Lockstep) {
+            Slice->Engine = new Chip8Lockstep(Slice->Count);
+            Slice->Actions.assign(Slice->Count, 0);
+        } else {
+            for (size_t Env = 0; Env < Slice->Count; ++Env) {
+                Slice->Envs.push_back(new Chip8Env());
+            }
+        }
+        
+        Slices.push_back(Slice);
+    }
+    
+    Cpu->Initialize();
+    InitialState = NewState(Cpu->GetState());
+    delete Cpu;
+    
+    for (size_t Slice = 1; Slice < Slices.size(); ++Slice) {
+        Workers.push_back(std::thread(&Chip8VecEnv::WorkerLoop, this, Slice));
+    }
+}
+
+Chip8VecEnv::~Chip8VecEnv()
+{
+    Dispatch(ENV_COMMAND_QUIT);
+    
+    for (size_t Worker = 0; Worker < Workers.size(); ++Worker) {
+        Workers[Worker].join();
+    }
+    
+    for (size_t Slice = 0; Slice < Slices.size(); ++Slice) {
+        
+        for (size_t Env = 0; Env < Slices[Slice]->Envs.size(); ++Env) {
+            delete Slices[Slice]->Envs[Env];
+        }
+        
+        delete Slices[Slice]->Engine;
+        delete Slices[Slice];
+    }
+    
+    Chip8::operator delete(InitialState);
+}
+
+bool Chip8VecEnv::LoadProgram(const unsigned char *Program, size_t Length)
+{
+    Chip8 *Cpu = new Chip8();
+    bool Loaded;
+    
+    Cpu->Initialize();
+    Loaded = Cpu->LoadProgram(Program, Length);
+    
+    if (Loaded) {
+        
+        memcpy(InitialState, &Cpu->GetState(), sizeof(Chip8State));
+        
+        for (size_t Slice = 0; Slice < Slices.size() && Loaded; ++Slice) {
+            
+            if (Slices[Slice]->Engine != NULL) {
+                Loaded = Slices[Slice]->Engine->LoadProgram(Program, Length);
+            }
+            
+            for (size_t Env = 0; Env < Slices[Slice]->Envs.size() && Loaded; ++Env) {
+                Loaded = Slices[Slice]->Envs[Env]->LoadProgram(Program, Length);
+            }
+        }
+    }
+    
+    delete Cpu;
+    
+    return Loaded;
+}
+
+//
+// Plain slices step each Chip8Env at its own rate, so they all need telling.
+//
+void Chip8VecEnv::SetCyclesPerFrame(unsigned long Cycles)
+{
+    CyclesPerFrame = Cycles;
+    
+    for (size_t Slice = 0; Slice < Slices.size(); ++Slice) {
+        for (size_t Env = 0; Env < Slices[Slice]->Envs.size(); ++Env) {
+            Slices[Slice]->Envs[Env]->SetCyclesPerFrame(Cycles);
+        }
+    }
+}
+
+void Chip8VecEnv::Reset(const uint32_t *NewSeeds, unsigned char *NewObservations)
+{
+    Seeds = NewSeeds;
+    Observations = NewObservations;
+    
+    Dispatch(ENV_COMMAND_RESET);
+}
+
+void Chip8VecEnv::ResetEnv(size_t Env, uint32_t Seed, unsigned char *NewObservations)
+{
+    for (size_t Slice = 0; Slice < Slices.size(); ++Slice) {
+        if (Env >= Slices[Slice]->First && Env - Slices[Slice]->First < Slices[Slice]->Count) {
+            ResetLane(*Slices[Slice], Env - Slices[Slice]->First, Seed, NewObservations == NULL ? NULL : NewObservations + Env * ENV_OBSERVATION_SIZE);
+        }
+    }
+}
+
+void Chip8VecEnv::Step(const uint16_t *NewActionMasks, unsigned int NewFrameSkip, unsigned char *NewObservations, unsigned char *NewDones)
+{
+    ActionMasks = NewActionMasks;
+    FrameSkip = NewFrameSkip;
+    Observations = NewObservations;
+    Dones = NewDones;
+    
+    Dispatch(ENV_COMMAND_STEP);
+}
+
+bool Chip8VecEnv::Done(size_t Env)
+{
+    for (size_t Slice = 0; Slice < Slices.size(); ++Slice) {
+        
+        EnvSlice &Owner = *Slices[Slice];
+        
+        if (Env >= Owner.First && Env - Owner.First < Owner.Count) {
+            return Owner.Engine != NULL ? Owner.Engine->LaneDone(Env - Owner.First) : Owner.Envs[Env - Owner.First]->Done();
+        }
+    }
+    
+    return true;
+}
+
+void Chip8VecEnv::GetState(size_t Env, Chip8State *State)
+{
+    for (size_t Slice = 0; Slice < Slices.size(); ++Slice) {
+        
+        EnvSlice &Owner = *Slices[Slice];
+        
+        if (Env >= Owner.First && Env - Owner.First < Owner.Count) {
+            
+            if (Owner.Engine != NULL) {
+                Owner.Engine->GetState(Env - Owner.First, State);
+            } else {
+                memcpy(State, &Owner.Envs[Env - Owner.First]->GetState(), sizeof(Chip8State));
+            }
+        }
+    }
+}
+
+void Chip8VecEnv::GetRegisters(size_t Env, unsigned char *Registers)
+{
+    for (size_t Slice = 0; Slice < Slices.size(); ++Slice) {
+        
+        EnvSlice &Owner = *Slices[Slice];
+        
+        if (Env >= Owner.First && Env - Owner.First < Owner.Count) {
+            
+            if (Owner.Engine != NULL) {
+                Owner.Engine->GetRegisters(Env - Owner.First, Registers);
+            } else {
+                memcpy(Registers, Owner.Envs[Env - Owner.First]->GetState().VRegisters, 16);
+            }
+        }
+    }
+}
+
+//
+// Publish the command, run slice 0 here, and wait for the workers to finish the rest.
+//
+void Chip8VecEnv::Dispatch(EnvCommand NextCommand)
+{
+    {
+        std::lock_guard<std::mutex> Guard(Lock);
+        
+        Command = NextCommand;
+        Pending = Workers.size();
+        ++Generation;
+    }
+    
+    WorkReady.notify_all();
+    
+    if (NextCommand != ENV_COMMAND_QUIT) {
+        RunSlice(*Slices[0]);
+    }
+    
+    std::unique_lock<std::mutex> Guard(Lock);
+    
+    while (Pending != 0) {
+        WorkDone.wait(Guard);
+    }
+}
+
+void Chip8VecEnv::WorkerLoop(size_t Slice)
+{
+    unsigned long long Seen = 0;
+    
+    while (true) {
+        
+        EnvCommand Next;
+        
+        {
+            std::unique_lock<std::mutex> Guard(Lock);
+            
+            while (Generation == Seen) {
+                WorkReady.wait(Guard);
+            }
+            
+            Seen = Generation;
+            Next = Command;
+        }
+        
+        if (Next != ENV_COMMAND_QUIT) {
+            RunSlice(*Slices[Slice]);
+        }
+        
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            
+            if (--Pending == 0) {
+                WorkDone.notify_one();
+            }
+        }
+        
+        if (Next == ENV_COMMAND_QUIT) {
+            return;
+        }
+    }
+}
+
+void Chip8VecEnv::RunSlice(EnvSlice &Slice)
+{
+    unsigned char *SliceObservations = Observations == NULL ? NULL : Observations + Slice.First * ENV_OBSERVATION_SIZE;
+    
+    switch (Command) {
+        
+        case ENV_COMMAND_RESET:
+            for (size_t Lane = 0; Lane < Slice.Count; ++Lane) {
+                ResetLane(Slice, Lane, Seeds[Slice.First + Lane], SliceObservations == NULL ? NULL : SliceObservations + Lane * ENV_OBSERVATION_SIZE);
+            }
+            break;
+        
+        case ENV_COMMAND_STEP:
+            if (Slice.Engine != NULL) {
+                
+                for (size_t Lane = 0; Lane < Slice.Count; ++Lane) {
+                    
+                    uint16_t Action = ActionMasks[Slice.First + Lane];
+                    
+                    if (Action != Slice.Actions[Lane]) {
+                        
+                        unsigned char Keys[16];
+                        
+                        KeysForAction(Action, Keys);
+                        Slice.Engine->SetKeys(Lane, Keys);
+                        Slice.Actions[Lane] = Action;
+                    }
+                }
+                
+                for (unsigned int Frame = 0; Frame < FrameSkip; ++Frame) {
+                    if (!Slice.Engine->RunFrame(CyclesPerFrame)) {
+                        break;
+                    }
+                }
+                
+            } else {
+                
+                for (size_t Lane = 0; Lane < Slice.Count; ++Lane) {
+                    Slice.Envs[Lane]->Step(ActionMasks[Slice.First + Lane], FrameSkip, NULL);
+                }
+            }
+            
+            for (size_t Lane = 0; Lane < Slice.Count; ++Lane) {
+                
+                if (SliceObservations != NULL) {
+                    WriteLaneObservation(Slice, Lane, SliceObservations + Lane * ENV_OBSERVATION_SIZE);
+                }
+                
+                if (Dones != NULL) {
+                    Dones[Slice.First + Lane] = (Slice.Engine != NULL ? Slice.Engine->LaneDone(Lane) : Slice.Envs[Lane]->Done()) ? 1 : 0;
+                }
+            }
+            break;
+        
+        case ENV_COMMAND_QUIT:
+            break;
+    }
+}
+
+void Chip8VecEnv::ResetLane(EnvSlice &Slice, size_t Lane, uint32_t Seed, unsigned char *Observation)
+{
+    if (Slice.Engine != NULL) {
+        
+        Slice.Engine->SetState(Lane, *InitialState);
+        Slice.Engine->SeedRandom(Lane, Seed);
+        Slice.Actions[Lane] = 0;
+        
+        if (Observation != NULL) {
+            WriteLaneObservation(Slice, Lane, Observation);
+        }
+        
+    } else {
+        Slice.Envs[Lane]->Reset(Seed, Observation);
+    }
+}
+
+void Chip8VecEnv::WriteLaneObservation(EnvSlice &Slice, size_t Lane, unsigned char *Observation)
+{
+    if (Slice.Engine != NULL) {
+        
+        uint64_t Words[GRAPHICS_WORDS];
+        bool HiRes = Slice.Engine->GetGraphics(Lane, Words);
+        
+        TransferGraphicsToBytes(Words, HiRes, Observation);
+        
+    } else {
+        TransferGraphicsToBytes(Slice.Envs[Lane]->GetState().Graphics, Slice.Envs[Lane]->GetState().HiRes, Observation);
+    }
+}
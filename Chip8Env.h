@@ -0,0 +1,197 @@
+//
+//  Chip8Env.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__Chip8Env__
+#define __Chip8Emulator__Chip8Env__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "Chip8.h"
+#include "Chip8Lockstep.h"
+
+//
+// Observations are the display, one byte per pixel at 64x32 in either mode (see
+// TransferGraphicsToBytes).
+//
+
+#define ENV_OBSERVATION_SIZE (GRAPHICS_X_AXIS * GRAPHICS_Y_AXIS)
+
+#define ENV_DEFAULT_CYCLES_PER_FRAME (10)
+
+//
+// A ROM as a reinforcement learning environment. An action is a mask of the keys held down,
+// bit N for key N, and a step holds it for FrameSkip frames of CyclesPerFrame instructions
+// and a timer tick each, then writes the display into the caller's observation buffer. An
+// episode is done once the machine halts or faults. Nothing is allocated after LoadProgram,
+// Reset just copies the starting state back in.
+//
+// There's no reward, CHIP-8 games have no standard place to keep a score. GetState gives
+// the whole machine to work one out from.
+//
+
+class Chip8Env {
+
+private:
+    
+    Chip8 *Cpu;
+    
+    //
+    // The machine as LoadProgram left it, what every episode starts from.
+    //
+    
+    Chip8State *InitialState;
+    
+    unsigned long CyclesPerFrame;
+    bool EpisodeDone;
+    
+    Chip8Env(const Chip8Env &Other);
+    Chip8Env &operator=(const Chip8Env &Other);
+
+public:
+    Chip8Env();
+    ~Chip8Env();
+    
+    bool LoadProgram(const unsigned char *Program, size_t Length);
+    void SetCyclesPerFrame(unsigned long Cycles) {CyclesPerFrame = Cycles;};
+    
+    //
+    // Observation may be NULL when the caller doesn't want one.
+    //
+    
+    void Reset(uint32_t Seed, unsigned char *Observation);
+    
+    //
+    // True when the episode is done. Stepping a done environment only writes the observation.
+    //
+    
+    bool Step(uint16_t ActionMask, unsigned int FrameSkip, unsigned char *Observation);
+    
+    bool Done() {return EpisodeDone;};
+    const Chip8State &GetState() {return Cpu->GetState();};
+    
+};
+
+//
+// Count environments on one ROM, stepped together across a fixed set of threads that live
+// as long as the object, so a step costs a wakeup rather than a thread start. Observations
+// go into one contiguous caller buffer of Count * ENV_OBSERVATION_SIZE bytes, environment N
+// at N * ENV_OBSERVATION_SIZE, and actions and done flags are arrays of Count.
+//
+// Each thread owns a contiguous slice of environments. With Lockstep the slice runs as the
+// lanes of a Chip8Lockstep, which is the faster way to step lots of environments on one ROM,
+// otherwise every environment is a Chip8Env of its own. Both behave the same.
+//
+
+class Chip8VecEnv {
+
+private:
+    
+    typedef enum EnvCommand {
+        ENV_COMMAND_RESET,
+        ENV_COMMAND_STEP,
+        ENV_COMMAND_QUIT
+    } EnvCommand;
+    
+    struct EnvSlice {
+        size_t First;
+        size_t Count;
+        
+        //
+        // One of these, depending on Lockstep.
+        //
+        
+        std::vector<Chip8Env *> Envs;
+        Chip8Lockstep *Engine;
+        
+        //
+        // The action each lockstep lane last had, so keys are only copied in when they change.
+        //
+        
+        std::vector<uint16_t> Actions;
+    };
+    
+    std::vector<EnvSlice *> Slices;
+    std::vector<std::thread> Workers;
+    
+    size_t EnvCount;
+    bool Lockstep;
+    unsigned long CyclesPerFrame;
+    Chip8State *InitialState;
+    
+    //
+    // The command every worker runs next, published under Lock with a new Generation.
+    //
+    
+    std::mutex Lock;
+    std::condition_variable WorkReady;
+    std::condition_variable WorkDone;
+    unsigned long long Generation;
+    size_t Pending;
+    
+    EnvCommand Command;
+    const uint32_t *Seeds;
+    const uint16_t *ActionMasks;
+    unsigned int FrameSkip;
+    unsigned char *Observations;
+    unsigned char *Dones;
+    
+    void Dispatch(EnvCommand NextCommand);
+    void WorkerLoop(size_t Slice);
+    void RunSlice(EnvSlice &Slice);
+    void ResetLane(EnvSlice &Slice, size_t Lane, uint32_t Seed, unsigned char *Observation);
+    void WriteLaneObservation(EnvSlice &Slice, size_t Lane, unsigned char *Observation);
+    
+    Chip8VecEnv(const Chip8VecEnv &Other);
+    Chip8VecEnv &operator=(const Chip8VecEnv &Other);
+
+public:
+    
+    //
+    // ThreadCount 0 means one per core. The calling thread runs a slice itself, so a single
+    // thread starts no workers at all.
+    //
+    
+    Chip8VecEnv(size_t Count, unsigned int ThreadCount, bool UseLockstep);
+    ~Chip8VecEnv();
+    
+    bool LoadProgram(const unsigned char *Program, size_t Length);
+    void SetCyclesPerFrame(unsigned long Cycles);
+    
+    size_t Count() {return EnvCount;};
+    unsigned int ThreadCount() {return (unsigned int) Slices.size();};
+    
+    //
+    // Reset every environment, environment N from Seeds[N].
+    //
+    
+    void Reset(const uint32_t *Seeds, unsigned char *Observations);
+    
+    //
+    // Reset just one, for starting a new episode where the last one finished. Runs on the
+    // calling thread and writes only that environment's part of Observations.
+    //
+    
+    void ResetEnv(size_t Env, uint32_t Seed, unsigned char *Observations);
+    
+    //
+    // Step every environment that isn't done, environment N holding ActionMasks[N]. Every
+    // observation is written, and Dones[N] is 1 once environment N's episode is over. Dones
+    // may be NULL.
+    //
+    
+    void Step(const uint16_t *ActionMasks, unsigned int FrameSkip, unsigned char *Observations, unsigned char *Dones);
+    
+    bool Done(size_t Env);
+    void GetState(size_t Env, Chip8State *State);
+    void GetRegisters(size_t Env, unsigned char *Registers);
+    
+};
+
+#endif /* defined(__Chip8Emulator__Chip8Env__) */
@@ -0,0 +1,96 @@
+//
+//  Chip8EnvC.cpp
+//  Chip8Emulator
+//
+
+#include <string.h>
+
+#include "Chip8EnvC.h"
+#include "Chip8Env.h"
+
+static_assert(CHIP8_ENV_OBSERVATION_SIZE == ENV_OBSERVATION_SIZE, "C observation size out of step with Chip8Env");
+
+//
+// The handles are the C++ objects themselves.
+//
+
+struct Chip8EnvHandle : public Chip8Env {};
+
+struct Chip8VecEnvHandle : public Chip8VecEnv {
+    Chip8VecEnvHandle(size_t Count, unsigned int ThreadCount, bool UseLockstep) : Chip8VecEnv(Count, ThreadCount, UseLockstep) {};
+};
+
+Chip8EnvHandle *Chip8EnvCreate(const unsigned char *Rom, size_t Length, unsigned long CyclesPerFrame)
+{
+    Chip8EnvHandle *Env = new Chip8EnvHandle();
+    
+    if (!Env->LoadProgram(Rom, Length)) {
+        delete Env;
+        return NULL;
+    }
+    
+    Env->SetCyclesPerFrame(CyclesPerFrame != 0 ? CyclesPerFrame : ENV_DEFAULT_CYCLES_PER_FRAME);
+    
+    return Env;
+}
+
+void Chip8EnvDestroy(Chip8EnvHandle *Env)
+{
+    delete Env;
+}
+
+void Chip8EnvReset(Chip8EnvHandle *Env, uint32_t Seed, unsigned char *Observation)
+{
+    Env->Reset(Seed, Observation);
+}
+
+int Chip8EnvStep(Chip8EnvHandle *Env, uint16_t ActionMask, unsigned int FrameSkip, unsigned char *Observation)
+{
+    return Env->Step(ActionMask, FrameSkip, Observation) ? 1 : 0;
+}
+
+void Chip8EnvGetRegisters(Chip8EnvHandle *Env, unsigned char *Registers)
+{
+    memcpy(Registers, Env->GetState().VRegisters, 16);
+}
+
+Chip8VecEnvHandle *Chip8VecEnvCreate(const unsigned char *Rom, size_t Length, unsigned long CyclesPerFrame,
+                                     size_t Count, unsigned int ThreadCount, int Lockstep)
+{
+    Chip8VecEnvHandle *Envs = new Chip8VecEnvHandle(Count, ThreadCount, Lockstep != 0);
+    
+    if (!Envs->LoadProgram(Rom, Length)) {
+        delete Envs;
+        return NULL;
+    }
+    
+    Envs->SetCyclesPerFrame(CyclesPerFrame != 0 ? CyclesPerFrame : ENV_DEFAULT_CYCLES_PER_FRAME);
+    
+    return Envs;
+}
+
+void Chip8VecEnvDestroy(Chip8VecEnvHandle *Envs)
+{
+    delete Envs;
+}
+
+void Chip8VecEnvReset(Chip8VecEnvHandle *Envs, const uint32_t *Seeds, unsigned char *Observations)
+{
+    Envs->Reset(Seeds, Observations);
+}
+
+void Chip8VecEnvResetEnv(Chip8VecEnvHandle *Envs, size_t Env, uint32_t Seed, unsigned char *Observations)
+{
+    Envs->ResetEnv(Env, Seed, Observations);
+}
+
+void Chip8VecEnvStep(Chip8VecEnvHandle *Envs, const uint16_t *ActionMasks, unsigned int FrameSkip,
+                     unsigned char *Observations, unsigned char *Dones)
+{
+    Envs->Step(ActionMasks, FrameSkip, Observations, Dones);
+}
+
+void Chip8VecEnvGetRegisters(Chip8VecEnvHandle *Envs, size_t Env, unsigned char *Registers)
+{
+    Envs->GetRegisters(Env, Registers);
+}
@@ -0,0 +1,69 @@
+//
+//  Chip8EnvC.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__Chip8EnvC__
+#define __Chip8Emulator__Chip8EnvC__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Chip8Env and Chip8VecEnv behind plain C functions, for training code that loads the core
+// as a shared library from Python (ctypes, cffi) or anything else that speaks C. Handles are
+// opaque, buffers are the caller's and nothing is allocated per step. See Chip8Env.h for
+// what reset and step do.
+//
+// Observations are CHIP8_ENV_OBSERVATION_SIZE bytes per environment, one byte per pixel, 1
+// for on, 64 to a row. Actions are masks of the keys held down, bit N for key N.
+//
+
+#define CHIP8_ENV_OBSERVATION_SIZE (64 * 32)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Chip8EnvHandle Chip8EnvHandle;
+typedef struct Chip8VecEnvHandle Chip8VecEnvHandle;
+
+//
+// NULL if the ROM doesn't fit in memory. CyclesPerFrame 0 means the default of 10.
+//
+
+Chip8EnvHandle *Chip8EnvCreate(const unsigned char *Rom, size_t Length, unsigned long CyclesPerFrame);
+void Chip8EnvDestroy(Chip8EnvHandle *Env);
+void Chip8EnvReset(Chip8EnvHandle *Env, uint32_t Seed, unsigned char *Observation);
+
+//
+// 1 once the episode is done, 0 otherwise.
+//
+
+int Chip8EnvStep(Chip8EnvHandle *Env, uint16_t ActionMask, unsigned int FrameSkip, unsigned char *Observation);
+
+//
+// V0-VF into Registers, for working out a reward.
+//
+
+void Chip8EnvGetRegisters(Chip8EnvHandle *Env, unsigned char *Registers);
+
+//
+// ThreadCount 0 means one per core. Lockstep nonzero runs each thread's environments as lanes
+// of a Chip8Lockstep.
+//
+
+Chip8VecEnvHandle *Chip8VecEnvCreate(const unsigned char *Rom, size_t Length, unsigned long CyclesPerFrame,
+                                     size_t Count, unsigned int ThreadCount, int Lockstep);
+void Chip8VecEnvDestroy(Chip8VecEnvHandle *Envs);
+void Chip8VecEnvReset(Chip8VecEnvHandle *Envs, const uint32_t *Seeds, unsigned char *Observations);
+void Chip8VecEnvResetEnv(Chip8VecEnvHandle *Envs, size_t Env, uint32_t Seed, unsigned char *Observations);
+void Chip8VecEnvStep(Chip8VecEnvHandle *Envs, const uint16_t *ActionMasks, unsigned int FrameSkip,
+                     unsigned char *Observations, unsigned char *Dones);
+void Chip8VecEnvGetRegisters(Chip8VecEnvHandle *Envs, size_t Env, unsigned char *Registers);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* defined(__Chip8Emulator__Chip8EnvC__) */
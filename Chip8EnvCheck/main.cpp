@@ -0,0 +1,172 @@
+//
+//  main.cpp
+//  Chip8EnvCheck
+//
+
+//
+// Checks that Chip8VecEnv behaves the same with and without lockstep. Every ROM in the
+// directory is stepped as two sets of environments, one plain and one lockstep, with the
+// same seeds and the same run of actions, at a few instructions per frame rates including
+// ones other than the default. After every step the observations, done flags and registers
+// of each pair have to match. Prints the first difference for each ROM and rate and exits
+// with 1 if there was one.
+//
+//     Chip8EnvCheck [rom directory] [--steps N]
+//
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "Chip8Env.h"
+#include "RomLibrary.h"
+
+#define DEFAULT_ROM_DIRECTORY "Roms"
+#define DEFAULT_STEPS (500)
+
+#define CHECK_ENV_COUNT (48)
+#define CHECK_THREADS (2)
+#define CHECK_FRAME_SKIP (2)
+
+static const unsigned long CheckRates[] = {7, ENV_DEFAULT_CYCLES_PER_FRAME, 23};
+
+bool CheckRom(const RomImage &Image, const std::string &Name, unsigned long CyclesPerFrame, unsigned int Steps);
+
+int main(int argc, char * argv[])
+{
+    const char *RomDirectoryName = DEFAULT_ROM_DIRECTORY;
+    unsigned int Steps = DEFAULT_STEPS;
+    std::vector<std::string> RomNames;
+    DIR *RomDirectory;
+    int Failures = 0;
+    
+    for (int ArgIndex = 1; ArgIndex < argc; ++ArgIndex) {
+        
+        if (strcmp(argv[ArgIndex], "--steps") == 0 && ArgIndex + 1 < argc) {
+            Steps = (unsigned int) strtoul(argv[++ArgIndex], NULL, 0);
+            
+        } else if (argv[ArgIndex][0] != '-') {
+            RomDirectoryName = argv[ArgIndex];
+            
+        } else {
+            fprintf(stderr, "Usage: %s [rom directory] [--steps N]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    RomDirectory = opendir(RomDirectoryName);
+    
+    if (RomDirectory == NULL) {
+        fprintf(stderr, "No ROM directory %s\n", RomDirectoryName);
+        return 1;
+    }
+    
+    for (struct dirent *Entry = readdir(RomDirectory); Entry != NULL; Entry = readdir(RomDirectory)) {
+        
+        std::string Name = Entry->d_name;
+        
+        if (Name.size() > 4 && Name.compare(Name.size() - 4, 4, ".ch8") == 0) {
+            RomNames.push_back(Name);
+        }
+    }
+    
+    closedir(RomDirectory);
+    std::sort(RomNames.begin(), RomNames.end());
+    
+    for (size_t Rom = 0; Rom < RomNames.size(); ++Rom) {
+        
+        std::string FileName = std::string(RomDirectoryName) + "/" + RomNames[Rom];
+        RomImage Image;
+        RomStatus Status = Image.Open(FileName.c_str());
+        
+        if (Status != ROM_OK) {
+            fprintf(stderr, "%s: %s\n", FileName.c_str(), RomImage::StatusMessage(Status));
+            ++Failures;
+            continue;
+        }
+        
+        for (size_t Rate = 0; Rate < sizeof(CheckRates) / sizeof(CheckRates[0]); ++Rate) {
+            if (!CheckRom(Image, RomNames[Rom], CheckRates[Rate], Steps)) {
+                ++Failures;
+            }
+        }
+    }
+    
+    printf("%d failed\n", Failures);
+    
+    return Failures == 0 ? 0 : 1;
+}
+
+//
+// Actions change every few steps and differ between environments, so lanes spread out over
+// different paths through the program rather than running as one.
+//
+static uint16_t ActionFor(size_t Env, unsigned int Step)
+{
+    uint32_t Mixed = (uint32_t) (Env * 2654435761u) ^ (uint32_t) ((Step / 8) * 40503u);
+    
+    Mixed ^= Mixed >> 13;
+    
+    return (uint16_t) (Mixed & 0xFFFF);
+}
+
+bool CheckRom(const RomImage &Image, const std::string &Name, unsigned long CyclesPerFrame, unsigned int Steps)
+{
+    Chip8VecEnv Plain(CHECK_ENV_COUNT, CHECK_THREADS, false);
+    Chip8VecEnv Lockstep(CHECK_ENV_COUNT, CHECK_THREADS, true);
+    std::vector<uint32_t> Seeds(CHECK_ENV_COUNT);
+    std::vector<uint16_t> Actions(CHECK_ENV_COUNT);
+    std::vector<unsigned char> PlainObservations(CHECK_ENV_COUNT * ENV_OBSERVATION_SIZE);
+    std::vector<unsigned char> LockstepObservations(CHECK_ENV_COUNT * ENV_OBSERVATION_SIZE);
+    std::vector<unsigned char> PlainDones(CHECK_ENV_COUNT);
+    std::vector<unsigned char> LockstepDones(CHECK_ENV_COUNT);
+    
+    if (!Plain.LoadProgram(Image.Bytes(), Image.Size()) || !Lockstep.LoadProgram(Image.Bytes(), Image.Size())) {
+        fprintf(stderr, "%s: doesn't fit in memory\n", Name.c_str());
+        return false;
+    }
+    
+    Plain.SetCyclesPerFrame(CyclesPerFrame);
+    Lockstep.SetCyclesPerFrame(CyclesPerFrame);
+    
+    for (size_t Env = 0; Env < CHECK_ENV_COUNT; ++Env) {
+        Seeds[Env] = (uint32_t) Env + 1;
+    }
+    
+    Plain.Reset(&Seeds[0], &PlainObservations[0]);
+    Lockstep.Reset(&Seeds[0], &LockstepObservations[0]);
+    
+    for (unsigned int Step = 0; Step < Steps; ++Step) {
+        
+        for (size_t Env = 0; Env < CHECK_ENV_COUNT; ++Env) {
+            Actions[Env] = ActionFor(Env, Step);
+        }
+        
+        Plain.Step(&Actions[0], CHECK_FRAME_SKIP, &PlainObservations[0], &PlainDones[0]);
+        Lockstep.Step(&Actions[0], CHECK_FRAME_SKIP, &LockstepObservations[0], &LockstepDones[0]);
+        
+        for (size_t Env = 0; Env < CHECK_ENV_COUNT; ++Env) {
+            
+            unsigned char PlainRegisters[16];
+            unsigned char LockstepRegisters[16];
+            
+            Plain.GetRegisters(Env, PlainRegisters);
+            Lockstep.GetRegisters(Env, LockstepRegisters);
+            
+            if (PlainDones[Env] != LockstepDones[Env] ||
+                memcmp(PlainRegisters, LockstepRegisters, sizeof(PlainRegisters)) != 0 ||
+                memcmp(&PlainObservations[Env * ENV_OBSERVATION_SIZE], &LockstepObservations[Env * ENV_OBSERVATION_SIZE], ENV_OBSERVATION_SIZE) != 0) {
+                printf("%s at %lu cycles per frame: environment %lu differs after step %u\n", Name.c_str(), CyclesPerFrame, (unsigned long) Env, Step + 1);
+                return false;
+            }
+        }
+    }
+    
+    printf("%s at %lu cycles per frame: ok\n", Name.c_str(), CyclesPerFrame);
+    
+    return true;
+}
@@ -0,0 +1,362 @@
+//
+//  main.cpp
+//  Chip8Headless
+//
+
+//
+// Headless runner. Loads a ROM into the core, runs it for a fixed number of cycles or frames
+// as fast as the host allows and reports how many instructions per second we managed. No
+// SDL anywhere in here, so this runs fine on machines without a display.
+//
+
+#include <iostream>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "Chip8.h"
+#include "InputScript.h"
+#include "InputMovie.h"
+#include "Chip8Trace.h"
+
+#define DEFAULT_CYCLES_PER_FRAME (10)
+
+void PrintUsage(const char *ProgramName);
+
+int main(int argc, char * argv[])
+{
+    Chip8 *Cpu;
+    Chip8 *ReferenceCpu = NULL;
+    const char *VerifiedMode = NULL;
+    InputScript Script;
+    InputMovie Movie;
+    char *RomFileName = NULL;
+    char *ScriptFileName = NULL;
+    char *LoadStateFileName = NULL;
+    char *SaveStateFileName = NULL;
+    char *RecordFileName = NULL;
+    char *ReplayFileName = NULL;
+    char *TraceFileName = NULL;
+    RomImage Rom;
+    RomStatus Status;
+    uint32_t TraceCategories = TRACE_ALL;
+    Chip8QuirkProfile Quirks = QUIRKS_DEFAULT;
+    unsigned long CycleBudget = 0;
+    unsigned long FrameBudget = 0;
+    unsigned long CyclesPerFrame = DEFAULT_CYCLES_PER_FRAME;
+    unsigned long CyclesRun = 0;
+    unsigned long Frame = 0;
+    unsigned char Keyboard[16];
+    unsigned long FrameCycles;
+    unsigned long FrameCyclesRun;
+    bool Running = true;
+    bool UseJit = false;
+    bool Verify = false;
+    bool Profile = false;
+    bool IdleSkip = true;
+    bool Replayed = true;
+    uint32_t Seed = (uint32_t) time(NULL);
+    
+    for (int ArgIndex = 1; ArgIndex < argc; ++ArgIndex) {
+        
+        if (strcmp(argv[ArgIndex], "--cycles") == 0 && ArgIndex + 1 < argc) {
+            CycleBudget = strtoul(argv[++ArgIndex], NULL, 0);
+            
+        } else if (strcmp(argv[ArgIndex], "--frames") == 0 && ArgIndex + 1 < argc) {
+            FrameBudget = strtoul(argv[++ArgIndex], NULL, 0);
+            
+        } else if (strcmp(argv[ArgIndex], "--ipf") == 0 && ArgIndex + 1 < argc) {
+            CyclesPerFrame = strtoul(argv[++ArgIndex], NULL, 0);
+            
+        } else if (strcmp(argv[ArgIndex], "--input") == 0 && ArgIndex + 1 < argc) {
+            ScriptFileName = argv[++ArgIndex];
+            
+        } else if (strcmp(argv[ArgIndex], "--load-state") == 0 && ArgIndex + 1 < argc) {
+            LoadStateFileName = argv[++ArgIndex];
+            
+        } else if (strcmp(argv[ArgIndex], "--save-state") == 0 && ArgIndex + 1 < argc) {
+            SaveStateFileName = argv[++ArgIndex];
+            
+        } else if (strcmp(argv[ArgIndex], "--record") == 0 && ArgIndex + 1 < argc) {
+            RecordFileName = argv[++ArgIndex];
+            
+        } else if (strcmp(argv[ArgIndex], "--replay") == 0 && ArgIndex + 1 < argc) {
+            ReplayFileName = argv[++ArgIndex];
+            
+        } else if (strcmp(argv[ArgIndex], "--seed") == 0 && ArgIndex + 1 < argc) {
+            Seed = (uint32_t) strtoul(argv[++ArgIndex], NULL, 0);
+            
+        } else if (strcmp(argv[ArgIndex], "--quirks") == 0 && ArgIndex + 1 < argc) {
+            
+            if (!ParseQuirkProfile(argv[++ArgIndex], &Quirks)) {
+                fprintf(stderr, "Unknown quirk profile %s\n", argv[ArgIndex]);
+                return 1;
+            }
+            
+        } else if (strcmp(argv[ArgIndex], "--jit") == 0) {
+            UseJit = true;
+            
+        } else if (strcmp(argv[ArgIndex], "--verify") == 0) {
+            UseJit = true;
+            Verify = true;
+            
+        } else if (strcmp(argv[ArgIndex], "--profile") == 0) {
+            Profile = true;
+            
+        } else if (strcmp(argv[ArgIndex], "--no-idle-skip") == 0) {
+            IdleSkip = false;
+            
+        } else if (strcmp(argv[ArgIndex], "--trace") == 0 && ArgIndex + 1 < argc) {
+            TraceFileName = argv[++ArgIndex];
+            
+        } else if (strcmp(argv[ArgIndex], "--trace-categories") == 0 && ArgIndex + 1 < argc) {
+            
+            if (!Chip8Trace::ParseCategories(argv[++ArgIndex], &TraceCategories)) {
+                fprintf(stderr, "Unknown trace category in %s\n", argv[ArgIndex]);
+                return 1;
+            }
+            
+        } else if (argv[ArgIndex][0] != '-' && RomFileName == NULL) {
+            RomFileName = argv[ArgIndex];
+            
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    
+    //
+    // A replay brings its own seed, quirk profile, input and frame lengths and runs until it
+    // runs out.
+    //
+    
+    if (ReplayFileName != NULL) {
+        
+        if (!Movie.Load(ReplayFileName)) {
+            fprintf(stderr, "Couldn't read input movie %s\n", ReplayFileName);
+            return 1;
+        }
+        
+        Seed = Movie.RandomSeed();
+        Quirks = Movie.QuirkProfile();
+        CycleBudget = ULONG_MAX;
+        FrameBudget = 0;
+        
+    } else if (RecordFileName != NULL) {
+        Movie.Start(Seed, Quirks);
+    }
+    
+    if (RomFileName == NULL || CyclesPerFrame == 0 || (CycleBudget == 0 && FrameBudget == 0)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    
+    if (ScriptFileName != NULL && !Script.Load(ScriptFileName)) {
+        fprintf(stderr, "Couldn't read input script %s\n", ScriptFileName);
+        return 1;
+    }
+    
+    if (FrameBudget != 0 && (CycleBudget == 0 || FrameBudget * CyclesPerFrame < CycleBudget)) {
+        CycleBudget = FrameBudget * CyclesPerFrame;
+    }
+    
+    Status = Rom.Open(RomFileName);
+    
+    if (Status != ROM_OK) {
+        fprintf(stderr, "Couldn't load ROM %s: %s\n", RomFileName, RomImage::StatusMessage(Status));
+        return 1;
+    }
+    
+    Cpu = new Chip8();
+    Cpu->Initialize();
+    Cpu->SeedRandom(Seed);
+    Cpu->LoadProgram(Rom.Bytes(), Rom.Size());
+    Cpu->SetQuirkProfile(Quirks);
+    
+    //
+    // A save state picks up where some earlier run left off, random state included, so
+    // there's no boot to sit through.
+    //
+    
+    if (LoadStateFileName != NULL && !Cpu->LoadState(LoadStateFileName)) {
+        fprintf(stderr, "Couldn't load save state %s\n", LoadStateFileName);
+        delete Cpu;
+        return 1;
+    }
+    
+    Cpu->SetProfilerEnabled(Profile);
+    Cpu->SetIdleSkipEnabled(IdleSkip);
+    
+    if (TraceFileName != NULL) {
+        Cpu->EnableTrace(TraceCategories);
+    }
+    
+    if (UseJit) {
+        Cpu->SetJitEnabled(true);
+        
+        if (!Cpu->JitEnabled()) {
+            fprintf(stderr, "JIT isn't available on this host, interpreting\n");
+        }
+    }
+    
+    //
+    // Verifying runs a second, interpreter only machine in lockstep and compares the two after
+    // every frame. Both get the same random seed so CXKK agrees. The reference runs every
+    // instruction, so idle loop skipping gets checked too.
+    //
+    
+    if (Verify) {
+        VerifiedMode = Cpu->JitEnabled() ? (IdleSkip ? "JIT with idle skipping" : "JIT") : (IdleSkip ? "Interpreter with idle skipping" : "Interpreter");
+        ReferenceCpu = new Chip8();
+        ReferenceCpu->SetIdleSkipEnabled(false);
+        ReferenceCpu->Initialize();
+        ReferenceCpu->SeedRandom(Seed);
+        ReferenceCpu->LoadProgram(Rom.Bytes(), Rom.Size());
+        ReferenceCpu->SetQuirkProfile(Quirks);
+        
+        if (LoadStateFileName != NULL) {
+            ReferenceCpu->LoadState(LoadStateFileName);
+        }
+    }
+    
+    memset(Keyboard, 0, 16 * sizeof(unsigned char));
+    
+    //
+    // Run uncapped. Input only changes on frame boundaries so the script sees the same
+    // frame numbers the interactive loop would.
+    //
+    
+    std::chrono::steady_clock::time_point StartTime = std::chrono::steady_clock::now();
+    
+    while (Running && CyclesRun < CycleBudget) {
+        
+        if (ReplayFileName != NULL) {
+            
+            if (Frame == Movie.FrameCount()) {
+                break;
+            }
+            
+            Movie.KeysForFrame(Frame, Keyboard);
+            FrameCycles = Movie.CyclesForFrame(Frame);
+            
+        } else {
+            Script.KeysForFrame(Frame, Keyboard);
+            FrameCycles = std::min(CyclesPerFrame, CycleBudget - CyclesRun);
+            
+            if (RecordFileName != NULL && !Movie.RecordFrame(Script.KeyMaskForFrame(Frame), FrameCycles)) {
+                fprintf(stderr, "Frame %lu runs too many instructions to record\n", Frame);
+                delete Cpu;
+                delete ReferenceCpu;
+                return 1;
+            }
+        }
+        
+        FrameCyclesRun = Cpu->Run(Keyboard, FrameCycles);
+        CyclesRun += FrameCyclesRun;
+        
+        Cpu->TickTimers();
+        
+        if (FrameCyclesRun != FrameCycles) {
+            Running = false;
+        }
+        
+        if (Verify) {
+            ReferenceCpu->Run(Keyboard, FrameCycles);
+            ReferenceCpu->TickTimers();
+            
+            if (!Cpu->CompareState(*ReferenceCpu)) {
+                fprintf(stderr, "%s and plain interpreter disagree after frame %lu\n", VerifiedMode, Frame);
+                delete Cpu;
+                delete ReferenceCpu;
+                return 2;
+            }
+        }
+        
+        ++Frame;
+    }
+    
+    std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - StartTime;
+    
+    if (SaveStateFileName != NULL && !Cpu->SaveState(SaveStateFileName)) {
+        fprintf(stderr, "Couldn't write save state %s\n", SaveStateFileName);
+    }
+    
+    if (TraceFileName != NULL && !Cpu->GetTrace()->Save(TraceFileName)) {
+        fprintf(stderr, "Couldn't write trace %s\n", TraceFileName);
+    }
+    
+    if (RecordFileName != NULL && ReplayFileName == NULL) {
+        Movie.Finish(*Cpu);
+        
+        if (!Movie.Save(RecordFileName)) {
+            fprintf(stderr, "Couldn't write input movie %s\n", RecordFileName);
+        }
+    }
+    
+    printf("rom:          %s\n"
+           "instructions: %lu\n"
+           "frames:       %lu\n"
+           "seconds:      %.6f\n"
+           "instr/sec:    %.0f\n"
+           "idle skipped: %llu\n"
+           "key waiting:  %llu\n",
+           RomFileName,
+           CyclesRun,
+           Frame,
+           Elapsed.count(),
+           Elapsed.count() > 0 ? CyclesRun / Elapsed.count() : 0.0,
+           Cpu->IdleCycles(),
+           Cpu->KeyWaitCycles());
+    
+    if (Profile) {
+        printf("\n");
+        Cpu->WriteProfileReport(stdout);
+    }
+    
+    if (Cpu->GetFault() != FAULT_NONE) {
+        printf("fault:        %s at 0x%03X\n", Chip8::FaultMessage(Cpu->GetFault()), Cpu->GetProgramCounter());
+    }
+    
+    //
+    // Anything other than the exact recorded end state means the run didn't reproduce.
+    //
+    
+    if (ReplayFileName != NULL) {
+        Replayed = Movie.MatchesFinalState(*Cpu);
+        printf("replay:       %s\n", Replayed ? "matches recording" : "DIVERGED from recording");
+    }
+    
+    delete Cpu;
+    delete ReferenceCpu;
+    
+    return Replayed ? 0 : 3;
+}
+
+void PrintUsage(const char *ProgramName)
+{
+    fprintf(stderr,
+            "Usage: %s <rom> (--cycles N | --frames N) [--ipf N] [--quirks P] [--input script] [--seed N]\n"
+            "       [--load-state F] [--save-state F] [--record F | --replay F] [--jit | --verify]\n"
+            "       [--profile] [--trace F [--trace-categories L]] [--no-idle-skip]\n"
+            "    --cycles N      stop after N instructions\n"
+            "    --frames N      stop after N frames\n"
+            "    --ipf N         instructions per frame (default %d)\n"
+            "    --quirks P      default, vip, schip or xochip, see Chip8Quirks.h\n"
+            "    --input F       scripted key states, see InputScript.h\n"
+            "    --seed N        random seed for CXKK (default the time)\n"
+            "    --load-state F  start from a save state instead of a fresh boot\n"
+            "    --save-state F  write a save state when the run ends\n"
+            "    --record F      record an input movie of the run, see InputMovie.h\n"
+            "    --replay F      replay an input movie as fast as possible and check the end state\n"
+            "    --jit           run compiled blocks where possible\n"
+            "    --verify        --jit, checked against the interpreter every frame\n"
+            "    --profile       count instructions per opcode and address and report at the end\n"
+            "    --trace F       write the most recent trace records to F, see Chip8Trace.h\n"
+            "    --trace-categories L\n"
+            "                    instructions, draw, input, timers or all (default all)\n"
+            "    --no-idle-skip  run idle loops instruction by instruction\n",
+            ProgramName,
+            DEFAULT_CYCLES_PER_FRAME);
+}
@@ -0,0 +1,602 @@
+//
+//  Chip8Jit.cpp
+//  Chip8Emulator
+//
+
+#include "Chip8Jit.h"
+#include "Chip8.h"
+
+#if CHIP8_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+//
+// Host registers V registers can live in during a block. RDI holds the VRegisters pointer
+// we get called with and R11 is kept free as scratch.
+//
+
+#define HOST_REGISTER_COUNT (7)
+#define HOST_SCRATCH_REGISTER (11)
+#define HOST_BASE_REGISTER (7)
+
+static const int HostRegisters[HOST_REGISTER_COUNT] = {0, 1, 2, 6, 8, 9, 10};
+
+//
+// x86 opcodes for "op r/m8, r8"
+//
+
+#define X86_ADD (0x00)
+#define X86_OR (0x08)
+#define X86_AND (0x20)
+#define X86_SUB (0x28)
+#define X86_XOR (0x30)
+#define X86_CMP (0x38)
+#define X86_MOV (0x88)
+
+//
+// Worst case a single instruction expands to, plus prologue and epilogue.
+//
+
+#define JIT_MAX_INSTRUCTION_BYTES (32)
+#define JIT_MAX_BLOCK_BYTES (JIT_MAX_BLOCK_INSTRUCTIONS * JIT_MAX_INSTRUCTION_BYTES + 16 * 8 * 2 + 64)
+
+typedef enum {
+    NotTranslated,
+    Straight,
+    Terminator
+} InstructionKind;
+
+//
+// 8XY1 to 8XY3 are only plain register operations when the quirk profile leaves VF alone.
+//
+static InstructionKind ClassifyOpcode(unsigned short Opcode, bool LogicClearsCarry)
+{
+    switch (Opcode & FIRST_FOUR_BITMASK) {
+        case 0x1000:
+        case 0x3000:
+        case 0x4000:
+            return Terminator;
+        
+        case 0x5000:
+        case 0x9000:
+            return (Opcode & LAST_FOUR_BITMASK) == 0 ? Terminator : NotTranslated;
+        
+        case 0x6000:
+        case 0x7000:
+        case 0xA000:
+            return Straight;
+        
+        case 0x8000:
+            if (LogicClearsCarry && (Opcode & LAST_FOUR_BITMASK) >= 0x1 && (Opcode & LAST_FOUR_BITMASK) <= 0x3) {
+                return NotTranslated;
+            }
+            
+            return (Opcode & LAST_FOUR_BITMASK) <= 0x5 ? Straight : NotTranslated;
+        
+        case 0xF000:
+            return (Opcode & LAST_EIGHT_BITMASK) == 0x1E ? Straight : NotTranslated;
+        
+        default:
+            return NotTranslated;
+    }
+}
+
+Chip8Jit::Chip8Jit()
+{
+    CodeBuffer = NULL;
+
+#if CHIP8_JIT_SUPPORTED
+    void *Mapping = mmap(NULL, JIT_CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    
+    if (Mapping != MAP_FAILED) {
+        CodeBuffer = (unsigned char *) Mapping;
+    }
+#endif
+    
+    Flush();
+}
+
+Chip8Jit::~Chip8Jit()
+{
+#if CHIP8_JIT_SUPPORTED
+    if (CodeBuffer != NULL) {
+        munmap(CodeBuffer, JIT_CODE_BUFFER_SIZE);
+    }
+#endif
+}
+
+//
+// Throw away every compiled block.
+//
+void Chip8Jit::Flush()
+{
+    CodeUsed = 0;
+    
+    memset(Blocks, 0, sizeof(Blocks));
+    memset(BlockInstructions, 0, sizeof(BlockInstructions));
+    memset(NotCompilable, 0, sizeof(NotCompilable));
+    memset(CoverCount, 0, sizeof(CoverCount));
+    memset(Recompiles, 0, sizeof(Recompiles));
+}
+
+//
+// Memory was written. Drop every block that overlaps the written bytes, including one that
+// starts with the byte before. The code space they used is only reclaimed on the next Flush.
+// Writes wrap at the top of memory like every other access, so the written range (with the
+// byte before it) is walked modulo 4096. Blocks themselves never wrap.
+//
+void Chip8Jit::Invalidate(unsigned short Address, unsigned short Length)
+{
+    int FirstAddress = (Address - 1) & ADDRESS_BITMASK;
+    bool Covered = false;
+    
+    for (int Offset = 0; Offset <= Length; ++Offset) {
+        
+        int CurrentAddress = (FirstAddress + Offset) & ADDRESS_BITMASK;
+        
+        Covered = Covered || CoverCount[CurrentAddress] != 0;
+        NotCompilable[CurrentAddress] = false;
+    }
+    
+    if (!Covered) {
+        return;
+    }
+    
+    for (int Offset = -(JIT_MAX_BLOCK_INSTRUCTIONS - 1) * 2; Offset <= Length; ++Offset) {
+        
+        int Start = (FirstAddress + Offset) & ADDRESS_BITMASK;
+        int End = Start + BlockInstructions[Start] * 2 - 1;
+        bool Overlaps = false;
+        
+        if (Blocks[Start] == NULL) {
+            continue;
+        }
+        
+        for (int CoveredAddress = Start; CoveredAddress <= End && !Overlaps; ++CoveredAddress) {
+            Overlaps = ((CoveredAddress - FirstAddress) & ADDRESS_BITMASK) <= Length;
+        }
+        
+        if (!Overlaps) {
+            continue;
+        }
+        
+        for (int CoveredAddress = Start; CoveredAddress <= End; ++CoveredAddress) {
+            --CoverCount[CoveredAddress];
+        }
+        
+        Blocks[Start] = NULL;
+        BlockInstructions[Start] = 0;
+        ++Recompiles[Start];
+    }
+}
+
+//
+// Slow path of RunBlock, compile the block at Address if we can. Returns false if there
+// isn't going to be one.
+//
+bool Chip8Jit::CompileAt(Chip8 &Cpu, unsigned short Address)
+{
+    if (CodeBuffer == NULL || Recompiles[Address] >= JIT_MAX_RECOMPILES) {
+        NotCompilable[Address] = true;
+        return false;
+    }
+    
+    Blocks[Address] = Compile(Cpu, Address);
+    
+    if (Blocks[Address] == NULL) {
+        NotCompilable[Address] = true;
+        return false;
+    }
+    
+    return true;
+}
+
+JitBlockFunction Chip8Jit::Compile(Chip8 &Cpu, unsigned short Address)
+{
+#if CHIP8_JIT_SUPPORTED
+    unsigned short Opcodes[JIT_MAX_BLOCK_INSTRUCTIONS];
+    InstructionKind Kinds[JIT_MAX_BLOCK_INSTRUCTIONS];
+    int HostRegisterFor[16];
+    bool Written[16];
+    int RegistersUsed = 0;
+    int InstructionCount = 0;
+    unsigned short CurrentAddress = Address;
+    long ProgramEndAddress = Cpu.State.ProgramEnd != NO_PROGRAM_END ? Cpu.State.ProgramEnd : -1;
+    bool LogicClearsCarry = QuirkLogicClearsCarry(Cpu.Quirks);
+    unsigned char *BlockStart;
+    
+    int IndexOffset = (int) ((unsigned char *) &Cpu.State.IndexRegister - Cpu.State.VRegisters);
+    int ProgramCounterOffset = (int) ((unsigned char *) &Cpu.State.ProgramCounter - Cpu.State.VRegisters);
+    
+    for (int Register = 0; Register < 16; ++Register) {
+        HostRegisterFor[Register] = -1;
+        Written[Register] = false;
+    }
+    
+    //
+    // Find the extent of the block and give every V register it touches a host register.
+    // Stop early if we run out of host registers.
+    //
+    
+    while (InstructionCount < JIT_MAX_BLOCK_INSTRUCTIONS &&
+           CurrentAddress < ADDRESS_BITMASK &&
+           CurrentAddress != ProgramEndAddress) {
+        
+        unsigned short Opcode = Cpu.State.Memory[CurrentAddress] << 8 | Cpu.State.Memory[CurrentAddress + 1];
+        InstructionKind Kind = ClassifyOpcode(Opcode, LogicClearsCarry);
+        int Needed[3];
+        int NeededCount = 0;
+        int NewRegisters = 0;
+        
+        //
+        // A jump closing an idle loop is left to the interpreter, which can tell when the
+        // loop is spinning and skip ahead.
+        //
+        
+        if ((Opcode & FIRST_FOUR_BITMASK) == 0x1000 && Cpu.IdleLoopCandidate(CurrentAddress)) {
+            Kind = NotTranslated;
+        }
+        
+        if (Kind == NotTranslated) {
+            break;
+        }
+        
+        switch (Opcode & FIRST_FOUR_BITMASK) {
+            case 0x1000:
+            case 0xA000:
+                break;
+            
+            case 0x8000:
+                Needed[NeededCount++] = (Opcode & REGISTER_ONE_BITMASK) >> 8;
+                Needed[NeededCount++] = (Opcode & REGISTER_TWO_BITMASK) >> 4;
+                
+                if ((Opcode & LAST_FOUR_BITMASK) >= 0x4) {
+                    Needed[NeededCount++] = 0xF;
+                }
+                break;
+            
+            case 0x5000:
+            case 0x9000:
+                Needed[NeededCount++] = (Opcode & REGISTER_ONE_BITMASK) >> 8;
+                Needed[NeededCount++] = (Opcode & REGISTER_TWO_BITMASK) >> 4;
+                break;
+            
+            default:
+                Needed[NeededCount++] = (Opcode & REGISTER_ONE_BITMASK) >> 8;
+                break;
+        }
+        
+        for (int Index = 0; Index < NeededCount; ++Index) {
+            bool AlreadyCounted = false;
+            
+            for (int Previous = 0; Previous < Index; ++Previous) {
+                AlreadyCounted = AlreadyCounted || Needed[Previous] == Needed[Index];
+            }
+            
+            if (HostRegisterFor[Needed[Index]] == -1 && !AlreadyCounted) {
+                ++NewRegisters;
+            }
+        }
+        
+        if (RegistersUsed + NewRegisters > HOST_REGISTER_COUNT) {
+            break;
+        }
+        
+        for (int Index = 0; Index < NeededCount; ++Index) {
+            if (HostRegisterFor[Needed[Index]] == -1) {
+                HostRegisterFor[Needed[Index]] = HostRegisters[RegistersUsed++];
+            }
+        }
+        
+        Opcodes[InstructionCount] = Opcode;
+        Kinds[InstructionCount] = Kind;
+        ++InstructionCount;
+        CurrentAddress += 2;
+        
+        if (Kind == Terminator) {
+            break;
+        }
+    }
+    
+    if (InstructionCount == 0) {
+        return NULL;
+    }
+    
+    if (CodeUsed + JIT_MAX_BLOCK_BYTES > JIT_CODE_BUFFER_SIZE) {
+        Flush();
+    }
+    
+    if (mprotect(CodeBuffer, JIT_CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        return NULL;
+    }
+    
+    BlockStart = CodeBuffer + CodeUsed;
+    Emit = BlockStart;
+    
+    //
+    // Prologue, pull the V registers into their host registers.
+    //
+    
+    for (int Register = 0; Register < 16; ++Register) {
+        int Host = HostRegisterFor[Register];
+        
+        if (Host != -1) {
+            EmitByte(0x40 | (Host >= 8 ? 0x4 : 0));
+            EmitByte(0x8A);
+            EmitByte(0x40 | (Host & 7) << 3 | HOST_BASE_REGISTER);
+            EmitByte(Register);
+        }
+    }
+    
+    for (int Index = 0; Index < InstructionCount; ++Index) {
+        
+        unsigned short Opcode = Opcodes[Index];
+        int X = HostRegisterFor[(Opcode & REGISTER_ONE_BITMASK) >> 8];
+        int Y = HostRegisterFor[(Opcode & REGISTER_TWO_BITMASK) >> 4];
+        int F = HostRegisterFor[0xF];
+        unsigned char Kk = Opcode & LAST_EIGHT_BITMASK;
+        
+        if (Kinds[Index] == Terminator) {
+            break;
+        }
+        
+        switch (Opcode & FIRST_FOUR_BITMASK) {
+            
+            case 0x6000:
+                
+                //
+                // mov x8, imm8
+                //
+                
+                EmitByte(0x40 | (X >= 8 ? 0x1 : 0));
+                EmitByte(0xB0 | (X & 7));
+                EmitByte(Kk);
+                Written[(Opcode & REGISTER_ONE_BITMASK) >> 8] = true;
+                break;
+            
+            case 0x7000:
+                
+                //
+                // add x8, imm8
+                //
+                
+                EmitByte(0x40 | (X >= 8 ? 0x1 : 0));
+                EmitByte(0x80);
+                EmitByte(0xC0 | (X & 7));
+                EmitByte(Kk);
+                Written[(Opcode & REGISTER_ONE_BITMASK) >> 8] = true;
+                break;
+            
+            case 0x8000:
+                
+                Written[(Opcode & REGISTER_ONE_BITMASK) >> 8] = true;
+                
+                switch (Opcode & LAST_FOUR_BITMASK) {
+                    case 0x0:
+                        EmitRegisterOp(X86_MOV, X, Y);
+                        break;
+                    
+                    case 0x1:
+                        EmitRegisterOp(X86_OR, X, Y);
+                        break;
+                    
+                    case 0x2:
+                        EmitRegisterOp(X86_AND, X, Y);
+                        break;
+                    
+                    case 0x3:
+                        EmitRegisterOp(X86_XOR, X, Y);
+                        break;
+                    
+                    case 0x4:
+                    case 0x5:
+                        
+                        //
+                        // The interpreter sets VF from the original values first, then does the
+                        // operation with whatever is in the registers afterwards, which matters
+                        // when X or Y is F. Work out the flag in scratch to get the same order.
+                        //
+                        
+                        EmitRegisterOp(X86_MOV, HOST_SCRATCH_REGISTER, X);
+                        
+                        if ((Opcode & LAST_FOUR_BITMASK) == 0x4) {
+                            EmitRegisterOp(X86_ADD, HOST_SCRATCH_REGISTER, Y);
+                        } else {
+                            EmitRegisterOp(X86_SUB, HOST_SCRATCH_REGISTER, Y);
+                        }
+                        
+                        //
+                        // setc for add, setnc (no borrow) for subtract
+                        //
+                        
+                        EmitByte(0x40 | (F >= 8 ? 0x1 : 0));
+                        EmitByte(0x0F);
+                        EmitByte((Opcode & LAST_FOUR_BITMASK) == 0x4 ? 0x92 : 0x93);
+                        EmitByte(0xC0 | (F & 7));
+                        
+                        EmitRegisterOp((Opcode & LAST_FOUR_BITMASK) == 0x4 ? X86_ADD : X86_SUB, X, Y);
+                        Written[0xF] = true;
+                        break;
+                    
+                    default:
+                        break;
+                }
+                break;
+            
+            case 0xA000:
+                
+                //
+                // mov word [rdi + I], imm16
+                //
+                
+                EmitByte(0x66);
+                EmitByte(0xC7);
+                EmitByte(0x80 | HOST_BASE_REGISTER);
+                EmitDword(IndexOffset);
+                EmitWord(Opcode & LAST_TWELVE_BITMASK);
+                break;
+            
+            case 0xF000:
+                
+                //
+                // movzx r11d, x8 then add word [rdi + I], r11w
+                //
+                
+                EmitByte(0x40 | 0x4 | (X >= 8 ? 0x1 : 0));
+                EmitByte(0x0F);
+                EmitByte(0xB6);
+                EmitByte(0xC0 | (HOST_SCRATCH_REGISTER & 7) << 3 | (X & 7));
+                
+                EmitByte(0x66);
+                EmitByte(0x44);
+                EmitByte(0x01);
+                EmitByte(0x80 | (HOST_SCRATCH_REGISTER & 7) << 3 | HOST_BASE_REGISTER);
+                EmitDword(IndexOffset);
+                break;
+            
+            default:
+                break;
+        }
+    }
+    
+    //
+    // If the block ends in a skip, do the compare now. Nothing after it touches the flags.
+    //
+    
+    unsigned short LastOpcode = Opcodes[InstructionCount - 1];
+    unsigned short LastAddress = Address + (InstructionCount - 1) * 2;
+    int LastX = HostRegisterFor[(LastOpcode & REGISTER_ONE_BITMASK) >> 8];
+    int LastY = HostRegisterFor[(LastOpcode & REGISTER_TWO_BITMASK) >> 4];
+    bool EndsInSkip = false;
+    unsigned char SkipJump = 0;
+    
+    if (Kinds[InstructionCount - 1] == Terminator) {
+        
+        switch (LastOpcode & FIRST_FOUR_BITMASK) {
+            case 0x3000:
+            case 0x4000:
+                
+                //
+                // cmp x8, imm8
+                //
+                
+                EmitByte(0x40 | (LastX >= 8 ? 0x1 : 0));
+                EmitByte(0x80);
+                EmitByte(0xC0 | 7 << 3 | (LastX & 7));
+                EmitByte(LastOpcode & LAST_EIGHT_BITMASK);
+                
+                EndsInSkip = true;
+                SkipJump = (LastOpcode & FIRST_FOUR_BITMASK) == 0x3000 ? 0x75 : 0x74;
+                break;
+            
+            case 0x5000:
+            case 0x9000:
+                EmitRegisterOp(X86_CMP, LastX, LastY);
+                
+                EndsInSkip = true;
+                SkipJump = (LastOpcode & FIRST_FOUR_BITMASK) == 0x5000 ? 0x75 : 0x74;
+                break;
+            
+            default:
+                break;
+        }
+    }
+    
+    //
+    // Epilogue, write back whatever the block changed and set the program counter.
+    //
+    
+    for (int Register = 0; Register < 16; ++Register) {
+        int Host = HostRegisterFor[Register];
+        
+        if (Host != -1 && Written[Register]) {
+            EmitByte(0x40 | (Host >= 8 ? 0x4 : 0));
+            EmitByte(X86_MOV);
+            EmitByte(0x40 | (Host & 7) << 3 | HOST_BASE_REGISTER);
+            EmitByte(Register);
+        }
+    }
+    
+    if (EndsInSkip) {
+        
+        //
+        // jne/je over the second store when the skip isn't taken
+        //
+        
+        EmitSetProgramCounter(ProgramCounterOffset, LastAddress + 2);
+        EmitByte(SkipJump);
+        EmitByte(9);
+        EmitSetProgramCounter(ProgramCounterOffset, LastAddress + 4);
+        
+    } else if (Kinds[InstructionCount - 1] == Terminator) {
+        EmitSetProgramCounter(ProgramCounterOffset, LastOpcode & LAST_TWELVE_BITMASK);
+        
+    } else {
+        EmitSetProgramCounter(ProgramCounterOffset, Address + InstructionCount * 2);
+    }
+    
+    //
+    // mov eax, InstructionCount; ret
+    //
+    
+    EmitByte(0xB8);
+    EmitDword(InstructionCount);
+    EmitByte(0xC3);
+    
+    CodeUsed = Emit - CodeBuffer;
+    
+    if (mprotect(CodeBuffer, JIT_CODE_BUFFER_SIZE, PROT_READ | PROT_EXEC) != 0) {
+        Flush();
+        return NULL;
+    }
+    
+    for (int Index = 0; Index < InstructionCount * 2; ++Index) {
+        ++CoverCount[Address + Index];
+    }
+    
+    BlockInstructions[Address] = InstructionCount;
+    
+    return (JitBlockFunction) BlockStart;
+#else
+    return NULL;
+#endif
+}
+
+void Chip8Jit::EmitByte(unsigned char Byte)
+{
+    *Emit++ = Byte;
+}
+
+void Chip8Jit::EmitWord(unsigned short Word)
+{
+    EmitByte(Word & 0xFF);
+    EmitByte(Word >> 8);
+}
+
+void Chip8Jit::EmitDword(unsigned int Dword)
+{
+    EmitWord(Dword & 0xFFFF);
+    EmitWord(Dword >> 16);
+}
+
+//
+// op Destination8, Source8 for the "op r/m8, r8" encodings
+//
+void Chip8Jit::EmitRegisterOp(unsigned char OpByte, int Destination, int Source)
+{
+    EmitByte(0x40 | (Source >= 8 ? 0x4 : 0) | (Destination >= 8 ? 0x1 : 0));
+    EmitByte(OpByte);
+    EmitByte(0xC0 | (Source & 7) << 3 | (Destination & 7));
+}
+
+//
+// mov word [rdi + ProgramCounter], Value. Always 9 bytes, the skip jumps rely on that.
+//
+void Chip8Jit::EmitSetProgramCounter(int ProgramCounterOffset, unsigned short Value)
+{
+    EmitByte(0x66);
+    EmitByte(0xC7);
+    EmitByte(0x80 | HOST_BASE_REGISTER);
+    EmitDword(ProgramCounterOffset);
+    EmitWord(Value);
+}
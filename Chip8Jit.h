@@ -0,0 +1,115 @@
+//
+//  Chip8Jit.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__Chip8Jit__
+#define __Chip8Emulator__Chip8Jit__
+
+#include <stddef.h>
+
+//
+// Basic block recompiler for x86-64. Straight runs of register instructions (6XKK, 7XKK,
+// 8XY0-8XY5, ANNN, FX1E) are translated to native code, with the V registers the block
+// touches loaded into host registers on entry and written back on exit. A block ends with a
+// 1NNN jump or one of the skip instructions, which are compiled as well, or just before the
+// first instruction we don't translate, which is then left to the interpreter. Everything
+// else (calls, returns, BNNN, drawing, timers, keys, memory stores) always goes through the
+// interpreter, which stays the reference implementation. So do jumps that close an idle
+// loop (see Chip8::IdleLoopCandidate).
+//
+// On anything other than x86-64 with mmap, Available() is false and the interpreter is used
+// for everything.
+//
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define CHIP8_JIT_SUPPORTED 1
+#else
+#define CHIP8_JIT_SUPPORTED 0
+#endif
+
+#define JIT_CODE_BUFFER_SIZE (1024 * 1024)
+#define JIT_MAX_BLOCK_INSTRUCTIONS (64)
+
+//
+// A block rewritten more often than this is left to the interpreter, recompiling self
+// modifying code every time around the loop costs more than it saves.
+//
+
+#define JIT_MAX_RECOMPILES (8)
+
+class Chip8;
+
+typedef unsigned int (*JitBlockFunction)(unsigned char *VRegisters);
+
+class Chip8Jit {
+
+private:
+    
+    unsigned char *CodeBuffer;
+    size_t CodeUsed;
+    
+    //
+    // Compiled block starting at each address, NULL if there isn't one yet. Blocks we tried
+    // and failed to compile are remembered so we don't keep retrying them.
+    //
+    
+    JitBlockFunction Blocks[4096];
+    unsigned char BlockInstructions[4096];
+    bool NotCompilable[4096];
+    
+    //
+    // How many compiled blocks cover each address, and how many times the block starting at
+    // each address has been thrown away, for invalidation.
+    //
+    
+    unsigned char CoverCount[4096];
+    unsigned char Recompiles[4096];
+    
+    unsigned char *Emit;
+    
+    bool CompileAt(Chip8 &Cpu, unsigned short Address);
+    JitBlockFunction Compile(Chip8 &Cpu, unsigned short Address);
+    
+    void EmitByte(unsigned char Byte);
+    void EmitWord(unsigned short Word);
+    void EmitDword(unsigned int Dword);
+    
+    void EmitRegisterOp(unsigned char OpByte, int Destination, int Source);
+    void EmitSetProgramCounter(int ProgramCounterOffset, unsigned short Value);
+
+public:
+    Chip8Jit();
+    ~Chip8Jit();
+    
+    bool Available() {return CodeBuffer != NULL;};
+    
+    //
+    // Run the compiled block at Address if there is one and it fits in the budget. Returns
+    // how many instructions it executed, 0 means the caller should interpret instead. This
+    // gets asked before every interpreted instruction, so the common answers stay inline.
+    //
+    
+    unsigned int RunBlock(Chip8 &Cpu, unsigned short Address, unsigned char *VRegisters, unsigned int CycleBudget)
+    {
+        if (Address >= 4096 || NotCompilable[Address]) {
+            return 0;
+        }
+        
+        if (Blocks[Address] == NULL && !CompileAt(Cpu, Address)) {
+            return 0;
+        }
+        
+        if (BlockInstructions[Address] > CycleBudget) {
+            return 0;
+        }
+        
+        return Blocks[Address](VRegisters);
+    };
+    
+    void Invalidate(unsigned short Address, unsigned short Length);
+    void Flush();
+    
+};
+
+#endif /* defined(__Chip8Emulator__Chip8Jit__) */
@@ -0,0 +1,1423 @@
+//
+//  Chip8Lockstep.cpp
+//  Chip8Emulator
+//
+
+#include <string.h>
+#include <algorithm>
+
+#include "Chip8Lockstep.h"
+
+#if CHIP8_LOCKSTEP_AVX2
+#include <immintrin.h>
+
+#define LOCKSTEP_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+#define LANE_BIT(Lane) (1u << (Lane))
+
+//
+// Lowest set bit, for walking a lane mask.
+//
+static inline int NextLane(uint32_t Lanes)
+{
+    return __builtin_ctz(Lanes);
+}
+
+Chip8Lockstep::Chip8Lockstep(size_t Lanes)
+{
+    LaneCount = Lanes;
+    BlockCount = (Lanes + LOCKSTEP_BLOCK_LANES - 1) / LOCKSTEP_BLOCK_LANES;
+    
+    //
+    // Blocks want cache line alignment, which Chip8's allocator already gives us.
+    //
+    
+    Blocks = (LockstepBlock *) Chip8::operator new(std::max(BlockCount, (size_t) 1) * sizeof(LockstepBlock));
+    memset(Blocks, 0, std::max(BlockCount, (size_t) 1) * sizeof(LockstepBlock));
+    memset(Program, 0, sizeof(Program));
+    
+    CycleBudget.assign(Lanes, LOCKSTEP_UNLIMITED_CYCLES);
+    CyclesRun.assign(Lanes, 0);
+    Done.assign(Lanes, false);
+    
+    VectorEnabled = VectorAvailable();
+    VectorSteps = 0;
+    ScalarSteps = 0;
+}
+
+Chip8Lockstep::~Chip8Lockstep()
+{
+    Chip8::operator delete(Blocks);
+}
+
+bool Chip8Lockstep::VectorAvailable()
+{
+#if CHIP8_LOCKSTEP_AVX2
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+//
+// Let a real Chip8 set up the starting machine, so there's exactly one definition of what a
+// freshly loaded machine looks like, then copy it into every lane.
+//
+bool Chip8Lockstep::LoadProgram(const unsigned char *ProgramBytes, size_t Length)
+{
+    Chip8 *Cpu = new Chip8();
+    bool Loaded;
+    
+    Cpu->Initialize();
+    Loaded = Cpu->LoadProgram(ProgramBytes, Length);
+    
+    if (Loaded) {
+        
+        memcpy(Program, Cpu->GetState().Memory, sizeof(Program));
+        
+        for (size_t Block = 0; Block < BlockCount; ++Block) {
+            memset(Blocks[Block].CodeWritten, 0, sizeof(Blocks[Block].CodeWritten));
+        }
+        
+        for (size_t Lane = 0; Lane < LaneCount; ++Lane) {
+            SetState(Lane, Cpu->GetState());
+        }
+    }
+    
+    delete Cpu;
+    
+    return Loaded;
+}
+
+void Chip8Lockstep::SeedRandom(size_t Lane, uint32_t Seed)
+{
+    //
+    // Same rule as Chip8::SeedRandom, xorshift gets stuck at zero.
+    //
+    
+    Blocks[Lane / LOCKSTEP_BLOCK_LANES].RandomState[Lane % LOCKSTEP_BLOCK_LANES] = Seed != 0 ? Seed : 0x2545F491;
+}
+
+void Chip8Lockstep::SetCycleBudget(size_t Lane, unsigned long Cycles)
+{
+    CycleBudget[Lane] = Cycles;
+}
+
+void Chip8Lockstep::SetKeys(size_t Lane, const unsigned char *KeyboardState)
+{
+    LockstepBlock &Block = Blocks[Lane / LOCKSTEP_BLOCK_LANES];
+    
+    for (int Key = 0; Key < 16; ++Key) {
+        Block.Key[Key][Lane % LOCKSTEP_BLOCK_LANES] = KeyboardState[Key];
+    }
+}
+
+void Chip8Lockstep::GetState(size_t Lane, Chip8State *State)
+{
+    const LockstepBlock &Block = Blocks[Lane / LOCKSTEP_BLOCK_LANES];
+    int Index = (int) (Lane % LOCKSTEP_BLOCK_LANES);
+    
+    memset(State, 0, sizeof(*State));
+    memcpy(State->Memory, Block.Memory[Index], sizeof(State->Memory));
+    
+    for (int Word = 0; Word < GRAPHICS_WORDS; ++Word) {
+        State->Graphics[Word] = Block.Graphics[Word][Index];
+    }
+    
+    for (int Register = 0; Register < 16; ++Register) {
+        State->VRegisters[Register] = Block.VRegisters[Register][Index];
+        State->Key[Register] = Block.Key[Register][Index];
+    }
+    
+    for (int Entry = 0; Entry < STACK_DEPTH; ++Entry) {
+        State->Stack[Entry] = Block.Stack[Entry][Index];
+    }
+    
+    State->IndexRegister = Block.IndexRegister[Index];
+    State->ProgramCounter = Block.ProgramCounter[Index];
+    State->DelayTimer = Block.DelayTimer[Index];
+    State->SoundTimer = Block.SoundTimer[Index];
+    State->StackPointer = Block.StackPointer[Index];
+    State->Fault = Block.Fault[Index];
+    State->ProgramEnd = Block.ProgramEnd[Index];
+    State->RandomState = Block.RandomState[Index];
+    State->DirtyRows = Block.DirtyRows[Index];
+    State->DrawFlag = Block.DrawFlag[Index] != 0;
+    State->HiRes = Block.HiRes[Index] != 0;
+    State->WaitingForKey = Block.WaitingForKey[Index] != 0;
+    State->KeyWaitRegister = Block.KeyWaitRegister[Index];
+    State->KeysHeld = Block.KeysHeld[Index];
+}
+
+bool Chip8Lockstep::GetGraphics(size_t Lane, uint64_t *Words)
+{
+    const LockstepBlock &Block = Blocks[Lane / LOCKSTEP_BLOCK_LANES];
+    int Index = (int) (Lane % LOCKSTEP_BLOCK_LANES);
+    
+    for (int Word = 0; Word < GRAPHICS_WORDS; ++Word) {
+        Words[Word] = Block.Graphics[Word][Index];
+    }
+    
+    return Block.HiRes[Index] != 0;
+}
+
+void Chip8Lockstep::GetRegisters(size_t Lane, unsigned char *Registers)
+{
+    const LockstepBlock &Block = Blocks[Lane / LOCKSTEP_BLOCK_LANES];
+    int Index = (int) (Lane % LOCKSTEP_BLOCK_LANES);
+    
+    for (int Register = 0; Register < 16; ++Register) {
+        Registers[Register] = Block.VRegisters[Register][Index];
+    }
+}
+
+//
+// Anywhere the new memory differs from the shared program stops being fetched from it, for
+// every lane in the block.
+//
+void Chip8Lockstep::SetState(size_t Lane, const Chip8State &State)
+{
+    LockstepBlock &Block = Blocks[Lane / LOCKSTEP_BLOCK_LANES];
+    int Index = (int) (Lane % LOCKSTEP_BLOCK_LANES);
+    
+    CyclesRun[Lane] = 0;
+    Done[Lane] = false;
+    
+    memcpy(Block.Memory[Index], State.Memory, sizeof(State.Memory));
+    
+    for (unsigned short Address = 0; Address < sizeof(Program); ++Address) {
+        if (State.Memory[Address] != Program[Address]) {
+            MarkWritten(Block, Address);
+        }
+    }
+    
+    for (int Word = 0; Word < GRAPHICS_WORDS; ++Word) {
+        Block.Graphics[Word][Index] = State.Graphics[Word];
+    }
+    
+    for (int Register = 0; Register < 16; ++Register) {
+        Block.VRegisters[Register][Index] = State.VRegisters[Register];
+        Block.Key[Register][Index] = State.Key[Register];
+    }
+    
+    for (int Entry = 0; Entry < STACK_DEPTH; ++Entry) {
+        Block.Stack[Entry][Index] = State.Stack[Entry];
+    }
+    
+    Block.IndexRegister[Index] = State.IndexRegister;
+    Block.ProgramCounter[Index] = State.ProgramCounter;
+    Block.DelayTimer[Index] = State.DelayTimer;
+    Block.SoundTimer[Index] = State.SoundTimer;
+    Block.StackPointer[Index] = State.StackPointer;
+    Block.Fault[Index] = State.Fault;
+    Block.ProgramEnd[Index] = State.ProgramEnd;
+    Block.RandomState[Index] = State.RandomState;
+    Block.DirtyRows[Index] = State.DirtyRows;
+    Block.DrawFlag[Index] = State.DrawFlag ? 1 : 0;
+    Block.HiRes[Index] = State.HiRes ? 1 : 0;
+    Block.WaitingForKey[Index] = State.WaitingForKey ? 1 : 0;
+    Block.KeyWaitRegister[Index] = State.KeyWaitRegister & 0xF;
+    Block.KeysHeld[Index] = State.KeysHeld;
+}
+
+bool Chip8Lockstep::CodeClean(const LockstepBlock &Block, unsigned short Address)
+{
+    unsigned short Next = (Address + 1) & ADDRESS_BITMASK;
+    
+    return ((Block.CodeWritten[Address / 64] >> (Address % 64)) & 1) == 0 &&
+           ((Block.CodeWritten[Next / 64] >> (Next % 64)) & 1) == 0;
+}
+
+void Chip8Lockstep::MarkWritten(LockstepBlock &Block, unsigned short Address)
+{
+    Block.CodeWritten[Address / 64] |= 1ull << (Address % 64);
+}
+
+bool Chip8Lockstep::RunFrame(unsigned long CyclesPerFrame)
+{
+    bool Running = false;
+    
+    //
+    // A frame's budget has to fit a lane's 32 bit counter.
+    //
+    
+    CyclesPerFrame = std::min(CyclesPerFrame, (unsigned long) UINT32_MAX);
+    
+    for (size_t BlockIndex = 0; BlockIndex < BlockCount; ++BlockIndex) {
+        
+        LockstepBlock &Block = Blocks[BlockIndex];
+        size_t FirstLane = BlockIndex * LOCKSTEP_BLOCK_LANES;
+        uint32_t Budget[LOCKSTEP_BLOCK_LANES];
+        uint32_t Lanes;
+        uint32_t Active;
+        
+        Lanes = StartFrame(Block, FirstLane, CyclesPerFrame);
+        
+        if (Lanes == 0) {
+            continue;
+        }
+        
+        memcpy(Budget, Block.Remaining, sizeof(Budget));
+        
+        //
+        // Lanes still waiting on FX0A spend the frame doing nothing but get their timer tick.
+        //
+        
+        Active = Lanes & ~ResumeKeyWaits(Block, Lanes);
+
+#if CHIP8_LOCKSTEP_AVX2
+        if (VectorEnabled) {
+            RunBlockVector(Block, Active);
+            TickTimersVector(Block, Lanes);
+        } else {
+            RunBlockScalar(Block, Active);
+            TickTimers(Block, Lanes);
+        }
+#else
+        RunBlockScalar(Block, Active);
+        TickTimers(Block, Lanes);
+#endif
+        
+        //
+        // Same stopping rule as Chip8Batch's frame loop: a short frame means the machine halted
+        // or faulted, and nothing runs past the budget.
+        //
+        
+        for (uint32_t Pending = Lanes; Pending != 0; Pending &= Pending - 1) {
+            
+            int Lane = NextLane(Pending);
+            size_t GlobalLane = FirstLane + Lane;
+            uint32_t Ran = Budget[Lane] - Block.Remaining[Lane];
+            
+            CyclesRun[GlobalLane] += Ran;
+            
+            if (Ran != Budget[Lane] || CyclesRun[GlobalLane] >= CycleBudget[GlobalLane]) {
+                Done[GlobalLane] = true;
+            } else {
+                Running = true;
+            }
+        }
+    }
+    
+    return Running;
+}
+
+//
+// Hand out this frame's instructions to every lane in the block that isn't done, and return
+// the mask of lanes taking part.
+//
+uint32_t Chip8Lockstep::StartFrame(LockstepBlock &Block, size_t FirstLane, unsigned long CyclesPerFrame)
+{
+    uint32_t Lanes = 0;
+    
+    for (int Lane = 0; Lane < LOCKSTEP_BLOCK_LANES && FirstLane + Lane < LaneCount; ++Lane) {
+        
+        size_t GlobalLane = FirstLane + Lane;
+        
+        Block.Remaining[Lane] = 0;
+        
+        if (Done[GlobalLane]) {
+            continue;
+        }
+        
+        if (CyclesRun[GlobalLane] >= CycleBudget[GlobalLane]) {
+            Done[GlobalLane] = true;
+            continue;
+        }
+        
+        Block.Remaining[Lane] = (uint32_t) std::min(CyclesPerFrame, CycleBudget[GlobalLane] - CyclesRun[GlobalLane]);
+        Lanes |= LANE_BIT(Lane);
+    }
+    
+    return Lanes;
+}
+
+//
+// Chip8::StillWaitingForKey for every waiting lane in Lanes, with the keys it has for this
+// frame. Returns the lanes that are still waiting, which use up the whole frame.
+//
+uint32_t Chip8Lockstep::ResumeKeyWaits(LockstepBlock &Block, uint32_t Lanes)
+{
+    uint32_t Waiting = 0;
+    
+    for (; Lanes != 0; Lanes &= Lanes - 1) {
+        
+        int Lane = NextLane(Lanes);
+        uint16_t Keys;
+        uint16_t Pressed;
+        
+        if (Block.WaitingForKey[Lane] == 0) {
+            continue;
+        }
+        
+        Keys = LaneKeyMask(Block, Lane);
+        Pressed = Keys & ~Block.KeysHeld[Lane];
+        Block.KeysHeld[Lane] = Keys;
+        
+        if (Pressed == 0) {
+            Block.Remaining[Lane] = 0;
+            Waiting |= LANE_BIT(Lane);
+            continue;
+        }
+        
+        Block.VRegisters[Block.KeyWaitRegister[Lane]][Lane] = (unsigned char) __builtin_ctz(Pressed);
+        Block.WaitingForKey[Lane] = 0;
+        Block.ProgramCounter[Lane] += 2;
+    }
+    
+    return Waiting;
+}
+
+uint16_t Chip8Lockstep::LaneKeyMask(const LockstepBlock &Block, int Lane)
+{
+    uint16_t Keys = 0;
+    
+    for (int Key = 0; Key < 16; ++Key) {
+        if (Block.Key[Key][Lane] != 0) {
+            Keys |= 1 << Key;
+        }
+    }
+    
+    return Keys;
+}
+
+bool Chip8Lockstep::LaneHalted(const LockstepBlock &Block, int Lane)
+{
+    return Block.ProgramCounter[Lane] == Block.ProgramEnd[Lane] || Block.Fault[Lane] != FAULT_NONE;
+}
+
+void Chip8Lockstep::RunBlockScalar(LockstepBlock &Block, uint32_t Lanes)
+{
+    for (; Lanes != 0; Lanes &= Lanes - 1) {
+        
+        int Lane = NextLane(Lanes);
+        
+        if (LaneHalted(Block, Lane)) {
+            continue;
+        }
+        
+        while (StepLane(Block, Lane)) {
+        }
+    }
+}
+
+//
+// One instruction on one lane, fetched from its own memory, as Chip8::Step. False once the
+// lane can't go on this frame: it faulted, halted or ran out of instructions.
+//
+bool Chip8Lockstep::StepLane(LockstepBlock &Block, int Lane)
+{
+    unsigned short Address = Block.ProgramCounter[Lane] & ADDRESS_BITMASK;
+    unsigned short Opcode = Block.Memory[Lane][Address] << 8 | Block.Memory[Lane][(Address + 1) & ADDRESS_BITMASK];
+    
+    Block.ProgramCounter[Lane] = Address + 2;
+    
+    ExecuteLanes(Block, LANE_BIT(Lane), Opcode);
+    
+    if (Block.Fault[Lane] != FAULT_NONE) {
+        return false;
+    }
+    
+    ++ScalarSteps;
+    
+    return --Block.Remaining[Lane] != 0 && !LaneHalted(Block, Lane);
+}
+
+void Chip8Lockstep::TickTimers(LockstepBlock &Block, uint32_t Lanes)
+{
+    for (; Lanes != 0; Lanes &= Lanes - 1) {
+        
+        int Lane = NextLane(Lanes);
+        
+        if (Block.SoundTimer[Lane] > 0) {
+            --Block.SoundTimer[Lane];
+        }
+        
+        if (Block.DelayTimer[Lane] > 0) {
+            --Block.DelayTimer[Lane];
+        }
+    }
+}
+
+//
+// Run Opcode on every lane in Lanes, program counters already past it. This is Chip8's
+// opcode handlers over again for the block layout, and every instruction the vector path
+// doesn't have a kernel for comes through here.
+//
+void Chip8Lockstep::ExecuteLanes(LockstepBlock &Block, uint32_t Lanes, unsigned short Opcode)
+{
+    unsigned char X = (Opcode & REGISTER_ONE_BITMASK) >> 8;
+    unsigned char Y = (Opcode & REGISTER_TWO_BITMASK) >> 4;
+    unsigned char N = Opcode & LAST_FOUR_BITMASK;
+    unsigned char Kk = Opcode & LAST_EIGHT_BITMASK;
+    unsigned short Nnn = Opcode & LAST_TWELVE_BITMASK;
+    
+    for (; Lanes != 0; Lanes &= Lanes - 1) {
+        
+        int Lane = NextLane(Lanes);
+        unsigned char &VX = Block.VRegisters[X][Lane];
+        unsigned char &VF = Block.VRegisters[0xF][Lane];
+        unsigned short &ProgramCounter = Block.ProgramCounter[Lane];
+        unsigned short &IndexRegister = Block.IndexRegister[Lane];
+        unsigned char *Memory = Block.Memory[Lane];
+        bool HiRes = Block.HiRes[Lane] != 0;
+        
+        switch (Opcode & FIRST_FOUR_BITMASK) {
+            
+            case 0x0000:
+                
+                //
+                // Decoded on the low byte like Chip8 does, whatever the middle nibble is.
+                //
+                
+                if (Kk == 0xE0) {
+                    
+                    int RowWords = GRAPHICS_ROW_WORDS(HiRes);
+                    
+                    for (int Word = 0; Word < GRAPHICS_USED_WORDS(HiRes); ++Word) {
+                        
+                        if (Block.Graphics[Word][Lane] != 0) {
+                            Block.DirtyRows[Lane] |= 1ull << (Word / RowWords);
+                        }
+                        
+                        Block.Graphics[Word][Lane] = 0;
+                    }
+                    
+                    Block.DrawFlag[Lane] = 1;
+                    
+                } else if ((Opcode & 0xFFF0) == 0x00C0) {
+                    
+                    ScrollLaneDown(Block, Lane, N);
+                    
+                } else if (Kk == 0xFB || Kk == 0xFC) {
+                    
+                    ScrollLaneSideways(Block, Lane, Kk == 0xFB);
+                    
+                } else if (Kk == 0xFD) {
+                    
+                    ProgramCounter -= 2;
+                    Block.ProgramEnd[Lane] = ProgramCounter;
+                    
+                } else if (Kk == 0xFE || Kk == 0xFF) {
+                    
+                    SetLaneHiRes(Block, Lane, Kk == 0xFF);
+                    
+                } else if (Kk == 0xEE) {
+                    
+                    if (Block.StackPointer[Lane] == 0) {
+                        Block.Fault[Lane] = FAULT_STACK_UNDERFLOW;
+                        ProgramCounter -= 2;
+                        break;
+                    }
+                    
+                    ProgramCounter = Block.Stack[--Block.StackPointer[Lane]][Lane];
+                }
+                break;
+            
+            case 0x1000:
+                ProgramCounter = Nnn;
+                break;
+            
+            case 0x2000:
+                if (Block.StackPointer[Lane] == STACK_DEPTH) {
+                    Block.Fault[Lane] = FAULT_STACK_OVERFLOW;
+                    ProgramCounter -= 2;
+                    break;
+                }
+                
+                Block.Stack[Block.StackPointer[Lane]++][Lane] = ProgramCounter;
+                ProgramCounter = Nnn;
+                break;
+            
+            case 0x3000:
+                if (VX == Kk) {
+                    ProgramCounter += 2;
+                }
+                break;
+            
+            case 0x4000:
+                if (VX != Kk) {
+                    ProgramCounter += 2;
+                }
+                break;
+            
+            case 0x5000:
+                if (VX == Block.VRegisters[Y][Lane]) {
+                    ProgramCounter += 2;
+                }
+                break;
+            
+            case 0x6000:
+                VX = Kk;
+                break;
+            
+            case 0x7000:
+                VX += Kk;
+                break;
+            
+            case 0x8000:
+                
+                //
+                // VF is written before VX, so when either operand is VF the result sees the
+                // flag, exactly as Chip8::CheckAndSetCarry leaves it.
+                //
+                
+                switch (N) {
+                    case 0x0:
+                        VX = Block.VRegisters[Y][Lane];
+                        break;
+                    
+                    case 0x1:
+                        VX |= Block.VRegisters[Y][Lane];
+                        break;
+                    
+                    case 0x2:
+                        VX &= Block.VRegisters[Y][Lane];
+                        break;
+                    
+                    case 0x3:
+                        VX ^= Block.VRegisters[Y][Lane];
+                        break;
+                    
+                    case 0x4:
+                        VF = VX + Block.VRegisters[Y][Lane] > 255 ? 1 : 0;
+                        VX += Block.VRegisters[Y][Lane];
+                        break;
+                    
+                    case 0x5:
+                        VF = VX >= Block.VRegisters[Y][Lane] ? 1 : 0;
+                        VX -= Block.VRegisters[Y][Lane];
+                        break;
+                    
+                    case 0x6: {
+                        unsigned char Source = VX;
+                        
+                        VF = Source & 1;
+                        VX = Source >> 1;
+                        break;
+                    }
+                    
+                    case 0x7:
+                        VF = Block.VRegisters[Y][Lane] >= VX ? 1 : 0;
+                        VX = Block.VRegisters[Y][Lane] - VX;
+                        break;
+                    
+                    case 0xE: {
+                        unsigned char Source = VX;
+                        
+                        VF = Source >> 7;
+                        VX = (unsigned char) (Source << 1);
+                        break;
+                    }
+                    
+                    default:
+                        break;
+                }
+                break;
+            
+            case 0x9000:
+                if (VX != Block.VRegisters[Y][Lane]) {
+                    ProgramCounter += 2;
+                }
+                break;
+            
+            case 0xA000:
+                IndexRegister = Nnn;
+                break;
+            
+            case 0xB000:
+                ProgramCounter = Nnn + Block.VRegisters[0][Lane];
+                break;
+            
+            case 0xC000: {
+                
+                uint32_t &RandomState = Block.RandomState[Lane];
+                
+                RandomState ^= RandomState << 13;
+                RandomState ^= RandomState >> 17;
+                RandomState ^= RandomState << 5;
+                
+                VX = (unsigned char) (RandomState >> 24) & Kk;
+                break;
+            }
+            
+            case 0xD000: {
+                
+                if (HiRes) {
+                    DrawLaneHiRes(Block, Lane, VX, Block.VRegisters[Y][Lane], N);
+                    break;
+                }
+                
+                unsigned int DrawLocX = VX % GRAPHICS_X_AXIS;
+                unsigned int DrawLocY = Block.VRegisters[Y][Lane] % GRAPHICS_Y_AXIS;
+                uint64_t Collision = 0;
+                
+                for (int SpriteRowIndex = 0; SpriteRowIndex < N; ++SpriteRowIndex) {
+                    
+                    uint64_t SpriteRow = (uint64_t) Memory[(IndexRegister + SpriteRowIndex) & ADDRESS_BITMASK] << (GRAPHICS_X_AXIS - 8);
+                    unsigned int GraphicsRowIndex = (DrawLocY + SpriteRowIndex) % GRAPHICS_Y_AXIS;
+                    uint64_t &GraphicsRow = Block.Graphics[GraphicsRowIndex][Lane];
+                    
+                    SpriteRow = (SpriteRow >> DrawLocX) | (SpriteRow << ((GRAPHICS_X_AXIS - DrawLocX) % GRAPHICS_X_AXIS));
+                    
+                    Collision |= GraphicsRow & SpriteRow;
+                    GraphicsRow ^= SpriteRow;
+                    
+                    if (SpriteRow != 0) {
+                        Block.DirtyRows[Lane] |= 1ull << GraphicsRowIndex;
+                    }
+                }
+                
+                VF = Collision != 0 ? 1 : 0;
+                Block.DrawFlag[Lane] = 1;
+                break;
+            }
+            
+            case 0xE000:
+                if (Kk == 0x9E && Block.Key[VX & 0xF][Lane] != 0) {
+                    ProgramCounter += 2;
+                    
+                } else if (Kk == 0xA1 && Block.Key[VX & 0xF][Lane] == 0) {
+                    ProgramCounter += 2;
+                }
+                break;
+            
+            case 0xF000:
+                switch (Kk) {
+                    case 0x07:
+                        VX = Block.DelayTimer[Lane];
+                        break;
+                    
+                    case 0x0A:
+                        
+                        //
+                        // Into the wait, as Chip8::OpWaitForKey. The keys can't change before
+                        // the next frame, so this is the lane's last instruction this one.
+                        //
+                        
+                        ProgramCounter -= 2;
+                        Block.WaitingForKey[Lane] = 1;
+                        Block.KeyWaitRegister[Lane] = X;
+                        Block.KeysHeld[Lane] = LaneKeyMask(Block, Lane);
+                        Block.Remaining[Lane] = 1;
+                        break;
+                    
+                    case 0x15:
+                        Block.DelayTimer[Lane] = VX;
+                        break;
+                    
+                    case 0x18:
+                        Block.SoundTimer[Lane] = VX;
+                        break;
+                    
+                    case 0x1E:
+                        IndexRegister += VX;
+                        break;
+                    
+                    case 0x29:
+                        if ('0' <= VX && VX <= '9') {
+                            IndexRegister = (VX - '0') * CHARACTER_SPRITE_SIZE;
+                            
+                        } else if ('a' <= VX && VX <= 'f') {
+                            IndexRegister = (VX - 'a' + 10) * CHARACTER_SPRITE_SIZE;
+                            
+                        } else if ('A' <= VX && VX <= 'F') {
+                            IndexRegister = (VX - 'A' + 10) * CHARACTER_SPRITE_SIZE;
+                            
+                        } else {
+                            IndexRegister = 0;
+                        }
+                        break;
+                    
+                    case 0x33: {
+                        
+                        unsigned char Value = VX;
+                        unsigned char Digits[3] = {(unsigned char) ('0' + Value / 100), (unsigned char) ('0' + (Value / 10) % 10), (unsigned char) ('0' + Value % 10)};
+                        
+                        for (int Digit = 0; Digit < 3; ++Digit) {
+                            Memory[(IndexRegister + Digit) & ADDRESS_BITMASK] = Digits[Digit];
+                            MarkWritten(Block, (IndexRegister + Digit) & ADDRESS_BITMASK);
+                        }
+                        break;
+                    }
+                    
+                    case 0x55:
+                        for (int Register = 0; Register <= X; ++Register) {
+                            Memory[(IndexRegister + Register) & ADDRESS_BITMASK] = Block.VRegisters[Register][Lane];
+                            MarkWritten(Block, (IndexRegister + Register) & ADDRESS_BITMASK);
+                        }
+                        break;
+                    
+                    case 0x65:
+                        for (int Register = 0; Register <= X; ++Register) {
+                            Block.VRegisters[Register][Lane] = Memory[(IndexRegister + Register) & ADDRESS_BITMASK];
+                        }
+                        break;
+                    
+                    default:
+                        break;
+                }
+                break;
+            
+            default:
+                break;
+        }
+    }
+}
+
+//
+// The SUPER-CHIP display instructions for one lane, Chip8's versions with the words strided
+// across the block.
+//
+void Chip8Lockstep::ScrollLaneDown(LockstepBlock &Block, int Lane, int Rows)
+{
+    bool HiRes = Block.HiRes[Lane] != 0;
+    int RowWords = GRAPHICS_ROW_WORDS(HiRes);
+    
+    for (int Row = GRAPHICS_ROWS(HiRes) - 1; Row >= 0; --Row) {
+        for (int Word = Row * RowWords; Word < (Row + 1) * RowWords; ++Word) {
+            
+            uint64_t Moved = Row >= Rows ? Block.Graphics[Word - Rows * RowWords][Lane] : 0;
+            
+            if (Block.Graphics[Word][Lane] != Moved) {
+                Block.Graphics[Word][Lane] = Moved;
+                Block.DirtyRows[Lane] |= 1ull << Row;
+            }
+        }
+    }
+    
+    Block.DrawFlag[Lane] = 1;
+}
+
+void Chip8Lockstep::ScrollLaneSideways(LockstepBlock &Block, int Lane, bool Right)
+{
+    if (Block.HiRes[Lane] == 0) {
+        
+        for (int Row = 0; Row < GRAPHICS_Y_AXIS; ++Row) {
+            if (Block.Graphics[Row][Lane] != 0) {
+                Block.Graphics[Row][Lane] = Right ? Block.Graphics[Row][Lane] >> 4 : Block.Graphics[Row][Lane] << 4;
+                Block.DirtyRows[Lane] |= 1ull << Row;
+            }
+        }
+        
+    } else {
+        
+        for (int Row = 0; Row < GRAPHICS_HIRES_Y_AXIS; ++Row) {
+            
+            uint64_t Left = Block.Graphics[Row * 2][Lane];
+            uint64_t RightWord = Block.Graphics[Row * 2 + 1][Lane];
+            
+            if ((Left | RightWord) == 0) {
+                continue;
+            }
+            
+            if (Right) {
+                Block.Graphics[Row * 2][Lane] = Left >> 4;
+                Block.Graphics[Row * 2 + 1][Lane] = RightWord >> 4 | Left << 60;
+            } else {
+                Block.Graphics[Row * 2][Lane] = Left << 4 | RightWord >> 60;
+                Block.Graphics[Row * 2 + 1][Lane] = RightWord << 4;
+            }
+            
+            Block.DirtyRows[Lane] |= 1ull << Row;
+        }
+    }
+    
+    Block.DrawFlag[Lane] = 1;
+}
+
+void Chip8Lockstep::SetLaneHiRes(LockstepBlock &Block, int Lane, bool HiRes)
+{
+    if ((Block.HiRes[Lane] != 0) == HiRes) {
+        return;
+    }
+    
+    for (int Word = 0; Word < GRAPHICS_WORDS; ++Word) {
+        Block.Graphics[Word][Lane] = 0;
+    }
+    
+    Block.HiRes[Lane] = HiRes ? 1 : 0;
+    Block.DirtyRows[Lane] = ALL_ROWS_DIRTY;
+    Block.DrawFlag[Lane] = 1;
+}
+
+void Chip8Lockstep::DrawLaneHiRes(LockstepBlock &Block, int Lane, unsigned char LocX, unsigned char LocY, int SpriteRows)
+{
+    unsigned int DrawLocX = LocX % GRAPHICS_HIRES_X_AXIS;
+    unsigned int DrawLocY = LocY % GRAPHICS_HIRES_Y_AXIS;
+    unsigned int Shift = DrawLocX % 64;
+    bool Wide = SpriteRows == 0;
+    unsigned short Address = Block.IndexRegister[Lane];
+    const unsigned char *Memory = Block.Memory[Lane];
+    uint64_t Collision = 0;
+    
+    if (Wide) {
+        SpriteRows = 16;
+    }
+    
+    for (int SpriteRowIndex = 0; SpriteRowIndex < SpriteRows; ++SpriteRowIndex) {
+        
+        unsigned int GraphicsRowIndex = (DrawLocY + SpriteRowIndex) % GRAPHICS_HIRES_Y_AXIS;
+        uint64_t &LeftWord = Block.Graphics[GraphicsRowIndex * 2][Lane];
+        uint64_t &RightWord = Block.Graphics[GraphicsRowIndex * 2 + 1][Lane];
+        uint64_t Left;
+        uint64_t Right = 0;
+        
+        if (Wide) {
+            Left = (uint64_t) (Memory[Address & ADDRESS_BITMASK] << 8 | Memory[(Address + 1) & ADDRESS_BITMASK]) << 48;
+            Address += 2;
+        } else {
+            Left = (uint64_t) Memory[Address & ADDRESS_BITMASK] << 56;
+            Address += 1;
+        }
+        
+        if (Shift != 0) {
+            Right = Left << (64 - Shift);
+            Left >>= Shift;
+        }
+        
+        if (DrawLocX >= 64) {
+            std::swap(Left, Right);
+        }
+        
+        Collision |= (LeftWord & Left) | (RightWord & Right);
+        LeftWord ^= Left;
+        RightWord ^= Right;
+        
+        if ((Left | Right) != 0) {
+            Block.DirtyRows[Lane] |= 1ull << GraphicsRowIndex;
+        }
+    }
+    
+    Block.VRegisters[0xF][Lane] = Collision != 0 ? 1 : 0;
+    Block.DrawFlag[Lane] = 1;
+}
+
+#if CHIP8_LOCKSTEP_AVX2
+
+//
+// Lane masks as vectors: all ones in every element whose bit is set in Lanes.
+//
+
+LOCKSTEP_AVX2_TARGET static inline __m256i ByteLanes(uint32_t Lanes)
+{
+    const __m256i Spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i Bits = _mm256_set1_epi64x((long long) 0x8040201008040201ull);
+    __m256i Bytes = _mm256_shuffle_epi8(_mm256_set1_epi32((int) Lanes), Spread);
+    
+    return _mm256_cmpeq_epi8(_mm256_and_si256(Bytes, Bits), Bits);
+}
+
+LOCKSTEP_AVX2_TARGET static inline __m256i WordLanes(uint32_t Lanes)
+{
+    const __m256i Bits = _mm256_setr_epi16(0x0001, 0x0002, 0x0004, 0x0008, 0x0010, 0x0020, 0x0040, 0x0080,
+                                           0x0100, 0x0200, 0x0400, 0x0800, 0x1000, 0x2000, 0x4000, (short) 0x8000);
+    
+    return _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_set1_epi16((short) Lanes), Bits), Bits);
+}
+
+LOCKSTEP_AVX2_TARGET static inline __m256i DwordLanes(uint32_t Lanes)
+{
+    const __m256i Bits = _mm256_setr_epi32(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80);
+    
+    return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int) Lanes), Bits), Bits);
+}
+
+LOCKSTEP_AVX2_TARGET static inline __m256i QwordLanes(uint32_t Lanes)
+{
+    const __m256i Bits = _mm256_setr_epi64x(1, 2, 4, 8);
+    
+    return _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(Lanes), Bits), Bits);
+}
+
+//
+// And back: one bit per lane from a 16 bit comparison of all 32 lanes, held in two vectors.
+//
+LOCKSTEP_AVX2_TARGET static inline uint32_t WordMaskBits(__m256i Low, __m256i High)
+{
+    __m256i Packed = _mm256_packs_epi16(Low, High);
+    
+    return (uint32_t) _mm256_movemask_epi8(_mm256_permute4x64_epi64(Packed, 0xD8));
+}
+
+LOCKSTEP_AVX2_TARGET static inline __m256i Load(const void *Address)
+{
+    return _mm256_load_si256((const __m256i *) Address);
+}
+
+LOCKSTEP_AVX2_TARGET static inline void Store(void *Address, __m256i Value)
+{
+    _mm256_store_si256((__m256i *) Address, Value);
+}
+
+//
+// Bytes of Value where Mask is set, Current elsewhere, written back to Address.
+//
+LOCKSTEP_AVX2_TARGET static inline void BlendStore(void *Address, __m256i Value, __m256i Mask)
+{
+    Store(Address, _mm256_blendv_epi8(Load(Address), Value, Mask));
+}
+
+//
+// Step the block until every lane is done with the frame. Each step takes the lowest program
+// counter among the lanes still going, so lanes that fell behind on a branch catch up with
+// the rest instead of the rest running away from them.
+//
+LOCKSTEP_AVX2_TARGET void Chip8Lockstep::RunBlockVector(LockstepBlock &Block, uint32_t Lanes)
+{
+    uint32_t Live = 0;
+    
+    for (uint32_t Pending = Lanes; Pending != 0; Pending &= Pending - 1) {
+        
+        int Lane = NextLane(Pending);
+        
+        if (!LaneHalted(Block, Lane)) {
+            Live |= LANE_BIT(Lane);
+        }
+    }
+    
+    while (Live != 0) {
+        
+        __m256i Low = Load(&Block.ProgramCounter[0]);
+        __m256i High = Load(&Block.ProgramCounter[16]);
+        __m256i Lowest;
+        __m128i Lowest128;
+        unsigned short Leader;
+        unsigned short Address;
+        uint32_t Group;
+        
+        //
+        // Lanes that aren't live look like 0xFFFF, then the smallest of the 32.
+        //
+        
+        Lowest = _mm256_min_epu16(_mm256_or_si256(Low, _mm256_andnot_si256(WordLanes(Live), _mm256_set1_epi32(-1))),
+                                  _mm256_or_si256(High, _mm256_andnot_si256(WordLanes(Live >> 16), _mm256_set1_epi32(-1))));
+        Lowest128 = _mm_min_epu16(_mm256_castsi256_si128(Lowest), _mm256_extracti128_si256(Lowest, 1));
+        Leader = (unsigned short) _mm_extract_epi16(_mm_minpos_epu16(Lowest128), 0);
+        
+        Group = Live & WordMaskBits(_mm256_cmpeq_epi16(Low, _mm256_set1_epi16((short) Leader)),
+                                    _mm256_cmpeq_epi16(High, _mm256_set1_epi16((short) Leader)));
+        
+        Address = Leader & ADDRESS_BITMASK;
+        
+        //
+        // A few stragglers, or code some lane has written over, go one lane at a time.
+        //
+        
+        if (__builtin_popcount(Group) < LOCKSTEP_MIN_VECTOR_LANES || !CodeClean(Block, Address)) {
+            
+            for (uint32_t Pending = Group; Pending != 0; Pending &= Pending - 1) {
+                
+                int Lane = NextLane(Pending);
+                
+                if (!StepLane(Block, Lane)) {
+                    Live &= ~LANE_BIT(Lane);
+                }
+            }
+            
+            continue;
+        }
+        
+        unsigned short Opcode = Program[Address] << 8 | Program[(Address + 1) & ADDRESS_BITMASK];
+        __m256i NextAddress = _mm256_set1_epi16((short) (Address + 2));
+        
+        BlendStore(&Block.ProgramCounter[0], NextAddress, WordLanes(Group));
+        BlendStore(&Block.ProgramCounter[16], NextAddress, WordLanes(Group >> 16));
+        
+        if (!ExecuteVector(Block, Group, Opcode)) {
+            
+            ExecuteLanes(Block, Group, Opcode);
+            
+            //
+            // Calls and returns can fault, and a lane that faulted didn't run the instruction.
+            //
+            
+            if ((Opcode & FIRST_FOUR_BITMASK) == 0x2000 || (Opcode & 0xF0FF) == 0x00EE) {
+                for (uint32_t Pending = Group; Pending != 0; Pending &= Pending - 1) {
+                    
+                    int Lane = NextLane(Pending);
+                    
+                    if (Block.Fault[Lane] != FAULT_NONE) {
+                        Group &= ~LANE_BIT(Lane);
+                        Live &= ~LANE_BIT(Lane);
+                    }
+                }
+            }
+        }
+        
+        Live &= ~FinishVectorStep(Block, Group);
+    }
+}
+
+//
+// Count the instruction against every lane in Group and return the lanes that are done with
+// the frame: out of instructions, or at the end of the program.
+//
+LOCKSTEP_AVX2_TARGET uint32_t Chip8Lockstep::FinishVectorStep(LockstepBlock &Block, uint32_t Group)
+{
+    uint32_t Finished = 0;
+    
+    VectorSteps += __builtin_popcount(Group);
+    
+    for (int Quarter = 0; Quarter < LOCKSTEP_BLOCK_LANES / 8; ++Quarter) {
+        
+        uint32_t Lanes = (Group >> (Quarter * 8)) & 0xFF;
+        
+        if (Lanes == 0) {
+            continue;
+        }
+        
+        //
+        // The lane mask is -1 where set, so adding it counts those lanes down by one.
+        //
+        
+        __m256i Remaining = _mm256_add_epi32(Load(&Block.Remaining[Quarter * 8]), DwordLanes(Lanes));
+        
+        Store(&Block.Remaining[Quarter * 8], Remaining);
+        Finished |= (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(Remaining, _mm256_setzero_si256()))) << (Quarter * 8);
+    }
+    
+    Finished |= WordMaskBits(_mm256_cmpeq_epi16(Load(&Block.ProgramCounter[0]), Load(&Block.ProgramEnd[0])),
+                             _mm256_cmpeq_epi16(Load(&Block.ProgramCounter[16]), Load(&Block.ProgramEnd[16])));
+    
+    return Finished & Group;
+}
+
+//
+// Opcode across every lane in Group, program counters already moved past it. False for the
+// instructions with no kernel here, which the caller runs lane by lane.
+//
+LOCKSTEP_AVX2_TARGET bool Chip8Lockstep::ExecuteVector(LockstepBlock &Block, uint32_t Group, unsigned short Opcode)
+{
+    unsigned char X = (Opcode & REGISTER_ONE_BITMASK) >> 8;
+    unsigned char Y = (Opcode & REGISTER_TWO_BITMASK) >> 4;
+    unsigned char Kk = Opcode & LAST_EIGHT_BITMASK;
+    unsigned short Nnn = Opcode & LAST_TWELVE_BITMASK;
+    __m256i Mask = ByteLanes(Group);
+    __m256i One = _mm256_set1_epi8(1);
+    __m256i Skip;
+    __m256i VX;
+    __m256i VY;
+    
+    switch (Opcode & FIRST_FOUR_BITMASK) {
+        
+        case 0x1000:
+            BlendStore(&Block.ProgramCounter[0], _mm256_set1_epi16((short) Nnn), WordLanes(Group));
+            BlendStore(&Block.ProgramCounter[16], _mm256_set1_epi16((short) Nnn), WordLanes(Group >> 16));
+            return true;
+        
+        case 0x3000:
+        case 0x4000:
+        case 0x5000:
+        case 0x9000:
+            VX = Load(Block.VRegisters[X]);
+            VY = (Opcode & FIRST_FOUR_BITMASK) == 0x3000 || (Opcode & FIRST_FOUR_BITMASK) == 0x4000 ? _mm256_set1_epi8((char) Kk) : Load(Block.VRegisters[Y]);
+            Skip = _mm256_cmpeq_epi8(VX, VY);
+            
+            if ((Opcode & FIRST_FOUR_BITMASK) == 0x4000 || (Opcode & FIRST_FOUR_BITMASK) == 0x9000) {
+                Skip = _mm256_andnot_si256(Skip, Mask);
+            } else {
+                Skip = _mm256_and_si256(Skip, Mask);
+            }
+            
+            //
+            // Widen the byte mask to the program counters and add 2 wherever it's set.
+            //
+            
+            Store(&Block.ProgramCounter[0], _mm256_add_epi16(Load(&Block.ProgramCounter[0]),
+                                                             _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_castsi256_si128(Skip)), _mm256_set1_epi16(2))));
+            Store(&Block.ProgramCounter[16], _mm256_add_epi16(Load(&Block.ProgramCounter[16]),
+                                                              _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_extracti128_si256(Skip, 1)), _mm256_set1_epi16(2))));
+            return true;
+        
+        case 0x6000:
+            BlendStore(Block.VRegisters[X], _mm256_set1_epi8((char) Kk), Mask);
+            return true;
+        
+        case 0x7000:
+            BlendStore(Block.VRegisters[X], _mm256_add_epi8(Load(Block.VRegisters[X]), _mm256_set1_epi8((char) Kk)), Mask);
+            return true;
+        
+        case 0x8000:
+            
+            //
+            // VF goes first and both operands are loaded again after it, same as ExecuteLanes.
+            //
+            
+            VX = Load(Block.VRegisters[X]);
+            VY = Load(Block.VRegisters[Y]);
+            
+            switch (Opcode & LAST_FOUR_BITMASK) {
+                case 0x0:
+                    BlendStore(Block.VRegisters[X], VY, Mask);
+                    return true;
+                
+                case 0x1:
+                    BlendStore(Block.VRegisters[X], _mm256_or_si256(VX, VY), Mask);
+                    return true;
+                
+                case 0x2:
+                    BlendStore(Block.VRegisters[X], _mm256_and_si256(VX, VY), Mask);
+                    return true;
+                
+                case 0x3:
+                    BlendStore(Block.VRegisters[X], _mm256_xor_si256(VX, VY), Mask);
+                    return true;
+                
+                case 0x4:
+                    
+                    //
+                    // A carry is where the saturating and the wrapping sums disagree.
+                    //
+                    
+                    BlendStore(Block.VRegisters[0xF],
+                               _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_adds_epu8(VX, VY), _mm256_add_epi8(VX, VY)), One),
+                               Mask);
+                    BlendStore(Block.VRegisters[X], _mm256_add_epi8(Load(Block.VRegisters[X]), Load(Block.VRegisters[Y])), Mask);
+                    return true;
+                
+                case 0x5:
+                    BlendStore(Block.VRegisters[0xF], _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(VX, VY), VX), One), Mask);
+                    BlendStore(Block.VRegisters[X], _mm256_sub_epi8(Load(Block.VRegisters[X]), Load(Block.VRegisters[Y])), Mask);
+                    return true;
+                
+                //
+                // There are no byte shifts, so shift 16 bit pairs and mask off what crossed over
+                // from the neighbouring byte.
+                //
+                
+                case 0x6:
+                    BlendStore(Block.VRegisters[0xF], _mm256_and_si256(VX, One), Mask);
+                    BlendStore(Block.VRegisters[X], _mm256_and_si256(_mm256_srli_epi16(VX, 1), _mm256_set1_epi8(0x7F)), Mask);
+                    return true;
+                
+                case 0x7:
+                    BlendStore(Block.VRegisters[0xF], _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(VY, VX), VY), One), Mask);
+                    BlendStore(Block.VRegisters[X], _mm256_sub_epi8(Load(Block.VRegisters[Y]), Load(Block.VRegisters[X])), Mask);
+                    return true;
+                
+                case 0xE:
+                    BlendStore(Block.VRegisters[0xF], _mm256_and_si256(_mm256_srli_epi16(VX, 7), One), Mask);
+                    BlendStore(Block.VRegisters[X], _mm256_add_epi8(VX, VX), Mask);
+                    return true;
+                
+                default:
+                    return true;
+            }
+        
+        case 0xA000:
+            BlendStore(&Block.IndexRegister[0], _mm256_set1_epi16((short) Nnn), WordLanes(Group));
+            BlendStore(&Block.IndexRegister[16], _mm256_set1_epi16((short) Nnn), WordLanes(Group >> 16));
+            return true;
+        
+        case 0xD000:
+            
+            //
+            // Only the 64x32 display has a kernel, a group with any hi-res lanes in it draws
+            // lane by lane.
+            //
+            
+            if (!_mm256_testz_si256(Load(Block.HiRes), Mask)) {
+                return false;
+            }
+            
+            DrawVector(Block, Group, Opcode);
+            return true;
+        
+        case 0xF000:
+            switch (Kk) {
+                case 0x07:
+                    BlendStore(Block.VRegisters[X], Load(Block.DelayTimer), Mask);
+                    return true;
+                
+                case 0x15:
+                    BlendStore(Block.DelayTimer, Load(Block.VRegisters[X]), Mask);
+                    return true;
+                
+                case 0x18:
+                    BlendStore(Block.SoundTimer, Load(Block.VRegisters[X]), Mask);
+                    return true;
+                
+                case 0x1E:
+                    VX = Load(Block.VRegisters[X]);
+                    BlendStore(&Block.IndexRegister[0],
+                               _mm256_add_epi16(Load(&Block.IndexRegister[0]), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(VX))),
+                               WordLanes(Group));
+                    BlendStore(&Block.IndexRegister[16],
+                               _mm256_add_epi16(Load(&Block.IndexRegister[16]), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(VX, 1))),
+                               WordLanes(Group >> 16));
+                    return true;
+                
+                default:
+                    return false;
+            }
+        
+        default:
+            return false;
+    }
+}
+
+//
+// DXYN four lanes at a time, one 64 bit display row per lane in each vector. Every lane's
+// sprite row goes to the top of its word and gets its own rotate, the same rotate as
+// Chip8::DrawSprites. When the four lanes draw at the same Y, which is nearly always, the
+// display rows are next to each other and load and store as one vector. Otherwise they're
+// gathered and written back one at a time.
+//
+LOCKSTEP_AVX2_TARGET void Chip8Lockstep::DrawVector(LockstepBlock &Block, uint32_t Group, unsigned short Opcode)
+{
+    unsigned char X = (Opcode & REGISTER_ONE_BITMASK) >> 8;
+    unsigned char Y = (Opcode & REGISTER_TWO_BITMASK) >> 4;
+    int SpriteRows = Opcode & LAST_FOUR_BITMASK;
+    const __m256i LaneIndex = _mm256_setr_epi64x(0, 1, 2, 3);
+    unsigned short SharedIndex = Block.IndexRegister[NextLane(Group)];
+    unsigned char SharedSprite[16];
+    bool Shared;
+    
+    //
+    // Usually every lane draws the same sprite from the same clean memory, and only where
+    // it goes differs. Then the sprite is read once from the shared program.
+    //
+    
+    Shared = (WordMaskBits(_mm256_cmpeq_epi16(Load(&Block.IndexRegister[0]), _mm256_set1_epi16((short) SharedIndex)),
+                           _mm256_cmpeq_epi16(Load(&Block.IndexRegister[16]), _mm256_set1_epi16((short) SharedIndex))) & Group) == Group;
+    
+    for (int SpriteRowIndex = 0; SpriteRowIndex < SpriteRows && Shared; ++SpriteRowIndex) {
+        
+        unsigned short Address = (SharedIndex + SpriteRowIndex) & ADDRESS_BITMASK;
+        
+        Shared = ((Block.CodeWritten[Address / 64] >> (Address % 64)) & 1) == 0;
+        SharedSprite[SpriteRowIndex] = Program[Address];
+    }
+    
+    for (int First = 0; First < LOCKSTEP_BLOCK_LANES; First += 4) {
+        
+        uint32_t Lanes = (Group >> First) & 0xF;
+        unsigned int DrawLocY[4];
+        unsigned short IndexRegister[4];
+        uint64_t Rows[4];
+        uint64_t Collisions[4];
+        __m256i Active;
+        __m256i DrawLocX;
+        __m256i Collision = _mm256_setzero_si256();
+        bool SameRow;
+        
+        if (Lanes == 0) {
+            continue;
+        }
+        
+        Active = QwordLanes(Lanes);
+        DrawLocX = _mm256_setr_epi64x(Block.VRegisters[X][First] % GRAPHICS_X_AXIS,
+                                      Block.VRegisters[X][First + 1] % GRAPHICS_X_AXIS,
+                                      Block.VRegisters[X][First + 2] % GRAPHICS_X_AXIS,
+                                      Block.VRegisters[X][First + 3] % GRAPHICS_X_AXIS);
+        
+        //
+        // Lanes sitting this one out draw nothing, give them the first active lane's Y so they
+        // don't stop the rest from taking the fast path.
+        //
+        
+        for (int Lane = 0; Lane < 4; ++Lane) {
+            
+            int Source = (Lanes >> Lane) & 1 ? Lane : NextLane(Lanes);
+            
+            DrawLocY[Lane] = Block.VRegisters[Y][First + Source] % GRAPHICS_Y_AXIS;
+            IndexRegister[Lane] = Block.IndexRegister[First + Lane];
+        }
+        
+        SameRow = DrawLocY[0] == DrawLocY[1] && DrawLocY[0] == DrawLocY[2] && DrawLocY[0] == DrawLocY[3];
+        
+        for (int SpriteRowIndex = 0; SpriteRowIndex < SpriteRows; ++SpriteRowIndex) {
+            
+            __m256i SpriteRow;
+            __m256i GraphicsRow;
+            
+            if (Shared) {
+                SpriteRow = _mm256_set1_epi64x((long long) ((uint64_t) SharedSprite[SpriteRowIndex] << (GRAPHICS_X_AXIS - 8)));
+            } else {
+                SpriteRow = _mm256_setr_epi64x(Block.Memory[First][(IndexRegister[0] + SpriteRowIndex) & ADDRESS_BITMASK],
+                                               Block.Memory[First + 1][(IndexRegister[1] + SpriteRowIndex) & ADDRESS_BITMASK],
+                                               Block.Memory[First + 2][(IndexRegister[2] + SpriteRowIndex) & ADDRESS_BITMASK],
+                                               Block.Memory[First + 3][(IndexRegister[3] + SpriteRowIndex) & ADDRESS_BITMASK]);
+                SpriteRow = _mm256_slli_epi64(SpriteRow, GRAPHICS_X_AXIS - 8);
+            }
+            
+            //
+            // A shift of 64 gives zero here, so X of 0 needs no special case.
+            //
+            
+            SpriteRow = _mm256_or_si256(_mm256_srlv_epi64(SpriteRow, DrawLocX),
+                                        _mm256_sllv_epi64(SpriteRow, _mm256_sub_epi64(_mm256_set1_epi64x(GRAPHICS_X_AXIS), DrawLocX)));
+            SpriteRow = _mm256_and_si256(SpriteRow, Active);
+            
+            if (SameRow) {
+                
+                uint64_t *Row = &Block.Graphics[(DrawLocY[0] + SpriteRowIndex) % GRAPHICS_Y_AXIS][First];
+                
+                GraphicsRow = _mm256_loadu_si256((const __m256i *) Row);
+                Collision = _mm256_or_si256(Collision, _mm256_and_si256(GraphicsRow, SpriteRow));
+                _mm256_storeu_si256((__m256i *) Row, _mm256_xor_si256(GraphicsRow, SpriteRow));
+                
+            } else {
+                
+                __m256i RowIndex = _mm256_setr_epi64x((DrawLocY[0] + SpriteRowIndex) % GRAPHICS_Y_AXIS,
+                                                      (DrawLocY[1] + SpriteRowIndex) % GRAPHICS_Y_AXIS,
+                                                      (DrawLocY[2] + SpriteRowIndex) % GRAPHICS_Y_AXIS,
+                                                      (DrawLocY[3] + SpriteRowIndex) % GRAPHICS_Y_AXIS);
+                __m256i Element = _mm256_add_epi64(_mm256_slli_epi64(RowIndex, 5), _mm256_add_epi64(LaneIndex, _mm256_set1_epi64x(First)));
+                
+                GraphicsRow = _mm256_i64gather_epi64((const long long *) &Block.Graphics[0][0], Element, 8);
+                Collision = _mm256_or_si256(Collision, _mm256_and_si256(GraphicsRow, SpriteRow));
+                _mm256_storeu_si256((__m256i *) Rows, _mm256_xor_si256(GraphicsRow, SpriteRow));
+                
+                for (int Lane = 0; Lane < 4; ++Lane) {
+                    Block.Graphics[(DrawLocY[Lane] + SpriteRowIndex) % GRAPHICS_Y_AXIS][First + Lane] = Rows[Lane];
+                }
+            }
+            
+            //
+            // Dirty rows for every lane whose sprite row had anything in it. A shared sprite
+            // row is either empty in every lane or in none of them.
+            //
+            
+            int Drawn;
+            
+            if (Shared) {
+                Drawn = SharedSprite[SpriteRowIndex] != 0 ? Lanes : 0;
+            } else {
+                Drawn = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(SpriteRow, _mm256_setzero_si256()))) ^ 0xF;
+            }
+            
+            for (; Drawn != 0; Drawn &= Drawn - 1) {
+                
+                int Lane = NextLane(Drawn);
+                
+                Block.DirtyRows[First + Lane] |= 1ull << ((DrawLocY[Lane] + SpriteRowIndex) % GRAPHICS_Y_AXIS);
+            }
+        }
+        
+        _mm256_storeu_si256((__m256i *) Collisions, Collision);
+        
+        for (uint32_t Pending = Lanes; Pending != 0; Pending &= Pending - 1) {
+            
+            int Lane = NextLane(Pending);
+            
+            Block.VRegisters[0xF][First + Lane] = Collisions[Lane] != 0 ? 1 : 0;
+        }
+    }
+    
+    BlendStore(Block.DrawFlag, _mm256_set1_epi8(1), ByteLanes(Group));
+}
+
+LOCKSTEP_AVX2_TARGET void Chip8Lockstep::TickTimersVector(LockstepBlock &Block, uint32_t Lanes)
+{
+    __m256i Mask = ByteLanes(Lanes);
+    __m256i One = _mm256_set1_epi8(1);
+    
+    BlendStore(Block.SoundTimer, _mm256_subs_epu8(Load(Block.SoundTimer), One), Mask);
+    BlendStore(Block.DelayTimer, _mm256_subs_epu8(Load(Block.DelayTimer), One), Mask);
+}
+
+#endif
@@ -0,0 +1,212 @@
+//
+//  Chip8Lockstep.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__Chip8Lockstep__
+#define __Chip8Emulator__Chip8Lockstep__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "Chip8.h"
+
+//
+// The vector kernels are built with a per function target attribute, so the rest of the core
+// doesn't need -mavx2, and are only used when the CPU we're running on has AVX2.
+//
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CHIP8_LOCKSTEP_AVX2 1
+#else
+#define CHIP8_LOCKSTEP_AVX2 0
+#endif
+
+//
+// Machines are kept in blocks of 32, one AVX2 register holds a V register for every machine
+// in a block.
+//
+
+#define LOCKSTEP_BLOCK_LANES (32)
+
+//
+// When fewer machines than this are at the same instruction, they're stepped one at a time.
+// Setting up a vector step for a couple of machines costs more than it saves.
+//
+
+#define LOCKSTEP_MIN_VECTOR_LANES (4)
+
+#define LOCKSTEP_UNLIMITED_CYCLES (~0ul)
+
+//
+// One block of machines, structure of arrays: every field holds that field for all 32 lanes,
+// so the same instruction across a block is a handful of vector operations. Memory is the
+// exception, each lane's 4K is its own contiguous array, since programs index it with
+// whatever happens to be in I.
+//
+
+struct alignas(64) LockstepBlock {
+    unsigned char VRegisters[16][LOCKSTEP_BLOCK_LANES];
+    unsigned char Key[16][LOCKSTEP_BLOCK_LANES];
+    unsigned short IndexRegister[LOCKSTEP_BLOCK_LANES];
+    unsigned short ProgramCounter[LOCKSTEP_BLOCK_LANES];
+    unsigned short ProgramEnd[LOCKSTEP_BLOCK_LANES];
+    unsigned char DelayTimer[LOCKSTEP_BLOCK_LANES];
+    unsigned char SoundTimer[LOCKSTEP_BLOCK_LANES];
+    unsigned char StackPointer[LOCKSTEP_BLOCK_LANES];
+    unsigned char Fault[LOCKSTEP_BLOCK_LANES];
+    unsigned char DrawFlag[LOCKSTEP_BLOCK_LANES];
+    unsigned char HiRes[LOCKSTEP_BLOCK_LANES];
+    unsigned char WaitingForKey[LOCKSTEP_BLOCK_LANES];
+    unsigned char KeyWaitRegister[LOCKSTEP_BLOCK_LANES];
+    uint16_t KeysHeld[LOCKSTEP_BLOCK_LANES];
+    uint32_t RandomState[LOCKSTEP_BLOCK_LANES];
+    uint64_t DirtyRows[LOCKSTEP_BLOCK_LANES];
+    
+    //
+    // Instructions each lane may still run this frame.
+    //
+    
+    uint32_t Remaining[LOCKSTEP_BLOCK_LANES];
+    
+    unsigned short Stack[STACK_DEPTH][LOCKSTEP_BLOCK_LANES];
+    uint64_t Graphics[GRAPHICS_WORDS][LOCKSTEP_BLOCK_LANES];
+    
+    //
+    // Bit N of word N / 64 set once any lane in the block has written address N, or was given
+    // a state whose memory differs there. Instructions at clean addresses are the same in every
+    // lane and come from the shared program, anything else is fetched lane by lane.
+    //
+    
+    uint64_t CodeWritten[4096 / 64];
+    
+    unsigned char Memory[LOCKSTEP_BLOCK_LANES][4096];
+};
+
+//
+// Many machines running the same program in lockstep, for search and training workloads
+// that play one ROM with lots of different inputs. Each step picks the lowest program counter
+// among the machines still running, and every machine sitting at it runs that instruction
+// together: register operations, skips, jumps, the timers and low-res DXYN are AVX2 across the
+// block, everything else loops over the lanes. Machines whose program counters have wandered off on
+// their own get stepped one at a time until they come back together.
+//
+// Every lane behaves exactly like a Chip8 driven the way Chip8Batch drives one: up to the
+// frame's instructions through Run, then TickTimers, until it halts, faults or uses up its
+// cycle budget. Chip8Batch --lockstep --verify checks that frame by frame. Lanes always
+// follow the default quirk profile (see Chip8Quirks.h).
+//
+
+class Chip8Lockstep {
+
+private:
+    
+    LockstepBlock *Blocks;
+    size_t BlockCount;
+    size_t LaneCount;
+    
+    //
+    // Memory as LoadProgram left it, where clean instructions are fetched from.
+    //
+    
+    unsigned char Program[4096];
+    
+    std::vector<unsigned long> CycleBudget;
+    std::vector<unsigned long> CyclesRun;
+    std::vector<bool> Done;
+    
+    bool VectorEnabled;
+    
+    unsigned long long VectorSteps;
+    unsigned long long ScalarSteps;
+    
+    bool CodeClean(const LockstepBlock &Block, unsigned short Address);
+    void MarkWritten(LockstepBlock &Block, unsigned short Address);
+    
+    uint32_t StartFrame(LockstepBlock &Block, size_t FirstLane, unsigned long CyclesPerFrame);
+    uint32_t ResumeKeyWaits(LockstepBlock &Block, uint32_t Lanes);
+    uint16_t LaneKeyMask(const LockstepBlock &Block, int Lane);
+    void RunBlockScalar(LockstepBlock &Block, uint32_t Lanes);
+    bool StepLane(LockstepBlock &Block, int Lane);
+    void ExecuteLanes(LockstepBlock &Block, uint32_t Lanes, unsigned short Opcode);
+    void ScrollLaneDown(LockstepBlock &Block, int Lane, int Rows);
+    void ScrollLaneSideways(LockstepBlock &Block, int Lane, bool Right);
+    void SetLaneHiRes(LockstepBlock &Block, int Lane, bool HiRes);
+    void DrawLaneHiRes(LockstepBlock &Block, int Lane, unsigned char LocX, unsigned char LocY, int SpriteRows);
+    bool LaneHalted(const LockstepBlock &Block, int Lane);
+    void TickTimers(LockstepBlock &Block, uint32_t Lanes);
+
+#if CHIP8_LOCKSTEP_AVX2
+    void RunBlockVector(LockstepBlock &Block, uint32_t Lanes);
+    bool ExecuteVector(LockstepBlock &Block, uint32_t Group, unsigned short Opcode);
+    void DrawVector(LockstepBlock &Block, uint32_t Group, unsigned short Opcode);
+    void TickTimersVector(LockstepBlock &Block, uint32_t Lanes);
+    uint32_t FinishVectorStep(LockstepBlock &Block, uint32_t Group);
+#endif
+    
+    Chip8Lockstep(const Chip8Lockstep &Other);
+    Chip8Lockstep &operator=(const Chip8Lockstep &Other);
+
+public:
+    Chip8Lockstep(size_t Lanes);
+    ~Chip8Lockstep();
+    
+    size_t Lanes() {return LaneCount;};
+    
+    //
+    // Start every lane from a freshly initialized machine with Program loaded, as
+    // Chip8::Initialize followed by LoadProgram.
+    //
+    
+    bool LoadProgram(const unsigned char *Program, size_t Length);
+    
+    void SeedRandom(size_t Lane, uint32_t Seed);
+    void SetCycleBudget(size_t Lane, unsigned long Cycles);
+    void SetKeys(size_t Lane, const unsigned char *KeyboardState);
+    
+    //
+    // Run one frame on every lane that isn't done yet: up to CyclesPerFrame instructions,
+    // less if that would go over its budget, then the timer tick. A lane that halts, faults
+    // or reaches its budget is done after that frame. False once every lane is done.
+    //
+    
+    bool RunFrame(unsigned long CyclesPerFrame);
+    
+    unsigned long LaneCyclesRun(size_t Lane) {return CyclesRun[Lane];};
+    bool LaneDone(size_t Lane) {return Done[Lane];};
+    
+    //
+    // SetState also starts the lane over: no cycles run and not done, whatever it was before.
+    //
+    
+    void GetState(size_t Lane, Chip8State *State);
+    void SetState(size_t Lane, const Chip8State &State);
+    
+    //
+    // Just the display, GRAPHICS_WORDS words laid out like Chip8State::Graphics and true if
+    // they're hi-res, or just V0-VF.
+    //
+    
+    bool GetGraphics(size_t Lane, uint64_t *Words);
+    void GetRegisters(size_t Lane, unsigned char *Registers);
+    
+    //
+    // Vector steps run on AVX2 when the CPU has it. Switching it off steps every lane on its
+    // own, which is the baseline the vector path is measured against.
+    //
+    
+    static bool VectorAvailable();
+    void SetVectorEnabled(bool Enabled) {VectorEnabled = Enabled && VectorAvailable();};
+    bool Vectorized() {return VectorEnabled;};
+    
+    //
+    // How many instructions ran as part of a vector step and how many one lane at a time.
+    //
+    
+    unsigned long long VectorInstructions() {return VectorSteps;};
+    unsigned long long ScalarInstructions() {return ScalarSteps;};
+    
+};
+
+#endif /* defined(__Chip8Emulator__Chip8Lockstep__) */
@@ -0,0 +1,107 @@
+//
+//  Chip8Profiler.cpp
+//  Chip8Emulator
+//
+
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "Chip8Profiler.h"
+#include "Disassembler.h"
+
+static const char *FamilyNames[16] = {
+    "0nnn (CLS, RET)", "1nnn (JP)", "2nnn (CALL)", "3xkk (SE)", "4xkk (SNE)", "5xy0 (SE)",
+    "6xkk (LD)", "7xkk (ADD)", "8xyn (ALU)", "9xy0 (SNE)", "Annn (LD I)", "Bnnn (JP V0)",
+    "Cxkk (RND)", "Dxyn (DRW)", "Exnn (SKP, SKNP)", "Fxnn (misc)"
+};
+
+void Chip8Profiler::Reset()
+{
+    memset(AddressCounts, 0, sizeof(AddressCounts));
+    memset(FamilyCounts, 0, sizeof(FamilyCounts));
+    Instructions = 0;
+    
+    DrawCalls = 0;
+    DrawNanoseconds = 0;
+    
+    KeyWaits = 0;
+    KeyWaitCycles = 0;
+}
+
+static bool CompareCountsDescending(const std::pair<uint64_t, int> &Left, const std::pair<uint64_t, int> &Right)
+{
+    return Left.first != Right.first ? Left.first > Right.first : Left.second < Right.second;
+}
+
+void Chip8Profiler::Report(FILE *Out, const unsigned char *Memory, int HotSpots)
+{
+    std::vector< std::pair<uint64_t, int> > Sorted;
+    double Total = Instructions != 0 ? (double) Instructions : 1.0;
+    char Disassembly[DISASSEMBLY_BUFFER_SIZE];
+    
+    fprintf(Out, "Profile: %llu instructions\n", (unsigned long long) Instructions);
+    
+    //
+    // Opcode families, busiest first
+    //
+    
+    for (int Family = 0; Family < 16; ++Family) {
+        if (FamilyCounts[Family] != 0) {
+            Sorted.push_back(std::make_pair(FamilyCounts[Family], Family));
+        }
+    }
+    
+    std::sort(Sorted.begin(), Sorted.end(), CompareCountsDescending);
+    
+    fprintf(Out, "\n  %-20s %14s %7s\n", "family", "count", "%");
+    
+    for (size_t Entry = 0; Entry < Sorted.size(); ++Entry) {
+        fprintf(Out, "  %-20s %14llu %6.2f%%\n",
+                FamilyNames[Sorted[Entry].second],
+                (unsigned long long) Sorted[Entry].first,
+                100.0 * Sorted[Entry].first / Total);
+    }
+    
+    //
+    // Hot spots, with what's at the address now. Self modifying code may have run something
+    // else there.
+    //
+    
+    Sorted.clear();
+    
+    for (int Address = 0; Address < 4096; ++Address) {
+        if (AddressCounts[Address] != 0) {
+            Sorted.push_back(std::make_pair(AddressCounts[Address], Address));
+        }
+    }
+    
+    std::sort(Sorted.begin(), Sorted.end(), CompareCountsDescending);
+    
+    fprintf(Out, "\n  %-7s %14s %7s  %-6s %s\n", "address", "count", "%", "opcode", "instruction");
+    
+    for (size_t Entry = 0; Entry < Sorted.size() && (int) Entry < HotSpots; ++Entry) {
+        
+        int Address = Sorted[Entry].second;
+        unsigned short Opcode = (unsigned short) (Memory[Address] << 8 | Memory[(Address + 1) & 0xFFF]);
+        
+        Disassemble(Opcode, Disassembly, sizeof(Disassembly));
+        
+        fprintf(Out, "  0x%03X   %14llu %6.2f%%  %04X   %s\n",
+                Address,
+                (unsigned long long) Sorted[Entry].first,
+                100.0 * Sorted[Entry].first / Total,
+                Opcode,
+                Disassembly);
+    }
+    
+    fprintf(Out, "\n  DXYN: %llu draws, %.3f ms drawing, %.1f ns per draw\n",
+            (unsigned long long) DrawCalls,
+            DrawNanoseconds / 1e6,
+            DrawCalls != 0 ? (double) DrawNanoseconds / DrawCalls : 0.0);
+    
+    fprintf(Out, "  FX0A: %llu key waits, %llu cycles spent waiting (%.2f%% of all cycles)\n",
+            (unsigned long long) KeyWaits,
+            (unsigned long long) KeyWaitCycles,
+            Instructions + KeyWaitCycles != 0 ? 100.0 * KeyWaitCycles / (Instructions + KeyWaitCycles) : 0.0);
+}
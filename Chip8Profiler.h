@@ -0,0 +1,73 @@
+//
+//  Chip8Profiler.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__Chip8Profiler__
+#define __Chip8Emulator__Chip8Profiler__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+
+//
+// Set CHIP8_PROFILER to 0 to compile the profiler out of the core entirely. Compiled in, it
+// costs a NULL check per instruction until someone turns it on.
+//
+
+#ifndef CHIP8_PROFILER
+#define CHIP8_PROFILER 1
+#endif
+
+#define PROFILER_DEFAULT_HOT_SPOTS (20)
+
+//
+// Execution profile for one machine: how often each address ran, how often each opcode
+// family (top nibble) ran, how long DXYN spent drawing and how many cycles went by with FX0A
+// waiting for a key. Waiting cycles run no instructions, so they're counted apart.
+//
+
+class Chip8Profiler {
+
+private:
+    uint64_t AddressCounts[4096];
+    uint64_t FamilyCounts[16];
+    uint64_t Instructions;
+    
+    uint64_t DrawCalls;
+    uint64_t DrawNanoseconds;
+    
+    uint64_t KeyWaits;
+    uint64_t KeyWaitCycles;
+
+public:
+    Chip8Profiler() {Reset();};
+    
+    void Reset();
+    
+    void CountInstruction(unsigned short Address, unsigned short Opcode)
+    {
+        ++AddressCounts[Address & 0xFFF];
+        ++FamilyCounts[Opcode >> 12];
+        ++Instructions;
+    };
+    
+    void CountDraw(uint64_t Nanoseconds) {++DrawCalls; DrawNanoseconds += Nanoseconds;};
+    void CountKeyWaitCycles(uint64_t Cycles) {KeyWaitCycles += Cycles;};
+    void CountKeyWait() {++KeyWaits;};
+    
+    static uint64_t Now()
+    {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    };
+    
+    //
+    // Sorted report: families, the HotSpots busiest addresses with the instruction that's
+    // there now (Memory), then drawing and key waits.
+    //
+    
+    void Report(FILE *Out, const unsigned char *Memory, int HotSpots = PROFILER_DEFAULT_HOT_SPOTS);
+    
+};
+
+#endif /* defined(__Chip8Emulator__Chip8Profiler__) */
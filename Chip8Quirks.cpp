@@ -0,0 +1,47 @@
+//
+//  Chip8Quirks.cpp
+//  Chip8Emulator
+//
+
+#include <string.h>
+
+#include "Chip8Quirks.h"
+
+static const char *ProfileNames[] = {"default", "vip", "schip", "xochip"};
+
+bool ParseQuirkProfile(const char *Name, Chip8QuirkProfile *Profile)
+{
+    for (int Index = 0; Index < (int) (sizeof(ProfileNames) / sizeof(ProfileNames[0])); ++Index) {
+        if (strcmp(Name, ProfileNames[Index]) == 0) {
+            *Profile = (Chip8QuirkProfile) Index;
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+const char *QuirkProfileName(Chip8QuirkProfile Profile)
+{
+    return ProfileNames[Profile];
+}
+
+bool QuirkLogicClearsCarry(Chip8QuirkProfile Profile)
+{
+    switch (Profile) {
+        
+        case QUIRKS_DEFAULT:
+            return DefaultQuirks::LogicClearsCarry;
+        
+        case QUIRKS_COSMAC_VIP:
+            return CosmacVipQuirks::LogicClearsCarry;
+        
+        case QUIRKS_SUPER_CHIP:
+            return SuperChipQuirks::LogicClearsCarry;
+        
+        case QUIRKS_XO_CHIP:
+            return XoChipQuirks::LogicClearsCarry;
+    }
+    
+    return false;
+}
@@ -0,0 +1,82 @@
+//
+//  Chip8Quirks.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__Chip8Quirks__
+#define __Chip8Emulator__Chip8Quirks__
+
+//
+// The places CHIP-8 interpreters disagree, as a profile per interpreter family. A profile
+// is a type with a constant for each quirk, and every handler that depends on one is a
+// template on the profile. Decoding an instruction picks the handler for the machine's
+// profile, so once it's in the decode cache the quirk is compiled in and there's nothing
+// left to branch on.
+//
+//     ShiftReadsVY        8XY6 and 8XYE shift VY into VX, instead of shifting VX in place
+//     LoadStoreMovesIndex FX55 and FX65 leave I pointing past the last register
+//     JumpUsesVX          BXNN jumps to XNN plus VX, instead of BNNN to NNN plus V0
+//     SpritesClip         sprites stop at the edges of the display instead of wrapping
+//                         round (where they start still wraps)
+//     LogicClearsCarry    8XY1, 8XY2 and 8XY3 set VF to 0
+//
+
+typedef enum Chip8QuirkProfile {
+    QUIRKS_DEFAULT,
+    QUIRKS_COSMAC_VIP,
+    QUIRKS_SUPER_CHIP,
+    QUIRKS_XO_CHIP
+} Chip8QuirkProfile;
+
+//
+// How this emulator has always behaved, and what a ROM without a profile gets.
+//
+
+struct DefaultQuirks {
+    static const bool ShiftReadsVY = false;
+    static const bool LoadStoreMovesIndex = false;
+    static const bool JumpUsesVX = false;
+    static const bool SpritesClip = false;
+    static const bool LogicClearsCarry = false;
+};
+
+struct CosmacVipQuirks {
+    static const bool ShiftReadsVY = true;
+    static const bool LoadStoreMovesIndex = true;
+    static const bool JumpUsesVX = false;
+    static const bool SpritesClip = true;
+    static const bool LogicClearsCarry = true;
+};
+
+struct SuperChipQuirks {
+    static const bool ShiftReadsVY = false;
+    static const bool LoadStoreMovesIndex = false;
+    static const bool JumpUsesVX = true;
+    static const bool SpritesClip = true;
+    static const bool LogicClearsCarry = false;
+};
+
+struct XoChipQuirks {
+    static const bool ShiftReadsVY = true;
+    static const bool LoadStoreMovesIndex = true;
+    static const bool JumpUsesVX = false;
+    static const bool SpritesClip = false;
+    static const bool LogicClearsCarry = false;
+};
+
+//
+// Profiles by the names used in the ROM library index and on command lines: "default",
+// "vip", "schip" and "xochip". False for a name we don't know.
+//
+
+bool ParseQuirkProfile(const char *Name, Chip8QuirkProfile *Profile);
+const char *QuirkProfileName(Chip8QuirkProfile Profile);
+
+//
+// For code that has to ask at run time rather than be built per profile, like the JIT
+// deciding what it can translate.
+//
+
+bool QuirkLogicClearsCarry(Chip8QuirkProfile Profile);
+
+#endif /* defined(__Chip8Emulator__Chip8Quirks__) */
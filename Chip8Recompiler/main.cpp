@@ -0,0 +1,850 @@
+//
+//  main.cpp
+//  Chip8Recompiler
+//
+
+//
+// Ahead of time recompiler. Follows a ROM's control flow from the start of the program
+// through its jumps, calls, returns and skips, and writes a C++ file with a function for
+// each basic block plus a StaticProgram table of them (see Chip8Static.h). Built against the
+// core library, that's a standalone executable that runs the ROM as native code, and with
+// --no-main the table can be linked into anything else that has a Chip8 to attach it to.
+//
+// Blocks are made of the instructions that only touch registers, timers, keys and the stack
+// (the JIT's set plus calls, returns, key skips, CXKK, the timer instructions, FX29 and FX65).
+// Anything else ends a block and is left to the interpreter: drawing, scrolling and the
+// display modes, memory stores, FX0A, 00FD and BNNN, whose target isn't known until it runs.
+// Code reached only through BNNN isn't found at all and just gets interpreted.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <set>
+
+#include "Chip8.h"
+#include "Disassembler.h"
+
+typedef enum {
+    NotTranslated,
+    Straight,
+    Terminator
+} InstructionKind;
+
+//
+// The quirks that change what a translated instruction does, for the profile the blocks are
+// built for. Sprites and BNNN are never translated, so their quirks don't matter here.
+//
+
+struct TranslationQuirks {
+    bool ShiftReadsVY;
+    bool LoadStoreMovesIndex;
+    bool LogicClearsCarry;
+};
+
+template <typename Profile>
+static TranslationQuirks QuirksFor()
+{
+    TranslationQuirks Quirks;
+    
+    Quirks.ShiftReadsVY = Profile::ShiftReadsVY;
+    Quirks.LoadStoreMovesIndex = Profile::LoadStoreMovesIndex;
+    Quirks.LogicClearsCarry = Profile::LogicClearsCarry;
+    
+    return Quirks;
+}
+
+//
+// What a block reads and writes, so only those registers get copied in and out of locals.
+//
+
+struct BlockRegisters {
+    bool Used[16];
+    bool Written[16];
+    bool UsesIndex;
+    bool WritesIndex;
+};
+
+struct RecompiledBlock {
+    unsigned short Address;
+    std::vector<unsigned short> Opcodes;
+};
+
+void PrintUsage(const char *ProgramName);
+static InstructionKind ClassifyOpcode(unsigned short Opcode);
+static std::set<unsigned short> FindLeaders(const std::vector<unsigned char> &Rom);
+static std::vector<RecompiledBlock> FormBlocks(const std::vector<unsigned char> &Rom, std::set<unsigned short> &Leaders);
+static void CollectRegisters(const RecompiledBlock &Block, BlockRegisters *Registers);
+static void EmitBlock(FILE *Out, const RecompiledBlock &Block, const TranslationQuirks &Quirks);
+static void EmitInstruction(FILE *Out, unsigned short Address, unsigned short Opcode, unsigned int Executed, const std::string &WriteBack, const std::string &BailOutWriteBack, const TranslationQuirks &Quirks);
+static void EmitMain(FILE *Out, const char *Name);
+
+static const char *QuirkProfileConstants[] = {"QUIRKS_DEFAULT", "QUIRKS_COSMAC_VIP", "QUIRKS_SUPER_CHIP", "QUIRKS_XO_CHIP"};
+
+int main(int argc, char * argv[])
+{
+    char *RomFileName = NULL;
+    char *OutFileName = NULL;
+    std::string Name;
+    Chip8QuirkProfile Profile = QUIRKS_DEFAULT;
+    TranslationQuirks Quirks;
+    bool WithMain = true;
+    RomImage Rom;
+    std::vector<unsigned char> RomBytes;
+    std::set<unsigned short> Leaders;
+    std::vector<RecompiledBlock> Blocks;
+    size_t Instructions = 0;
+    FILE *Out = stdout;
+    
+    for (int ArgIndex = 1; ArgIndex < argc; ++ArgIndex) {
+        
+        if (strcmp(argv[ArgIndex], "-o") == 0 && ArgIndex + 1 < argc) {
+            OutFileName = argv[++ArgIndex];
+            
+        } else if (strcmp(argv[ArgIndex], "--name") == 0 && ArgIndex + 1 < argc) {
+            Name = argv[++ArgIndex];
+            
+        } else if (strcmp(argv[ArgIndex], "--quirks") == 0 && ArgIndex + 1 < argc) {
+            
+            if (!ParseQuirkProfile(argv[++ArgIndex], &Profile)) {
+                fprintf(stderr, "Unknown quirk profile %s\n", argv[ArgIndex]);
+                return 1;
+            }
+            
+        } else if (strcmp(argv[ArgIndex], "--no-main") == 0) {
+            WithMain = false;
+            
+        } else if (argv[ArgIndex][0] != '-' && RomFileName == NULL) {
+            RomFileName = argv[ArgIndex];
+            
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (RomFileName == NULL) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    
+    if (Rom.Open(RomFileName) != ROM_OK || Rom.Size() == 0 || Rom.Size() > sizeof(Chip8State::Memory) - PROGRAM_START_LOCATION) {
+        fprintf(stderr, "Couldn't load ROM %s\n", RomFileName);
+        return 1;
+    }
+    
+    RomBytes.assign(Rom.Bytes(), Rom.Bytes() + Rom.Size());
+    Rom.Close();
+    
+    //
+    // The name prefixes everything the file defines, by default the ROM's file name made into
+    // an identifier.
+    //
+    
+    if (Name.empty()) {
+        
+        const char *BaseName = strrchr(RomFileName, '/') != NULL ? strrchr(RomFileName, '/') + 1 : RomFileName;
+        
+        for (const char *Character = BaseName; *Character != '\0' && *Character != '.'; ++Character) {
+            Name += isalnum((unsigned char) *Character) ? *Character : '_';
+        }
+        
+        if (Name.empty() || isdigit((unsigned char) Name[0])) {
+            Name = "Rom" + Name;
+        }
+    }
+    
+    switch (Profile) {
+        
+        case QUIRKS_DEFAULT:
+            Quirks = QuirksFor<DefaultQuirks>();
+            break;
+        
+        case QUIRKS_COSMAC_VIP:
+            Quirks = QuirksFor<CosmacVipQuirks>();
+            break;
+        
+        case QUIRKS_SUPER_CHIP:
+            Quirks = QuirksFor<SuperChipQuirks>();
+            break;
+        
+        case QUIRKS_XO_CHIP:
+            Quirks = QuirksFor<XoChipQuirks>();
+            break;
+    }
+    
+    Leaders = FindLeaders(RomBytes);
+    Blocks = FormBlocks(RomBytes, Leaders);
+    
+    if (OutFileName != NULL && (Out = fopen(OutFileName, "w")) == NULL) {
+        fprintf(stderr, "Couldn't write %s\n", OutFileName);
+        return 1;
+    }
+    
+    fprintf(Out, "//\n");
+    fprintf(Out, "// Generated by Chip8Recompiler from %s with the %s quirk profile. Build it against\n", RomFileName, QuirkProfileName(Profile));
+    fprintf(Out, "// the core library, and don't edit it, recompile the ROM instead.\n");
+    fprintf(Out, "//\n\n");
+    fprintf(Out, "#include <stdio.h>\n");
+    fprintf(Out, "#include <stdlib.h>\n");
+    fprintf(Out, "#include <string.h>\n");
+    fprintf(Out, "#include <chrono>\n\n");
+    fprintf(Out, "#include \"Chip8.h\"\n\n");
+    
+    fprintf(Out, "static const unsigned char %sRom[] = {", Name.c_str());
+    
+    for (size_t Index = 0; Index < RomBytes.size(); ++Index) {
+        fprintf(Out, "%s0x%02X", Index == 0 ? "\n    " : Index % 16 == 0 ? ",\n    " : ", ", RomBytes[Index]);
+    }
+    
+    fprintf(Out, "\n};\n\n");
+    
+    //
+    // Same as OpSetIndexToCharacter.
+    //
+    
+    fprintf(Out, "static inline unsigned short CharacterAddress(unsigned char Character)\n");
+    fprintf(Out, "{\n");
+    fprintf(Out, "    if ('0' <= Character && Character <= '9') {\n");
+    fprintf(Out, "        return (Character - '0') * CHARACTER_SPRITE_SIZE;\n");
+    fprintf(Out, "    } else if ('a' <= Character && Character <= 'f') {\n");
+    fprintf(Out, "        return (Character - 'a' + 10) * CHARACTER_SPRITE_SIZE;\n");
+    fprintf(Out, "    } else if ('A' <= Character && Character <= 'F') {\n");
+    fprintf(Out, "        return (Character - 'A' + 10) * CHARACTER_SPRITE_SIZE;\n");
+    fprintf(Out, "    }\n\n");
+    fprintf(Out, "    return 0;\n");
+    fprintf(Out, "}\n\n");
+    
+    for (size_t Index = 0; Index < Blocks.size(); ++Index) {
+        EmitBlock(Out, Blocks[Index], Quirks);
+        Instructions += Blocks[Index].Opcodes.size();
+    }
+    
+    if (!Blocks.empty()) {
+        
+        fprintf(Out, "static const StaticBlock %sBlocks[] = {\n", Name.c_str());
+        
+        for (size_t Index = 0; Index < Blocks.size(); ++Index) {
+            fprintf(Out, "    {0x%03X, %u, Block%03X},\n", Blocks[Index].Address, (unsigned int) Blocks[Index].Opcodes.size(), Blocks[Index].Address);
+        }
+        
+        fprintf(Out, "};\n\n");
+    }
+    
+    fprintf(Out, "extern const StaticProgram %sProgram;\n\n", Name.c_str());
+    fprintf(Out, "const StaticProgram %sProgram = {\n", Name.c_str());
+    fprintf(Out, "    %sRom,\n", Name.c_str());
+    fprintf(Out, "    sizeof(%sRom),\n", Name.c_str());
+    fprintf(Out, "    %s,\n", QuirkProfileConstants[Profile]);
+    
+    if (!Blocks.empty()) {
+        fprintf(Out, "    %sBlocks,\n", Name.c_str());
+        fprintf(Out, "    sizeof(%sBlocks) / sizeof(%sBlocks[0])\n", Name.c_str(), Name.c_str());
+    } else {
+        fprintf(Out, "    NULL,\n");
+        fprintf(Out, "    0\n");
+    }
+    
+    fprintf(Out, "};\n");
+    
+    if (WithMain) {
+        EmitMain(Out, Name.c_str());
+    }
+    
+    if (Out != stdout) {
+        fclose(Out);
+    }
+    
+    fprintf(stderr, "%s: %lu blocks, %lu instructions recompiled\n", RomFileName, (unsigned long) Blocks.size(), (unsigned long) Instructions);
+    
+    return 0;
+}
+
+void PrintUsage(const char *ProgramName)
+{
+    fprintf(stderr,
+            "Usage: %s <rom> [-o F] [--name N] [--quirks P] [--no-main]\n"
+            "    -o F         write the C++ to F instead of standard output\n"
+            "    --name N     prefix for what the file defines, NProgram is the StaticProgram\n"
+            "                 (default the ROM's file name)\n"
+            "    --quirks P   quirk profile to build the blocks for: default, vip, schip or xochip\n"
+            "    --no-main    leave out main, for linking the program into something else\n",
+            ProgramName);
+}
+
+//
+// Which instructions go into blocks. Jumps, calls, returns and skips end one.
+//
+static InstructionKind ClassifyOpcode(unsigned short Opcode)
+{
+    switch (Opcode & FIRST_FOUR_BITMASK) {
+        
+        case 0x0000:
+            return (Opcode & LAST_EIGHT_BITMASK) == 0xEE ? Terminator : NotTranslated;
+        
+        case 0x1000:
+        case 0x2000:
+        case 0x3000:
+        case 0x4000:
+        case 0x5000:
+        case 0x9000:
+            return Terminator;
+        
+        case 0x6000:
+        case 0x7000:
+        case 0xA000:
+        case 0xC000:
+            return Straight;
+        
+        case 0x8000:
+            return (Opcode & LAST_FOUR_BITMASK) <= 0x7 || (Opcode & LAST_FOUR_BITMASK) == 0xE ? Straight : NotTranslated;
+        
+        case 0xE000:
+            return (Opcode & LAST_EIGHT_BITMASK) == 0x9E || (Opcode & LAST_EIGHT_BITMASK) == 0xA1 ? Terminator : NotTranslated;
+        
+        case 0xF000:
+            switch (Opcode & LAST_EIGHT_BITMASK) {
+                case 0x07:
+                case 0x15:
+                case 0x18:
+                case 0x1E:
+                case 0x29:
+                case 0x65:
+                    return Straight;
+                
+                default:
+                    return NotTranslated;
+            }
+        
+        default:
+            return NotTranslated;
+    }
+}
+
+//
+// Walk every path from the start of the program and collect the addresses a basic block has
+// to start at: the program start, jump, call and skip targets, the instruction after a call
+// (where its return lands) and the instruction after anything the interpreter runs.
+//
+static std::set<unsigned short> FindLeaders(const std::vector<unsigned char> &Rom)
+{
+    std::set<unsigned short> Leaders;
+    std::vector<unsigned short> Pending;
+    std::vector<bool> Visited(4096, false);
+    int ProgramEnd = (int) (PROGRAM_START_LOCATION + Rom.size());
+    
+    Pending.push_back(PROGRAM_START_LOCATION);
+    
+    while (!Pending.empty()) {
+        
+        unsigned short Address = Pending.back();
+        
+        Pending.pop_back();
+        
+        if (Address < PROGRAM_START_LOCATION || Address + 1 >= ProgramEnd) {
+            continue;
+        }
+        
+        Leaders.insert(Address);
+        
+        while (Address + 1 < ProgramEnd && !Visited[Address]) {
+            
+            unsigned short Opcode = Rom[Address - PROGRAM_START_LOCATION] << 8 | Rom[Address + 1 - PROGRAM_START_LOCATION];
+            unsigned short Nnn = Opcode & LAST_TWELVE_BITMASK;
+            bool FallsThrough = true;
+            
+            Visited[Address] = true;
+            
+            switch (Opcode & FIRST_FOUR_BITMASK) {
+                
+                case 0x0000:
+                    FallsThrough = (Opcode & LAST_EIGHT_BITMASK) != 0xEE && (Opcode & LAST_EIGHT_BITMASK) != 0xFD;
+                    break;
+                
+                case 0x1000:
+                    Pending.push_back(Nnn);
+                    FallsThrough = false;
+                    break;
+                
+                case 0x2000:
+                    Pending.push_back(Nnn);
+                    Pending.push_back(Address + 2);
+                    FallsThrough = false;
+                    break;
+                
+                case 0x3000:
+                case 0x4000:
+                case 0x5000:
+                case 0x9000:
+                    Pending.push_back(Address + 2);
+                    Pending.push_back(Address + 4);
+                    FallsThrough = false;
+                    break;
+                
+                case 0xB000:
+                    FallsThrough = false;
+                    break;
+                
+                case 0xE000:
+                    if (ClassifyOpcode(Opcode) == Terminator) {
+                        Pending.push_back(Address + 2);
+                        Pending.push_back(Address + 4);
+                        FallsThrough = false;
+                    }
+                    break;
+                
+                default:
+                    break;
+            }
+            
+            if (!FallsThrough) {
+                break;
+            }
+            
+            if (ClassifyOpcode(Opcode) == NotTranslated) {
+                Pending.push_back(Address + 2);
+                break;
+            }
+            
+            Address += 2;
+        }
+    }
+    
+    return Leaders;
+}
+
+//
+// A block runs from a leader up to and including the first terminator, stopping short of an
+// instruction we don't translate, the next leader, the end of the ROM or the block size limit.
+// Stopping at the limit makes the next instruction a leader of its own.
+//
+static std::vector<RecompiledBlock> FormBlocks(const std::vector<unsigned char> &Rom, std::set<unsigned short> &Leaders)
+{
+    std::vector<RecompiledBlock> Blocks;
+    int ProgramEnd = (int) (PROGRAM_START_LOCATION + Rom.size());
+    
+    for (std::set<unsigned short>::iterator Leader = Leaders.begin(); Leader != Leaders.end(); ++Leader) {
+        
+        RecompiledBlock Block;
+        unsigned short Address = *Leader;
+        
+        Block.Address = Address;
+        
+        while (Address + 1 < ProgramEnd) {
+            
+            unsigned short Opcode = Rom[Address - PROGRAM_START_LOCATION] << 8 | Rom[Address + 1 - PROGRAM_START_LOCATION];
+            InstructionKind Kind = ClassifyOpcode(Opcode);
+            
+            if (Kind == NotTranslated || (Address != Block.Address && Leaders.count(Address) != 0)) {
+                break;
+            }
+            
+            if (Block.Opcodes.size() == STATIC_MAX_BLOCK_INSTRUCTIONS) {
+                Leaders.insert(Address);
+                break;
+            }
+            
+            Block.Opcodes.push_back(Opcode);
+            Address += 2;
+            
+            if (Kind == Terminator) {
+                break;
+            }
+        }
+        
+        if (!Block.Opcodes.empty()) {
+            Blocks.push_back(Block);
+        }
+    }
+    
+    return Blocks;
+}
+
+static void CollectRegisters(const RecompiledBlock &Block, BlockRegisters *Registers)
+{
+    memset(Registers, 0, sizeof(*Registers));
+    
+    for (size_t Index = 0; Index < Block.Opcodes.size(); ++Index) {
+        
+        unsigned short Opcode = Block.Opcodes[Index];
+        int X = (Opcode & REGISTER_ONE_BITMASK) >> 8;
+        int Y = (Opcode & REGISTER_TWO_BITMASK) >> 4;
+        
+        switch (Opcode & FIRST_FOUR_BITMASK) {
+            
+            case 0x3000:
+            case 0x4000:
+                Registers->Used[X] = true;
+                break;
+            
+            case 0x5000:
+            case 0x9000:
+                Registers->Used[X] = Registers->Used[Y] = true;
+                break;
+            
+            case 0x6000:
+            case 0x7000:
+            case 0xC000:
+                Registers->Used[X] = Registers->Written[X] = true;
+                break;
+            
+            case 0x8000:
+                Registers->Used[X] = Registers->Written[X] = true;
+                Registers->Used[Y] = true;
+                
+                if ((Opcode & LAST_FOUR_BITMASK) != 0x0) {
+                    Registers->Used[0xF] = Registers->Written[0xF] = true;
+                }
+                break;
+            
+            case 0xA000:
+                Registers->UsesIndex = Registers->WritesIndex = true;
+                break;
+            
+            case 0xE000:
+                Registers->Used[X] = true;
+                break;
+            
+            case 0xF000:
+                Registers->Used[X] = true;
+                
+                switch (Opcode & LAST_EIGHT_BITMASK) {
+                    case 0x07:
+                        Registers->Written[X] = true;
+                        break;
+                    
+                    case 0x1E:
+                    case 0x29:
+                        Registers->UsesIndex = Registers->WritesIndex = true;
+                        break;
+                    
+                    case 0x65:
+                        for (int Register = 0; Register <= X; ++Register) {
+                            Registers->Used[Register] = Registers->Written[Register] = true;
+                        }
+                        
+                        Registers->UsesIndex = Registers->WritesIndex = true;
+                        break;
+                    
+                    default:
+                        break;
+                }
+                break;
+            
+            default:
+                break;
+        }
+    }
+}
+
+//
+// The registers a block touches live in locals while it runs, which the compiler can keep in
+// host registers, and go back into the state wherever the block leaves.
+//
+static void EmitBlock(FILE *Out, const RecompiledBlock &Block, const TranslationQuirks &Quirks)
+{
+    BlockRegisters Registers;
+    std::string WriteBack;
+    std::string BailOutWriteBack;
+    char Line[64];
+    unsigned short Address = Block.Address;
+    unsigned short LastOpcode = Block.Opcodes.back();
+    
+    CollectRegisters(Block, &Registers);
+    
+    for (int Register = 0; Register < 16; ++Register) {
+        if (Registers.Written[Register]) {
+            snprintf(Line, sizeof(Line), "State.VRegisters[0x%X] = V%X;\n", Register, Register);
+            WriteBack += std::string("    ") + Line;
+            BailOutWriteBack += std::string("        ") + Line;
+        }
+    }
+    
+    if (Registers.WritesIndex) {
+        WriteBack += "    State.IndexRegister = I;\n";
+        BailOutWriteBack += "        State.IndexRegister = I;\n";
+    }
+    
+    fprintf(Out, "static unsigned int Block%03X(Chip8State &State)\n", Block.Address);
+    fprintf(Out, "{\n");
+    
+    for (int Register = 0; Register < 16; ++Register) {
+        if (Registers.Used[Register]) {
+            fprintf(Out, "    unsigned char V%X = State.VRegisters[0x%X];\n", Register, Register);
+        }
+    }
+    
+    if (Registers.UsesIndex) {
+        fprintf(Out, "    unsigned short I = State.IndexRegister;\n");
+    }
+    
+    if (memchr(Registers.Used, true, sizeof(Registers.Used)) != NULL || Registers.UsesIndex) {
+        fprintf(Out, "\n");
+    }
+    
+    for (size_t Index = 0; Index < Block.Opcodes.size(); ++Index) {
+        EmitInstruction(Out, Address, Block.Opcodes[Index], (unsigned int) Index, WriteBack, BailOutWriteBack, Quirks);
+        Address += 2;
+    }
+    
+    if (ClassifyOpcode(LastOpcode) != Terminator) {
+        fprintf(Out, "%s", WriteBack.c_str());
+        fprintf(Out, "    State.ProgramCounter = 0x%03X;\n", Address);
+    }
+    
+    fprintf(Out, "    return %u;\n", (unsigned int) Block.Opcodes.size());
+    fprintf(Out, "}\n\n");
+}
+
+//
+// One instruction, doing what its handler in Chip8.cpp does, in the same order. Executed is
+// how many of the block's instructions came before it, and BailOutWriteBack is WriteBack
+// indented for inside the stack checks.
+//
+static void EmitInstruction(FILE *Out, unsigned short Address, unsigned short Opcode, unsigned int Executed, const std::string &WriteBack, const std::string &BailOutWriteBack, const TranslationQuirks &Quirks)
+{
+    char Disassembly[DISASSEMBLY_BUFFER_SIZE];
+    int X = (Opcode & REGISTER_ONE_BITMASK) >> 8;
+    int Y = (Opcode & REGISTER_TWO_BITMASK) >> 4;
+    int Source = Quirks.ShiftReadsVY ? Y : X;
+    unsigned int Nnn = Opcode & LAST_TWELVE_BITMASK;
+    unsigned int Kk = Opcode & LAST_EIGHT_BITMASK;
+    
+    Disassemble(Opcode, Disassembly, sizeof(Disassembly));
+    fprintf(Out, "    // %03X  %04X  %s\n", Address, Opcode, Disassembly);
+    
+    switch (Opcode & FIRST_FOUR_BITMASK) {
+        
+        case 0x0000:
+            fprintf(Out, "    if (State.StackPointer == 0) {\n");
+            fprintf(Out, "%s", BailOutWriteBack.c_str());
+            fprintf(Out, "        State.ProgramCounter = 0x%03X;\n", Address);
+            fprintf(Out, "        return %u;\n", Executed);
+            fprintf(Out, "    }\n");
+            fprintf(Out, "%s", WriteBack.c_str());
+            fprintf(Out, "    State.ProgramCounter = State.Stack[--State.StackPointer];\n");
+            break;
+        
+        case 0x1000:
+            fprintf(Out, "%s", WriteBack.c_str());
+            fprintf(Out, "    State.ProgramCounter = 0x%03X;\n", Nnn);
+            break;
+        
+        case 0x2000:
+            fprintf(Out, "    if (State.StackPointer == STACK_DEPTH) {\n");
+            fprintf(Out, "%s", BailOutWriteBack.c_str());
+            fprintf(Out, "        State.ProgramCounter = 0x%03X;\n", Address);
+            fprintf(Out, "        return %u;\n", Executed);
+            fprintf(Out, "    }\n");
+            fprintf(Out, "%s", WriteBack.c_str());
+            fprintf(Out, "    State.Stack[State.StackPointer++] = 0x%03X;\n", Address + 2);
+            fprintf(Out, "    State.ProgramCounter = 0x%03X;\n", Nnn);
+            break;
+        
+        case 0x3000:
+            fprintf(Out, "%s", WriteBack.c_str());
+            fprintf(Out, "    State.ProgramCounter = V%X == 0x%02X ? 0x%03X : 0x%03X;\n", X, Kk, Address + 4, Address + 2);
+            break;
+        
+        case 0x4000:
+            fprintf(Out, "%s", WriteBack.c_str());
+            fprintf(Out, "    State.ProgramCounter = V%X != 0x%02X ? 0x%03X : 0x%03X;\n", X, Kk, Address + 4, Address + 2);
+            break;
+        
+        case 0x5000:
+            fprintf(Out, "%s", WriteBack.c_str());
+            fprintf(Out, "    State.ProgramCounter = V%X == V%X ? 0x%03X : 0x%03X;\n", X, Y, Address + 4, Address + 2);
+            break;
+        
+        case 0x9000:
+            fprintf(Out, "%s", WriteBack.c_str());
+            fprintf(Out, "    State.ProgramCounter = V%X != V%X ? 0x%03X : 0x%03X;\n", X, Y, Address + 4, Address + 2);
+            break;
+        
+        case 0x6000:
+            fprintf(Out, "    V%X = 0x%02X;\n", X, Kk);
+            break;
+        
+        case 0x7000:
+            fprintf(Out, "    V%X = (unsigned char) (V%X + 0x%02X);\n", X, X, Kk);
+            break;
+        
+        case 0x8000:
+            switch (Opcode & LAST_FOUR_BITMASK) {
+                case 0x0:
+                    fprintf(Out, "    V%X = V%X;\n", X, Y);
+                    break;
+                
+                case 0x1:
+                case 0x2:
+                case 0x3:
+                    if (Quirks.LogicClearsCarry) {
+                        fprintf(Out, "    VF = 0;\n");
+                    }
+                    
+                    fprintf(Out, "    V%X = V%X %c V%X;\n", X, X, "|&^"[(Opcode & LAST_FOUR_BITMASK) - 1], Y);
+                    break;
+                
+                case 0x4:
+                    fprintf(Out, "    VF = V%X + V%X > 255;\n", X, Y);
+                    fprintf(Out, "    V%X = (unsigned char) (V%X + V%X);\n", X, X, Y);
+                    break;
+                
+                case 0x5:
+                    fprintf(Out, "    VF = V%X >= V%X;\n", X, Y);
+                    fprintf(Out, "    V%X = (unsigned char) (V%X - V%X);\n", X, X, Y);
+                    break;
+                
+                case 0x6:
+                    fprintf(Out, "    {\n");
+                    fprintf(Out, "        unsigned char Source = V%X;\n", Source);
+                    fprintf(Out, "        VF = Source & 1;\n");
+                    fprintf(Out, "        V%X = Source >> 1;\n", X);
+                    fprintf(Out, "    }\n");
+                    break;
+                
+                case 0x7:
+                    fprintf(Out, "    VF = V%X >= V%X;\n", Y, X);
+                    fprintf(Out, "    V%X = (unsigned char) (V%X - V%X);\n", X, Y, X);
+                    break;
+                
+                case 0xE:
+                    fprintf(Out, "    {\n");
+                    fprintf(Out, "        unsigned char Source = V%X;\n", Source);
+                    fprintf(Out, "        VF = Source >> 7;\n");
+                    fprintf(Out, "        V%X = (unsigned char) (Source << 1);\n", X);
+                    fprintf(Out, "    }\n");
+                    break;
+                
+                default:
+                    break;
+            }
+            break;
+        
+        case 0xA000:
+            fprintf(Out, "    I = 0x%03X;\n", Nnn);
+            break;
+        
+        case 0xC000:
+            fprintf(Out, "    State.RandomState ^= State.RandomState << 13;\n");
+            fprintf(Out, "    State.RandomState ^= State.RandomState >> 17;\n");
+            fprintf(Out, "    State.RandomState ^= State.RandomState << 5;\n");
+            fprintf(Out, "    V%X = (unsigned char) (State.RandomState >> 24) & 0x%02X;\n", X, Kk);
+            break;
+        
+        case 0xE000:
+            fprintf(Out, "%s", WriteBack.c_str());
+            fprintf(Out, "    State.ProgramCounter = State.Key[V%X & 0xF] %s 0 ? 0x%03X : 0x%03X;\n", X, Kk == 0x9E ? "!=" : "==", Address + 4, Address + 2);
+            break;
+        
+        case 0xF000:
+            switch (Kk) {
+                case 0x07:
+                    fprintf(Out, "    V%X = State.DelayTimer;\n", X);
+                    break;
+                
+                case 0x15:
+                    fprintf(Out, "    State.DelayTimer = V%X;\n", X);
+                    break;
+                
+                case 0x18:
+                    fprintf(Out, "    State.SoundTimer = V%X;\n", X);
+                    break;
+                
+                case 0x1E:
+                    fprintf(Out, "    I = (unsigned short) (I + V%X);\n", X);
+                    break;
+                
+                case 0x29:
+                    fprintf(Out, "    I = CharacterAddress(V%X);\n", X);
+                    break;
+                
+                case 0x65:
+                    for (int Register = 0; Register <= X; ++Register) {
+                        fprintf(Out, "    V%X = State.Memory[(I + %d) & ADDRESS_BITMASK];\n", Register, Register);
+                    }
+                    
+                    if (Quirks.LoadStoreMovesIndex) {
+                        fprintf(Out, "    I = (unsigned short) (I + %d);\n", X + 1);
+                    }
+                    break;
+                
+                default:
+                    break;
+            }
+            break;
+        
+        default:
+            break;
+    }
+}
+
+//
+// A runner like Chip8Headless without the options: no keys pressed, a fixed number of
+// frames, and --verify to check every frame against the interpreter.
+//
+static void EmitMain(FILE *Out, const char *Name)
+{
+    fprintf(Out, "\n");
+    fprintf(Out, "int main(int argc, char * argv[])\n");
+    fprintf(Out, "{\n");
+    fprintf(Out, "    Chip8 *Cpu = new Chip8();\n");
+    fprintf(Out, "    Chip8 *ReferenceCpu = NULL;\n");
+    fprintf(Out, "    unsigned char Keyboard[16] = {0};\n");
+    fprintf(Out, "    unsigned long Frames = 600;\n");
+    fprintf(Out, "    unsigned long CyclesPerFrame = 10;\n");
+    fprintf(Out, "    unsigned long long Instructions = 0;\n");
+    fprintf(Out, "    uint32_t Seed = 1;\n");
+    fprintf(Out, "    bool Verify = false;\n\n");
+    fprintf(Out, "    for (int ArgIndex = 1; ArgIndex < argc; ++ArgIndex) {\n");
+    fprintf(Out, "        if (strcmp(argv[ArgIndex], \"--frames\") == 0 && ArgIndex + 1 < argc) {\n");
+    fprintf(Out, "            Frames = strtoul(argv[++ArgIndex], NULL, 0);\n");
+    fprintf(Out, "        } else if (strcmp(argv[ArgIndex], \"--ipf\") == 0 && ArgIndex + 1 < argc) {\n");
+    fprintf(Out, "            CyclesPerFrame = strtoul(argv[++ArgIndex], NULL, 0);\n");
+    fprintf(Out, "        } else if (strcmp(argv[ArgIndex], \"--seed\") == 0 && ArgIndex + 1 < argc) {\n");
+    fprintf(Out, "            Seed = (uint32_t) strtoul(argv[++ArgIndex], NULL, 0);\n");
+    fprintf(Out, "        } else if (strcmp(argv[ArgIndex], \"--verify\") == 0) {\n");
+    fprintf(Out, "            Verify = true;\n");
+    fprintf(Out, "        } else {\n");
+    fprintf(Out, "            fprintf(stderr, \"Usage: %%s [--frames N] [--ipf N] [--seed N] [--verify]\\n\", argv[0]);\n");
+    fprintf(Out, "            return 1;\n");
+    fprintf(Out, "        }\n");
+    fprintf(Out, "    }\n\n");
+    fprintf(Out, "    Cpu->Initialize();\n");
+    fprintf(Out, "    Cpu->LoadProgram(%sRom, sizeof(%sRom));\n", Name, Name);
+    fprintf(Out, "    Cpu->SetQuirkProfile(%sProgram.Quirks);\n", Name);
+    fprintf(Out, "    Cpu->SeedRandom(Seed);\n");
+    fprintf(Out, "    Cpu->SetStaticProgram(&%sProgram);\n\n", Name);
+    fprintf(Out, "    if (Verify) {\n");
+    fprintf(Out, "        ReferenceCpu = new Chip8();\n");
+    fprintf(Out, "        ReferenceCpu->Initialize();\n");
+    fprintf(Out, "        ReferenceCpu->LoadProgram(%sRom, sizeof(%sRom));\n", Name, Name);
+    fprintf(Out, "        ReferenceCpu->SetQuirkProfile(%sProgram.Quirks);\n", Name);
+    fprintf(Out, "        ReferenceCpu->SeedRandom(Seed);\n");
+    fprintf(Out, "    }\n\n");
+    fprintf(Out, "    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();\n\n");
+    fprintf(Out, "    for (unsigned long Frame = 0; Frame < Frames; ++Frame) {\n");
+    fprintf(Out, "        Instructions += Cpu->Run(Keyboard, CyclesPerFrame);\n");
+    fprintf(Out, "        Cpu->TickTimers();\n\n");
+    fprintf(Out, "        if (ReferenceCpu != NULL) {\n");
+    fprintf(Out, "            ReferenceCpu->Run(Keyboard, CyclesPerFrame);\n");
+    fprintf(Out, "            ReferenceCpu->TickTimers();\n\n");
+    fprintf(Out, "            if (!Cpu->CompareState(*ReferenceCpu)) {\n");
+    fprintf(Out, "                fprintf(stderr, \"Recompiled code differs from the interpreter after frame %%lu\\n\", Frame);\n");
+    fprintf(Out, "                return 1;\n");
+    fprintf(Out, "            }\n");
+    fprintf(Out, "        }\n");
+    fprintf(Out, "    }\n\n");
+    fprintf(Out, "    double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();\n\n");
+    fprintf(Out, "    printf(\"instructions: %%llu\\n\", Instructions);\n");
+    fprintf(Out, "    printf(\"frames:       %%lu\\n\", Frames);\n");
+    fprintf(Out, "    printf(\"seconds:      %%f\\n\", Seconds);\n");
+    fprintf(Out, "    printf(\"instr/sec:    %%.0f\\n\", Seconds > 0 ? Instructions / Seconds : 0.0);\n\n");
+    fprintf(Out, "    delete Cpu;\n");
+    fprintf(Out, "    delete ReferenceCpu;\n\n");
+    fprintf(Out, "    return 0;\n");
+    fprintf(Out, "}\n");
+}
@@ -0,0 +1,71 @@
+//
+//  Chip8Static.cpp
+//  Chip8Emulator
+//
+
+#include "Chip8Static.h"
+#include "Chip8.h"
+
+Chip8Static::Chip8Static(const StaticProgram &StaticCode) : Program(StaticCode)
+{
+    memset(Compiled, 0, sizeof(Compiled));
+    memset(Blocks, 0, sizeof(Blocks));
+    memset(BlockInstructions, 0, sizeof(BlockInstructions));
+    
+    for (size_t Index = 0; Index < Program.BlockCount; ++Index) {
+        
+        const StaticBlock &Block = Program.Blocks[Index];
+        
+        //
+        // The recompiler never makes anything else, but a table from somewhere else that
+        // doesn't fit is left out rather than trusted.
+        //
+        
+        if (Block.Address < PROGRAM_START_LOCATION ||
+            Block.Instructions == 0 ||
+            Block.Instructions > STATIC_MAX_BLOCK_INSTRUCTIONS ||
+            (size_t) (Block.Address + Block.Instructions * 2) > PROGRAM_START_LOCATION + Program.RomSize) {
+            continue;
+        }
+        
+        Compiled[Block.Address] = Block.Function;
+        BlockInstructions[Block.Address] = (unsigned char) Block.Instructions;
+    }
+}
+
+//
+// A block can run when the machine has the profile it was compiled for and every byte it
+// covers is the same as in the ROM. One ending with a jump that closes an idle loop is left
+// to the interpreter, which can skip the loop rather than go round it.
+//
+void Chip8Static::Revalidate(Chip8 &Cpu, unsigned short Address, unsigned short Length)
+{
+    int FirstAddress = std::max(Address - (STATIC_MAX_BLOCK_INSTRUCTIONS * 2 - 1), PROGRAM_START_LOCATION);
+    int LastAddress = std::min(Address + Length - 1, ADDRESS_BITMASK);
+    bool SameProfile = Cpu.Quirks == Program.Quirks;
+    
+    for (int Start = FirstAddress; Start <= LastAddress; ++Start) {
+        
+        int End = Start + BlockInstructions[Start] * 2;
+        unsigned short LastOpcode;
+        
+        if (Compiled[Start] == NULL || End <= Address) {
+            continue;
+        }
+        
+        Blocks[Start] = NULL;
+        
+        if (!SameProfile ||
+            memcmp(Cpu.State.Memory + Start, Program.Rom + (Start - PROGRAM_START_LOCATION), End - Start) != 0) {
+            continue;
+        }
+        
+        LastOpcode = Cpu.State.Memory[End - 2] << 8 | Cpu.State.Memory[End - 1];
+        
+        if ((LastOpcode & FIRST_FOUR_BITMASK) == 0x1000 && Cpu.IdleLoopCandidate(End - 2)) {
+            continue;
+        }
+        
+        Blocks[Start] = Compiled[Start];
+    }
+}
@@ -0,0 +1,104 @@
+//
+//  Chip8Static.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__Chip8Static__
+#define __Chip8Emulator__Chip8Static__
+
+#include <stddef.h>
+
+#include "Chip8Quirks.h"
+
+//
+// Runtime side of ahead of time recompiled ROMs. Chip8Recompiler turns a ROM into a C++ file
+// with a function for each basic block it can find, and a StaticProgram listing them, which
+// is compiled and linked against the core like any other code. A machine given the program
+// runs those functions in place of the interpreter wherever one starts, much as it would
+// JIT compiled blocks, but with nothing generated or made executable at run time.
+//
+// A block only runs while the memory it was compiled from still holds the same bytes as the
+// ROM did, so self modifying code, or a different program loaded over it, quietly falls back
+// to the interpreter, and only runs under the quirk profile it was compiled for. Jumps that
+// close an idle loop are left to the interpreter, same as with the JIT.
+//
+
+#define STATIC_MAX_BLOCK_INSTRUCTIONS (64)
+
+struct Chip8State;
+class Chip8;
+
+//
+// Runs the block against State and returns the instructions it executed. That's all of them
+// unless a call or return at the end would overflow or underflow the stack, in which case it
+// stops with the program counter on it and leaves the fault to the interpreter.
+//
+
+typedef unsigned int (*StaticBlockFunction)(Chip8State &State);
+
+struct StaticBlock {
+    unsigned short Address;
+    unsigned short Instructions;
+    StaticBlockFunction Function;
+};
+
+struct StaticProgram {
+    const unsigned char *Rom;
+    size_t RomSize;
+    Chip8QuirkProfile Quirks;
+    const StaticBlock *Blocks;
+    size_t BlockCount;
+};
+
+class Chip8Static {
+
+private:
+    
+    const StaticProgram &Program;
+    
+    //
+    // Every block in the program by start address, and the ones that can run right now.
+    //
+    
+    StaticBlockFunction Compiled[4096];
+    StaticBlockFunction Blocks[4096];
+    unsigned char BlockInstructions[4096];
+    
+    Chip8Static(const Chip8Static &Other);
+    Chip8Static &operator=(const Chip8Static &Other);
+
+public:
+    Chip8Static(const StaticProgram &StaticCode);
+    
+    //
+    // Run the block at Address if there's one that can run and it fits in the budget. Returns
+    // how many instructions it executed, 0 means the caller should interpret instead.
+    //
+    
+    unsigned int RunBlock(Chip8State &State, unsigned short Address, unsigned short ProgramEnd, unsigned int CycleBudget)
+    {
+        if (Address >= 4096 || Blocks[Address] == NULL || BlockInstructions[Address] > CycleBudget) {
+            return 0;
+        }
+        
+        //
+        // A program end inside the block has to stop the machine partway through it.
+        //
+        
+        if (ProgramEnd > Address && ProgramEnd < Address + BlockInstructions[Address] * 2) {
+            return 0;
+        }
+        
+        return Blocks[Address](State);
+    };
+    
+    //
+    // Memory from Address for Length bytes may have changed, or the machine's quirk profile
+    // has. Work out again which blocks there can run.
+    //
+    
+    void Revalidate(Chip8 &Cpu, unsigned short Address, unsigned short Length);
+    
+};
+
+#endif /* defined(__Chip8Emulator__Chip8Static__) */
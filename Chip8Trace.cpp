@@ -0,0 +1,250 @@
+//
+//  Chip8Trace.cpp
+//  Chip8Emulator
+//
+
+#include <string.h>
+#include <algorithm>
+
+#include "Chip8Trace.h"
+
+static const char *CategoryNames[] = {"instructions", "draw", "input", "timers"};
+
+Chip8Trace::Chip8Trace(size_t Capacity)
+{
+    size_t Rounded = 1;
+    
+    while (Rounded < Capacity) {
+        Rounded <<= 1;
+    }
+    
+    Words = new std::atomic<uint64_t>[Rounded * 2];
+    Mask = Rounded - 1;
+    Frame = 0;
+    
+    for (size_t Word = 0; Word < Rounded * 2; ++Word) {
+        Words[Word].store(0, std::memory_order_relaxed);
+    }
+    
+    Head.store(0, std::memory_order_relaxed);
+    Categories.store(0, std::memory_order_relaxed);
+}
+
+Chip8Trace::~Chip8Trace()
+{
+    delete[] Words;
+}
+
+void Chip8Trace::Snapshot(std::vector<TraceRecord> &Records)
+{
+    uint64_t End = Head.load(std::memory_order_acquire);
+    uint64_t Start = End > Mask + 1 ? End - (Mask + 1) : 0;
+    uint64_t Lapped;
+    
+    Records.resize((size_t) (End - Start));
+    
+    for (uint64_t Position = Start; Position < End; ++Position) {
+        
+        std::atomic<uint64_t> *Slot = &Words[(Position & Mask) * 2];
+        TraceRecord *Out = &Records[(size_t) (Position - Start)];
+        uint64_t Low = Slot[0].load(std::memory_order_relaxed);
+        uint64_t High = Slot[1].load(std::memory_order_relaxed);
+        
+        Out->Frame = (uint32_t) Low;
+        Out->ProgramCounter = (uint16_t) (Low >> 32);
+        Out->Opcode = (uint16_t) (Low >> 48);
+        Out->IndexRegister = (uint16_t) High;
+        Out->Category = (uint8_t) (High >> 16);
+        Out->Register = (uint8_t) (High >> 24);
+        Out->Value = (uint8_t) (High >> 32);
+        Out->Extra = (uint8_t) (High >> 40);
+        Out->Reserved = 0;
+    }
+    
+    //
+    // The writer may have lapped us while we were copying. Anything it has written over, or
+    // could be halfway through writing over right now, gets dropped from the front.
+    //
+    
+    std::atomic_thread_fence(std::memory_order_acquire);
+    
+    Lapped = Head.load(std::memory_order_relaxed) + 1;
+    
+    if (Lapped > Start + Mask + 1) {
+        
+        uint64_t Torn = std::min(Lapped - (Mask + 1) - Start, End - Start);
+        
+        Records.erase(Records.begin(), Records.begin() + (size_t) Torn);
+    }
+}
+
+bool Chip8Trace::Save(const char *FileName)
+{
+    std::vector<TraceRecord> Records;
+    std::vector<unsigned char> Blob;
+    unsigned char *Out;
+    FILE *TraceFile;
+    bool Written;
+    
+    Snapshot(Records);
+    
+    Blob.resize(TRACE_FILE_HEADER_SIZE + Records.size() * TRACE_RECORD_SIZE);
+    Out = &Blob[0];
+    
+    //
+    // Little endian, a byte at a time.
+    //
+    
+    uint64_t Fields[] = {TRACE_FILE_MAGIC, TRACE_FILE_VERSION, TRACE_RECORD_SIZE, Records.size()};
+    int FieldSizes[] = {4, 2, 2, 4};
+    
+    for (int Field = 0; Field < 4; ++Field) {
+        for (int Byte = 0; Byte < FieldSizes[Field]; ++Byte) {
+            *Out++ = (unsigned char) (Fields[Field] >> (Byte * 8));
+        }
+    }
+    
+    for (size_t Entry = 0; Entry < Records.size(); ++Entry) {
+        
+        const TraceRecord &Record = Records[Entry];
+        
+        for (int Byte = 0; Byte < 4; ++Byte) {
+            *Out++ = (unsigned char) (Record.Frame >> (Byte * 8));
+        }
+        
+        *Out++ = (unsigned char) Record.ProgramCounter;
+        *Out++ = (unsigned char) (Record.ProgramCounter >> 8);
+        *Out++ = (unsigned char) Record.Opcode;
+        *Out++ = (unsigned char) (Record.Opcode >> 8);
+        *Out++ = (unsigned char) Record.IndexRegister;
+        *Out++ = (unsigned char) (Record.IndexRegister >> 8);
+        *Out++ = Record.Category;
+        *Out++ = Record.Register;
+        *Out++ = Record.Value;
+        *Out++ = Record.Extra;
+        *Out++ = 0;
+        *Out++ = 0;
+    }
+    
+    TraceFile = fopen(FileName, "wb");
+    
+    if (TraceFile == NULL) {
+        return false;
+    }
+    
+    Written = fwrite(&Blob[0], 1, Blob.size(), TraceFile) == Blob.size();
+    
+    return fclose(TraceFile) == 0 && Written;
+}
+
+bool Chip8Trace::Load(const char *FileName, std::vector<TraceRecord> &Records)
+{
+    unsigned char Header[TRACE_FILE_HEADER_SIZE];
+    unsigned char Bytes[TRACE_RECORD_SIZE];
+    uint64_t Fields[4];
+    int FieldSizes[] = {4, 2, 2, 4};
+    const unsigned char *Cursor = Header;
+    FILE *TraceFile;
+    
+    Records.clear();
+    
+    TraceFile = fopen(FileName, "rb");
+    
+    if (TraceFile == NULL) {
+        return false;
+    }
+    
+    if (fread(Header, 1, sizeof(Header), TraceFile) != sizeof(Header)) {
+        fclose(TraceFile);
+        return false;
+    }
+    
+    for (int Field = 0; Field < 4; ++Field) {
+        
+        Fields[Field] = 0;
+        
+        for (int Byte = 0; Byte < FieldSizes[Field]; ++Byte) {
+            Fields[Field] |= (uint64_t) *Cursor++ << (Byte * 8);
+        }
+    }
+    
+    if (Fields[0] != TRACE_FILE_MAGIC || Fields[1] != TRACE_FILE_VERSION || Fields[2] != TRACE_RECORD_SIZE) {
+        fclose(TraceFile);
+        return false;
+    }
+    
+    for (uint64_t Entry = 0; Entry < Fields[3]; ++Entry) {
+        
+        TraceRecord Record;
+        
+        if (fread(Bytes, 1, sizeof(Bytes), TraceFile) != sizeof(Bytes)) {
+            fclose(TraceFile);
+            Records.clear();
+            return false;
+        }
+        
+        Record.Frame = (uint32_t) (Bytes[0] | Bytes[1] << 8 | Bytes[2] << 16 | (uint32_t) Bytes[3] << 24);
+        Record.ProgramCounter = (uint16_t) (Bytes[4] | Bytes[5] << 8);
+        Record.Opcode = (uint16_t) (Bytes[6] | Bytes[7] << 8);
+        Record.IndexRegister = (uint16_t) (Bytes[8] | Bytes[9] << 8);
+        Record.Category = Bytes[10];
+        Record.Register = Bytes[11];
+        Record.Value = Bytes[12];
+        Record.Extra = Bytes[13];
+        Record.Reserved = 0;
+        
+        Records.push_back(Record);
+    }
+    
+    fclose(TraceFile);
+    
+    return true;
+}
+
+bool Chip8Trace::ParseCategories(const char *Names, uint32_t *Mask)
+{
+    const char *Cursor = Names;
+    
+    *Mask = 0;
+    
+    while (*Cursor != '\0') {
+        
+        size_t Length = strcspn(Cursor, ",");
+        bool Found = false;
+        
+        if (Length == 3 && strncmp(Cursor, "all", 3) == 0) {
+            *Mask |= TRACE_ALL;
+            Found = true;
+        }
+        
+        for (int Category = 0; Category < 4 && !Found; ++Category) {
+            if (strlen(CategoryNames[Category]) == Length && strncmp(Cursor, CategoryNames[Category], Length) == 0) {
+                *Mask |= 1u << Category;
+                Found = true;
+            }
+        }
+        
+        if (!Found) {
+            return false;
+        }
+        
+        Cursor += Length;
+        
+        if (*Cursor == ',') {
+            ++Cursor;
+        }
+    }
+    
+    return true;
+}
+
+const char *Chip8Trace::CategoryName(uint8_t Category)
+{
+    for (int Bit = 0; Bit < 4; ++Bit) {
+        if (Category == 1u << Bit) {
+            return CategoryNames[Bit];
+        }
+    }
+    
+    return "unknown";
+}
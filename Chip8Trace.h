@@ -0,0 +1,155 @@
+//
+//  Chip8Trace.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__Chip8Trace__
+#define __Chip8Emulator__Chip8Trace__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+//
+// Trace categories. Every record belongs to exactly one.
+//
+
+#define TRACE_INSTRUCTIONS (0x01) // every instruction the interpreter executes
+#define TRACE_DRAW (0x02)         // DXYN and CLS, with the collision flag
+#define TRACE_INPUT (0x04)        // FX0A getting its key
+#define TRACE_TIMERS (0x08)       // the 60 Hz timer tick
+#define TRACE_ALL (0x0F)
+
+//
+// Categories compiled into the core. Anything left out here costs nothing at all, the test
+// folds away. Whatever's compiled in costs one NULL check until a trace is switched on.
+//
+
+#ifndef CHIP8_TRACE_CATEGORIES
+#define CHIP8_TRACE_CATEGORIES (TRACE_ALL)
+#endif
+
+#define TRACE_COMPILED(Category) ((CHIP8_TRACE_CATEGORIES & (Category)) != 0)
+
+#define TRACE_DEFAULT_CAPACITY (1 << 16)
+
+#define TRACE_NO_REGISTER (0xFF)
+
+//
+// Trace files are the little endian header below followed by the records, oldest first.
+//
+
+#define TRACE_FILE_MAGIC (0x52543843) // "C8TR"
+#define TRACE_FILE_VERSION (1)
+#define TRACE_FILE_HEADER_SIZE (4 + 2 + 2 + 4)
+#define TRACE_RECORD_SIZE (16)
+
+//
+// One fixed size record. Register and Value are the V register the instruction wrote and
+// what it holds afterwards, TRACE_NO_REGISTER if it didn't write one, so a draw records VF
+// and FX0A the key it got. Instructions keep VF in Extra as well. A timer tick has no
+// register, Value and Extra are the delay and sound timers after it.
+//
+
+struct TraceRecord {
+    uint32_t Frame;
+    uint16_t ProgramCounter;
+    uint16_t Opcode;
+    uint16_t IndexRegister;
+    uint8_t Category;
+    uint8_t Register;
+    uint8_t Value;
+    uint8_t Extra;
+    uint16_t Reserved;
+};
+
+//
+// Ring buffer of the most recent records. The emulation thread is the only writer, and
+// anybody may take a snapshot at any time without stopping it: each record is two 64 bit
+// words stored with relaxed atomics (plain moves on x86-64), and the head is published with
+// release ordering after them. A reader copies what it wants, then rereads the head and
+// throws away anything the writer may have lapped while it was copying, the same way a
+// seqlock reader retries.
+//
+
+class Chip8Trace {
+
+private:
+    std::atomic<uint64_t> *Words;
+    uint64_t Mask;
+    std::atomic<uint64_t> Head;
+    std::atomic<uint32_t> Categories;
+    uint32_t Frame;
+    
+    Chip8Trace(const Chip8Trace &Other);
+    Chip8Trace &operator=(const Chip8Trace &Other);
+
+public:
+    
+    //
+    // Capacity is rounded up to a power of two.
+    //
+    
+    Chip8Trace(size_t Capacity = TRACE_DEFAULT_CAPACITY);
+    ~Chip8Trace();
+    
+    void SetCategories(uint32_t Enabled) {Categories.store(Enabled, std::memory_order_relaxed);};
+    uint32_t EnabledCategories() {return Categories.load(std::memory_order_relaxed);};
+    bool Enabled(uint32_t Category) {return (Categories.load(std::memory_order_relaxed) & Category) != 0;};
+    
+    void NextFrame() {++Frame;};
+    
+    void Record(uint8_t Category,
+                uint16_t ProgramCounter,
+                uint16_t Opcode,
+                uint16_t IndexRegister,
+                uint8_t Register,
+                uint8_t Value,
+                uint8_t Extra)
+    {
+        uint64_t Position = Head.load(std::memory_order_relaxed);
+        std::atomic<uint64_t> *Slot = &Words[(Position & Mask) * 2];
+        
+        //
+        // Orders the previous head store before the words below, so a reader that sees any
+        // of them also sees at least this Position (a compiler barrier on x86-64).
+        //
+        
+        std::atomic_thread_fence(std::memory_order_release);
+        
+        Slot[0].store((uint64_t) Frame |
+                      (uint64_t) ProgramCounter << 32 |
+                      (uint64_t) Opcode << 48, std::memory_order_relaxed);
+        Slot[1].store((uint64_t) IndexRegister |
+                      (uint64_t) Category << 16 |
+                      (uint64_t) Register << 24 |
+                      (uint64_t) Value << 32 |
+                      (uint64_t) Extra << 40, std::memory_order_relaxed);
+        
+        Head.store(Position + 1, std::memory_order_release);
+    };
+    
+    uint64_t RecordsWritten() {return Head.load(std::memory_order_acquire);};
+    size_t Capacity() {return (size_t) Mask + 1;};
+    
+    //
+    // Copy out the records still in the buffer, oldest first. Safe from any thread.
+    //
+    
+    void Snapshot(std::vector<TraceRecord> &Records);
+    
+    bool Save(const char *FileName);
+    static bool Load(const char *FileName, std::vector<TraceRecord> &Records);
+    
+    //
+    // "instructions,draw", "all" and so on into a category mask. False on an unknown name.
+    //
+    
+    static bool ParseCategories(const char *Names, uint32_t *Mask);
+    static const char *CategoryName(uint8_t Category);
+    
+};
+
+#endif /* defined(__Chip8Emulator__Chip8Trace__) */
@@ -0,0 +1,127 @@
+//
+//  main.cpp
+//  Chip8TraceDecode
+//
+
+//
+// Offline decoder for the binary traces the core writes (see Chip8Trace.h). Prints one line
+// per record with the instruction disassembled, so a trace taken from a live session can be
+// read without slowing the session down with text formatting.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "Chip8Trace.h"
+#include "Disassembler.h"
+
+void PrintUsage(const char *ProgramName);
+void PrintRecord(const TraceRecord &Record);
+
+int main(int argc, char * argv[])
+{
+    char *TraceFileName = NULL;
+    uint32_t Categories = TRACE_ALL;
+    unsigned long Last = 0;
+    std::vector<TraceRecord> Records;
+    size_t First = 0;
+    
+    for (int ArgIndex = 1; ArgIndex < argc; ++ArgIndex) {
+        
+        if (strcmp(argv[ArgIndex], "--categories") == 0 && ArgIndex + 1 < argc) {
+            
+            if (!Chip8Trace::ParseCategories(argv[++ArgIndex], &Categories)) {
+                fprintf(stderr, "Unknown trace category in %s\n", argv[ArgIndex]);
+                return 1;
+            }
+            
+        } else if (strcmp(argv[ArgIndex], "--last") == 0 && ArgIndex + 1 < argc) {
+            Last = strtoul(argv[++ArgIndex], NULL, 0);
+            
+        } else if (argv[ArgIndex][0] != '-' && TraceFileName == NULL) {
+            TraceFileName = argv[ArgIndex];
+            
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (TraceFileName == NULL) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    
+    if (!Chip8Trace::Load(TraceFileName, Records)) {
+        fprintf(stderr, "Couldn't read trace %s\n", TraceFileName);
+        return 1;
+    }
+    
+    //
+    // --last counts records of the categories asked for, not records in the file.
+    //
+    
+    if (Last != 0) {
+        
+        unsigned long Matching = 0;
+        
+        for (First = Records.size(); First > 0 && Matching < Last; --First) {
+            if ((Records[First - 1].Category & Categories) != 0) {
+                ++Matching;
+            }
+        }
+    }
+    
+    for (size_t Entry = First; Entry < Records.size(); ++Entry) {
+        if ((Records[Entry].Category & Categories) != 0) {
+            PrintRecord(Records[Entry]);
+        }
+    }
+    
+    return 0;
+}
+
+void PrintRecord(const TraceRecord &Record)
+{
+    char Disassembly[DISASSEMBLY_BUFFER_SIZE];
+    
+    printf("%8u  %-12s  0x%03X  ", Record.Frame, Chip8Trace::CategoryName(Record.Category), Record.ProgramCounter);
+    
+    switch (Record.Category) {
+        
+        case TRACE_TIMERS:
+            printf("DT=%02X ST=%02X\n", Record.Value, Record.Extra);
+            break;
+        
+        case TRACE_INPUT:
+            printf("%04X  key %X into V%X\n", Record.Opcode, Record.Value, Record.Register);
+            break;
+        
+        default:
+            Disassemble(Record.Opcode, Disassembly, sizeof(Disassembly));
+            
+            printf("%04X  %-20s I=%03X", Record.Opcode, Disassembly, Record.IndexRegister);
+            
+            if (Record.Register != TRACE_NO_REGISTER) {
+                printf(" V%X=%02X", Record.Register, Record.Value);
+            }
+            
+            if (Record.Category == TRACE_INSTRUCTIONS && Record.Register != 0xF) {
+                printf(" VF=%02X", Record.Extra);
+            }
+            
+            printf("\n");
+            break;
+    }
+}
+
+void PrintUsage(const char *ProgramName)
+{
+    fprintf(stderr,
+            "Usage: %s <trace> [--categories list] [--last N]\n"
+            "    --categories L  comma separated: instructions, draw, input, timers or all\n"
+            "    --last N        only the last N matching records\n",
+            ProgramName);
+}
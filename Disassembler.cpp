@@ -0,0 +1,159 @@
+//
+//  Disassembler.cpp
+//  Chip8Emulator
+//
+
+#include <stdio.h>
+
+#include "Disassembler.h"
+
+void Disassemble(unsigned short Opcode, char *Buffer, size_t BufferSize)
+{
+    unsigned int X = (Opcode >> 8) & 0xF;
+    unsigned int Y = (Opcode >> 4) & 0xF;
+    unsigned int N = Opcode & 0xF;
+    unsigned int Kk = Opcode & 0xFF;
+    unsigned int Nnn = Opcode & 0xFFF;
+    
+    switch (Opcode >> 12) {
+        
+        case 0x0:
+            if (Opcode == 0x00E0) {
+                snprintf(Buffer, BufferSize, "CLS");
+            } else if (Opcode == 0x00EE) {
+                snprintf(Buffer, BufferSize, "RET");
+            } else if ((Opcode & 0xFFF0) == 0x00C0) {
+                snprintf(Buffer, BufferSize, "SCD %u", N);
+            } else if (Opcode == 0x00FB) {
+                snprintf(Buffer, BufferSize, "SCR");
+            } else if (Opcode == 0x00FC) {
+                snprintf(Buffer, BufferSize, "SCL");
+            } else if (Opcode == 0x00FD) {
+                snprintf(Buffer, BufferSize, "EXIT");
+            } else if (Opcode == 0x00FE) {
+                snprintf(Buffer, BufferSize, "LOW");
+            } else if (Opcode == 0x00FF) {
+                snprintf(Buffer, BufferSize, "HIGH");
+            } else {
+                snprintf(Buffer, BufferSize, "SYS 0x%03X", Nnn);
+            }
+            return;
+        
+        case 0x1:
+            snprintf(Buffer, BufferSize, "JP 0x%03X", Nnn);
+            return;
+        
+        case 0x2:
+            snprintf(Buffer, BufferSize, "CALL 0x%03X", Nnn);
+            return;
+        
+        case 0x3:
+            snprintf(Buffer, BufferSize, "SE V%X, 0x%02X", X, Kk);
+            return;
+        
+        case 0x4:
+            snprintf(Buffer, BufferSize, "SNE V%X, 0x%02X", X, Kk);
+            return;
+        
+        case 0x5:
+            if (N == 0) {
+                snprintf(Buffer, BufferSize, "SE V%X, V%X", X, Y);
+                return;
+            }
+            break;
+        
+        case 0x6:
+            snprintf(Buffer, BufferSize, "LD V%X, 0x%02X", X, Kk);
+            return;
+        
+        case 0x7:
+            snprintf(Buffer, BufferSize, "ADD V%X, 0x%02X", X, Kk);
+            return;
+        
+        case 0x8: {
+            static const char *Mnemonics[16] = {"LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                                                NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL};
+            
+            if (Mnemonics[N] != NULL) {
+                snprintf(Buffer, BufferSize, "%s V%X, V%X", Mnemonics[N], X, Y);
+                return;
+            }
+            break;
+        }
+        
+        case 0x9:
+            if (N == 0) {
+                snprintf(Buffer, BufferSize, "SNE V%X, V%X", X, Y);
+                return;
+            }
+            break;
+        
+        case 0xA:
+            snprintf(Buffer, BufferSize, "LD I, 0x%03X", Nnn);
+            return;
+        
+        case 0xB:
+            snprintf(Buffer, BufferSize, "JP V0, 0x%03X", Nnn);
+            return;
+        
+        case 0xC:
+            snprintf(Buffer, BufferSize, "RND V%X, 0x%02X", X, Kk);
+            return;
+        
+        case 0xD:
+            snprintf(Buffer, BufferSize, "DRW V%X, V%X, %u", X, Y, N);
+            return;
+        
+        case 0xE:
+            if (Kk == 0x9E) {
+                snprintf(Buffer, BufferSize, "SKP V%X", X);
+                return;
+            } else if (Kk == 0xA1) {
+                snprintf(Buffer, BufferSize, "SKNP V%X", X);
+                return;
+            }
+            break;
+        
+        case 0xF:
+            switch (Kk) {
+                case 0x07:
+                    snprintf(Buffer, BufferSize, "LD V%X, DT", X);
+                    return;
+                    
+                case 0x0A:
+                    snprintf(Buffer, BufferSize, "LD V%X, K", X);
+                    return;
+                    
+                case 0x15:
+                    snprintf(Buffer, BufferSize, "LD DT, V%X", X);
+                    return;
+                    
+                case 0x18:
+                    snprintf(Buffer, BufferSize, "LD ST, V%X", X);
+                    return;
+                    
+                case 0x1E:
+                    snprintf(Buffer, BufferSize, "ADD I, V%X", X);
+                    return;
+                    
+                case 0x29:
+                    snprintf(Buffer, BufferSize, "LD F, V%X", X);
+                    return;
+                    
+                case 0x33:
+                    snprintf(Buffer, BufferSize, "LD B, V%X", X);
+                    return;
+                    
+                case 0x55:
+                    snprintf(Buffer, BufferSize, "LD [I], V%X", X);
+                    return;
+                    
+                case 0x65:
+                    snprintf(Buffer, BufferSize, "LD V%X, [I]", X);
+                    return;
+            }
+            break;
+    }
+    
+    snprintf(Buffer, BufferSize, "DW 0x%04X", Opcode);
+}
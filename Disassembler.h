@@ -0,0 +1,20 @@
+//
+//  Disassembler.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__Disassembler__
+#define __Chip8Emulator__Disassembler__
+
+#include <stddef.h>
+
+//
+// Turns an opcode into the usual mnemonics ("LD V3, 0x1F", "DRW V0, V1, 5"), for profiler
+// and trace reports. Anything we don't know comes out as "DW 0xNNNN".
+//
+
+#define DISASSEMBLY_BUFFER_SIZE (32)
+
+void Disassemble(unsigned short Opcode, char *Buffer, size_t BufferSize);
+
+#endif /* defined(__Chip8Emulator__Disassembler__) */
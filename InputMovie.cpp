@@ -0,0 +1,173 @@
+//
+//  InputMovie.cpp
+//  Chip8Emulator
+//
+
+#include <stdio.h>
+
+#include "InputMovie.h"
+#include "Chip8.h"
+
+void InputMovie::Start(uint32_t Seed, Chip8QuirkProfile Quirks)
+{
+    this->Seed = Seed;
+    this->Quirks = Quirks;
+    FinalStateHash = 0;
+    Frames.clear();
+}
+
+bool InputMovie::RecordFrame(unsigned short KeyMask, unsigned long Cycles)
+{
+    Frame NewFrame;
+    
+    if (Cycles > 0xFFFFFFFFul) {
+        return false;
+    }
+    
+    NewFrame.KeyMask = KeyMask;
+    NewFrame.Cycles = (uint32_t) Cycles;
+    
+    Frames.push_back(NewFrame);
+    
+    return true;
+}
+
+//
+// For rewinding while recording, the frame we stepped back over never happened.
+//
+void InputMovie::DropLastFrame()
+{
+    if (!Frames.empty()) {
+        Frames.pop_back();
+    }
+}
+
+void InputMovie::Finish(Chip8 &Cpu)
+{
+    FinalStateHash = HashState(Cpu);
+}
+
+void InputMovie::KeysForFrame(size_t Frame, unsigned char *Keyboard)
+{
+    unsigned short KeyMask = KeyMaskForFrame(Frame);
+    
+    for (int KeyIndex = 0; KeyIndex < 16; ++KeyIndex) {
+        Keyboard[KeyIndex] = (KeyMask >> KeyIndex) & 1;
+    }
+}
+
+//
+// 64 bit FNV-1a over the machine's save state.
+//
+uint64_t InputMovie::HashState(Chip8 &Cpu)
+{
+    std::vector<unsigned char> State;
+    uint64_t Hash = 0xCBF29CE484222325ull;
+    
+    Cpu.SaveState(State);
+    
+    for (size_t Byte = 0; Byte < State.size(); ++Byte) {
+        Hash ^= State[Byte];
+        Hash *= 0x100000001B3ull;
+    }
+    
+    return Hash;
+}
+
+bool InputMovie::Save(const char *FileName)
+{
+    std::vector<unsigned char> Blob(INPUT_MOVIE_HEADER_SIZE + Frames.size() * INPUT_MOVIE_FRAME_SIZE);
+    unsigned char *Out = &Blob[0];
+    FILE *MovieFile;
+    bool Written;
+    
+    //
+    // Little endian, a byte at a time.
+    //
+    
+    uint64_t Fields[] = {INPUT_MOVIE_MAGIC, INPUT_MOVIE_VERSION, (uint64_t) Quirks, Seed, Frames.size(), FinalStateHash};
+    int FieldSizes[] = {4, 2, 2, 4, 4, 8};
+    
+    for (int Field = 0; Field < 6; ++Field) {
+        for (int Byte = 0; Byte < FieldSizes[Field]; ++Byte) {
+            *Out++ = (unsigned char) (Fields[Field] >> (Byte * 8));
+        }
+    }
+    
+    for (size_t Entry = 0; Entry < Frames.size(); ++Entry) {
+        *Out++ = (unsigned char) Frames[Entry].KeyMask;
+        *Out++ = (unsigned char) (Frames[Entry].KeyMask >> 8);
+        
+        for (int Byte = 0; Byte < 4; ++Byte) {
+            *Out++ = (unsigned char) (Frames[Entry].Cycles >> (Byte * 8));
+        }
+    }
+    
+    MovieFile = fopen(FileName, "wb");
+    
+    if (MovieFile == NULL) {
+        return false;
+    }
+    
+    Written = fwrite(&Blob[0], 1, Blob.size(), MovieFile) == Blob.size();
+    
+    return fclose(MovieFile) == 0 && Written;
+}
+
+bool InputMovie::Load(const char *FileName)
+{
+    unsigned char Header[INPUT_MOVIE_HEADER_SIZE];
+    unsigned char FrameBytes[INPUT_MOVIE_FRAME_SIZE];
+    uint64_t Fields[6];
+    int FieldSizes[] = {4, 2, 2, 4, 4, 8};
+    const unsigned char *Cursor = Header;
+    FILE *MovieFile;
+    
+    MovieFile = fopen(FileName, "rb");
+    
+    if (MovieFile == NULL) {
+        return false;
+    }
+    
+    if (fread(Header, 1, sizeof(Header), MovieFile) != sizeof(Header)) {
+        fclose(MovieFile);
+        return false;
+    }
+    
+    for (int Field = 0; Field < 6; ++Field) {
+        
+        Fields[Field] = 0;
+        
+        for (int Byte = 0; Byte < FieldSizes[Field]; ++Byte) {
+            Fields[Field] |= (uint64_t) *Cursor++ << (Byte * 8);
+        }
+    }
+    
+    if (Fields[0] != INPUT_MOVIE_MAGIC || Fields[1] != INPUT_MOVIE_VERSION || Fields[2] > QUIRKS_XO_CHIP) {
+        fclose(MovieFile);
+        return false;
+    }
+    
+    Start((uint32_t) Fields[3], (Chip8QuirkProfile) Fields[2]);
+    FinalStateHash = Fields[5];
+    
+    for (uint64_t Entry = 0; Entry < Fields[4]; ++Entry) {
+        
+        Frame NewFrame;
+        
+        if (fread(FrameBytes, 1, sizeof(FrameBytes), MovieFile) != sizeof(FrameBytes)) {
+            fclose(MovieFile);
+            Frames.clear();
+            return false;
+        }
+        
+        NewFrame.KeyMask = (unsigned short) (FrameBytes[0] | (FrameBytes[1] << 8));
+        NewFrame.Cycles = (uint32_t) FrameBytes[2] | ((uint32_t) FrameBytes[3] << 8) | ((uint32_t) FrameBytes[4] << 16) | ((uint32_t) FrameBytes[5] << 24);
+        
+        Frames.push_back(NewFrame);
+    }
+    
+    fclose(MovieFile);
+    
+    return true;
+}
@@ -0,0 +1,80 @@
+//
+//  InputMovie.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__InputMovie__
+#define __Chip8Emulator__InputMovie__
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "Chip8Quirks.h"
+
+class Chip8;
+
+//
+// A recording of everything a run depended on: the random seed, the quirk profile and, for
+// every frame, which keys were down and how many instructions ran. Booting the same ROM with
+// the same seed and profile and feeding the frames back in reproduces the run exactly, at
+// whatever speed we like. The hash of the final state is kept so a replay can tell whether
+// it ended up in the same place.
+//
+// On disk it's little endian: "C8MV", version, quirk profile word, seed, frame count, final
+// state hash, then a key mask word and an instruction count dword per frame.
+//
+
+#define INPUT_MOVIE_MAGIC (0x564D3843) // "C8MV"
+#define INPUT_MOVIE_VERSION (3)
+#define INPUT_MOVIE_HEADER_SIZE (4 + 2 + 2 + 4 + 4 + 8)
+#define INPUT_MOVIE_FRAME_SIZE (2 + 4)
+
+class InputMovie {
+
+private:
+    
+    struct Frame {
+        unsigned short KeyMask;
+        uint32_t Cycles;
+    };
+    
+    std::vector<Frame> Frames;
+    uint32_t Seed;
+    Chip8QuirkProfile Quirks;
+    uint64_t FinalStateHash;
+
+public:
+    InputMovie() : Seed(0), Quirks(QUIRKS_DEFAULT), FinalStateHash(0) {};
+    
+    void Start(uint32_t Seed, Chip8QuirkProfile Quirks);
+    
+    //
+    // False, and nothing recorded, if the frame ran more instructions than fit in a dword.
+    //
+    
+    bool RecordFrame(unsigned short KeyMask, unsigned long Cycles);
+    void DropLastFrame();
+    void Finish(Chip8 &Cpu);
+    
+    bool Load(const char *FileName);
+    bool Save(const char *FileName);
+    
+    uint32_t RandomSeed() {return Seed;};
+    Chip8QuirkProfile QuirkProfile() {return Quirks;};
+    size_t FrameCount() {return Frames.size();};
+    unsigned short KeyMaskForFrame(size_t Frame) {return Frames[Frame].KeyMask;};
+    unsigned long CyclesForFrame(size_t Frame) {return Frames[Frame].Cycles;};
+    void KeysForFrame(size_t Frame, unsigned char *Keyboard);
+    
+    //
+    // True when Cpu is where the recording ended up.
+    //
+    
+    bool MatchesFinalState(Chip8 &Cpu) {return HashState(Cpu) == FinalStateHash;};
+    
+    static uint64_t HashState(Chip8 &Cpu);
+    
+};
+
+#endif /* defined(__Chip8Emulator__InputMovie__) */
@@ -0,0 +1,91 @@
+//
+//  InputScript.cpp
+//  Chip8Emulator
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "InputScript.h"
+
+//
+// Read the whole script up front, entries have to be in frame order.
+//
+bool InputScript::Load(const char *FileName)
+{
+    FILE *ScriptFile;
+    char Line[256];
+    unsigned long Frame;
+    unsigned int KeyMask;
+    Entry NewEntry;
+    
+    ScriptFile = fopen(FileName, "r");
+    
+    if (ScriptFile == NULL) {
+        return false;
+    }
+    
+    Entries.clear();
+    Cursor = 0;
+    
+    while (fgets(Line, sizeof(Line), ScriptFile) != NULL) {
+        
+        if (Line[0] == '#' || Line[0] == '\n') {
+            continue;
+        }
+        
+        if (sscanf(Line, "%lu %x", &Frame, &KeyMask) != 2) {
+            fclose(ScriptFile);
+            return false;
+        }
+        
+        if (!Entries.empty() && Entries.back().Frame > Frame) {
+            fclose(ScriptFile);
+            return false;
+        }
+        
+        NewEntry.Frame = Frame;
+        NewEntry.KeyMask = (unsigned short) KeyMask;
+        Entries.push_back(NewEntry);
+    }
+    
+    fclose(ScriptFile);
+    
+    return true;
+}
+
+//
+// Frames are expected to be asked for in increasing order, so we just walk a cursor forward
+// instead of searching the entries every time.
+//
+unsigned short InputScript::KeyMaskForFrame(unsigned long Frame)
+{
+    if (Cursor > 0 && Entries[Cursor - 1].Frame > Frame) {
+        Cursor = 0;
+    }
+    
+    while (Cursor < Entries.size() && Entries[Cursor].Frame <= Frame) {
+        ++Cursor;
+    }
+    
+    if (Cursor == 0) {
+        return 0;
+    }
+    
+    return Entries[Cursor - 1].KeyMask;
+}
+
+void InputScript::KeysForFrame(unsigned long Frame, unsigned char *Keyboard)
+{
+    unsigned short KeyMask;
+    
+    assert(Keyboard != NULL);
+    
+    KeyMask = KeyMaskForFrame(Frame);
+    
+    for (int KeyIndex = 0; KeyIndex < 16; ++KeyIndex) {
+        Keyboard[KeyIndex] = (KeyMask >> KeyIndex) & 1;
+    }
+}
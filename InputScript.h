@@ -0,0 +1,44 @@
+//
+//  InputScript.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__InputScript__
+#define __Chip8Emulator__InputScript__
+
+#include <vector>
+
+//
+// Scripted keyboard input for runs without a real keyboard. A script is a text file with one
+// "<frame> <keymask>" pair per line, where keymask is a 16 bit hex value with bit N set when
+// key N is held. A key state holds from its frame until the next line replaces it. Lines
+// starting with '#' are comments.
+//
+//     # hold key 5 for a second, then let go
+//     0    0x0020
+//     60   0x0000
+//
+
+class InputScript {
+
+private:
+    
+    struct Entry {
+        unsigned long Frame;
+        unsigned short KeyMask;
+    };
+    
+    std::vector<Entry> Entries;
+    
+    size_t Cursor;
+
+public:
+    InputScript() : Cursor(0) {};
+    
+    bool Load(const char *FileName);
+    unsigned short KeyMaskForFrame(unsigned long Frame);
+    void KeysForFrame(unsigned long Frame, unsigned char *Keyboard);
+    
+};
+
+#endif /* defined(__Chip8Emulator__InputScript__) */
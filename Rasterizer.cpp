@@ -0,0 +1,112 @@
+//
+//  Rasterizer.cpp
+//  Chip8Emulator
+//
+
+#include "Rasterizer.h"
+#include "Chip8.h"
+
+//
+// Scale is a template argument so the inner loop is unrolled for each mode.
+//
+template <int Scale>
+static void TransferRows(const uint64_t *Graphics, int RowWords, int FirstRow, int LastRow, uint32_t *Destination, int Pitch)
+{
+    //
+    // Each "pixel" in our graphics array is going to represent a Scale x Scale block on
+    // our actual screen. Go row by row so we write the pixels array in order: build the
+    // first screen line of the row, then copy it down to the rest.
+    //
+    
+    unsigned char *Line = (unsigned char *) Destination;
+    
+    for (int yIndex = FirstRow; yIndex <= LastRow; ++yIndex) {
+        
+        uint32_t *FirstLine = (uint32_t *) Line;
+        
+        for (int Word = 0; Word < RowWords; ++Word) {
+            
+            uint64_t Row = Graphics[yIndex * RowWords + Word];
+            uint32_t *WordLine = FirstLine + Word * 64 * Scale;
+            
+            for (int xIndex = 0; xIndex < 64; ++xIndex) {
+                
+                uint32_t Color = (Row >> (63 - xIndex)) & 1 ? PIXEL_ON_COLOR : PIXEL_OFF_COLOR;
+                
+                for (int i = 0; i < Scale; ++i) {
+                    WordLine[xIndex * Scale + i] = Color;
+                }
+            }
+        }
+        
+        Line += Pitch;
+        
+        for (int i = 1; i < Scale; ++i) {
+            memcpy(Line, FirstLine, GRAPHICS_X_AXIS * PIXEL_SCALE * sizeof(uint32_t));
+            Line += Pitch;
+        }
+    }
+}
+
+void TransferGraphicsToPixels(const uint64_t *Graphics, bool HiRes, int FirstRow, int LastRow, uint32_t *Destination, int Pitch)
+{
+    if (HiRes) {
+        TransferRows<PIXEL_SCALE_FOR(true)>(Graphics, GRAPHICS_ROW_WORDS(true), FirstRow, LastRow, Destination, Pitch);
+    } else {
+        TransferRows<PIXEL_SCALE_FOR(false)>(Graphics, GRAPHICS_ROW_WORDS(false), FirstRow, LastRow, Destination, Pitch);
+    }
+}
+
+//
+// OR each pair of neighbouring pixels in a word together and pack the 32 results into the
+// low half, leftmost pair in the top bit.
+//
+static uint64_t FoldPixelPairs(uint64_t Word)
+{
+    Word = (Word | Word >> 1) & 0x5555555555555555ull;
+    Word = (Word | Word >> 1) & 0x3333333333333333ull;
+    Word = (Word | Word >> 2) & 0x0F0F0F0F0F0F0F0Full;
+    Word = (Word | Word >> 4) & 0x00FF00FF00FF00FFull;
+    Word = (Word | Word >> 8) & 0x0000FFFF0000FFFFull;
+    Word = (Word | Word >> 16) & 0x00000000FFFFFFFFull;
+    
+    return Word;
+}
+
+void TransferGraphicsToBytes(const uint64_t *Graphics, bool HiRes, unsigned char *Destination)
+{
+    for (int yIndex = 0; yIndex < GRAPHICS_Y_AXIS; ++yIndex) {
+        
+        uint64_t Row;
+        
+        if (HiRes) {
+            
+            //
+            // Two hi-res rows down to one, then two pixels across down to one.
+            //
+            
+            uint64_t Left = Graphics[yIndex * 4] | Graphics[yIndex * 4 + 2];
+            uint64_t Right = Graphics[yIndex * 4 + 1] | Graphics[yIndex * 4 + 3];
+            
+            Row = FoldPixelPairs(Left) << 32 | FoldPixelPairs(Right);
+            
+        } else {
+            Row = Graphics[yIndex];
+        }
+        
+        for (int Byte = 0; Byte < GRAPHICS_X_AXIS / 8; ++Byte) {
+            
+            //
+            // Spread the 8 pixels of one byte into 8 bytes with a multiply. The lowest
+            // byte of the result gets the top bit, which is the leftmost pixel as long as
+            // the host is little endian, like everything we build for.
+            //
+            
+            uint64_t Pixels = (uint64_t) ((Row >> (GRAPHICS_X_AXIS - 8 - Byte * 8)) & 0xFF);
+            
+            Pixels = ((Pixels * 0x8040201008040201ull) >> 7) & 0x0101010101010101ull;
+            memcpy(Destination, &Pixels, sizeof(Pixels));
+            Destination += sizeof(Pixels);
+        }
+    }
+}
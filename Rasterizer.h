@@ -0,0 +1,44 @@
+//
+//  Rasterizer.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__Rasterizer__
+#define __Chip8Emulator__Rasterizer__
+
+#include <stdint.h>
+
+//
+// Turning the packed display into 32 bit pixels lives down here rather than in the SDL
+// frontend so anything can use it (and time it) without a window.
+//
+
+#define PIXEL_SCALE (8)
+
+//
+// Hi-res pixels are half the size, so the screen is the same size in both modes.
+//
+
+#define PIXEL_SCALE_FOR(HiRes) ((HiRes) ? PIXEL_SCALE / 2 : PIXEL_SCALE)
+
+#define PIXEL_ON_COLOR (0x00000000)
+#define PIXEL_OFF_COLOR (0xFFFFFFFF)
+
+//
+// Rasterize display rows FirstRow through LastRow of a display in the given mode, each pixel
+// becoming a PIXEL_SCALE_FOR(HiRes) square. Destination is where the first screen line of
+// FirstRow goes, Pitch is in bytes.
+//
+
+void TransferGraphicsToPixels(const uint64_t *Graphics, bool HiRes, int FirstRow, int LastRow, uint32_t *Destination, int Pitch);
+
+//
+// The whole display as one byte per pixel, 1 for on and 0 for off, rows top to bottom with
+// nothing between them: GRAPHICS_X_AXIS * GRAPHICS_Y_AXIS bytes. This is the observation
+// Chip8Env hands to training code. A hi-res display is folded down to 64x32, each byte on
+// if any of the four pixels it covers is.
+//
+
+void TransferGraphicsToBytes(const uint64_t *Graphics, bool HiRes, unsigned char *Destination);
+
+#endif /* defined(__Chip8Emulator__Rasterizer__) */
@@ -0,0 +1,244 @@
+//
+//  RewindBuffer.cpp
+//  Chip8Emulator
+//
+
+#include <chrono>
+
+#include "RewindBuffer.h"
+#include "Chip8.h"
+
+//
+// A literal run in a delta ends once we see this many zero bytes in a row, shorter gaps are
+// cheaper to just copy than to start a new run for.
+//
+
+#define DELTA_ZERO_RUN_BREAK (4)
+
+static void PutVarint(std::vector<unsigned char> &Out, size_t Value)
+{
+    while (Value >= 0x80) {
+        Out.push_back((unsigned char) (Value | 0x80));
+        Value >>= 7;
+    }
+    
+    Out.push_back((unsigned char) Value);
+}
+
+static bool GetVarint(const unsigned char *&Cursor, const unsigned char *End, size_t &Value)
+{
+    int Shift = 0;
+    
+    Value = 0;
+    
+    while (Cursor < End && Shift < 28) {
+        unsigned char Byte = *Cursor++;
+        
+        Value |= (size_t) (Byte & 0x7F) << Shift;
+        
+        if ((Byte & 0x80) == 0) {
+            return true;
+        }
+        
+        Shift += 7;
+    }
+    
+    return false;
+}
+
+RewindBuffer::RewindBuffer(unsigned int Seconds, size_t ByteBudget)
+{
+    MaxFrames = std::max((size_t) Seconds * REWIND_FRAMES_PER_SECOND, (size_t) 1);
+    this->ByteBudget = ByteBudget;
+    
+    TotalCaptureSeconds = 0;
+    WorstCaptureSeconds = 0;
+    Captures = 0;
+    
+    Clear();
+}
+
+void RewindBuffer::Clear()
+{
+    Snapshots.clear();
+    BytesUsed = 0;
+    FramesSinceKeyframe = 0;
+}
+
+void RewindBuffer::Capture(Chip8 &Cpu)
+{
+    std::chrono::steady_clock::time_point StartTime = std::chrono::steady_clock::now();
+    
+    Snapshots.push_back(Snapshot());
+    Snapshot &Newest = Snapshots.back();
+    
+    Cpu.SaveState(State);
+    
+    //
+    // The stack depth changes the size of a save state, and a delta only works against a
+    // keyframe the same size, so that forces a keyframe too.
+    //
+    
+    if (Snapshots.size() == 1 ||
+        FramesSinceKeyframe + 1 >= REWIND_KEYFRAME_INTERVAL ||
+        State.size() != Keyframe.size()) {
+        
+        Newest.Keyframe = true;
+        Newest.Data = State;
+        Keyframe = State;
+        FramesSinceKeyframe = 0;
+        
+    } else {
+        
+        Newest.Keyframe = false;
+        EncodeDelta(Keyframe, State, Newest.Data);
+        ++FramesSinceKeyframe;
+    }
+    
+    BytesUsed += Newest.Data.size();
+    
+    while (Snapshots.size() > MaxFrames || BytesUsed > ByteBudget) {
+        
+        size_t SizeBefore = Snapshots.size();
+        
+        DropOldest();
+        
+        if (Snapshots.size() == SizeBefore) {
+            break;
+        }
+    }
+    
+    std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - StartTime;
+    
+    TotalCaptureSeconds += Elapsed.count();
+    WorstCaptureSeconds = std::max(WorstCaptureSeconds, Elapsed.count());
+    ++Captures;
+}
+
+//
+// Drop the oldest keyframe and every delta that depends on it, unless it's the only
+// keyframe we have.
+//
+void RewindBuffer::DropOldest()
+{
+    size_t GroupEnd = 1;
+    
+    while (GroupEnd < Snapshots.size() && !Snapshots[GroupEnd].Keyframe) {
+        ++GroupEnd;
+    }
+    
+    if (GroupEnd == Snapshots.size()) {
+        return;
+    }
+    
+    for (size_t Entry = 0; Entry < GroupEnd; ++Entry) {
+        BytesUsed -= Snapshots.front().Data.size();
+        Snapshots.pop_front();
+    }
+}
+
+bool RewindBuffer::StepBack(Chip8 &Cpu)
+{
+    size_t KeyframeIndex;
+    
+    if (Snapshots.size() < 2) {
+        return false;
+    }
+    
+    BytesUsed -= Snapshots.back().Data.size();
+    Snapshots.pop_back();
+    
+    //
+    // Find the keyframe the new newest frame hangs off, and carry on capturing against it.
+    //
+    
+    KeyframeIndex = Snapshots.size() - 1;
+    
+    while (!Snapshots[KeyframeIndex].Keyframe) {
+        --KeyframeIndex;
+    }
+    
+    Keyframe = Snapshots[KeyframeIndex].Data;
+    FramesSinceKeyframe = Snapshots.size() - 1 - KeyframeIndex;
+    
+    if (Snapshots.back().Keyframe) {
+        State = Keyframe;
+    } else if (!DecodeDelta(Keyframe, Snapshots.back().Data, State)) {
+        return false;
+    }
+    
+    return Cpu.LoadState(&State[0], State.size());
+}
+
+//
+// A delta is a list of (zero bytes to skip, literal count, literal bytes) runs, counts as
+// varints, literals being Current XOR Base.
+//
+void RewindBuffer::EncodeDelta(const std::vector<unsigned char> &Base, const std::vector<unsigned char> &Current, std::vector<unsigned char> &Delta)
+{
+    size_t Length = Current.size();
+    size_t Position = 0;
+    
+    Delta.clear();
+    
+    while (Position < Length) {
+        
+        size_t RunStart = Position;
+        size_t LiteralStart;
+        size_t Zeros = 0;
+        
+        while (Position < Length && Current[Position] == Base[Position]) {
+            ++Position;
+        }
+        
+        if (Position == Length) {
+            break;
+        }
+        
+        LiteralStart = Position;
+        
+        while (Position < Length && Zeros < DELTA_ZERO_RUN_BREAK) {
+            Zeros = Current[Position] == Base[Position] ? Zeros + 1 : 0;
+            ++Position;
+        }
+        
+        Position -= Zeros;
+        
+        PutVarint(Delta, LiteralStart - RunStart);
+        PutVarint(Delta, Position - LiteralStart);
+        
+        for (size_t Byte = LiteralStart; Byte < Position; ++Byte) {
+            Delta.push_back(Current[Byte] ^ Base[Byte]);
+        }
+    }
+}
+
+bool RewindBuffer::DecodeDelta(const std::vector<unsigned char> &Base, const std::vector<unsigned char> &Delta, std::vector<unsigned char> &Current)
+{
+    const unsigned char *Cursor = Delta.empty() ? NULL : &Delta[0];
+    const unsigned char *End = Cursor + Delta.size();
+    size_t Position = 0;
+    size_t Skip;
+    size_t Literals;
+    
+    Current = Base;
+    
+    while (Cursor < End) {
+        
+        if (!GetVarint(Cursor, End, Skip) || !GetVarint(Cursor, End, Literals)) {
+            return false;
+        }
+        
+        Position += Skip;
+        
+        if (Position + Literals > Current.size() || (size_t) (End - Cursor) < Literals) {
+            return false;
+        }
+        
+        for (size_t Byte = 0; Byte < Literals; ++Byte) {
+            Current[Position++] ^= *Cursor++;
+        }
+    }
+    
+    return true;
+}
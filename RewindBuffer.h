@@ -0,0 +1,90 @@
+//
+//  RewindBuffer.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__RewindBuffer__
+#define __Chip8Emulator__RewindBuffer__
+
+#include <deque>
+#include <vector>
+#include <stddef.h>
+
+#define REWIND_DEFAULT_SECONDS (60)
+#define REWIND_DEFAULT_BUDGET (512 * 1024)
+#define REWIND_FRAMES_PER_SECOND (60)
+
+//
+// Every this many frames we store a whole save state, the frames in between are stored as
+// the difference from it.
+//
+
+#define REWIND_KEYFRAME_INTERVAL (60)
+
+class Chip8;
+
+//
+// The last few seconds of save states, one per frame, for stepping backwards. A frame is
+// kept as its save state XORed against the last keyframe and run length encoded, which is
+// mostly zeros since a frame only touches a handful of bytes, so a delta is usually tens of
+// bytes against 4 KB and change for a whole state.
+//
+// Old history is thrown away a keyframe and its deltas at a time, once we hold more than
+// the frame limit or the byte budget. The newest keyframe group is never thrown away, so
+// memory use can go over the budget by at most one group.
+//
+
+class RewindBuffer {
+
+private:
+    
+    struct Snapshot {
+        bool Keyframe;
+        std::vector<unsigned char> Data;
+    };
+    
+    std::deque<Snapshot> Snapshots;
+    
+    size_t MaxFrames;
+    size_t ByteBudget;
+    size_t BytesUsed;
+    unsigned long FramesSinceKeyframe;
+    
+    std::vector<unsigned char> State;
+    std::vector<unsigned char> Keyframe;
+    
+    double TotalCaptureSeconds;
+    double WorstCaptureSeconds;
+    unsigned long Captures;
+    
+    void EncodeDelta(const std::vector<unsigned char> &Base, const std::vector<unsigned char> &Current, std::vector<unsigned char> &Delta);
+    bool DecodeDelta(const std::vector<unsigned char> &Base, const std::vector<unsigned char> &Delta, std::vector<unsigned char> &Current);
+    void DropOldest();
+
+public:
+    RewindBuffer(unsigned int Seconds = REWIND_DEFAULT_SECONDS, size_t ByteBudget = REWIND_DEFAULT_BUDGET);
+    
+    //
+    // Remember the machine as it is now. Call once per frame.
+    //
+    
+    void Capture(Chip8 &Cpu);
+    
+    //
+    // Throw away the newest frame and put the machine back to the one before it. False when
+    // there's nothing older left to go back to.
+    //
+    
+    bool StepBack(Chip8 &Cpu);
+    
+    void Clear();
+    
+    size_t FramesStored() {return Snapshots.size();};
+    size_t MemoryUsed() {return BytesUsed;};
+    size_t MemoryBudget() {return ByteBudget;};
+    double AverageCaptureMicroseconds() {return Captures != 0 ? TotalCaptureSeconds * 1000000.0 / Captures : 0.0;};
+    double WorstCaptureMicroseconds() {return WorstCaptureSeconds * 1000000.0;};
+    
+};
+
+#endif /* defined(__Chip8Emulator__RewindBuffer__) */
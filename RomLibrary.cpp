@@ -0,0 +1,307 @@
+//
+//  RomLibrary.cpp
+//  Chip8Emulator
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "RomLibrary.h"
+
+#if ROM_MMAP_SUPPORTED
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define INDEX_HEADER "# hash size mtime ipf quirks path\n"
+
+RomStatus RomImage::Open(const char *FileName)
+{
+    struct stat FileStatus;
+    
+    Close();
+    
+    if (stat(FileName, &FileStatus) != 0) {
+        return ROM_NOT_FOUND;
+    }
+    
+    if (FileStatus.st_size == 0) {
+        return ROM_EMPTY;
+    }
+    
+    if (FileStatus.st_size > ROM_MAX_SIZE) {
+        return ROM_TOO_LARGE;
+    }
+
+#if ROM_MMAP_SUPPORTED
+    int Descriptor = open(FileName, O_RDONLY);
+    
+    if (Descriptor < 0) {
+        return ROM_NOT_FOUND;
+    }
+    
+    Mapping = mmap(NULL, (size_t) FileStatus.st_size, PROT_READ, MAP_PRIVATE, Descriptor, 0);
+    close(Descriptor);
+    
+    if (Mapping == MAP_FAILED) {
+        Mapping = NULL;
+        return ROM_READ_FAILED;
+    }
+    
+    Data = (const unsigned char *) Mapping;
+#else
+    FILE *RomFile = fopen(FileName, "rb");
+    
+    if (RomFile == NULL) {
+        return ROM_NOT_FOUND;
+    }
+    
+    Buffer.resize((size_t) FileStatus.st_size);
+    
+    if (fread(&Buffer[0], 1, Buffer.size(), RomFile) != Buffer.size()) {
+        fclose(RomFile);
+        Buffer.clear();
+        return ROM_READ_FAILED;
+    }
+    
+    fclose(RomFile);
+    
+    Data = &Buffer[0];
+#endif
+    
+    Length = (size_t) FileStatus.st_size;
+    
+    return ROM_OK;
+}
+
+void RomImage::Close()
+{
+#if ROM_MMAP_SUPPORTED
+    if (Mapping != NULL) {
+        munmap(Mapping, Length);
+    }
+#endif
+    
+    Buffer.clear();
+    Mapping = NULL;
+    Data = NULL;
+    Length = 0;
+}
+
+const char *RomImage::StatusMessage(RomStatus Status)
+{
+    switch (Status) {
+        
+        case ROM_OK:
+            return "ok";
+        
+        case ROM_NOT_FOUND:
+            return "no such file";
+        
+        case ROM_EMPTY:
+            return "file is empty";
+        
+        case ROM_TOO_LARGE:
+            return "larger than the 3584 bytes of program memory";
+        
+        case ROM_READ_FAILED:
+            return "couldn't read file";
+    }
+    
+    return "unknown error";
+}
+
+//
+// 64 bit FNV-1a, same as everywhere else we hash.
+//
+uint64_t RomLibrary::HashRom(const unsigned char *Rom, size_t Length)
+{
+    uint64_t Hash = 0xCBF29CE484222325ull;
+    
+    for (size_t Byte = 0; Byte < Length; ++Byte) {
+        Hash ^= Rom[Byte];
+        Hash *= 0x100000001B3ull;
+    }
+    
+    return Hash;
+}
+
+bool RomLibrary::LoadIndex(const char *FileName)
+{
+    FILE *IndexFile;
+    char Line[1024];
+    unsigned long long Hash;
+    unsigned long long Size;
+    long long ModifiedTime;
+    unsigned long CyclesPerFrame;
+    char Quirks[64];
+    int PathOffset;
+    
+    IndexFile = fopen(FileName, "r");
+    
+    if (IndexFile == NULL) {
+        return false;
+    }
+    
+    Entries.clear();
+    PathsByHash.clear();
+    Changed = false;
+    
+    while (fgets(Line, sizeof(Line), IndexFile) != NULL) {
+        
+        if (Line[0] == '#' || Line[0] == '\n') {
+            continue;
+        }
+        
+        Line[strcspn(Line, "\r\n")] = '\0';
+        
+        if (sscanf(Line, "%llx %llu %lld %lu %63s %n", &Hash, &Size, &ModifiedTime, &CyclesPerFrame, Quirks, &PathOffset) != 5 ||
+            Line[PathOffset] == '\0') {
+            fclose(IndexFile);
+            Entries.clear();
+            PathsByHash.clear();
+            return false;
+        }
+        
+        RomInfo Info;
+        
+        Info.Path = Line + PathOffset;
+        Info.Hash = Hash;
+        Info.Size = Size;
+        Info.ModifiedTime = ModifiedTime;
+        Info.CyclesPerFrame = CyclesPerFrame;
+        Info.Quirks = Quirks;
+        
+        SetEntry(Info);
+    }
+    
+    fclose(IndexFile);
+    
+    return true;
+}
+
+bool RomLibrary::SaveIndex(const char *FileName)
+{
+    FILE *IndexFile;
+    bool Written;
+    
+    IndexFile = fopen(FileName, "w");
+    
+    if (IndexFile == NULL) {
+        return false;
+    }
+    
+    Written = fputs(INDEX_HEADER, IndexFile) >= 0;
+    
+    for (std::map<std::string, RomInfo>::iterator Entry = Entries.begin(); Entry != Entries.end() && Written; ++Entry) {
+        
+        const RomInfo &Info = Entry->second;
+        
+        Written = fprintf(IndexFile, "%016llx %llu %lld %lu %s %s\n",
+                          (unsigned long long) Info.Hash,
+                          (unsigned long long) Info.Size,
+                          (long long) Info.ModifiedTime,
+                          Info.CyclesPerFrame,
+                          Info.Quirks.c_str(),
+                          Info.Path.c_str()) > 0;
+    }
+    
+    if (fclose(IndexFile) != 0 || !Written) {
+        return false;
+    }
+    
+    Changed = false;
+    
+    return true;
+}
+
+//
+// Stat the file and trust the index if nothing about it changed. Otherwise map it, check its
+// size and hash it, and remember the result.
+//
+RomStatus RomLibrary::Lookup(const char *Path, RomInfo *Info)
+{
+    struct stat FileStatus;
+    std::map<std::string, RomInfo>::iterator Entry;
+    RomImage Image;
+    RomStatus Status;
+    RomInfo NewInfo;
+    
+    if (stat(Path, &FileStatus) != 0) {
+        return ROM_NOT_FOUND;
+    }
+    
+    Entry = Entries.find(Path);
+    
+    if (Entry != Entries.end() &&
+        Entry->second.Size == (uint64_t) FileStatus.st_size &&
+        Entry->second.ModifiedTime == (int64_t) FileStatus.st_mtime) {
+        *Info = Entry->second;
+        return ROM_OK;
+    }
+    
+    Status = Image.Open(Path);
+    
+    if (Status != ROM_OK) {
+        return Status;
+    }
+    
+    NewInfo.Path = Path;
+    NewInfo.Hash = HashRom(Image.Bytes(), Image.Size());
+    NewInfo.Size = Image.Size();
+    NewInfo.ModifiedTime = (int64_t) FileStatus.st_mtime;
+    
+    if (!FindHash(NewInfo.Hash, Info)) {
+        Info->CyclesPerFrame = Entry != Entries.end() ? Entry->second.CyclesPerFrame : 0;
+        Info->Quirks = Entry != Entries.end() ? Entry->second.Quirks : ROM_DEFAULT_QUIRKS;
+    }
+    
+    NewInfo.CyclesPerFrame = Info->CyclesPerFrame;
+    NewInfo.Quirks = Info->Quirks;
+    
+    SetEntry(NewInfo);
+    Changed = true;
+    
+    *Info = NewInfo;
+    
+    return ROM_OK;
+}
+
+bool RomLibrary::FindHash(uint64_t Hash, RomInfo *Info)
+{
+    HashIndex::iterator Found = PathsByHash.find(Hash);
+    
+    if (Found == PathsByHash.end()) {
+        return false;
+    }
+    
+    *Info = Entries[Found->second];
+    
+    return true;
+}
+
+//
+// Add or replace the entry for Info.Path, keeping PathsByHash in step.
+//
+void RomLibrary::SetEntry(const RomInfo &Info)
+{
+    std::map<std::string, RomInfo>::iterator Entry = Entries.find(Info.Path);
+    
+    if (Entry != Entries.end()) {
+        
+        std::pair<HashIndex::iterator, HashIndex::iterator> Range = PathsByHash.equal_range(Entry->second.Hash);
+        
+        for (HashIndex::iterator Path = Range.first; Path != Range.second; ++Path) {
+            if (Path->second == Info.Path) {
+                PathsByHash.erase(Path);
+                break;
+            }
+        }
+    }
+    
+    Entries[Info.Path] = Info;
+    PathsByHash.insert(std::make_pair(Info.Hash, Info.Path));
+}
@@ -0,0 +1,127 @@
+//
+//  RomLibrary.h
+//  Chip8Emulator
+//
+
+#ifndef __Chip8Emulator__RomLibrary__
+#define __Chip8Emulator__RomLibrary__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+#if !defined(_WIN32)
+#define ROM_MMAP_SUPPORTED 1
+#else
+#define ROM_MMAP_SUPPORTED 0
+#endif
+
+//
+// Everything from 0x200 to the top of memory is program space.
+//
+
+#define ROM_MAX_SIZE (4096 - 0x200)
+
+#define ROM_DEFAULT_QUIRKS "default"
+
+typedef enum RomStatus {
+    ROM_OK,
+    ROM_NOT_FOUND,
+    ROM_EMPTY,
+    ROM_TOO_LARGE,
+    ROM_READ_FAILED
+} RomStatus;
+
+//
+// A ROM file mapped read only, or read into a buffer where there's no mmap. Size is checked
+// before anything is mapped, so Data() is always a loadable program.
+//
+
+class RomImage {
+
+private:
+    const unsigned char *Data;
+    size_t Length;
+    void *Mapping;
+    std::vector<unsigned char> Buffer;
+    
+    RomImage(const RomImage &Other);
+    RomImage &operator=(const RomImage &Other);
+
+public:
+    RomImage() : Data(NULL), Length(0), Mapping(NULL) {};
+    ~RomImage() {Close();};
+    
+    RomStatus Open(const char *FileName);
+    void Close();
+    
+    const unsigned char *Bytes() const {return Data;};
+    size_t Size() const {return Length;};
+    
+    static const char *StatusMessage(RomStatus Status);
+    
+};
+
+//
+// What the library knows about one ROM file. CyclesPerFrame 0 means whatever the frontend
+// defaults to.
+//
+
+struct RomInfo {
+    std::string Path;
+    uint64_t Hash;
+    uint64_t Size;
+    int64_t ModifiedTime;
+    unsigned long CyclesPerFrame;
+    std::string Quirks;
+};
+
+//
+// Index of ROM files by path, with a 64 bit FNV-1a hash of each file's contents and the
+// per-game settings that go with it. The index is a text file so the settings can be edited
+// by hand, one ROM per line, path last so it may contain spaces:
+//
+//     # hash size mtime ipf quirks path
+//     5d1b2c8e0f4a7713 246 1700000000 0 default Roms/Maze.ch8
+//
+// Looking a path up only stats the file while its size and modification time match the
+// index, so a farm starting up against thousands of known ROMs never reads or hashes them.
+// A file seen for the first time picks up the settings of any other file with the same hash,
+// so renamed or copied ROMs keep theirs. Not thread safe, look everything up before handing
+// jobs out.
+//
+
+class RomLibrary {
+
+private:
+    std::map<std::string, RomInfo> Entries;
+    
+    //
+    // The path of every entry by its hash, so finding a hash doesn't walk the whole index.
+    //
+    
+    typedef std::unordered_multimap<uint64_t, std::string> HashIndex;
+    
+    HashIndex PathsByHash;
+    bool Changed;
+    
+    void SetEntry(const RomInfo &Info);
+
+public:
+    RomLibrary() : Changed(false) {};
+    
+    bool LoadIndex(const char *FileName);
+    bool SaveIndex(const char *FileName);
+    bool IndexChanged() {return Changed;};
+    
+    RomStatus Lookup(const char *Path, RomInfo *Info);
+    bool FindHash(uint64_t Hash, RomInfo *Info);
+    
+    static uint64_t HashRom(const unsigned char *Rom, size_t Length);
+    
+};
+
+#endif /* defined(__Chip8Emulator__RomLibrary__) */